@@ -49,43 +49,58 @@ static void on_data_available(uint8_t int_id, void *ctx)
 // Input SDR width, must be divisible by 3
 #define SDR_WIDTH 27
 
-// SDR instances
-static sl_htm_sdr_t sdr_x;
-static sl_htm_sdr_t sdr_y;
-static sl_htm_sdr_t sdr_z;
+// Encoders for x, y and z, each one fills a third of the input SDR
+static sl_htm_encoder_t encoders[3];
+static const sl_htm_encoder_region_t regions[3] = {
+  { 0, SDR_WIDTH / 3 * 0, SDR_WIDTH },
+  { 0, SDR_WIDTH / 3 * 1, SDR_WIDTH },
+  { 0, SDR_WIDTH / 3 * 2, SDR_WIDTH },
+};
+static sl_htm_encoder_composite_t input_encoder;
+
+// Input SDR
 static sl_htm_sdr_t input_sdr;
-static sl_htm_sdr_t sp_sdr;
 
-// SP and TM instances
-static sl_htm_tm_t tm;
-static sl_htm_sp_t sp;
+// Turns the anomaly scores of the model into the probability that the recent ones are unusual
+static sl_htm_anomaly_likelihood_t anomaly_likelihood;
+// Likelihood from which a step is reported as an anomaly
+#define ANOMALY_LIKELIHOOD_THRESHOLD 0.99f
 void app_init(void)
 {
-  // Initialize SDRs, x y and z will be encoded into one input sdr, hence the division by 3.
-  sl_htm_sdr_init(&sdr_x, SDR_WIDTH, SDR_WIDTH / 3);
-  sl_htm_sdr_init(&sdr_y, SDR_WIDTH, SDR_WIDTH / 3);
-  sl_htm_sdr_init(&sdr_z, SDR_WIDTH, SDR_WIDTH / 3);
+  // Initialize the encoders, x y and z will be encoded into one input sdr, hence the division by 3.
+  for (uint8_t i = 0; i < 3; i++) {
+    sl_htm_encoder_scalar_init(&encoders[i], -1.0f, 1.0f, SDR_WIDTH * SDR_WIDTH / 3, 9);
+  }
   sl_htm_sdr_init(&input_sdr, SDR_WIDTH, SDR_WIDTH);
-  sl_htm_sdr_init(&sp_sdr, 6, 6);
+  sl_htm_encoder_composite_init(&input_encoder, encoders, regions, 3, SDR_WIDTH, SDR_WIDTH);
 
   // Initialize SP and TM parameters
-  sl_htm_sp_init_default_params(&sp.parameters);
-  sp.parameters.potential_radius = 8;
-  sp.parameters.potential_pct = 0.2f;
-  sp.parameters.sparsity = 0.3f;
-  sp.parameters.permanence_threshold = 50;
-  sp.parameters.permanence_increment = 10;
-  sp.parameters.permanence_decrement = 10;
-
-  sl_htm_tm_init_default_params(&tm.parameters);
-  tm.parameters.synapse_permanence_increment = 30;
-  tm.parameters.synapse_permanence_decrement = 30;
-  tm.parameters.num_cells_per_column = 4;
-
-  // Initialize SP and TM
-  sl_htm_sp_init(&sp, SDR_WIDTH, SDR_WIDTH, sp_sdr.width, sp_sdr.height);
-
-  sl_htm_tm_init(&tm, sp_sdr.width, sp_sdr.height);
+  sl_htm_sp_parameters_t sp_parameters;
+  sl_htm_sp_init_default_params(&sp_parameters);
+  sp_parameters.potential_radius = 8;
+  sp_parameters.potential_pct = 0.2f;
+  sp_parameters.sparsity = 0.3f;
+  sp_parameters.permanence_threshold = 50;
+  sp_parameters.permanence_increment = 10;
+  sp_parameters.permanence_decrement = 10;
+
+  sl_htm_tm_parameters_t tm_parameters;
+  sl_htm_tm_init_default_params(&tm_parameters);
+  tm_parameters.synapse_permanence_increment = 30;
+  tm_parameters.synapse_permanence_decrement = 30;
+  tm_parameters.num_cells_per_column = 4;
+
+  // Initialize the model, with the anomaly likelihood stage after the TM
+  sl_htm_status_t htm_status = sl_htm_init(SDR_WIDTH, SDR_WIDTH, 6, 6, sp_parameters, tm_parameters);
+  if (htm_status == SL_HTM_STATUS_OK) {
+    sl_htm_anomaly_likelihood_init_default_params(&anomaly_likelihood.parameters);
+    htm_status = sl_htm_anomaly_likelihood_init(&anomaly_likelihood);
+  }
+  if (htm_status != SL_HTM_STATUS_OK) {
+    printf("FAIL: HTM init returned %d\n", (int)htm_status);
+    EFM_ASSERT(false);
+  }
+  sl_htm_set_anomaly_likelihood(&anomaly_likelihood);
 
   // Initialize accelerometer
   sl_status_t status = accelerometer_setup(on_data_available);
@@ -95,10 +110,8 @@ void app_init(void)
   }
 }
 
-// Track statistics
+// Time step
 static uint16_t t = 0;
-static float anomaly_sum = 0;
-static size_t anomaly_count = 0;
 /***************************************************************************//**
  * App ticking function.
  ******************************************************************************/
@@ -122,45 +135,25 @@ void app_process_action(void)
   imu_data_normalized.y /= 4000;
   imu_data_normalized.z /= 4000;
 
-  // Encode data
-  sl_htm_encoder_simple_number(imu_data_normalized.x, -1.0f, 1.0f, 9, &sdr_x);
-  sl_htm_encoder_simple_number(imu_data_normalized.y, -1.0f, 1.0f, 9, &sdr_y);
-  sl_htm_encoder_simple_number(imu_data_normalized.z, -1.0f, 1.0f, 9, &sdr_z);
+  // Encode data, values outside of [-1, 1] are clamped
+  float values[3] = { imu_data_normalized.x, imu_data_normalized.y, imu_data_normalized.z };
+  sl_htm_encoder_composite_encode(&input_encoder, values, &input_sdr);
 
-  // Clear input sdr
-  sl_htm_sdr_clear(&input_sdr);
-
-  // Insert data into input sdr
-  sl_htm_sdr_insert(&input_sdr, &sdr_x, 0, SDR_WIDTH / 3 * 0);
-  sl_htm_sdr_insert(&input_sdr, &sdr_y, 0, SDR_WIDTH / 3 * 1);
-  sl_htm_sdr_insert(&input_sdr, &sdr_z, 0, SDR_WIDTH / 3 * 2);
-
-  // Execute SP and TM
-  float anomaly_score = 0;
-  sl_htm_sp_execute(&sp, &input_sdr, &sp_sdr, true);
-  anomaly_score = sl_htm_tm_execute(&tm, &sp_sdr, true);
-
-  // Update stats
-  anomaly_sum += anomaly_score;
-  anomaly_count++;
-
-  // Print stats every 10th iteration
-  if (t % 10 == 0) {
-    float anomaly_avg = anomaly_sum / anomaly_count;
+  // Execute SP and TM, the likelihood stage is updated with the anomaly score
+  sl_htm_execute(&input_sdr, true);
+  float likelihood = sl_htm_anomaly_likelihood_get(&anomaly_likelihood);
+  if (likelihood >= ANOMALY_LIKELIHOOD_THRESHOLD) {
+    printf("[t=%u] Anomaly: likelihood %f [x: %f, y: %f, z: %f]\n", t, likelihood, imu_data_normalized.x, imu_data_normalized.y, imu_data_normalized.z);
+  }
+  // Picked up by the visualization script
+  printf("anom_likelihood:%f\n", likelihood);
 
-    // Print stats
-    sl_htm_sp_print(&sp);
+  // Print the model every 100th iteration
+  if (t % 100 == 0) {
+    sl_htm_sp_print(sl_htm_get_sp());
     printf("SDR Memory size: %u\n", sl_htm_sdr_memory_size(&input_sdr));
-    printf("SP Memory size: %u\n", sl_htm_sp_memory_size(&sp));
-    printf("TM Memory size: %u\n", sl_htm_tm_memory_size(&tm));
-    printf("[t=%u] Anomaly score: %f [x: %f, y: %f, z: %f]\n", t, anomaly_avg, imu_data_normalized.x, imu_data_normalized.y, imu_data_normalized.z);
-
-    // This one is a special case of the above, and is picked up by the visualization script.
-    printf("anom_score:%f\n", anomaly_avg);
-
-    // Reset stats
-    anomaly_sum = 0;
-    anomaly_count = 0;
+    printf("SP Memory size: %u\n", sl_htm_sp_memory_size(sl_htm_get_sp()));
+    printf("TM Memory size: %u\n", sl_htm_tm_memory_size(sl_htm_get_tm()));
   }
 
   // Data has been processed, wait until new data is available
@@ -13,18 +13,18 @@ def display(ser):
         raw_line = ser.readline()
         line = raw_line.decode("utf-8").strip()
         print(line)
-        if line.startswith("anom_score"):
+        if line.startswith("anom_likelihood:"):
             line_info = line.split(":")
-            anomaly_score = float(line_info[1])
-            # Add anomaly score to buffer
-            buffer.append(anomaly_score)
+            anomaly_likelihood = float(line_info[1])
+            # Add anomaly likelihood to buffer
+            buffer.append(anomaly_likelihood)
             buffer = buffer[1:]
             # Plot buffer
             # Set axis limits
             axs.set_ylim(0, 1)
             axs.set_xlim(0, buffer_len)
             # Set title
-            axs.set_title("Anomaly Score")
+            axs.set_title("Anomaly Likelihood")
             axs.plot(buffer, color="red", linewidth=1)
             # Draw plot to screen
             fig.tight_layout()
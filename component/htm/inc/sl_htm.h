@@ -21,13 +21,216 @@
 extern "C" {
 #endif
 
+#include "sl_htm_status.h"
 #include "sl_htm_sdr.h"
 #include "sl_htm_sp.h"
 #include "sl_htm_tm.h"
 #include "sl_htm_encoder.h"
+#include "sl_htm_anomaly.h"
 #include "sl_htm_utils.h"
+#include "sl_htm_serialize.h"
+/**
+ * @brief An HTM model is a Spatial Pooler feeding a Temporal Memory. All the state of the model lives in this struct,
+ * so any number of models can run side by side, or on different threads as long as each model is only used by one thread at a time.
+ *
+ */
+typedef struct {
+  sl_htm_sp_t sp;
+  sl_htm_tm_t tm;
+  // Output of the SP, input of the TM
+  sl_htm_sdr_t sp_sdr;
+  // Optional stage after the TM, NULL if it is not used
+  sl_htm_anomaly_likelihood_t* likelihood;
+  // Buffer that sl_htm_model_load_file loaded the model from, NULL otherwise. Released by sl_htm_model_deinit.
+  void* file_buffer;
+  size_t file_size;
+  bool file_mapped;
+} sl_htm_model_t;
+/**
+ * @brief A frozen HTM model is an inference-only copy of a trained model, see sl_htm_model_freeze.
+ *
+ */
+typedef struct {
+  sl_htm_sp_frozen_t sp;
+  sl_htm_tm_frozen_t tm;
+  // Output of the SP, input of the TM
+  sl_htm_sdr_t sp_sdr;
+  // Optional stage after the TM, NULL if it is not used
+  sl_htm_anomaly_likelihood_t* likelihood;
+} sl_htm_model_frozen_t;
+/**
+ * @brief Initialize an HTM model. This will initialize its SP and TM using the provided parameters.
+ *
+ * @param model The model to initialize
+ * @param input_width Width of the input SDR
+ * @param input_height Height of the input SDR
+ * @param width Width of the SP output and TM input
+ * @param height Height of the SP output and TM input
+ * @param params_sp Parameters for the Spatial Pooler
+ * @param params_tm Parameters for the Temporal Memory
+ * @return SL_HTM_STATUS_OK, or the status of the SP or TM init that failed. The model must not be executed after a failure, and nothing is left allocated.
+ */
+sl_htm_status_t sl_htm_model_init(sl_htm_model_t* model, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm);
+/**
+ * @brief Free everything that sl_htm_model_init, sl_htm_model_load or sl_htm_model_load_file took from the heap, and unmap the file
+ * of a model loaded with sl_htm_model_load_file. Nothing is freed for a model initialized with sl_htm_model_init_static, nor for the
+ * parts of a model loaded in place from a caller's buffer. The model must be initialized or loaded again before it is used.
+ *
+ * @param model The model to deinitialize
+ */
+void sl_htm_model_deinit(sl_htm_model_t* model);
+/**
+ * @brief Initialize an HTM model like sl_htm_model_init, but carve its SP, TM and SDR from one caller-owned buffer.
+ * The model never touches the heap, neither during init nor while executing, so this also works with SL_HTM_STATIC_MEMORY.
+ *
+ * @param model The model to initialize
+ * @param memory The buffer to allocate from. It needs sl_htm_model_static_memory_size bytes for this model, and it must outlive it.
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the buffer is too small, otherwise as sl_htm_model_init
+ */
+sl_htm_status_t sl_htm_model_init_static(sl_htm_model_t* model, sl_htm_memory_t* memory, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm);
+/**
+ * @brief Get the size of the buffer that sl_htm_model_init_static needs for a model with the given sizes and parameters.
+ *
+ * @return The buffer size in bytes, 0 if the sizes or parameters cannot be used
+ */
+size_t sl_htm_model_static_memory_size(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, const sl_htm_sp_parameters_t* params_sp, const sl_htm_tm_parameters_t* params_tm);
+/**
+ * @brief Execute an HTM model. This will execute its SP and TM using the provided input SDR.
+ *
+ * @param model The model to execute
+ * @param input_sdr Input SDR
+ * @param learn Whether to learn or not
+ * @return The anomaly score as a float in range [0, 1], or NAN if the SP rejected the input SDR, see sl_htm_sp_execute.
+ * The model is not changed in that case.
+ */
+float sl_htm_model_execute(sl_htm_model_t* model, sl_htm_sdr_t* input_sdr, bool learn);
+/**
+ * @brief Feed the anomaly score of every step of a model to an anomaly likelihood. The execute functions still return the raw score,
+ * read the likelihood of the step with sl_htm_anomaly_likelihood_get.
+ *
+ * @param model The model
+ * @param likelihood An initialized anomaly likelihood that outlives the model, or NULL to remove the stage
+ */
+void sl_htm_model_set_anomaly_likelihood(sl_htm_model_t* model, sl_htm_anomaly_likelihood_t* likelihood);
+/**
+ * @brief Get the number of bytes needed to save an HTM model.
+ *
+ * @param model The model
+ * @return The serialized size in bytes
+ */
+size_t sl_htm_model_serialized_size(sl_htm_model_t* model);
+/**
+ * @brief Save the learned state of an HTM model to a buffer. The buffer holds the SP followed by the TM.
+ *
+ * @param model The model to save
+ * @param buffer Destination, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the destination in bytes
+ * @return The number of bytes written, or 0 if the buffer is too small or not aligned
+ */
+size_t sl_htm_model_save(sl_htm_model_t* model, void* buffer, size_t buffer_size);
+/**
+ * @brief Load an HTM model that was saved with sl_htm_model_save, instead of initializing it with sl_htm_model_init.
+ * To start an inference-only model without copying, place the saved model in flash or map it into memory and load it in place.
+ * A model that was already initialized or loaded must be deinitialized with sl_htm_model_deinit first, otherwise its memory is lost.
+ *
+ * @param model The model to load into
+ * @param buffer Source, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the source in bytes
+ * @param in_place If true, the bulk of the model is used directly from the buffer instead of being copied.
+ * The buffer must then outlive the model, and must be writable if the model learns.
+ * @return true if the buffer held a valid model. Every index stored in the buffer is checked, so a corrupted buffer is rejected
+ * instead of making the model read or write out of bounds. If loading fails, nothing is left allocated.
+ */
+bool sl_htm_model_load(sl_htm_model_t* model, const void* buffer, size_t buffer_size, bool in_place);
+#if SL_HTM_SERIALIZE_FILES
+/**
+ * @brief Save an HTM model to a file.
+ *
+ * @param model The model to save
+ * @param path Path of the file
+ * @return true if the file was written
+ */
+bool sl_htm_model_save_file(sl_htm_model_t* model, const char* path);
+/**
+ * @brief Load an HTM model from a file. As with sl_htm_model_load, a model that already holds one, for example from an earlier file,
+ * must be deinitialized with sl_htm_model_deinit first.
+ *
+ * @param model The model to load into
+ * @param path Path of the file
+ * @param map If true, the file is memory mapped copy-on-write and the model is loaded in place, so only the pages that learning
+ * touches are ever copied. Otherwise the file is read into one heap buffer, which the model then uses in place.
+ * Either way the model owns the buffer until sl_htm_model_deinit. If loading fails, nothing is left mapped or allocated.
+ * @return true if the file held a valid model
+ */
+bool sl_htm_model_load_file(sl_htm_model_t* model, const char* path, bool map);
+#endif
+/**
+ * @brief Compile a trained HTM model into a frozen, inference-only model. The frozen model only keeps the connected synapses
+ * in read-only tables, so it uses far less RAM and each step skips the synapses that could never count.
+ * It gives the same anomaly scores as executing the trained model without learning. The trained model is not changed
+ * and can be discarded afterwards.
+ *
+ * @param model The trained model
+ * @param frozen The frozen model to create
+ * @return SL_HTM_STATUS_OK, or the status of the SP or TM freeze that failed. Nothing is left allocated after a failure.
+ */
+sl_htm_status_t sl_htm_model_freeze(sl_htm_model_t* model, sl_htm_model_frozen_t* frozen);
+/**
+ * @brief Free what sl_htm_model_freeze or sl_htm_model_frozen_load took from the heap, including the tables that sl_htm_model_freeze
+ * compiled. Tables loaded with sl_htm_model_frozen_load stay in the caller's buffer. The frozen model must not be used afterwards.
+ *
+ * @param frozen The frozen model to deinitialize
+ */
+void sl_htm_model_frozen_deinit(sl_htm_model_frozen_t* frozen);
+/**
+ * @brief Execute a frozen HTM model.
+ *
+ * @param frozen The frozen model to execute
+ * @param input_sdr Input SDR
+ * @return The anomaly score as a float in range [0, 1], or NAN if the SP rejected the input SDR, see sl_htm_sp_frozen_execute
+ */
+float sl_htm_model_frozen_execute(sl_htm_model_frozen_t* frozen, sl_htm_sdr_t* input_sdr);
+/**
+ * @brief Feed the anomaly score of every step of a frozen model to an anomaly likelihood, see sl_htm_model_set_anomaly_likelihood.
+ *
+ */
+void sl_htm_model_frozen_set_anomaly_likelihood(sl_htm_model_frozen_t* frozen, sl_htm_anomaly_likelihood_t* likelihood);
+/**
+ * @brief Get the number of bytes needed to save the tables of a frozen HTM model.
+ *
+ * @param frozen The frozen model
+ * @return The serialized size in bytes
+ */
+size_t sl_htm_model_frozen_serialized_size(sl_htm_model_frozen_t* frozen);
+/**
+ * @brief Save the tables of a frozen HTM model to a buffer, for example to be written to flash.
+ *
+ * @param frozen The frozen model to save
+ * @param buffer Destination, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the destination in bytes
+ * @return The number of bytes written, or 0 if the buffer is too small or not aligned
+ */
+size_t sl_htm_model_frozen_save(sl_htm_model_frozen_t* frozen, void* buffer, size_t buffer_size);
+/**
+ * @brief Load a frozen HTM model that was saved with sl_htm_model_frozen_save. The tables are always used in place and never written,
+ * so the buffer can be in flash, and must outlive the frozen model. Only the per-step buffers are allocated in RAM.
+ *
+ * @param frozen The frozen model to load into
+ * @param buffer Source, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the source in bytes
+ * @return true if the buffer held a valid frozen model. If loading fails, nothing is left allocated.
+ */
+bool sl_htm_model_frozen_load(sl_htm_model_frozen_t* frozen, const void* buffer, size_t buffer_size);
+/**
+ * @brief Get the RAM used by a frozen HTM model, without its read-only tables.
+ *
+ * @param frozen The frozen model
+ * @return The memory size in bytes
+ */
+size_t sl_htm_model_frozen_memory_size(sl_htm_model_frozen_t* frozen);
 /**
  * @brief Initialize the HTM system. This will initialize the SP and TM using the provided parameters.
+ * This uses a single built-in model, use sl_htm_model_init to run more than one model.
  *
  * @param input_width Width of the input SDR
  * @param input_height Height of the input SDR
@@ -35,16 +238,30 @@ extern "C" {
  * @param height Height of the SP output and TM input
  * @param params_sp Parameters for the Spatial Pooler
  * @param params_tm Parameters for the Temporal Memory
+ * @return SL_HTM_STATUS_OK, or the status of the init that failed, see sl_htm_model_init
  */
-void sl_htm_init(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm);
+sl_htm_status_t sl_htm_init(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm);
+/**
+ * @brief Initialize the built-in model from a caller-owned buffer, see sl_htm_model_init_static.
+ *
+ * @param memory The buffer to allocate from, sized with sl_htm_model_static_memory_size
+ * @return SL_HTM_STATUS_OK, or the status of the init that failed
+ */
+sl_htm_status_t sl_htm_init_static(sl_htm_memory_t* memory, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm);
 /**
  * @brief Execute the HTM system. This will execute the SP and TM using the provided input SDR.
  *
  * @param input_sdr Input SDR
  * @param learn Whether to learn or not
- * @return The anomaly score as a float in range [0, 1]
+ * @return The anomaly score as a float in range [0, 1], or NAN on failure, see sl_htm_model_execute
  */
 float sl_htm_execute(sl_htm_sdr_t* input_sdr, bool learn);
+/**
+ * @brief Feed the anomaly score of every step of the built-in model to an anomaly likelihood, see sl_htm_model_set_anomaly_likelihood.
+ *
+ * @param likelihood An initialized anomaly likelihood, or NULL to remove the stage
+ */
+void sl_htm_set_anomaly_likelihood(sl_htm_anomaly_likelihood_t* likelihood);
 
 sl_htm_sp_t* sl_htm_get_sp();
 sl_htm_tm_t* sl_htm_get_tm();
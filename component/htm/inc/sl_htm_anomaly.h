@@ -0,0 +1,100 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#ifndef SL_HTM_ANOMALY_H
+#define SL_HTM_ANOMALY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sl_htm_status.h"
+
+// Largest short-term averaging window, the recent scores are kept inline so the likelihood never allocates
+#ifndef SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW
+#define SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW 16
+#endif
+
+// Scores, means and probabilities are Q16 fixed point: 1.0 is SL_HTM_ANOMALY_ONE
+#define SL_HTM_ANOMALY_ONE 65536
+
+typedef struct {
+  // Number of recent anomaly scores that are averaged into the short-term score, at most SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW
+  uint16_t averaging_window;
+  // Number of steps the long-term mean and variance of the short-term score are taken over
+  uint16_t window;
+  // Number of steps before the statistics are trusted, the likelihood is 0.5 until then
+  uint16_t learning_period;
+} sl_htm_anomaly_likelihood_parameters_t;
+
+/**
+ * @brief Turns the raw anomaly score of every step into the likelihood that the recent scores are unusual.
+ * The average of the last few scores is compared to the long-term distribution of that average, modeled as a Gaussian
+ * with a rolling mean and variance, and the likelihood is one minus its tail probability. It takes constant memory
+ * and all the arithmetic is in fixed point.
+ */
+typedef struct {
+  sl_htm_anomaly_likelihood_parameters_t parameters;
+  // Ring of the last scores in Q16, and their sum
+  uint32_t recent_scores[SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW];
+  uint32_t recent_sum;
+  uint16_t num_recent;
+  uint16_t next_recent;
+  // Rolling mean and variance of the short-term score in Q16
+  int32_t mean;
+  uint32_t variance;
+  uint32_t num_steps;
+  // Likelihood of the last step in Q16
+  uint32_t likelihood;
+} sl_htm_anomaly_likelihood_t;
+
+/**
+ * @brief Set the default parameters: an averaging window of 10 steps, statistics over 256 steps and as many steps of learning.
+ *
+ * @param params
+ */
+void sl_htm_anomaly_likelihood_init_default_params(sl_htm_anomaly_likelihood_parameters_t* params);
+/**
+ * @brief Initialize an anomaly likelihood with the parameters in likelihood->parameters.
+ *
+ * @param likelihood
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if a window is empty or the averaging window is larger than SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW
+ */
+sl_htm_status_t sl_htm_anomaly_likelihood_init(sl_htm_anomaly_likelihood_t* likelihood);
+/**
+ * @brief Add the anomaly score of a step and compute the likelihood that the recent scores are anomalous.
+ * The score is judged against the statistics of the steps before it, then added to them.
+ *
+ * @param likelihood
+ * @param anomaly_score Raw anomaly score in range [0, 1], values outside of it are clamped and NaN counts as 0
+ * @return The likelihood in range [0, 1]. Values close to 1, e.g. above 0.9999, mark an anomaly.
+ */
+float sl_htm_anomaly_likelihood_update(sl_htm_anomaly_likelihood_t* likelihood, float anomaly_score);
+/**
+ * @brief Get the likelihood of the last step.
+ *
+ * @param likelihood
+ * @return The likelihood in range [0, 1]
+ */
+float sl_htm_anomaly_likelihood_get(const sl_htm_anomaly_likelihood_t* likelihood);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SL_HTM_ANOMALY_H
@@ -0,0 +1,99 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#ifndef SL_HTM_BATCH_H
+#define SL_HTM_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "sl_htm.h"
+
+// Worker threads are only available on Linux hosts. Define SL_HTM_BATCH_DISABLE_THREADS to always run the batch on the calling thread.
+#if defined(__linux__) && !defined(SL_HTM_BATCH_DISABLE_THREADS)
+#define SL_HTM_BATCH_THREADS 1
+#else
+#define SL_HTM_BATCH_THREADS 0
+#endif
+
+/**
+ * @brief A batch of independent HTM models that share one configuration, typically one model per sensor stream.
+ * The models are stored in slots that are aligned to cache lines, so that models executed on different threads never share a cache line.
+ *
+ */
+typedef struct {
+  // Model slots, each slot_size bytes apart
+  void* slots;
+  // Allocation the slots were carved from, freed by sl_htm_batch_deinit after the models in it
+  void* memory;
+  size_t slot_size;
+  uint16_t num_models;
+  // Number of worker threads in addition to the calling thread
+  uint16_t num_workers;
+  // Thread pool, NULL if the batch runs on the calling thread only
+  void* pool;
+} sl_htm_batch_t;
+/**
+ * @brief Initialize a batch of models that all use the same parameters.
+ *
+ * @param batch The batch to initialize
+ * @param num_models Number of models in the batch
+ * @param input_width Width of the input SDR
+ * @param input_height Height of the input SDR
+ * @param width Width of the SP output and TM input
+ * @param height Height of the SP output and TM input
+ * @param params_sp Parameters for the Spatial Pooler
+ * @param params_tm Parameters for the Temporal Memory
+ * @param num_threads Total number of threads to execute the batch on, including the calling thread. 0 or 1 runs the batch on the calling thread only.
+ * If some of the threads cannot be started, the batch runs on the ones that could.
+ * @return SL_HTM_STATUS_OK, or the status of the first model init that failed. SL_HTM_STATUS_ALLOCATION_FAILED if the models or the
+ * thread pool could not be allocated. If a model failed, the models initialized before it are deinitialized and nothing is left allocated. If only the thread pool failed, the batch still runs
+ * on the calling thread and must be released with sl_htm_batch_deinit.
+ */
+sl_htm_status_t sl_htm_batch_init(sl_htm_batch_t* batch, uint16_t num_models, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height,
+                       sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm, uint16_t num_threads);
+/**
+ * @brief Get a model of the batch, for example to inspect it or to execute it on its own.
+ *
+ * @param batch
+ * @param index Index of the model
+ * @return The model
+ */
+sl_htm_model_t* sl_htm_batch_get_model(sl_htm_batch_t* batch, uint16_t index);
+/**
+ * @brief Advance every model of the batch by one step. Model i is executed on input_sdrs[i], and its anomaly score is written to anomaly_scores[i].
+ * The models are spread over the threads of the batch, and the call returns once all of them are done.
+ *
+ * @param batch The batch to execute
+ * @param input_sdrs One input SDR per model
+ * @param learn Whether to learn or not
+ * @param anomaly_scores Output, one anomaly score per model
+ */
+void sl_htm_batch_execute(sl_htm_batch_t* batch, sl_htm_sdr_t* input_sdrs, bool learn, float* anomaly_scores);
+/**
+ * @brief Stop the worker threads of the batch, deinitialize every model with sl_htm_model_deinit and free the model slots.
+ * The models must not be used afterwards.
+ *
+ * @param batch
+ */
+void sl_htm_batch_deinit(sl_htm_batch_t* batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SL_HTM_BATCH_H
@@ -30,8 +30,158 @@ extern "C" {
  * @param max_value  The maximum value that can be encoded
  * @param num_active_bits The number of active bits that you want the value to be encoded into
  * @param output_sdr The SDR instance to encode the value into
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the value lies outside of [min_value, max_value), the SDR is then left empty
  */
-void sl_htm_encoder_simple_number(float value, float min_value, float max_value, uint16_t num_active_bits, sl_htm_sdr_t* output_sdr);
+sl_htm_status_t sl_htm_encoder_simple_number(float value, float min_value, float max_value, uint16_t num_active_bits, sl_htm_sdr_t* output_sdr);
+
+typedef enum {
+  // Clamped scalar: values outside of the range land in the first or last bucket
+  SL_HTM_ENCODER_SCALAR,
+  // Periodic scalar, e.g. an angle or the time of day: the run of active bits wraps around the end of the field
+  SL_HTM_ENCODER_CYCLIC,
+  // Clamped scalar of the difference between a value and the previous value
+  SL_HTM_ENCODER_DELTA,
+  // Clamped scalar of the logarithm of a value, for values that span several orders of magnitude
+  SL_HTM_ENCODER_LOG,
+  // Random distributed scalar: every bucket of the given resolution hashes to its own set of bits, so the range is unbounded
+  SL_HTM_ENCODER_RDSE,
+} sl_htm_encoder_type_t;
+
+/**
+ * @brief An encoder turns a value into a field of consecutive SDR bits. Initialize it with one of the sl_htm_encoder_*_init functions.
+ * Encoders hold no pointers and encoding allocates nothing, so they can live in static storage or on the stack.
+ */
+typedef struct {
+  sl_htm_encoder_type_t type;
+  // Number of bits in the field, and how many of them are active for every value
+  uint16_t size;
+  uint16_t num_active_bits;
+  // Range that is encoded, the period for a cyclic encoder. A log encoder keeps the log2 of its range.
+  float min_value;
+  float max_value;
+  // Width of the buckets of an RDSE, and the seed of its hash
+  float resolution;
+  uint32_t seed;
+  // Value of the previous call to a delta encoder
+  float prev_value;
+  bool has_prev_value;
+} sl_htm_encoder_t;
+
+/**
+ * @brief Initialize a clamped scalar encoder.
+ *
+ * @param encoder
+ * @param min_value
+ * @param max_value
+ * @param size Number of bits in the field
+ * @param num_active_bits Number of consecutive active bits, at most size
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the range is empty or the number of bits does not fit
+ */
+sl_htm_status_t sl_htm_encoder_scalar_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits);
+/**
+ * @brief Initialize a cyclic encoder. Values are taken modulo the period [min_value, max_value), so max_value encodes like min_value.
+ * Every bit of the field starts a bucket.
+ *
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the period is empty or the number of bits does not fit
+ */
+sl_htm_status_t sl_htm_encoder_cyclic_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits);
+/**
+ * @brief Initialize a delta encoder. It encodes the change since the previous value, clamped to [-max_delta, max_delta].
+ * The first value encodes as a change of 0.
+ *
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if max_delta is not positive or the number of bits does not fit
+ */
+sl_htm_status_t sl_htm_encoder_delta_init(sl_htm_encoder_t* encoder, float max_delta, uint16_t size, uint16_t num_active_bits);
+/**
+ * @brief Initialize a log-scale encoder. Every doubling of the value moves the active bits by the same amount.
+ *
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if min_value is not positive, the range is empty or the number of bits does not fit
+ */
+sl_htm_status_t sl_htm_encoder_log_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits);
+/**
+ * @brief Initialize a random distributed scalar encoder. Values in the same bucket of width resolution give the same bits,
+ * and neighboring buckets share all but one active bit. Bits of a bucket can collide, which leaves fewer of them active.
+ *
+ * @param seed Seed of the hash that places the bits, encoders with different seeds give unrelated fields
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the resolution is not positive or the number of bits does not fit
+ */
+sl_htm_status_t sl_htm_encoder_rdse_init(sl_htm_encoder_t* encoder, float resolution, uint16_t size, uint16_t num_active_bits, uint32_t seed);
+/**
+ * @brief Encode a value into the first bits of an SDR. The SDR is cleared first.
+ *
+ * @param encoder
+ * @param value
+ * @param output_sdr
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the field does not fit in the SDR, SL_HTM_STATUS_INVALID_PARAMETER if the value is NaN.
+ * The SDR is then left empty.
+ */
+sl_htm_status_t sl_htm_encoder_encode(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr);
+/**
+ * @brief Encode a value into the field that starts at bit offset of an SDR. The active bits are added to the SDR, so the field should be clear.
+ *
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the field does not fit in the SDR, SL_HTM_STATUS_INVALID_PARAMETER if the value is NaN.
+ * The SDR is then left unchanged.
+ */
+sl_htm_status_t sl_htm_encoder_encode_at(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr, uint16_t offset);
+/**
+ * @brief Encode several values into one SDR, one field after the other. The SDR is cleared first, then value i is encoded
+ * by encoder i into the field that follows the field of encoder i - 1.
+ *
+ * @param encoders
+ * @param values
+ * @param num_fields Number of encoders and values
+ * @param output_sdr
+ * @return The first error of sl_htm_encoder_encode_at, the fields before it have been written
+ */
+sl_htm_status_t sl_htm_encoder_encode_fields(sl_htm_encoder_t* encoders, const float* values, uint16_t num_fields, sl_htm_sdr_t* output_sdr);
+
+/**
+ * @brief Region of an SDR that a channel of a composite encoder is encoded into. The field fills the region row by row,
+ * so the region is as many rows high as the field needs.
+ */
+typedef struct {
+  // Top left corner of the region
+  uint8_t x;
+  uint8_t y;
+  // Number of bits per row of the region
+  uint8_t width;
+} sl_htm_encoder_region_t;
+
+/**
+ * @brief Encodes several channels, e.g. the axes of a sensor, straight into their regions of one SDR.
+ * The layout is checked once at init, so encoding a sample only sets the active runs.
+ */
+typedef struct {
+  sl_htm_encoder_t* encoders;
+  const sl_htm_encoder_region_t* regions;
+  uint16_t num_channels;
+  // Size of the SDR the layout is made for
+  uint8_t width;
+  uint8_t height;
+} sl_htm_encoder_composite_t;
+
+/**
+ * @brief Initialize a composite encoder. The encoders and regions are referenced, not copied, and must outlive the composite encoder.
+ *
+ * @param composite
+ * @param encoders Encoder of each channel, initialized
+ * @param regions Region of each channel, the layout descriptor
+ * @param num_channels
+ * @param width Width of the SDR that will be encoded into
+ * @param height Height of the SDR that will be encoded into
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if a region does not fit in the SDR, SL_HTM_STATUS_INVALID_PARAMETER if two regions overlap
+ */
+sl_htm_status_t sl_htm_encoder_composite_init(sl_htm_encoder_composite_t* composite, sl_htm_encoder_t* encoders, const sl_htm_encoder_region_t* regions,
+                                              uint16_t num_channels, uint8_t width, uint8_t height);
+/**
+ * @brief Encode one value per channel. The SDR is cleared first.
+ *
+ * @param composite
+ * @param values Value of each channel
+ * @param output_sdr
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the SDR does not have the size of the layout, or if a value is NaN. The channels before it have been written.
+ */
+sl_htm_status_t sl_htm_encoder_composite_encode(sl_htm_encoder_composite_t* composite, const float* values, sl_htm_sdr_t* output_sdr);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,114 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#ifndef SL_HTM_MEMORY_H
+#define SL_HTM_MEMORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sl_htm_status.h"
+
+// Define SL_HTM_STATIC_MEMORY as 1 to build the HTM without any heap allocation. Only the *_init_static functions can then
+// allocate, from the buffer that the caller hands them. Everything that would use the heap fails with SL_HTM_STATUS_ALLOCATION_FAILED.
+#ifndef SL_HTM_STATIC_MEMORY
+#define SL_HTM_STATIC_MEMORY 0
+#endif
+
+// Every allocation taken from a buffer starts at a multiple of this, relative to the start of the buffer
+#define SL_HTM_MEMORY_ALIGN 8
+
+/**
+ * @brief A caller-owned buffer that allocations are carved from front to back. Nothing is ever returned to it,
+ * except that freeing the most recent allocations rewinds it, so that scratch memory needed during init can be reused.
+ *
+ */
+typedef struct {
+  uint8_t* buffer;
+  size_t size;
+  size_t used;
+} sl_htm_memory_t;
+
+/**
+ * @brief Round a size up to the alignment of the allocations in a buffer. The static memory size functions add up
+ * the aligned sizes of the allocations, so a buffer of that size fits them exactly.
+ *
+ */
+static inline size_t sl_htm_memory_align(size_t size)
+{
+  return (size + SL_HTM_MEMORY_ALIGN - 1) & ~(size_t)(SL_HTM_MEMORY_ALIGN - 1);
+}
+
+/**
+ * @brief Initialize a memory to hand out the bytes of a buffer.
+ *
+ * @param buffer The buffer, aligned to SL_HTM_MEMORY_ALIGN. It must outlive everything that is initialized from it.
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the buffer is NULL or not aligned
+ */
+sl_htm_status_t sl_htm_memory_init(sl_htm_memory_t* memory, void* buffer, size_t size);
+
+/**
+ * @brief Allocate uninitialized memory. If memory is NULL, the memory is taken from the heap instead of a buffer.
+ *
+ * @return NULL if the buffer is exhausted, the heap allocation failed or the heap is disabled by SL_HTM_STATIC_MEMORY
+ */
+void* sl_htm_memory_alloc(sl_htm_memory_t* memory, size_t size);
+
+/**
+ * @brief Allocate zeroed memory for count elements. If memory is NULL, the memory is taken from the heap instead of a buffer.
+ *
+ * @return NULL if the buffer is exhausted, the heap allocation failed or the heap is disabled by SL_HTM_STATIC_MEMORY
+ */
+void* sl_htm_memory_calloc(sl_htm_memory_t* memory, size_t count, size_t size);
+
+/**
+ * @brief Grow a heap allocation. Allocations from a buffer cannot grow.
+ *
+ * @return NULL if memory is a buffer or the reallocation failed, the old allocation is then left as it was
+ */
+void* sl_htm_memory_realloc(sl_htm_memory_t* memory, void* ptr, size_t size);
+
+/**
+ * @brief Free an allocation. For a buffer, this releases the allocation together with every allocation made after it,
+ * so allocations must be freed in the reverse order they were made in.
+ *
+ */
+void sl_htm_memory_free(sl_htm_memory_t* memory, void* ptr);
+
+/**
+ * @brief Get the number of heap allocations made through this API that were not freed yet, across all models.
+ * Used to check that the deinit functions release everything that init and load allocated.
+ *
+ */
+size_t sl_htm_memory_num_heap_allocations(void);
+
+#ifdef UNIT_TEST
+/**
+ * @brief Make every heap allocation fail once the given number of further allocations succeeded. SIZE_MAX never fails.
+ * Only built for the unit tests, to check the failure paths of init and load.
+ *
+ */
+void sl_htm_memory_fail_heap_after(size_t num_allocations);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SL_HTM_MEMORY_H
@@ -28,26 +28,185 @@ extern "C" {
 #include <stdint.h>
 #include <string.h>
 #include "sl_htm_utils.h"
+#include "sl_htm_status.h"
+#include "sl_htm_memory.h"
+
+// The SDR bits are packed into words, 32 bits per word by default. Define SL_HTM_SDR_WORD_BITS as 64 to use 64-bit words on hosts.
+#ifndef SL_HTM_SDR_WORD_BITS
+#define SL_HTM_SDR_WORD_BITS 32
+#endif
+
+#if SL_HTM_SDR_WORD_BITS == 32
+typedef uint32_t sl_htm_sdr_word_t;
+#define SL_HTM_SDR_WORD_SHIFT 5
+#elif SL_HTM_SDR_WORD_BITS == 64
+typedef uint64_t sl_htm_sdr_word_t;
+#define SL_HTM_SDR_WORD_SHIFT 6
+#else
+#error "SL_HTM_SDR_WORD_BITS must be 32 or 64"
+#endif
+
+#define SL_HTM_SDR_WORD_MASK (SL_HTM_SDR_WORD_BITS - 1)
+#define SL_HTM_SDR_NUM_WORDS(num_bits) (((num_bits) + SL_HTM_SDR_WORD_BITS - 1) / SL_HTM_SDR_WORD_BITS)
 
 typedef struct {
-  bool *bits;
+  sl_htm_sdr_word_t *words;
   uint8_t width;
   uint8_t height;
   uint16_t num_active_bits;
 } sl_htm_sdr_t;
+/**
+ * @brief Sparse form of an SDR. Instead of one bit per position, it keeps a sorted list of the indices of the active bits.
+ * Iterating over it costs O(active bits) instead of O(width * height).
+ *
+ */
+typedef struct {
+  uint16_t *indices;
+  uint16_t len;
+  uint16_t capacity;
+  uint8_t width;
+  uint8_t height;
+} sl_htm_sdr_sparse_t;
 
+/**
+ * @brief Read a bit of the SDR.
+ *
+ * @param sdr
+ * @param index
+ * @return The value of the bit, false if the index is out of bounds. The index is not checked if SL_HTM_DISABLE_BOUNDS_CHECK is defined.
+ */
 bool sl_htm_sdr_get_bit(sl_htm_sdr_t *sdr, uint16_t index);
-void sl_htm_sdr_set_bit(sl_htm_sdr_t *sdr, uint16_t index, bool value);
-
-void sl_htm_sdr_init(sl_htm_sdr_t *sdr, uint8_t width, uint8_t height);
+/**
+ * @brief Write a bit of the SDR and keep the number of active bits up to date.
+ *
+ * @param sdr
+ * @param index
+ * @param value
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the index is out of bounds, the SDR is left unchanged. The index is not checked if SL_HTM_DISABLE_BOUNDS_CHECK is defined.
+ */
+sl_htm_status_t sl_htm_sdr_set_bit(sl_htm_sdr_t *sdr, uint16_t index, bool value);
+/**
+ * @brief Initialize an SDR with all bits cleared.
+ *
+ * @param sdr
+ * @param width
+ * @param height
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the bits could not be allocated
+ */
+sl_htm_status_t sl_htm_sdr_init(sl_htm_sdr_t *sdr, uint8_t width, uint8_t height);
+/**
+ * @brief Initialize an SDR with all bits cleared, taking its bits from a caller-owned buffer instead of the heap.
+ *
+ * @param memory The buffer to allocate from, see sl_htm_sdr_static_memory_size. NULL allocates from the heap.
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the buffer is too small
+ */
+sl_htm_status_t sl_htm_sdr_init_static(sl_htm_sdr_t *sdr, sl_htm_memory_t* memory, uint8_t width, uint8_t height);
+/**
+ * @brief Number of bytes that sl_htm_sdr_init_static takes from its buffer.
+ *
+ */
+size_t sl_htm_sdr_static_memory_size(uint8_t width, uint8_t height);
+/**
+ * @brief Free the bits of an SDR that was initialized with sl_htm_sdr_init. SDRs taken from a buffer are released with the buffer.
+ *
+ */
+void sl_htm_sdr_deinit(sl_htm_sdr_t *sdr);
 void sl_htm_sdr_clear(sl_htm_sdr_t *sdr);
-void sl_htm_sdr_randomize(sl_htm_sdr_t *sdr, float sparsity);
-
-void sl_htm_sdr_insert(sl_htm_sdr_t* target_sdr, sl_htm_sdr_t* source_sdr, uint8_t x, uint8_t y);
+void sl_htm_sdr_shuffle(sl_htm_sdr_t *sdr, sl_htm_random_t* random);
+/**
+ * @brief Randomize the SDR to the given sparsity.
+ *
+ * @param sdr
+ * @param sparsity Fraction of active bits, in range [0, 1]
+ * @param random Random number generator to draw the active bits from
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the sparsity is out of range, the SDR is left unchanged
+ */
+sl_htm_status_t sl_htm_sdr_randomize(sl_htm_sdr_t *sdr, float sparsity, sl_htm_random_t* random);
+/**
+ * @brief Set a run of consecutive bits to 1, one word at a time.
+ *
+ * @param sdr The SDR to modify
+ * @param index Index of the first bit in the run
+ * @param len Number of bits in the run
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the run does not fit in the SDR, the SDR is left unchanged
+ */
+sl_htm_status_t sl_htm_sdr_set_range(sl_htm_sdr_t *sdr, uint16_t index, uint16_t len);
+/**
+ * @brief Copy the bits of the source SDR into the target SDR, starting at the (x, y) position of the target.
+ * The bits are copied one word at a time, overwriting the bits that were already in the target.
+ *
+ * @param target_sdr
+ * @param source_sdr
+ * @param x
+ * @param y
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if the source does not fit in the target, the target is left unchanged
+ */
+sl_htm_status_t sl_htm_sdr_insert(sl_htm_sdr_t* target_sdr, sl_htm_sdr_t* source_sdr, uint8_t x, uint8_t y);
+/**
+ * @brief Count the number of bits that are active in both SDRs. The SDRs must have the same size.
+ *
+ * @param sdr_a
+ * @param sdr_b
+ * @return The number of overlapping active bits
+ */
+uint16_t sl_htm_sdr_overlap(const sl_htm_sdr_t* sdr_a, const sl_htm_sdr_t* sdr_b);
+/**
+ * @brief Store the intersection (bitwise AND) of two SDRs in the target SDR. All three SDRs must have the same size.
+ *
+ * @param target_sdr The SDR to store the intersection in, may be one of the inputs
+ * @param sdr_a
+ * @param sdr_b
+ * @return The number of active bits in the intersection
+ */
+uint16_t sl_htm_sdr_intersection(sl_htm_sdr_t* target_sdr, const sl_htm_sdr_t* sdr_a, const sl_htm_sdr_t* sdr_b);
+/**
+ * @brief Initialize a sparse SDR.
+ *
+ * @param sparse The sparse SDR to initialize
+ * @param width
+ * @param height
+ * @param capacity Maximum number of active bits the sparse SDR can hold, 0 means width * height
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the indices could not be allocated
+ */
+sl_htm_status_t sl_htm_sdr_sparse_init(sl_htm_sdr_sparse_t* sparse, uint8_t width, uint8_t height, uint16_t capacity);
+/**
+ * @brief Initialize a sparse SDR, taking its indices from a caller-owned buffer instead of the heap.
+ *
+ * @param memory The buffer to allocate from, see sl_htm_sdr_sparse_static_memory_size. NULL allocates from the heap.
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the buffer is too small
+ */
+sl_htm_status_t sl_htm_sdr_sparse_init_static(sl_htm_sdr_sparse_t* sparse, sl_htm_memory_t* memory, uint8_t width, uint8_t height, uint16_t capacity);
+/**
+ * @brief Number of bytes that sl_htm_sdr_sparse_init_static takes from its buffer.
+ *
+ */
+size_t sl_htm_sdr_sparse_static_memory_size(uint8_t width, uint8_t height, uint16_t capacity);
+/**
+ * @brief Free the indices of a sparse SDR that was initialized with sl_htm_sdr_sparse_init.
+ *
+ */
+void sl_htm_sdr_sparse_deinit(sl_htm_sdr_sparse_t* sparse);
+/**
+ * @brief Convert a dense SDR into its sparse form. The cost is proportional to the number of words plus the number of active bits.
+ *
+ * @param sdr The dense SDR to read
+ * @param sparse The sparse SDR to write, must have the same size and enough capacity for all the active bits
+ * @return SL_HTM_STATUS_WOULD_OVERFLOW if the capacity is too small, the sparse SDR is then left empty
+ */
+sl_htm_status_t sl_htm_sdr_to_sparse(const sl_htm_sdr_t* sdr, sl_htm_sdr_sparse_t* sparse);
+/**
+ * @brief Convert a sparse SDR into its dense form. Only the active bits are written after the dense SDR has been cleared.
+ *
+ * @param sdr The dense SDR to write, must have the same size
+ * @param sparse The sparse SDR to read
+ * @return SL_HTM_STATUS_OUT_OF_BOUNDS if an index is out of bounds, the indices before it have been written
+ */
+sl_htm_status_t sl_htm_sdr_from_sparse(sl_htm_sdr_t* sdr, const sl_htm_sdr_sparse_t* sparse);
 
 void sl_htm_sdr_print(sl_htm_sdr_t* sdr);
 
 size_t sl_htm_sdr_memory_size(sl_htm_sdr_t *sdr);
+size_t sl_htm_sdr_sparse_memory_size(sl_htm_sdr_sparse_t *sparse);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,93 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#ifndef SL_HTM_SERIALIZE_H
+#define SL_HTM_SERIALIZE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Binary format of trained models.
+ *
+ * A serialized SP, TM or model is a section that starts with a header, followed by a fixed-size record and a number of arrays.
+ * A model section holds an SP section followed by a TM section. All sections and arrays start on SL_HTM_SERIALIZE_ALIGN byte
+ * boundaries relative to the start of the buffer, and refer to each other by index only, so a buffer can be placed at any
+ * suitably aligned address. This allows loading a model in place, directly from a memory-mapped file or from flash.
+ * Values are stored in the byte order of the device that saved them. Loading a buffer with the other byte order fails on the magic number.
+ * Buffers of any other version are rejected.
+ */
+#define SL_HTM_SERIALIZE_VERSION 1
+// Saving to and loading from files, including memory mapping, is only available on POSIX hosts
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(SL_HTM_SERIALIZE_DISABLE_FILES)
+#define SL_HTM_SERIALIZE_FILES 1
+#else
+#define SL_HTM_SERIALIZE_FILES 0
+#endif
+#define SL_HTM_SERIALIZE_ALIGN 8
+#define SL_HTM_SERIALIZE_MAGIC(a, b, c, d) ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+#define SL_HTM_SERIALIZE_MAGIC_SP SL_HTM_SERIALIZE_MAGIC('H', 'T', 'S', 'P')
+#define SL_HTM_SERIALIZE_MAGIC_TM SL_HTM_SERIALIZE_MAGIC('H', 'T', 'T', 'M')
+#define SL_HTM_SERIALIZE_MAGIC_MODEL SL_HTM_SERIALIZE_MAGIC('H', 'T', 'M', 'M')
+// Frozen, inference-only models. Their tables are the serialized sections themselves.
+#define SL_HTM_SERIALIZE_MAGIC_SP_FROZEN SL_HTM_SERIALIZE_MAGIC('H', 'F', 'S', 'P')
+#define SL_HTM_SERIALIZE_MAGIC_TM_FROZEN SL_HTM_SERIALIZE_MAGIC('H', 'F', 'T', 'M')
+#define SL_HTM_SERIALIZE_MAGIC_MODEL_FROZEN SL_HTM_SERIALIZE_MAGIC('H', 'F', 'M', 'M')
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  // Section specific, the TM stores its index width in bits here
+  uint16_t flags;
+  // Size of the whole section in bytes, including this header
+  uint32_t size;
+  uint32_t reserved;
+} sl_htm_serialize_header_t;
+
+/**
+ * @brief Round a size or offset up to the alignment of the format.
+ *
+ */
+static inline size_t sl_htm_serialize_align(size_t size)
+{
+  return (size + SL_HTM_SERIALIZE_ALIGN - 1) & ~(size_t)(SL_HTM_SERIALIZE_ALIGN - 1);
+}
+/**
+ * @brief Check the header at the start of a buffer.
+ *
+ * @param buffer Start of the section
+ * @param buffer_size Number of bytes available in the buffer
+ * @param magic Expected magic number of the section
+ * @param flags Expected flags of the section
+ * @return true if the header is valid and the section fits in the buffer
+ */
+bool sl_htm_serialize_check_header(const void* buffer, size_t buffer_size, uint32_t magic, uint16_t flags);
+/**
+ * @brief Write a section header at the start of a buffer.
+ *
+ */
+void sl_htm_serialize_write_header(void* buffer, uint32_t magic, uint16_t flags, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SL_HTM_SERIALIZE_H
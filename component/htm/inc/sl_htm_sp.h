@@ -34,7 +34,15 @@ typedef struct {
 typedef struct {
   sl_htm_sp_connection_t* connections;
   uint16_t num_connections;
-  uint16_t overlap_score;
+  // Number of connected synapses on active input bits
+  uint16_t raw_overlap_score;
+  // Raw overlap score multiplied by the boost factor in Q8.8, this is what the columns compete with
+  uint32_t overlap_score;
+  // Moving averages of how often the column is active and how often it has any overlap, in Q0.32 so that small steps are not lost
+  uint32_t active_duty_cycle;
+  uint32_t overlap_duty_cycle;
+  // Boost factor in Q8.8, 256 means no boosting
+  uint16_t boost_factor;
   uint8_t column_x;
   uint8_t column_y;
 } sl_htm_sp_column_t;
@@ -47,14 +55,70 @@ typedef struct {
   uint16_t overlap_score_threshold;
   uint16_t potential_radius;
   float potential_pct;
+  // If true, each column only competes with the columns within inhibition_radius of it, instead of with all columns.
+  // The sparsity then applies to each neighborhood, and columns below overlap_score_threshold never become active.
+  bool local_inhibition;
+  uint16_t inhibition_radius;
+  // How strongly columns that are active less often than the sparsity are boosted, 0 disables boosting
+  float boost_strength;
+  // Number of steps the duty cycles average over
+  uint16_t duty_cycle_period;
+  // Columns whose overlap duty cycle is below this fraction of the highest one get all their permanences increased
+  float min_pct_overlap_duty_cycle;
+  // Seed of the random number generator of the spatial pooler, which picks the potential pool and the initial permanences
+  uint32_t seed;
 } sl_htm_sp_parameters_t;
 
 typedef struct {
   sl_htm_sp_parameters_t parameters;
   sl_htm_sp_column_t* columns;
+  // Connections of all columns, stored contiguously column after column
+  sl_htm_sp_connection_t* connections;
+  uint32_t num_connections;
+  // Input-major index of the connections: the connections that sample input bit i are
+  // input_connections[input_offsets[i]] to input_connections[input_offsets[i + 1] - 1]
+  uint32_t* input_offsets;
+  uint32_t* input_connections;
+  // Active bits of the current input, so that only those need to be visited
+  sl_htm_sdr_sparse_t active_inputs;
+  uint8_t input_width;
+  uint8_t input_height;
+  // The columns selected by inhibition in the current step
+  sl_htm_sp_column_t** top_columns;
+  // Scratch buffers for local inhibition: columns sorted by rank, and a 2D Fenwick tree over the column grid
+  uint16_t* inhibition_order;
+  uint16_t* inhibition_order_tmp;
+  uint16_t* inhibition_tree;
+  // Number of learning steps, used to warm up the duty cycles before a full period has passed
+  uint32_t num_iterations;
+  sl_htm_random_t random;
   uint8_t width;
   uint8_t height;
+  // Whether the arrays above were taken from the heap, so that sl_htm_sp_deinit frees them.
+  // The connections and the input index are left alone when they are used in place from the buffer the SP was loaded from.
+  bool heap_allocated;
+  bool tables_in_place;
 } sl_htm_sp_t;
+/**
+ * @brief A frozen spatial pooler is an inference-only copy of a trained spatial pooler. It only keeps the connected synapses,
+ * as an input-major table that gives the columns each input bit is connected to. The tables are read-only and stored in the
+ * serialized format, so they can be placed in flash.
+ */
+typedef struct {
+  // Holds the overlap scores and the inhibition buffers. It has no connections, since those are only needed for learning.
+  sl_htm_sp_t sp;
+  // Input bit i is connected to the columns input_columns[input_offsets[i]] to input_columns[input_offsets[i + 1] - 1]
+  const uint32_t* input_offsets;
+  const uint16_t* input_columns;
+  // Q8.8 boost factor of every column, as it was when the spatial pooler was frozen
+  const uint16_t* boost_factors;
+  uint32_t num_connected;
+  // Serialized section that holds the tables
+  const void* tables;
+  size_t tables_size;
+  // Whether the tables were allocated by sl_htm_sp_freeze, so that sl_htm_sp_frozen_deinit frees them
+  bool owns_tables;
+} sl_htm_sp_frozen_t;
 /**
  * @brief Initialize the spatial pooler using its parameters.
  *
@@ -63,8 +127,34 @@ typedef struct {
  * @param input_height Height of the input SDR
  * @param output_width Width of the output SDR
  * @param output_height Height of the output SDR
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the sizes or parameters cannot be used, e.g. the input is smaller than the output
+ * or the potential radius covers fewer input bits than a column has connections. SL_HTM_STATUS_ALLOCATION_FAILED if the
+ * memory could not be allocated. The SP must not be executed after a failure, and nothing is left allocated.
+ */
+sl_htm_status_t sl_htm_sp_init(sl_htm_sp_t* sp, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height);
+/**
+ * @brief Initialize the spatial pooler like sl_htm_sp_init, but take all of its memory from a caller-owned buffer instead of the heap.
+ * Nothing is allocated after init, so executing the SP never touches the heap either.
+ *
+ * @param sp The SP instance to initialize, with its parameters set.
+ * @param memory The buffer to allocate from. It needs sl_htm_sp_static_memory_size bytes for this SP, and it must outlive it.
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the buffer is too small, otherwise as sl_htm_sp_init
+ */
+sl_htm_status_t sl_htm_sp_init_static(sl_htm_sp_t* sp, sl_htm_memory_t* memory, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height);
+/**
+ * @brief Free what sl_htm_sp_init or sl_htm_sp_load took from the heap. Nothing is freed for an SP initialized with sl_htm_sp_init_static,
+ * nor for the tables of an SP loaded in place, since those belong to the caller's buffer. The SP must be initialized or loaded again before it is used.
+ *
+ * @param sp The SP instance to deinitialize
+ */
+void sl_htm_sp_deinit(sl_htm_sp_t* sp);
+/**
+ * @brief Get the size of the buffer that sl_htm_sp_init_static needs for a spatial pooler with the given parameters and sizes.
+ * Scratch memory used during init is included, it is given back to the buffer before init returns.
+ *
+ * @return The buffer size in bytes
  */
-void sl_htm_sp_init(sl_htm_sp_t* sp, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height);
+size_t sl_htm_sp_static_memory_size(const sl_htm_sp_parameters_t* params, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height);
 /**
  * @brief Initialize the parameters for the Spatial Pooler with default values.
  *
@@ -78,8 +168,32 @@ void sl_htm_sp_init_default_params(sl_htm_sp_parameters_t* params);
  * @param input_sdr The input SDR.
  * @param output_sdr The output SDR.
  * @param learn Whether to learn or not.
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the input SDR does not have the input size of the SP, or the status of sl_htm_sdr_to_sparse.
+ * The SP and the output SDR are not changed on failure.
+ */
+sl_htm_status_t sl_htm_sp_execute(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr, bool learn);
+/**
+ * @brief Select the columns with the highest overlap scores. This is the global inhibition step of the spatial pooler.
+ * It runs in O(number of columns) using a histogram select over the overlap score. When columns tie, the ones with
+ * the lowest column index are selected first. The selected columns are written in column order.
+ *
+ * @param top_columns Output array with room for num_active_columns pointers.
+ * @param num_active_columns Number of columns to select.
+ * @param sp The SP instance.
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if there are fewer columns than num_active_columns, nothing is selected
  */
-void sl_htm_sp_execute(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr, bool learn);
+sl_htm_status_t sl_htm_sp_get_top_columns(sl_htm_sp_column_t** top_columns, uint16_t num_active_columns, sl_htm_sp_t* sp);
+/**
+ * @brief Select the active columns with local inhibition. A column is active if fewer than sparsity * (neighbors + 1)
+ * of the columns within inhibition_radius of it rank higher, where ranking is by overlap score and ties go to the lowest
+ * column index. Columns are visited from the highest rank down and counted in a 2D Fenwick tree, so the cost is
+ * O(N log^2 N) regardless of the radius.
+ *
+ * @param top_columns Output array with room for one pointer per column.
+ * @param sp The SP instance.
+ * @return The number of active columns, written to top_columns in rank order.
+ */
+uint16_t sl_htm_sp_get_local_top_columns(sl_htm_sp_column_t** top_columns, sl_htm_sp_t* sp);
 /**
  * @brief Print the state of the spatial pooler. It will be a table with the active columns and their overlap scores.
  *
@@ -87,12 +201,81 @@ void sl_htm_sp_execute(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* o
  */
 void sl_htm_sp_print(sl_htm_sp_t* sp);
 /**
- * @brief Estimate the memory size of the spatial pooler.
+ * @brief Estimate the memory size of the spatial pooler, including the SP structure itself. See sl_htm_sp_static_memory_size
+ * for the size of a buffer to initialize it from.
  *
  * @param sp The SP instance to estimate the memory size.
  * @return The memory size in bytes.
  */
 size_t sl_htm_sp_memory_size(sl_htm_sp_t* sp);
+/**
+ * @brief Get the number of bytes needed to save the spatial pooler.
+ *
+ * @param sp The SP instance
+ * @return The serialized size in bytes
+ */
+size_t sl_htm_sp_serialized_size(sl_htm_sp_t* sp);
+/**
+ * @brief Save the learned state of the spatial pooler to a buffer, in the format described in sl_htm_serialize.h.
+ *
+ * @param sp The SP instance to save
+ * @param buffer Destination, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the destination in bytes
+ * @return The number of bytes written, or 0 if the buffer is too small or not aligned
+ */
+size_t sl_htm_sp_save(sl_htm_sp_t* sp, void* buffer, size_t buffer_size);
+/**
+ * @brief Load a spatial pooler that was saved with sl_htm_sp_save. An SP that was already initialized or loaded must be
+ * deinitialized with sl_htm_sp_deinit first, otherwise its memory is lost.
+ *
+ * @param sp The SP instance to load into
+ * @param buffer Source, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the source in bytes
+ * @param in_place If true, the connections and the input index are used directly from the buffer instead of being copied.
+ * The buffer must then outlive the SP, and must be writable if the SP learns.
+ * @return true if the buffer held a valid spatial pooler and the SP could be allocated. If loading fails, nothing is left allocated.
+ */
+bool sl_htm_sp_load(sl_htm_sp_t* sp, const void* buffer, size_t buffer_size, bool in_place);
+/**
+ * @brief Compile a trained spatial pooler into a frozen one. The spatial pooler is not changed and can be discarded afterwards.
+ *
+ * @param sp The trained SP instance
+ * @param frozen The frozen SP to create
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the tables could not be allocated
+ */
+sl_htm_status_t sl_htm_sp_freeze(sl_htm_sp_t* sp, sl_htm_sp_frozen_t* frozen);
+/**
+ * @brief Execute a frozen spatial pooler. The output is the same as sl_htm_sp_execute without learning on the spatial pooler it was frozen from.
+ *
+ * @param frozen The frozen SP instance
+ * @param input_sdr The input SDR
+ * @param output_sdr The output SDR
+ * @return SL_HTM_STATUS_OK, or the same errors as sl_htm_sp_execute
+ */
+sl_htm_status_t sl_htm_sp_frozen_execute(sl_htm_sp_frozen_t* frozen, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr);
+/**
+ * @brief Load a frozen spatial pooler from its tables, for example from flash. The tables are used in place and never written.
+ *
+ * @param frozen The frozen SP to load into
+ * @param buffer Tables of a frozen spatial pooler, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the buffer in bytes
+ * @return true if the buffer held valid tables and the runtime buffers could be allocated. If loading fails, nothing is left allocated.
+ */
+bool sl_htm_sp_frozen_load(sl_htm_sp_frozen_t* frozen, const void* buffer, size_t buffer_size);
+/**
+ * @brief Free the runtime buffers of a frozen spatial pooler, and its tables if sl_htm_sp_freeze allocated them.
+ * Tables loaded with sl_htm_sp_frozen_load belong to the caller's buffer and are left alone.
+ *
+ * @param frozen The frozen SP to deinitialize
+ */
+void sl_htm_sp_frozen_deinit(sl_htm_sp_frozen_t* frozen);
+/**
+ * @brief Get the RAM used by a frozen spatial pooler, without its read-only tables.
+ *
+ * @param frozen The frozen SP instance
+ * @return The memory size in bytes
+ */
+size_t sl_htm_sp_frozen_memory_size(sl_htm_sp_frozen_t* frozen);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,52 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#ifndef SL_HTM_STATUS_H
+#define SL_HTM_STATUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Result of the HTM functions that can fail. Failures leave the process running, the caller decides how to recover.
+ *
+ */
+typedef enum {
+  SL_HTM_STATUS_OK = 0,
+  // A heap allocation failed
+  SL_HTM_STATUS_ALLOCATION_FAILED,
+  // The parameters or sizes cannot be used, e.g. the input is smaller than the spatial pooler
+  SL_HTM_STATUS_INVALID_PARAMETER,
+  // An index or a range of indices lies outside of an SDR
+  SL_HTM_STATUS_OUT_OF_BOUNDS,
+  // The destination cannot hold the result, e.g. a sparse SDR with too little capacity
+  SL_HTM_STATUS_WOULD_OVERFLOW,
+} sl_htm_status_t;
+
+// The per-bit SDR accessors check their index unless SL_HTM_DISABLE_BOUNDS_CHECK is defined. Release builds whose indices
+// are known to be valid can define it to remove the check from the innermost loops.
+#ifndef SL_HTM_DISABLE_BOUNDS_CHECK
+#define SL_HTM_BOUNDS_CHECK 1
+#else
+#define SL_HTM_BOUNDS_CHECK 0
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SL_HTM_STATUS_H
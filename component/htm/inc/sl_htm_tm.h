@@ -34,8 +34,33 @@ void sl_htm_tm_init_default_params(sl_htm_tm_parameters_t* params);
  * @param tm The TM instance to initialize
  * @param width Width of the input SDR from the Spatial Pooler
  * @param height Height of the input SDR from the Spatial Pooler
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the TM has no cells, segments or synapses, too many to be indexed,
+ * a width or height above 255 like any SDR, or a shape that differs from the one fixed at compile time with SL_HTM_TM_FIXED_*.
+ * SL_HTM_STATUS_ALLOCATION_FAILED if the memory could not be allocated. The TM must not be executed after a failure, and nothing is left allocated.
  */
-void sl_htm_tm_init(sl_htm_tm_t* tm, uint16_t width, uint16_t height);
+sl_htm_status_t sl_htm_tm_init(sl_htm_tm_t* tm, uint16_t width, uint16_t height);
+/**
+ * @brief Initialize the Temporal Memory like sl_htm_tm_init, but take all of its memory from a caller-owned buffer instead of the heap.
+ * The state arrays cannot grow in a buffer. Cells or segments that do not fit in them are dropped and reported by sl_htm_tm_get_status.
+ *
+ * @param tm The TM instance to initialize, with its parameters set
+ * @param memory The buffer to allocate from. It needs sl_htm_tm_static_memory_size bytes for this TM, and it must outlive it.
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the buffer is too small, otherwise as sl_htm_tm_init
+ */
+sl_htm_status_t sl_htm_tm_init_static(sl_htm_tm_t* tm, sl_htm_memory_t* memory, uint16_t width, uint16_t height);
+/**
+ * @brief Free what sl_htm_tm_init or sl_htm_tm_load took from the heap. Nothing is freed for a TM initialized with sl_htm_tm_init_static,
+ * nor for the arena of a TM loaded in place, since those belong to the caller's buffer. The TM must be initialized or loaded again before it is used.
+ *
+ * @param tm The TM instance to deinitialize
+ */
+void sl_htm_tm_deinit(sl_htm_tm_t* tm);
+/**
+ * @brief Get the size of the buffer that sl_htm_tm_init_static needs for a temporal memory with the given parameters and sizes.
+ *
+ * @return The buffer size in bytes, 0 if the parameters and sizes cannot be used
+ */
+size_t sl_htm_tm_static_memory_size(const sl_htm_tm_parameters_t* params, uint16_t width, uint16_t height);
 /**
  * @brief Execute the Temporal Memory.
  *
@@ -46,6 +71,94 @@ void sl_htm_tm_init(sl_htm_tm_t* tm, uint16_t width, uint16_t height);
  */
 float sl_htm_tm_execute(sl_htm_tm_t* tm, sl_htm_sdr_t* sp_sdr, bool learn);
 size_t sl_htm_tm_memory_size(sl_htm_tm_t* tm);
+/**
+ * @brief Get the number of times the state arrays of the Temporal Memory had to grow beyond the capacity reserved at init.
+ * In steady state this stays constant, since executing does not touch the heap otherwise.
+ *
+ * @param tm The TM instance
+ * @return The number of growth events
+ */
+uint32_t sl_htm_tm_num_state_growths(sl_htm_tm_t* tm);
+/**
+ * @brief Check whether every step so far ran to completion. If a state array was full and could not grow, the cells or
+ * segments that did not fit were left out of that step. The TM keeps running, but it may have missed predictions and learning.
+ *
+ * @param tm The TM instance
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if a step left out cells or segments, SL_HTM_STATUS_OK otherwise
+ */
+sl_htm_status_t sl_htm_tm_get_status(sl_htm_tm_t* tm);
+/**
+ * @brief Get the number of bytes needed to save the temporal memory.
+ *
+ * @param tm The TM instance
+ * @return The serialized size in bytes
+ */
+size_t sl_htm_tm_serialized_size(sl_htm_tm_t* tm);
+/**
+ * @brief Save the learned state of the temporal memory to a buffer, in the format described in sl_htm_serialize.h.
+ * The cells active in the last step are saved as well, so a loaded TM continues the sequence where the saved one stopped.
+ *
+ * @param tm The TM instance to save
+ * @param buffer Destination, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the destination in bytes
+ * @return The number of bytes written, or 0 if the buffer is too small or not aligned
+ */
+size_t sl_htm_tm_save(sl_htm_tm_t* tm, void* buffer, size_t buffer_size);
+/**
+ * @brief Load a temporal memory that was saved with sl_htm_tm_save. A TM that was already initialized or loaded must be
+ * deinitialized with sl_htm_tm_deinit first, otherwise its memory is lost.
+ *
+ * @param tm The TM instance to load into
+ * @param buffer Source, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the source in bytes
+ * @param in_place If true, the cells, segments and synapses are used directly from the buffer instead of being copied.
+ * The buffer must then outlive the TM, and must be writable if the TM learns.
+ * @return true if the buffer held a valid temporal memory saved with the same SL_HTM_TM_INDEX_BITS and the TM could be allocated.
+ * If loading fails, nothing is left allocated.
+ */
+bool sl_htm_tm_load(sl_htm_tm_t* tm, const void* buffer, size_t buffer_size, bool in_place);
+/**
+ * @brief Compile a trained temporal memory into a frozen one. The cells predicted by the last step carry over,
+ * so the frozen TM continues the sequence. The temporal memory is not changed and can be discarded afterwards.
+ * The segment activation threshold must be at least 1.
+ *
+ * @param tm The trained TM instance
+ * @param frozen The frozen TM to create
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the segment activation threshold is 0, SL_HTM_STATUS_ALLOCATION_FAILED if the tables could not be allocated
+ */
+sl_htm_status_t sl_htm_tm_freeze(sl_htm_tm_t* tm, sl_htm_tm_frozen_t* frozen);
+/**
+ * @brief Execute a frozen temporal memory. The anomaly score is the same as sl_htm_tm_execute without learning on the temporal memory it was frozen from.
+ *
+ * @param frozen The frozen TM instance
+ * @param sp_sdr The SDR output from the Spatial Pooler
+ * @return The anomaly score as a float in range [0, 1]
+ */
+float sl_htm_tm_frozen_execute(sl_htm_tm_frozen_t* frozen, sl_htm_sdr_t* sp_sdr);
+/**
+ * @brief Load a frozen temporal memory from its tables, for example from flash. The tables are used in place and never written.
+ *
+ * @param frozen The frozen TM to load into
+ * @param buffer Tables of a frozen temporal memory, aligned to SL_HTM_SERIALIZE_ALIGN bytes
+ * @param buffer_size Size of the buffer in bytes
+ * @return true if the buffer held valid tables built with the same SL_HTM_TM_INDEX_BITS and the runtime buffers could be allocated.
+ * If loading fails, nothing is left allocated.
+ */
+bool sl_htm_tm_frozen_load(sl_htm_tm_frozen_t* frozen, const void* buffer, size_t buffer_size);
+/**
+ * @brief Free the runtime buffers of a frozen temporal memory, and its tables if sl_htm_tm_freeze allocated them.
+ * Tables loaded with sl_htm_tm_frozen_load belong to the caller's buffer and are left alone.
+ *
+ * @param frozen The frozen TM to deinitialize
+ */
+void sl_htm_tm_frozen_deinit(sl_htm_tm_frozen_t* frozen);
+/**
+ * @brief Get the RAM used by a frozen temporal memory, without its read-only tables.
+ *
+ * @param frozen The frozen TM instance
+ * @return The memory size in bytes
+ */
+size_t sl_htm_tm_frozen_memory_size(sl_htm_tm_frozen_t* frozen);
 #ifdef __cplusplus
 }
 #endif
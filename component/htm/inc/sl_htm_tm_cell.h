@@ -22,10 +22,19 @@ extern "C" {
 #endif
 
 #include "sl_htm_tm_types.h"
-
-void sl_htm_tm_cell_init(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell, sl_htm_tm_column_t* parent_column);
-sl_htm_tm_segment_t* sl_htm_tm_cell_grow_segment(sl_htm_tm_t * tm, sl_htm_tm_cell_t * cell);
-void sl_htm_tm_cell_delete_segment(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell, sl_htm_tm_segment_t* segment);
+void sl_htm_tm_cell_init(sl_htm_tm_t* tm, sl_htm_tm_index_t cell);
+/**
+ * @brief Get the column that a cell belongs to.
+ *
+ */
+sl_htm_tm_index_t sl_htm_tm_cell_column(sl_htm_tm_t* tm, sl_htm_tm_index_t cell);
+/**
+ * @brief Grow a new segment on the cell. If all the segment slots are in use, the least useful segment is replaced.
+ *
+ * @return Returns the index of the new segment, or SL_HTM_TM_INDEX_NONE if no segment could be grown.
+ */
+sl_htm_tm_index_t sl_htm_tm_cell_grow_segment(sl_htm_tm_t * tm, sl_htm_tm_index_t cell);
+void sl_htm_tm_cell_delete_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t cell, sl_htm_tm_index_t segment);
 
 #ifdef __cplusplus
 }
@@ -25,16 +25,38 @@ extern "C" {
 
 #include "sl_htm_tm_column.h"
 
-void sl_htm_tm_column_init(sl_htm_tm_t* tm, sl_htm_tm_column_t* column);
+void sl_htm_tm_column_init(sl_htm_tm_t* tm, sl_htm_tm_index_t column);
 /**
  * @brief Find the least used cell in the column. The least used cell is the one with the lowest number of segments.
  * If there are multiple cells with the same number of segments, choose one randomly.
  *
  */
-sl_htm_tm_cell_t* sl_htm_tm_column_least_used_cell(sl_htm_tm_t* tm, sl_htm_tm_column_t* column);
-void sl_htm_tm_column_burst(sl_htm_tm_t* tm, sl_htm_tm_column_t* column, bool learn, sl_htm_tm_state_t* state_current, sl_htm_tm_state_t* state_prev);
-bool sl_htm_tm_column_activate_predicted(sl_htm_tm_t* tm, sl_htm_tm_column_t* column, bool learn, sl_htm_tm_state_t* state_current, sl_htm_tm_state_t* state_prev);
-void sl_htm_tm_column_punish_predicted(sl_htm_tm_t* tm, sl_htm_tm_column_t* column, sl_htm_tm_state_t* state_prev);
+sl_htm_tm_index_t sl_htm_tm_column_least_used_cell(sl_htm_tm_t* tm, sl_htm_tm_index_t column);
+/**
+ * @brief Find the segments of a column in a segment array that is sorted by segment index. The columns must be looked up in increasing order:
+ * the search starts at the end of the range of the previous column, so looking up every column costs one pass over the array.
+ *
+ * @param tm
+ * @param column
+ * @param segments
+ * @param range The range of the previous column on input, { 0, 0 } for the first lookup. The range of the column on output.
+ */
+void sl_htm_tm_column_segment_range(sl_htm_tm_t* tm, sl_htm_tm_index_t column, sl_htm_tm_segment_array_t* segments, sl_htm_tm_segment_range_t* range);
+/**
+ * @brief Activate all the cells of a column that had no predictive cells, and pick a winner cell to learn on.
+ *
+ * @param matching_segments The range of the previous matching segments that are on the column
+ */
+void sl_htm_tm_column_burst(sl_htm_tm_t* tm, sl_htm_tm_index_t column, bool learn, sl_htm_tm_state_t* state_current, sl_htm_tm_state_t* state_prev,
+                            const sl_htm_tm_segment_range_t* matching_segments);
+/**
+ * @brief Activate the predictive cells of an active column.
+ *
+ * @param active_segments The range of the previous active segments that are on the column
+ * @return true if the column had predictive cells
+ */
+bool sl_htm_tm_column_activate_predicted(sl_htm_tm_t* tm, bool learn, sl_htm_tm_state_t* state_current, sl_htm_tm_state_t* state_prev,
+                                         const sl_htm_tm_segment_range_t* active_segments);
 #ifdef __cplusplus
 }
 #endif
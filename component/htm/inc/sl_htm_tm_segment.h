@@ -22,12 +22,20 @@ extern "C" {
 #endif
 
 #include "sl_htm_tm_types.h"
-#include "sl_htm_tm_segment.h"
 #include "sl_htm_tm_synapse.h"
-
-void sl_htm_segment_init(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment);
-void sl_htm_segment_reset(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment);
-bool sl_htm_tm_segment_is_existing(sl_htm_tm_segment_t* segment);
+void sl_htm_segment_init(sl_htm_tm_t* tm, sl_htm_tm_index_t segment);
+void sl_htm_segment_reset(sl_htm_tm_t* tm, sl_htm_tm_index_t segment);
+bool sl_htm_tm_segment_is_existing(sl_htm_tm_t* tm, sl_htm_tm_index_t segment);
+/**
+ * @brief Get the cell that a segment slot belongs to.
+ *
+ */
+sl_htm_tm_index_t sl_htm_tm_segment_cell(sl_htm_tm_t* tm, sl_htm_tm_index_t segment);
+/**
+ * @brief Get the column that a segment slot belongs to.
+ *
+ */
+sl_htm_tm_index_t sl_htm_tm_segment_column(sl_htm_tm_t* tm, sl_htm_tm_index_t segment);
 
 /**
  * @brief Check if a segment is active, i.e. if it has enough active synapses.
@@ -37,7 +45,7 @@ bool sl_htm_tm_segment_is_existing(sl_htm_tm_segment_t* segment);
  * @return true if num_active_synapses >= activation_threshold
  * @return false otherwise
  */
-bool sl_htm_tm_segment_is_active(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_current);
+bool sl_htm_tm_segment_is_active(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_current);
 
 /**
  * @brief Count the number of active potential synapses in a segment.
@@ -46,17 +54,36 @@ bool sl_htm_tm_segment_is_active(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment,
  * @param segment
  * @return uint16_t
  */
-uint16_t sl_htm_tm_segment_potential_score(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state);
-sl_htm_tm_synapse_t* sl_htm_tm_segment_grow_synapse(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_cell_t* target_cell);
-void sl_htm_tm_segment_delete_synapse(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_synapse_t* synapse);
-void sl_htm_tm_segment_update_permanence(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_prev);
+uint16_t sl_htm_tm_segment_potential_score(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state);
+/**
+ * @brief Grow a new synapse on the segment.
+ *
+ * @param tm
+ * @param segment
+ * @param target_cell
+ * @return Returns the index of the new synapse, or SL_HTM_TM_INDEX_NONE if the segment is full.
+ */
+sl_htm_tm_index_t sl_htm_tm_segment_grow_synapse(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_index_t target_cell);
+void sl_htm_tm_segment_delete_synapse(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_index_t synapse);
+void sl_htm_tm_segment_update_permanence(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev);
+/**
+ * @brief Punish a segment that predicted a column which did not become active, by decreasing the permanence of its active synapses.
+ *
+ * @param tm
+ * @param segment
+ * @param state_prev
+ */
+void sl_htm_tm_segment_punish(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev);
 /**
- * @brief Grow a segment by adding synapses to it or there are no more unconnected winner cells to connect to.
+ * @brief Grow synapses from a segment to randomly drawn cells that were active in the previous step, until the segment is full
+ * or there are no more unconnected active cells to connect to. The cost is bounded by the size of the segment, not by the number
+ * of active cells, and the active cells of the previous state are not reordered.
  *
  * @param tm
  * @param segment
+ * @param state_prev
  */
-void sl_htm_tm_segment_grow_synapses(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_prev);
+void sl_htm_tm_segment_grow_synapses(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev);
 
 #ifdef __cplusplus
 }
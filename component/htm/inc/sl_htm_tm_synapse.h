@@ -22,11 +22,25 @@ extern "C" {
 #endif
 
 #include "sl_htm_tm_types.h"
-void sl_htm_tm_synapse_setup(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_segment_t* parent_segment, sl_htm_tm_cell_t* target_cell);
-void sl_htm_tm_synapse_reset(sl_htm_tm_synapse_t* synapse);
-bool sl_htm_tm_synapse_is_existing(sl_htm_tm_synapse_t* synapse);
-bool sl_htm_tm_synapse_is_existing_active(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_state_t* state_current);
-bool sl_htm_tm_synapse_is_connected_active(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_state_t* state_current);
+/**
+ * @brief Get the segment that a synapse slot belongs to.
+ *
+ */
+sl_htm_tm_index_t sl_htm_tm_synapse_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse);
+void sl_htm_tm_synapse_setup(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_index_t target_cell);
+void sl_htm_tm_synapse_reset(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse);
+bool sl_htm_tm_synapse_is_existing(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse);
+bool sl_htm_tm_synapse_is_existing_active(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_state_t* state_current);
+bool sl_htm_tm_synapse_is_connected_active(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_state_t* state_current);
+/**
+ * @brief Whether a synapse with this permanence counts towards the potential score that makes a segment matching.
+ * The dendrite pass and the scores restored by sl_htm_tm_load both use it, so a loaded model picks the same segments to learn on.
+ *
+ */
+static inline bool sl_htm_tm_synapse_is_potential(uint8_t permanence)
+{
+  return permanence > 0;
+}
 
 #ifdef __cplusplus
 }
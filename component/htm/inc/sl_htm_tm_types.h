@@ -23,45 +23,50 @@ extern "C" {
 
 #include "sl_htm_sdr.h"
 
-typedef struct sl_htm_tm_cell sl_htm_tm_cell_t;
-typedef struct sl_htm_tm_segment sl_htm_tm_segment_t;
-typedef struct sl_htm_tm_column sl_htm_tm_column_t;
 /**
- * @brief A synapse is a connection between a segment and a cell.
+ * @brief Columns, cells, segments and synapses are addressed by their index in the temporal memory.
  *
+ * Column c owns cells [c * num_cells_per_column, (c + 1) * num_cells_per_column),
+ * cell i owns segment slots [i * max_segments_in_cell, (i + 1) * max_segments_in_cell), and
+ * segment s owns synapse slots [s * max_synapses_in_segment, (s + 1) * max_synapses_in_segment).
+ * The parent of any of them is therefore found with a single division.
+ * Indices are 16 bits by default. Define SL_HTM_TM_INDEX_BITS as 32 for temporal memories with more than 65534 synapse slots.
  */
-typedef struct {
-  uint8_t permanence;
-  sl_htm_tm_cell_t* target_cell; // aka presynaptic cell
-  sl_htm_tm_segment_t *parent_segment;
-} sl_htm_tm_synapse_t;
-/**
- * @brief A segment is a list of synapses.
- *
- */
-struct sl_htm_tm_segment{
-  sl_htm_tm_synapse_t *synapses;
-  uint16_t num_synapses;
+#ifndef SL_HTM_TM_INDEX_BITS
+#define SL_HTM_TM_INDEX_BITS 16
+#endif
 
-  sl_htm_tm_cell_t *parent_cell;
-};
-/**
- * @brief A cell has a state, and a list of segments.
- *
- */
-struct sl_htm_tm_cell{
-  sl_htm_tm_segment_t *segments;
-  uint16_t num_segments;
+#if SL_HTM_TM_INDEX_BITS == 16
+typedef uint16_t sl_htm_tm_index_t;
+#define SL_HTM_TM_INDEX_NONE UINT16_MAX
+#elif SL_HTM_TM_INDEX_BITS == 32
+typedef uint32_t sl_htm_tm_index_t;
+#define SL_HTM_TM_INDEX_NONE UINT32_MAX
+#else
+#error "SL_HTM_TM_INDEX_BITS must be 16 or 32"
+#endif
+// Number of synapses of a segment slot that is not in use
+#define SL_HTM_TM_SEGMENT_FREE UINT16_MAX
 
-  sl_htm_tm_column_t *parent_column;
-};
 /**
- * @brief A column is a group of cells. It also keeps track of the segments that are connected to the cells in the column.
- *
+ * @brief The shape of the temporal memory is read from its parameters at runtime. Define any of these as a nonzero constant
+ * to fix that part of the shape at compile time instead, so that the compiler can fully unroll the loops over the cells of a column,
+ * the segments of a cell and the synapses of a segment. sl_htm_tm_init then rejects parameters that do not match the fixed shape.
  */
-struct sl_htm_tm_column{
-  sl_htm_tm_cell_t *cells;
-};
+#ifndef SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN
+#define SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN 0
+#endif
+#ifndef SL_HTM_TM_FIXED_MAX_SEGMENTS_IN_CELL
+#define SL_HTM_TM_FIXED_MAX_SEGMENTS_IN_CELL 0
+#endif
+#ifndef SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT
+#define SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT 0
+#endif
+// The fixed value if there is one, the runtime value otherwise. The choice is folded at compile time.
+#define SL_HTM_TM_SHAPE(fixed, runtime) ((fixed) != 0 ? (uint16_t)(fixed) : (runtime))
+#define SL_HTM_TM_NUM_CELLS_PER_COLUMN(tm) SL_HTM_TM_SHAPE(SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN, (tm)->parameters.num_cells_per_column)
+#define SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm) SL_HTM_TM_SHAPE(SL_HTM_TM_FIXED_MAX_SEGMENTS_IN_CELL, (tm)->parameters.max_segments_in_cell)
+#define SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm) SL_HTM_TM_SHAPE(SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT, (tm)->parameters.max_synapses_in_segment)
 
 typedef struct {
   uint16_t segment_activation_threshold;
@@ -73,48 +78,303 @@ typedef struct {
   uint16_t max_synapses_in_segment;
   uint16_t max_segments_in_cell;
   uint16_t num_cells_per_column;
+  // Seed of the random number generator of the temporal memory, which breaks ties and picks the cells to grow synapses to
+  uint32_t seed;
 } sl_htm_tm_parameters_t;
-/**
- * @brief A temporal memory is a set of columns, each of which contains a set of cells. The number of cells in a column is the depth of the temporal memory.
- *
- */
-typedef struct {
-  sl_htm_tm_parameters_t parameters;
-  sl_htm_tm_column_t *columns;
-  uint16_t width;
-  uint16_t height;
-  uint16_t input_sparsity;
-} sl_htm_tm_t;
-
 typedef struct {
-  sl_htm_tm_cell_t** cells;
+  sl_htm_tm_index_t* cells;
   uint16_t len;
   uint16_t capacity;
+  // Number of times the array had to be reallocated because it was full
+  uint16_t num_growths;
+  // Number of cells that were left out because the array was full and could not grow
+  uint16_t num_dropped;
+  // The storage was carved from a buffer and never grows
+  bool fixed_capacity;
 } sl_htm_tm_cell_array_t;
 
 typedef struct {
-  sl_htm_tm_segment_t** segments;
+  sl_htm_tm_index_t* segments;
   uint16_t len;
   uint16_t capacity;
+  // Number of times the array had to be reallocated because it was full
+  uint16_t num_growths;
+  // Number of segments that were left out because the array was full and could not grow
+  uint16_t num_dropped;
+  // The storage was carved from a buffer and never grows
+  bool fixed_capacity;
 } sl_htm_tm_segment_array_t;
+
+// Segments [begin, end) of a segment array that is sorted by segment index, e.g. the ones on a single column
+typedef struct {
+  uint16_t begin;
+  uint16_t end;
+} sl_htm_tm_segment_range_t;
+/**
+ * @brief Draws distinct random positions from [0, population) one at a time, as a partial Fisher-Yates shuffle.
+ * The shuffle is virtual: only the swapped positions are recorded, so the array being sampled is never written,
+ * and drawing k positions costs O(k) random numbers and O(k^2) lookups in a table of k entries.
+ */
+typedef struct {
+  // Position j of the virtual shuffle holds swap_values[i] if swap_positions[i] == j, and j otherwise
+  uint16_t* swap_positions;
+  uint16_t* swap_values;
+  uint16_t num_swaps;
+  // Maximum number of draws between two calls to sl_htm_tm_sampler_start
+  uint16_t capacity;
+  uint16_t num_drawn;
+  uint16_t population;
+} sl_htm_tm_sampler_t;
 typedef struct {
   sl_htm_tm_cell_array_t active_cells;
   sl_htm_tm_cell_array_t winner_cells;
   sl_htm_tm_segment_array_t active_segments;
   sl_htm_tm_segment_array_t matching_segments;
+  // Number of active potential synapses of each matching segment, in the order of matching_segments.
+  // Kept from the dendrite pass so that choosing the segment to learn on does not count the synapses again.
+  uint16_t* matching_scores;
+  uint16_t matching_scores_capacity;
   uint16_t num_predictive_and_active_columns;
+  // One bit per cell index that is set while the cell is in active_cells, NULL if not tracked
+  sl_htm_sdr_word_t* active_cells_bitset;
+  uint16_t num_cells;
 } sl_htm_tm_state_t;
 
+/**
+ * @brief A temporal memory is a set of columns, each of which contains a set of cells. The number of cells in a column is the depth of the temporal memory.
+ *
+ * All cells, segments and synapses are stored as parallel arrays carved from one arena allocation.
+ */
+typedef struct {
+  sl_htm_tm_parameters_t parameters;
+  uint16_t width;
+  uint16_t height;
+  uint16_t input_sparsity;
+  uint16_t num_columns;
+  uint16_t num_cells;
+  uint32_t num_segments;
+  uint32_t num_synapses;
+
+  // Single allocation that holds all the arrays below, except for the dendrite scratch counters
+  void* arena;
+  size_t arena_size;
+
+  // Per cell: number of segments in use, and the first synapse that has the cell as presynaptic cell
+  uint16_t* cell_num_segments;
+  sl_htm_tm_index_t* cell_presynaptic_head;
+
+  // Per segment slot: number of synapses in use, or SL_HTM_TM_SEGMENT_FREE
+  uint16_t* segment_num_synapses;
+  // Per segment slot: scratch counters used while activating the dendrites, always zero outside of that
+  uint16_t* segment_num_active_connected;
+  uint16_t* segment_num_active_potential;
+
+  // Per synapse slot: presynaptic cell or SL_HTM_TM_INDEX_NONE, permanence,
+  // and links in the list of synapses that share the same presynaptic cell
+  sl_htm_tm_index_t* synapse_presynaptic_cell;
+  uint8_t* synapse_permanence;
+  sl_htm_tm_index_t* synapse_prev_presynaptic;
+  sl_htm_tm_index_t* synapse_next_presynaptic;
+
+  // Active columns of the current input, so that only those need to be visited
+  sl_htm_sdr_sparse_t active_columns;
+
+  // State of the current and the previous timestep
+  sl_htm_tm_state_t state_current;
+  sl_htm_tm_state_t state_prev;
+  sl_htm_random_t random;
+
+  // Scratch for growing synapses: draws the candidate presynaptic cells, and marks the cells a segment is already connected to
+  sl_htm_tm_sampler_t grow_sampler;
+  sl_htm_sdr_word_t* grow_connected_cells;
+
+  // Scratch for sorting the active and matching segments by column
+  sl_htm_tm_segment_array_t segment_sort_scratch;
+
+  // Whether the buffers and the arena were taken from the heap, so that sl_htm_tm_deinit frees them.
+  // The arena is left alone when it is used in place from the buffer the TM was loaded from.
+  bool heap_allocated;
+  bool arena_in_place;
+} sl_htm_tm_t;
+
+/**
+ * @brief A frozen temporal memory is an inference-only copy of a trained temporal memory. It only keeps the segments that can
+ * become active and their connected synapses, indexed by presynaptic cell so that a step only visits the synapses of the active cells.
+ * The tables are read-only and stored in the serialized format, so they can be placed in flash.
+ */
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint16_t num_columns;
+  uint16_t num_cells;
+  uint16_t num_cells_per_column;
+  uint16_t segment_activation_threshold;
+  uint32_t num_segments;
+  uint32_t num_connected;
+
+  // Cell i is presynaptic to the segments cell_segments[cell_offsets[i]] to cell_segments[cell_offsets[i + 1] - 1],
+  // once for every connected synapse. Segment s belongs to cell segment_cell[s].
+  const sl_htm_tm_index_t* cell_offsets;
+  const sl_htm_tm_index_t* cell_segments;
+  const sl_htm_tm_index_t* segment_cell;
+  // Serialized section that holds the tables
+  const void* tables;
+  size_t tables_size;
+  // Whether the tables were allocated by sl_htm_tm_freeze, so that sl_htm_tm_frozen_deinit frees them
+  bool owns_tables;
+
+  // Per segment: number of active connected synapses, always zero outside of a step
+  uint16_t* segment_num_active;
+  // One bit per cell that is predicted for the next step
+  sl_htm_sdr_word_t* predictive_cells;
+  // Cells active in the current step
+  sl_htm_tm_index_t* active_cells;
+  uint16_t num_active_cells;
+  sl_htm_sdr_sparse_t active_columns;
+} sl_htm_tm_frozen_t;
+
+void sl_htm_tm_init_segment_array(sl_htm_tm_segment_array_t* arr);
 void sl_htm_tm_init_state(sl_htm_tm_state_t* state);
-void sl_htm_tm_add_cell_to_array(sl_htm_tm_cell_t* cell, sl_htm_tm_cell_array_t* arr);
-bool sl_htm_tm_is_cell_in_array(sl_htm_tm_cell_t* cell, sl_htm_tm_cell_array_t* arr);
+/**
+ * @brief Free the arrays of a state that were allocated on the heap, and leave the state empty.
+ * Must not be used on a state reserved in a buffer, that storage is released with the buffer.
+ *
+ * @param state
+ */
+void sl_htm_tm_deinit_state(sl_htm_tm_state_t* state);
+/**
+ * @brief Track the active cells of a state in a bitset indexed by cell index, so that sl_htm_tm_is_cell_active runs in constant time.
+ *
+ * @param state
+ * @param memory The buffer to allocate the bitset from, NULL for the heap
+ * @param num_cells Total number of cells in the temporal memory
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the bitset could not be allocated, the state then keeps scanning its array
+ */
+sl_htm_status_t sl_htm_tm_init_state_active_cells_bitset(sl_htm_tm_state_t* state, sl_htm_memory_t* memory, uint16_t num_cells);
+/**
+ * @brief Allocate room for the given number of elements in the arrays of a state up front,
+ * so that adding cells and segments does not touch the heap. Reserving does not count as a growth.
+ *
+ * @param state
+ * @param memory The buffer to allocate from, NULL for the heap. Arrays reserved in a buffer keep their capacity for good:
+ * elements added past it are dropped and counted in num_dropped.
+ * @param cell_capacity Capacity of the active and winner cell arrays
+ * @param segment_capacity Capacity of the active and matching segment arrays, and of the matching scores
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if an array could not be allocated, the arrays reserved so far keep their new capacity
+ */
+sl_htm_status_t sl_htm_tm_reserve_state(sl_htm_tm_state_t* state, sl_htm_memory_t* memory, uint16_t cell_capacity, uint16_t segment_capacity);
+/**
+ * @brief Allocate room for the given number of segments in an array up front.
+ *
+ * @param arr
+ * @param memory The buffer to allocate from, NULL for the heap. An array reserved in a buffer keeps its capacity for good.
+ * @param capacity
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the array could not be allocated
+ */
+sl_htm_status_t sl_htm_tm_reserve_segment_array(sl_htm_tm_segment_array_t* arr, sl_htm_memory_t* memory, uint16_t capacity);
+/**
+ * @brief Append a cell to an array, growing the array if it is full.
+ *
+ * @param cell
+ * @param arr
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the array is full and could not grow. The cell is then left out and counted in num_dropped.
+ */
+sl_htm_status_t sl_htm_tm_add_cell_to_array(sl_htm_tm_index_t cell, sl_htm_tm_cell_array_t* arr);
+bool sl_htm_tm_is_cell_in_array(sl_htm_tm_index_t cell, sl_htm_tm_cell_array_t* arr);
+/**
+ * @brief Add a cell to the active cells of a state. If the bitset is tracked, cells that are already active are not added again.
+ *
+ * @param cell
+ * @param state
+ */
+void sl_htm_tm_activate_cell(sl_htm_tm_index_t cell, sl_htm_tm_state_t* state);
+/**
+ * @brief Check if a cell is in the active cells of a state. Constant time if the bitset is tracked, otherwise a linear scan.
+ *
+ * @param cell
+ * @param state
+ * @return true if the cell is active
+ */
+bool sl_htm_tm_is_cell_active(sl_htm_tm_index_t cell, sl_htm_tm_state_t* state);
+
+/**
+ * @brief Shuffle the cells of an array, so that every order is equally likely.
+ *
+ * @param arr
+ * @param random
+ */
+void sl_htm_tm_shuffle_cell_array(sl_htm_tm_cell_array_t* arr, sl_htm_random_t* random);
 
-void sl_htm_tm_shuffle_cell_array(sl_htm_tm_cell_array_t* arr);
+/**
+ * @brief Allocate a sampler that can draw up to capacity positions per round.
+ *
+ * @param memory The buffer to allocate the swap table from, NULL for the heap
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the swap table could not be allocated
+ */
+sl_htm_status_t sl_htm_tm_sampler_init(sl_htm_tm_sampler_t* sampler, sl_htm_memory_t* memory, uint16_t capacity);
+/**
+ * @brief Free the swap table of a sampler that was allocated on the heap.
+ *
+ */
+void sl_htm_tm_sampler_deinit(sl_htm_tm_sampler_t* sampler);
+/**
+ * @brief Start a new round of draws from [0, population).
+ *
+ */
+void sl_htm_tm_sampler_start(sl_htm_tm_sampler_t* sampler, uint16_t population);
+/**
+ * @brief Draw a position that was not drawn before in this round.
+ *
+ * @param sampler
+ * @param random
+ * @return The position, or UINT16_MAX if the whole population or the capacity has been drawn
+ */
+uint16_t sl_htm_tm_sampler_next(sl_htm_tm_sampler_t* sampler, sl_htm_random_t* random);
+size_t sl_htm_tm_sampler_memory_size(sl_htm_tm_sampler_t* sampler);
 
-void sl_htm_tm_add_segment_to_array(sl_htm_tm_segment_t* segment, sl_htm_tm_segment_array_t* arr);
+/**
+ * @brief Append a segment to an array, growing the array if it is full.
+ *
+ * @param segment
+ * @param arr
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the array is full and could not grow. The segment is then left out and counted in num_dropped.
+ */
+sl_htm_status_t sl_htm_tm_add_segment_to_array(sl_htm_tm_index_t segment, sl_htm_tm_segment_array_t* arr);
+/**
+ * @brief Sort the segments of an array by index in linear time. Segment indices are laid out by cell and cells by column,
+ * so the segments of a column end up next to each other, in the order of the columns.
+ *
+ * @param arr
+ * @param scratch Array whose storage the sort works in, its elements are overwritten. It grows to the length of arr if it is shorter.
+ * @return SL_HTM_STATUS_WOULD_OVERFLOW if the scratch has a fixed capacity below the length of arr, or SL_HTM_STATUS_ALLOCATION_FAILED
+ * if it could not grow. arr is left unsorted but complete in both cases.
+ */
+sl_htm_status_t sl_htm_tm_sort_segment_array(sl_htm_tm_segment_array_t* arr, sl_htm_tm_segment_array_t* scratch);
+/**
+ * @brief Record the number of active potential synapses of every matching segment of a state in matching_scores.
+ * The scores grow with the matching segments, and if they cannot, the segments past them are left out and counted in num_dropped.
+ *
+ * @param state
+ * @param segment_num_active_potential Number of active potential synapses, indexed by segment
+ */
+void sl_htm_tm_score_matching_segments(sl_htm_tm_state_t* state, const uint16_t* segment_num_active_potential);
 
 void sl_htm_tm_swap_and_clear_states(sl_htm_tm_state_t* state_prev, sl_htm_tm_state_t* state_current);
 size_t sl_htm_tm_state_memory_size(sl_htm_tm_state_t* state);
+/**
+ * @brief Count how many times the arrays of a state had to grow beyond their reserved capacity.
+ *
+ * @param state
+ * @return The number of growth events
+ */
+uint32_t sl_htm_tm_state_num_growths(sl_htm_tm_state_t* state);
+/**
+ * @brief Count how many cells and segments the arrays of a state left out because they were full and could not grow.
+ *
+ * @param state
+ * @return The number of dropped elements
+ */
+uint32_t sl_htm_tm_state_num_dropped(sl_htm_tm_state_t* state);
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,41 @@ extern "C" {
 
 #include <stddef.h>
 #include <stdint.h>
+/**
+ * @brief Small xorshift random number generator. Every SP and TM has its own, seeded from its parameters,
+ * so runs are reproducible and instances do not share any state.
+ */
+typedef struct {
+  uint32_t state;
+} sl_htm_random_t;
+/**
+ * @brief Seed a random number generator. Any seed is valid, including 0.
+ *
+ * @param random
+ * @param seed
+ */
+void sl_htm_random_seed(sl_htm_random_t* random, uint32_t seed);
+/**
+ * @brief Get the next 32 random bits.
+ *
+ */
+static inline uint32_t sl_htm_random_next(sl_htm_random_t* random)
+{
+  uint32_t x = random->state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  random->state = x;
+  return x;
+}
+/**
+ * @brief Get a random number in [0, bound) with a multiply and shift instead of a division.
+ *
+ */
+static inline uint32_t sl_htm_random_below(sl_htm_random_t* random, uint32_t bound)
+{
+  return (uint32_t)(((uint64_t)sl_htm_random_next(random) * bound) >> 32);
+}
 /**
  * @brief Fast clamp function that can compile into only 3(!) instructions. https://stackoverflow.com/a/16659263
  *
@@ -33,6 +68,13 @@ extern "C" {
  */
 uint8_t sl_htm_utils_clamp_uint8(uint8_t d, uint8_t min, uint8_t max);
 int sl_htm_utils_floorf(float x);
+/**
+ * @brief Approximate base 2 logarithm, within 0.01 of the exact value, without the math library.
+ *
+ * @param x A positive, normal number
+ * @return float
+ */
+float sl_htm_utils_log2f(float x);
 uint16_t sl_htm_utils_xy_to_index(uint8_t x, uint8_t y, uint8_t width, uint8_t height);
 uint8_t sl_htm_utils_index_to_x(uint16_t index, uint8_t width);
 uint8_t sl_htm_utils_index_to_y(uint16_t index, uint8_t width, uint8_t height);
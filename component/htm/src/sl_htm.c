@@ -16,34 +16,391 @@
  ******************************************************************************/
 
 #include "sl_htm.h"
+#include <math.h>
+#if SL_HTM_SERIALIZE_FILES
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-static sl_htm_tm_t sl_htm_tm_instance;
-static sl_htm_sp_t sl_htm_sp_instance;
-static sl_htm_sdr_t sl_htm_sp_sdr;
+// The model used by the single-instance API
+static sl_htm_model_t sl_htm_default_model;
 
-void sl_htm_init(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm)
+sl_htm_status_t sl_htm_model_init(sl_htm_model_t* model, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm)
 {
-  sl_htm_tm_instance.parameters = params_tm;
-  sl_htm_sp_instance.parameters = params_sp;
-  sl_htm_sp_init(&sl_htm_sp_instance, input_width, input_height, width, height);
-  sl_htm_tm_init(&sl_htm_tm_instance, width, height);
-  sl_htm_sdr_init(&sl_htm_sp_sdr, width, height);
+  return sl_htm_model_init_static(model, NULL, input_width, input_height, width, height, params_sp, params_tm);
 }
 
-float sl_htm_execute(sl_htm_sdr_t* input_sdr, bool learn)
+sl_htm_status_t sl_htm_model_init_static(sl_htm_model_t* model, sl_htm_memory_t* memory, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm)
+{
+  // SDRs are at most 255 bits wide and high
+  if (input_width > UINT8_MAX || input_height > UINT8_MAX || width > UINT8_MAX || height > UINT8_MAX) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  model->tm.parameters = params_tm;
+  model->sp.parameters = params_sp;
+  model->likelihood = NULL;
+  model->file_buffer = NULL;
+  model->file_size = 0;
+  model->file_mapped = false;
+  sl_htm_status_t status = sl_htm_sp_init_static(&model->sp, memory, input_width, input_height, width, height);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  status = sl_htm_tm_init_static(&model->tm, memory, width, height);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_sp_deinit(&model->sp);
+    return status;
+  }
+  status = sl_htm_sdr_init_static(&model->sp_sdr, memory, width, height);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_tm_deinit(&model->tm);
+    sl_htm_sp_deinit(&model->sp);
+  }
+  return status;
+}
+
+#if SL_HTM_SERIALIZE_FILES
+/**
+ * @brief Unmap or free the buffer that sl_htm_model_load_file loaded a model from.
+ *
+ */
+static void sl_htm_model_release_file(sl_htm_model_t* model)
+{
+  if (model->file_buffer == NULL) {
+    return;
+  }
+  if (model->file_mapped) {
+    munmap(model->file_buffer, model->file_size);
+  } else {
+    free(model->file_buffer);
+  }
+  model->file_buffer = NULL;
+  model->file_size = 0;
+  model->file_mapped = false;
+}
+#endif
+
+void sl_htm_model_deinit(sl_htm_model_t* model)
+{
+  // The SP output is taken from the same memory as the SP
+  if (model->sp.heap_allocated) {
+    sl_htm_sdr_deinit(&model->sp_sdr);
+  }
+  sl_htm_tm_deinit(&model->tm);
+  sl_htm_sp_deinit(&model->sp);
+#if SL_HTM_SERIALIZE_FILES
+  // Parts of a model loaded in place live in the file buffer, so it goes last
+  sl_htm_model_release_file(model);
+#endif
+}
+
+size_t sl_htm_model_static_memory_size(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, const sl_htm_sp_parameters_t* params_sp, const sl_htm_tm_parameters_t* params_tm)
+{
+  if (input_width > UINT8_MAX || input_height > UINT8_MAX || width > UINT8_MAX || height > UINT8_MAX) {
+    return 0;
+  }
+  size_t tm_size = sl_htm_tm_static_memory_size(params_tm, width, height);
+  if (tm_size == 0) {
+    return 0;
+  }
+  return sl_htm_sp_static_memory_size(params_sp, input_width, input_height, width, height) + tm_size + sl_htm_sdr_static_memory_size(width, height);
+}
+
+float sl_htm_model_execute(sl_htm_model_t* model, sl_htm_sdr_t* input_sdr, bool learn)
 {
-  sl_htm_sp_execute(&sl_htm_sp_instance, input_sdr, &sl_htm_sp_sdr, learn);
+  if (sl_htm_sp_execute(&model->sp, input_sdr, &model->sp_sdr, learn) != SL_HTM_STATUS_OK) {
+    return NAN;
+  }
   float anomaly_score = 0;
-  anomaly_score = sl_htm_tm_execute(&sl_htm_tm_instance, &sl_htm_sp_sdr, learn);
+  anomaly_score = sl_htm_tm_execute(&model->tm, &model->sp_sdr, learn);
+  if (model->likelihood != NULL) {
+    sl_htm_anomaly_likelihood_update(model->likelihood, anomaly_score);
+  }
+
+  return anomaly_score;
+}
+
+void sl_htm_model_set_anomaly_likelihood(sl_htm_model_t* model, sl_htm_anomaly_likelihood_t* likelihood)
+{
+  model->likelihood = likelihood;
+}
+
+size_t sl_htm_model_serialized_size(sl_htm_model_t* model)
+{
+  size_t size = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  size += sl_htm_sp_serialized_size(&model->sp);
+  size += sl_htm_tm_serialized_size(&model->tm);
+  return size;
+}
+
+size_t sl_htm_model_save(sl_htm_model_t* model, void* buffer, size_t buffer_size)
+{
+  size_t size = sl_htm_model_serialized_size(model);
+  if (buffer_size < size || ((uintptr_t)buffer % SL_HTM_SERIALIZE_ALIGN) != 0) {
+    printf("Error [%s:%d]: Buffer is too small or not aligned.\n", __FILE__, __LINE__);
+    return 0;
+  }
+  uint8_t* base = buffer;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  memset(base, 0, offset);
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_MODEL, 0, size);
+  offset += sl_htm_sp_save(&model->sp, base + offset, buffer_size - offset);
+  offset += sl_htm_tm_save(&model->tm, base + offset, buffer_size - offset);
+  return offset;
+}
+
+bool sl_htm_model_load(sl_htm_model_t* model, const void* buffer, size_t buffer_size, bool in_place)
+{
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_MODEL, 0)) {
+    return false;
+  }
+  model->likelihood = NULL;
+  model->file_buffer = NULL;
+  model->file_size = 0;
+  model->file_mapped = false;
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  if (size < offset || !sl_htm_sp_load(&model->sp, base + offset, size - offset, in_place)) {
+    return false;
+  }
+  offset += ((const sl_htm_serialize_header_t*)(base + offset))->size;
+  if (!sl_htm_tm_load(&model->tm, base + offset, size - offset, in_place)) {
+    sl_htm_sp_deinit(&model->sp);
+    return false;
+  }
+  // The SP output is the TM input
+  if (model->sp.width != model->tm.width || model->sp.height != model->tm.height) {
+    printf("Error [%s:%d]: Serialized SP and TM have different sizes.\n", __FILE__, __LINE__);
+    sl_htm_tm_deinit(&model->tm);
+    sl_htm_sp_deinit(&model->sp);
+    return false;
+  }
+  if (sl_htm_sdr_init(&model->sp_sdr, model->sp.width, model->sp.height) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the model.\n", __FILE__, __LINE__);
+    sl_htm_tm_deinit(&model->tm);
+    sl_htm_sp_deinit(&model->sp);
+    return false;
+  }
+  return true;
+}
+
+#if SL_HTM_SERIALIZE_FILES
+bool sl_htm_model_save_file(sl_htm_model_t* model, const char* path)
+{
+  size_t size = sl_htm_model_serialized_size(model);
+  void* buffer = malloc(size);
+  if (buffer == NULL) {
+    printf("Error [%s:%d]: Could not allocate memory for saving the model.\n", __FILE__, __LINE__);
+    return false;
+  }
+  sl_htm_model_save(model, buffer, size);
+  FILE* file = fopen(path, "wb");
+  bool written = file != NULL && fwrite(buffer, 1, size, file) == size;
+  if (file != NULL && fclose(file) != 0) {
+    written = false;
+  }
+  free(buffer);
+  if (!written) {
+    printf("Error [%s:%d]: Could not write model to %s.\n", __FILE__, __LINE__, path);
+  }
+  return written;
+}
+
+bool sl_htm_model_load_file(sl_htm_model_t* model, const char* path, bool map)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    printf("Error [%s:%d]: Could not open model file %s.\n", __FILE__, __LINE__, path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  size_t size = file_stat.st_size;
+  void* buffer = NULL;
+  if (map) {
+    // Private mapping: learning writes to copies of the touched pages, the file itself is never changed
+    buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (buffer == MAP_FAILED) {
+      buffer = NULL;
+    }
+  } else {
+    buffer = malloc(size);
+    // A read may return fewer bytes than asked for, keep reading until the whole file is in
+    size_t num_read = 0;
+    while (buffer != NULL && num_read < size) {
+      ssize_t result = read(fd, (uint8_t*)buffer + num_read, size - num_read);
+      if (result < 0 && errno == EINTR) {
+        continue;
+      }
+      if (result <= 0) {
+        free(buffer);
+        buffer = NULL;
+        break;
+      }
+      num_read += result;
+    }
+  }
+  close(fd);
+  if (buffer == NULL) {
+    printf("Error [%s:%d]: Could not read model file %s.\n", __FILE__, __LINE__, path);
+    return false;
+  }
+  if (!sl_htm_model_load(model, buffer, size, true)) {
+    if (map) {
+      munmap(buffer, size);
+    } else {
+      free(buffer);
+    }
+    return false;
+  }
+  // The buffer is owned by the model from here on
+  model->file_buffer = buffer;
+  model->file_size = size;
+  model->file_mapped = map;
+  return true;
+}
+#endif
 
+sl_htm_status_t sl_htm_model_freeze(sl_htm_model_t* model, sl_htm_model_frozen_t* frozen)
+{
+  frozen->likelihood = NULL;
+  sl_htm_status_t status = sl_htm_sp_freeze(&model->sp, &frozen->sp);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  status = sl_htm_tm_freeze(&model->tm, &frozen->tm);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_sp_frozen_deinit(&frozen->sp);
+    return status;
+  }
+  status = sl_htm_sdr_init(&frozen->sp_sdr, model->sp.width, model->sp.height);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_tm_frozen_deinit(&frozen->tm);
+    sl_htm_sp_frozen_deinit(&frozen->sp);
+  }
+  return status;
+}
+
+void sl_htm_model_frozen_deinit(sl_htm_model_frozen_t* frozen)
+{
+  sl_htm_sdr_deinit(&frozen->sp_sdr);
+  sl_htm_tm_frozen_deinit(&frozen->tm);
+  sl_htm_sp_frozen_deinit(&frozen->sp);
+}
+
+float sl_htm_model_frozen_execute(sl_htm_model_frozen_t* frozen, sl_htm_sdr_t* input_sdr)
+{
+  if (sl_htm_sp_frozen_execute(&frozen->sp, input_sdr, &frozen->sp_sdr) != SL_HTM_STATUS_OK) {
+    return NAN;
+  }
+  float anomaly_score = sl_htm_tm_frozen_execute(&frozen->tm, &frozen->sp_sdr);
+  if (frozen->likelihood != NULL) {
+    sl_htm_anomaly_likelihood_update(frozen->likelihood, anomaly_score);
+  }
   return anomaly_score;
 }
 
+void sl_htm_model_frozen_set_anomaly_likelihood(sl_htm_model_frozen_t* frozen, sl_htm_anomaly_likelihood_t* likelihood)
+{
+  frozen->likelihood = likelihood;
+}
+
+size_t sl_htm_model_frozen_serialized_size(sl_htm_model_frozen_t* frozen)
+{
+  return sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)) + frozen->sp.tables_size + frozen->tm.tables_size;
+}
+
+size_t sl_htm_model_frozen_save(sl_htm_model_frozen_t* frozen, void* buffer, size_t buffer_size)
+{
+  size_t size = sl_htm_model_frozen_serialized_size(frozen);
+  if (buffer_size < size || ((uintptr_t)buffer % SL_HTM_SERIALIZE_ALIGN) != 0) {
+    printf("Error [%s:%d]: Buffer is too small or not aligned.\n", __FILE__, __LINE__);
+    return 0;
+  }
+  uint8_t* base = buffer;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  memset(base, 0, offset);
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_MODEL_FROZEN, 0, size);
+  // The tables already are serialized sections
+  memcpy(base + offset, frozen->sp.tables, frozen->sp.tables_size);
+  offset += frozen->sp.tables_size;
+  memcpy(base + offset, frozen->tm.tables, frozen->tm.tables_size);
+  offset += frozen->tm.tables_size;
+  return offset;
+}
+
+bool sl_htm_model_frozen_load(sl_htm_model_frozen_t* frozen, const void* buffer, size_t buffer_size)
+{
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_MODEL_FROZEN, 0)) {
+    return false;
+  }
+  frozen->likelihood = NULL;
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  if (size < offset) {
+    printf("Error [%s:%d]: Frozen model is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (!sl_htm_sp_frozen_load(&frozen->sp, base + offset, size - offset)) {
+    return false;
+  }
+  offset += frozen->sp.tables_size;
+  if (!sl_htm_tm_frozen_load(&frozen->tm, base + offset, size - offset)) {
+    sl_htm_sp_frozen_deinit(&frozen->sp);
+    return false;
+  }
+  if (frozen->sp.sp.width != frozen->tm.width || frozen->sp.sp.height != frozen->tm.height) {
+    printf("Error [%s:%d]: Frozen SP and TM have different sizes.\n", __FILE__, __LINE__);
+    sl_htm_tm_frozen_deinit(&frozen->tm);
+    sl_htm_sp_frozen_deinit(&frozen->sp);
+    return false;
+  }
+  if (sl_htm_sdr_init(&frozen->sp_sdr, frozen->sp.sp.width, frozen->sp.sp.height) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the frozen model.\n", __FILE__, __LINE__);
+    sl_htm_tm_frozen_deinit(&frozen->tm);
+    sl_htm_sp_frozen_deinit(&frozen->sp);
+    return false;
+  }
+  return true;
+}
+
+size_t sl_htm_model_frozen_memory_size(sl_htm_model_frozen_t* frozen)
+{
+  return sl_htm_sp_frozen_memory_size(&frozen->sp) + sl_htm_tm_frozen_memory_size(&frozen->tm) + sl_htm_sdr_memory_size(&frozen->sp_sdr);
+}
+
+sl_htm_status_t sl_htm_init(uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm)
+{
+  return sl_htm_model_init(&sl_htm_default_model, input_width, input_height, width, height, params_sp, params_tm);
+}
+
+sl_htm_status_t sl_htm_init_static(sl_htm_memory_t* memory, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height, sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm)
+{
+  return sl_htm_model_init_static(&sl_htm_default_model, memory, input_width, input_height, width, height, params_sp, params_tm);
+}
+
+float sl_htm_execute(sl_htm_sdr_t* input_sdr, bool learn)
+{
+  return sl_htm_model_execute(&sl_htm_default_model, input_sdr, learn);
+}
+
+void sl_htm_set_anomaly_likelihood(sl_htm_anomaly_likelihood_t* likelihood)
+{
+  sl_htm_model_set_anomaly_likelihood(&sl_htm_default_model, likelihood);
+}
+
 sl_htm_sp_t* sl_htm_get_sp()
 {
-  return &sl_htm_sp_instance;
+  return &sl_htm_default_model.sp;
 }
 sl_htm_tm_t* sl_htm_get_tm()
 {
-  return &sl_htm_tm_instance;
+  return &sl_htm_default_model.tm;
 }
@@ -0,0 +1,142 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#include "sl_htm_anomaly.h"
+
+// Gaussian tail probability Q(z) in Q16, for z from 0 to 5 in steps of 1/8
+#define SL_HTM_ANOMALY_TAIL_STEP_SHIFT 13
+#define SL_HTM_ANOMALY_TAIL_SIZE 41
+static const uint16_t sl_htm_anomaly_tail[SL_HTM_ANOMALY_TAIL_SIZE] = {
+  32768, 29508, 26299, 23189, 20220, 17432, 14852, 12503,
+  10398, 8539, 6924, 5542, 4378, 3413, 2625, 1992,
+  1491, 1101, 801, 575, 407, 284, 195, 132,
+  88, 58, 38, 24, 15, 9, 6, 3,
+  2, 1, 1, 0, 0, 0, 0, 0,
+  0,
+};
+// Smallest standard deviation in Q16. It keeps a perfectly steady score from turning every tiny change into an anomaly.
+#define SL_HTM_ANOMALY_MIN_STDDEV 2048
+
+void sl_htm_anomaly_likelihood_init_default_params(sl_htm_anomaly_likelihood_parameters_t* params)
+{
+  params->averaging_window = 10;
+  params->window = 256;
+  params->learning_period = 256;
+}
+
+sl_htm_status_t sl_htm_anomaly_likelihood_init(sl_htm_anomaly_likelihood_t* likelihood)
+{
+  if (likelihood->parameters.averaging_window == 0 || likelihood->parameters.averaging_window > SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW
+      || likelihood->parameters.window == 0) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  likelihood->recent_sum = 0;
+  likelihood->num_recent = 0;
+  likelihood->next_recent = 0;
+  likelihood->mean = 0;
+  likelihood->variance = 0;
+  likelihood->num_steps = 0;
+  likelihood->likelihood = SL_HTM_ANOMALY_ONE / 2;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Integer square root, one result bit per iteration.
+ *
+ */
+static uint32_t sl_htm_anomaly_isqrt(uint32_t x)
+{
+  uint32_t root = 0;
+  uint32_t bit = (uint32_t)1 << 30;
+  while (bit > x) {
+    bit >>= 2;
+  }
+  while (bit != 0) {
+    if (x >= root + bit) {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+/**
+ * @brief Gaussian tail probability Q(z) for z >= 0 in Q16, interpolated from the table.
+ *
+ */
+static uint32_t sl_htm_anomaly_tail_probability(uint32_t z)
+{
+  uint32_t index = z >> SL_HTM_ANOMALY_TAIL_STEP_SHIFT;
+  if (index >= SL_HTM_ANOMALY_TAIL_SIZE - 1) {
+    return 0;
+  }
+  uint32_t fraction = z & ((1u << SL_HTM_ANOMALY_TAIL_STEP_SHIFT) - 1);
+  uint32_t drop = sl_htm_anomaly_tail[index] - sl_htm_anomaly_tail[index + 1];
+  return sl_htm_anomaly_tail[index] - ((drop * fraction) >> SL_HTM_ANOMALY_TAIL_STEP_SHIFT);
+}
+
+float sl_htm_anomaly_likelihood_update(sl_htm_anomaly_likelihood_t* likelihood, float anomaly_score)
+{
+  uint32_t score = 0;
+  if (anomaly_score >= 1.0f) {
+    score = SL_HTM_ANOMALY_ONE;
+  } else if (anomaly_score > 0.0f) {
+    score = (uint32_t)(anomaly_score * SL_HTM_ANOMALY_ONE);
+  }
+  // Average the recent scores, replacing the oldest one once the ring is full
+  if (likelihood->num_recent < likelihood->parameters.averaging_window) {
+    likelihood->num_recent++;
+  } else {
+    likelihood->recent_sum -= likelihood->recent_scores[likelihood->next_recent];
+  }
+  likelihood->recent_scores[likelihood->next_recent] = score;
+  likelihood->recent_sum += score;
+  likelihood->next_recent = (likelihood->next_recent + 1) % likelihood->parameters.averaging_window;
+  int32_t average = (int32_t)(likelihood->recent_sum / likelihood->num_recent);
+
+  // Judge the average against the statistics of the steps before it
+  int32_t deviation = average - likelihood->mean;
+  if (likelihood->num_steps < likelihood->parameters.learning_period) {
+    likelihood->likelihood = SL_HTM_ANOMALY_ONE / 2;
+  } else {
+    uint32_t variance = likelihood->variance < UINT16_MAX ? likelihood->variance : UINT16_MAX;
+    uint32_t stddev = sl_htm_anomaly_isqrt(variance << 16);
+    if (stddev < SL_HTM_ANOMALY_MIN_STDDEV) {
+      stddev = SL_HTM_ANOMALY_MIN_STDDEV;
+    }
+    uint32_t z = (uint32_t)(((int64_t)(deviation < 0 ? -deviation : deviation) << 16) / stddev);
+    uint32_t tail = sl_htm_anomaly_tail_probability(z);
+    // The likelihood is 1 - Q(z), which is Q(-z) for averages below the mean
+    likelihood->likelihood = deviation > 0 ? SL_HTM_ANOMALY_ONE - tail : tail;
+  }
+
+  // Add the average to the statistics. Until the window has filled up, every step so far has the same weight.
+  likelihood->num_steps++;
+  uint32_t weight = likelihood->num_steps < likelihood->parameters.window ? likelihood->num_steps : likelihood->parameters.window;
+  int32_t squared = (int32_t)(((int64_t)deviation * deviation) >> 16);
+  likelihood->mean += deviation / (int32_t)weight;
+  likelihood->variance = (uint32_t)((int32_t)likelihood->variance + (squared - (int32_t)likelihood->variance) / (int32_t)weight);
+  if (likelihood->num_steps == 1) {
+    likelihood->variance = 0;
+  }
+  return sl_htm_anomaly_likelihood_get(likelihood);
+}
+
+float sl_htm_anomaly_likelihood_get(const sl_htm_anomaly_likelihood_t* likelihood)
+{
+  return (float)likelihood->likelihood / SL_HTM_ANOMALY_ONE;
+}
@@ -0,0 +1,225 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#include "sl_htm_batch.h"
+#if SL_HTM_BATCH_THREADS
+#include <pthread.h>
+#endif
+
+#define SL_HTM_BATCH_CACHE_LINE 64
+
+#if SL_HTM_BATCH_THREADS
+typedef struct {
+  sl_htm_batch_t* batch;
+  pthread_t* threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  // Incremented for every batch execution, workers start when it changes
+  uint32_t generation;
+  uint16_t num_workers_done;
+  bool stop;
+  // The current job
+  sl_htm_sdr_t* input_sdrs;
+  float* anomaly_scores;
+  bool learn;
+  // Next model to execute, shared by all threads
+  uint16_t next_model;
+} sl_htm_batch_pool_t;
+#endif
+
+sl_htm_model_t* sl_htm_batch_get_model(sl_htm_batch_t* batch, uint16_t index)
+{
+  return (sl_htm_model_t*)((uint8_t*)batch->slots + (size_t)index * batch->slot_size);
+}
+
+#if SL_HTM_BATCH_THREADS
+/**
+ * @brief Execute models until there are none left. Models are handed out one at a time, so threads that get cheap models take more of them.
+ *
+ */
+static void sl_htm_batch_run_jobs(sl_htm_batch_pool_t* pool)
+{
+  sl_htm_batch_t* batch = pool->batch;
+  while (1) {
+    uint16_t index = __atomic_fetch_add(&pool->next_model, 1, __ATOMIC_RELAXED);
+    if (index >= batch->num_models) {
+      break;
+    }
+    pool->anomaly_scores[index] = sl_htm_model_execute(sl_htm_batch_get_model(batch, index), &pool->input_sdrs[index], pool->learn);
+  }
+}
+static void* sl_htm_batch_worker(void* arg)
+{
+  sl_htm_batch_pool_t* pool = arg;
+  uint32_t generation = 0;
+  while (1) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->generation == generation && !pool->stop) {
+      pthread_cond_wait(&pool->start, &pool->mutex);
+    }
+    if (pool->stop) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    generation = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    sl_htm_batch_run_jobs(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->num_workers_done++;
+    if (pool->num_workers_done == pool->batch->num_workers) {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+  }
+  return NULL;
+}
+#endif
+
+sl_htm_status_t sl_htm_batch_init(sl_htm_batch_t* batch, uint16_t num_models, uint16_t input_width, uint16_t input_height, uint16_t width, uint16_t height,
+                       sl_htm_sp_parameters_t params_sp, sl_htm_tm_parameters_t params_tm, uint16_t num_threads)
+{
+  batch->num_models = num_models;
+  batch->num_workers = 0;
+  batch->pool = NULL;
+  batch->memory = NULL;
+  batch->slots = NULL;
+  batch->slot_size = (sizeof(sl_htm_model_t) + SL_HTM_BATCH_CACHE_LINE - 1) & ~(size_t)(SL_HTM_BATCH_CACHE_LINE - 1);
+  // Over-allocate so that the first slot can start on a cache line
+  void* memory = sl_htm_memory_alloc(NULL, batch->slot_size * num_models + SL_HTM_BATCH_CACHE_LINE);
+  if (memory == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  batch->memory = memory;
+  batch->slots = (void*)(((uintptr_t)memory + SL_HTM_BATCH_CACHE_LINE - 1) & ~(uintptr_t)(SL_HTM_BATCH_CACHE_LINE - 1));
+  for (uint16_t i = 0; i < num_models; i++) {
+    sl_htm_status_t status = sl_htm_model_init(sl_htm_batch_get_model(batch, i), input_width, input_height, width, height, params_sp, params_tm);
+    if (status != SL_HTM_STATUS_OK) {
+      // The failed model released its own memory, the ones before it are complete
+      for (uint16_t j = 0; j < i; j++) {
+        sl_htm_model_deinit(sl_htm_batch_get_model(batch, j));
+      }
+      sl_htm_memory_free(NULL, batch->memory);
+      batch->memory = NULL;
+      batch->slots = NULL;
+      batch->num_models = 0;
+      return status;
+    }
+  }
+
+#if SL_HTM_BATCH_THREADS
+  // There is no point in having more threads than models
+  if (num_threads > num_models) {
+    num_threads = num_models;
+  }
+  if (num_threads <= 1) {
+    return SL_HTM_STATUS_OK;
+  }
+  sl_htm_batch_pool_t* pool = sl_htm_memory_alloc(NULL, sizeof(sl_htm_batch_pool_t));
+  if (pool == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  pool->batch = batch;
+  pool->generation = 0;
+  pool->num_workers_done = 0;
+  pool->stop = false;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  pool->threads = sl_htm_memory_alloc(NULL, sizeof(pthread_t) * (num_threads - 1));
+  if (pool->threads == NULL) {
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    sl_htm_memory_free(NULL, pool);
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  // If a thread cannot be started, the batch runs on the threads that could
+  while (batch->num_workers < num_threads - 1) {
+    if (pthread_create(&pool->threads[batch->num_workers], NULL, sl_htm_batch_worker, pool) != 0) {
+      break;
+    }
+    batch->num_workers++;
+  }
+  batch->pool = pool;
+#else
+  (void)num_threads;
+#endif
+  return SL_HTM_STATUS_OK;
+}
+
+void sl_htm_batch_execute(sl_htm_batch_t* batch, sl_htm_sdr_t* input_sdrs, bool learn, float* anomaly_scores)
+{
+#if SL_HTM_BATCH_THREADS
+  sl_htm_batch_pool_t* pool = batch->pool;
+  if (pool != NULL) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->input_sdrs = input_sdrs;
+    pool->anomaly_scores = anomaly_scores;
+    pool->learn = learn;
+    pool->next_model = 0;
+    pool->num_workers_done = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    // The calling thread takes part as well
+    sl_htm_batch_run_jobs(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->num_workers_done < batch->num_workers) {
+      pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return;
+  }
+#endif
+  for (uint16_t i = 0; i < batch->num_models; i++) {
+    anomaly_scores[i] = sl_htm_model_execute(sl_htm_batch_get_model(batch, i), &input_sdrs[i], learn);
+  }
+}
+
+void sl_htm_batch_deinit(sl_htm_batch_t* batch)
+{
+#if SL_HTM_BATCH_THREADS
+  sl_htm_batch_pool_t* pool = batch->pool;
+  if (pool != NULL) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+    for (uint16_t i = 0; i < batch->num_workers; i++) {
+      pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    sl_htm_memory_free(NULL, pool->threads);
+    sl_htm_memory_free(NULL, pool);
+    batch->pool = NULL;
+  }
+#endif
+  batch->num_workers = 0;
+  for (uint16_t i = 0; i < batch->num_models; i++) {
+    sl_htm_model_deinit(sl_htm_batch_get_model(batch, i));
+  }
+  sl_htm_memory_free(NULL, batch->memory);
+  batch->memory = NULL;
+  batch->slots = NULL;
+  batch->num_models = 0;
+}
@@ -17,7 +17,7 @@
 #include "sl_htm_encoder.h"
 #include "sl_htm_utils.h"
 
-void sl_htm_encoder_simple_number(float value, float min_value, float max_value, uint16_t num_active_bits, sl_htm_sdr_t* output_sdr)
+sl_htm_status_t sl_htm_encoder_simple_number(float value, float min_value, float max_value, uint16_t num_active_bits, sl_htm_sdr_t* output_sdr)
 {
   float range = max_value - min_value;
   uint16_t n = output_sdr->width * output_sdr->height;
@@ -25,7 +25,299 @@ void sl_htm_encoder_simple_number(float value, float min_value, float max_value,
 
   sl_htm_sdr_clear(output_sdr);
   uint16_t index = sl_htm_utils_floorf((float)num_buckets * (value - min_value) / range);
-  for (uint16_t i = 0; i < num_active_bits; i++) {
-    sl_htm_sdr_set_bit(output_sdr, index + i, 1);
+  return sl_htm_sdr_set_range(output_sdr, index, num_active_bits);
+}
+
+/**
+ * @brief Check the bit counts that every encoder shares, and set up the fields that every encoder has.
+ *
+ */
+static sl_htm_status_t sl_htm_encoder_init_common(sl_htm_encoder_t* encoder, sl_htm_encoder_type_t type, uint16_t size, uint16_t num_active_bits)
+{
+  if (size == 0 || num_active_bits == 0 || num_active_bits > size) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  encoder->type = type;
+  encoder->size = size;
+  encoder->num_active_bits = num_active_bits;
+  encoder->min_value = 0.0f;
+  encoder->max_value = 0.0f;
+  encoder->resolution = 0.0f;
+  encoder->seed = 0;
+  encoder->prev_value = 0.0f;
+  encoder->has_prev_value = false;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Set the range of an encoder. The comparison also rejects NaN.
+ *
+ */
+static sl_htm_status_t sl_htm_encoder_set_range(sl_htm_encoder_t* encoder, float min_value, float max_value)
+{
+  if (!(min_value < max_value)) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  encoder->min_value = min_value;
+  encoder->max_value = max_value;
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_encoder_scalar_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits)
+{
+  sl_htm_status_t status = sl_htm_encoder_init_common(encoder, SL_HTM_ENCODER_SCALAR, size, num_active_bits);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  return sl_htm_encoder_set_range(encoder, min_value, max_value);
+}
+sl_htm_status_t sl_htm_encoder_cyclic_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits)
+{
+  sl_htm_status_t status = sl_htm_encoder_init_common(encoder, SL_HTM_ENCODER_CYCLIC, size, num_active_bits);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  return sl_htm_encoder_set_range(encoder, min_value, max_value);
+}
+sl_htm_status_t sl_htm_encoder_delta_init(sl_htm_encoder_t* encoder, float max_delta, uint16_t size, uint16_t num_active_bits)
+{
+  sl_htm_status_t status = sl_htm_encoder_init_common(encoder, SL_HTM_ENCODER_DELTA, size, num_active_bits);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  return sl_htm_encoder_set_range(encoder, -max_delta, max_delta);
+}
+sl_htm_status_t sl_htm_encoder_log_init(sl_htm_encoder_t* encoder, float min_value, float max_value, uint16_t size, uint16_t num_active_bits)
+{
+  sl_htm_status_t status = sl_htm_encoder_init_common(encoder, SL_HTM_ENCODER_LOG, size, num_active_bits);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  if (!(min_value > 0.0f && min_value < max_value)) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  // The logarithm is taken once here, values are compared against the range in the log domain
+  return sl_htm_encoder_set_range(encoder, sl_htm_utils_log2f(min_value), sl_htm_utils_log2f(max_value));
+}
+sl_htm_status_t sl_htm_encoder_rdse_init(sl_htm_encoder_t* encoder, float resolution, uint16_t size, uint16_t num_active_bits, uint32_t seed)
+{
+  sl_htm_status_t status = sl_htm_encoder_init_common(encoder, SL_HTM_ENCODER_RDSE, size, num_active_bits);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  if (!(resolution > 0.0f)) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  encoder->resolution = resolution;
+  encoder->seed = seed;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Find the bucket of a value in [min_value, max_value], clamping the values outside of it.
+ *
+ * @return A bucket in [0, num_buckets)
+ */
+static uint16_t sl_htm_encoder_clamped_bucket(float value, float min_value, float max_value, uint16_t num_buckets)
+{
+  if (value <= min_value) {
+    return 0;
+  }
+  if (value >= max_value) {
+    return num_buckets - 1;
+  }
+  int bucket = sl_htm_utils_floorf((float)num_buckets * (value - min_value) / (max_value - min_value));
+  // Rounding can put a value just below max_value one bucket too far
+  return bucket < num_buckets ? (uint16_t)bucket : num_buckets - 1;
+}
+/**
+ * @brief Find the start of the active bits of a cyclic encoder, the value is wrapped into the period first.
+ *
+ */
+static uint16_t sl_htm_encoder_cyclic_bucket(sl_htm_encoder_t* encoder, float value)
+{
+  float position = (value - encoder->min_value) / (encoder->max_value - encoder->min_value);
+  // Values far outside of the period lose their fraction, they still land in a bucket
+  if (position > 1e6f || position < -1e6f) {
+    position = 0.0f;
+  }
+  position -= (float)sl_htm_utils_floorf(position);
+  int bucket = sl_htm_utils_floorf(position * (float)encoder->size);
+  return bucket < encoder->size ? (uint16_t)bucket : 0;
+}
+/**
+ * @brief Mix the bits of a bucket index into a well-distributed hash.
+ *
+ */
+static uint32_t sl_htm_encoder_hash(uint32_t x, uint32_t seed)
+{
+  x ^= seed * 0x9E3779B9u;
+  x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+  x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+  return x ^ (x >> 16);
+}
+/**
+ * @brief Where the bits of a field go in an SDR. Field bit i is at offset + (i / width) * stride + i % width,
+ * so a linear field has width == stride, and a field in a rectangle of the SDR has the SDR width as stride.
+ */
+typedef struct {
+  uint16_t offset;
+  uint8_t width;
+  uint8_t stride;
+} sl_htm_encoder_placement_t;
+
+static uint16_t sl_htm_encoder_place(const sl_htm_encoder_placement_t* placement, uint16_t bit)
+{
+  return placement->offset + (bit / placement->width) * placement->stride + bit % placement->width;
+}
+/**
+ * @brief Set the field bits [start, start + len), one word-at-a-time run per row of the placement.
+ *
+ */
+static void sl_htm_encoder_set_run(sl_htm_sdr_t* output_sdr, const sl_htm_encoder_placement_t* placement, uint16_t start, uint16_t len)
+{
+  while (len > 0) {
+    uint16_t chunk = placement->width - start % placement->width;
+    if (chunk > len) {
+      chunk = len;
+    }
+    sl_htm_sdr_set_range(output_sdr, sl_htm_encoder_place(placement, start), chunk);
+    start += chunk;
+    len -= chunk;
+  }
+}
+static void sl_htm_encoder_rdse_set_bits(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr, const sl_htm_encoder_placement_t* placement)
+{
+  float bucket_position = value / encoder->resolution;
+  // Keep the bucket in the range of an int, the buckets at the ends are shared by everything beyond them
+  if (bucket_position > 1e9f) {
+    bucket_position = 1e9f;
+  } else if (bucket_position < -1e9f) {
+    bucket_position = -1e9f;
+  }
+  uint32_t bucket = (uint32_t)sl_htm_utils_floorf(bucket_position);
+  // Bit i of a bucket is the hash of bucket + i, so a bucket shares num_active_bits - 1 hashes with each neighbor
+  for (uint16_t i = 0; i < encoder->num_active_bits; i++) {
+    uint32_t hash = sl_htm_encoder_hash(bucket + i, encoder->seed);
+    uint16_t bit = (uint16_t)(((uint64_t)hash * encoder->size) >> 32);
+    sl_htm_sdr_set_bit(output_sdr, sl_htm_encoder_place(placement, bit), true);
+  }
+}
+/**
+ * @brief Encode a value into a field that has already been checked to fit in the SDR.
+ *
+ */
+static sl_htm_status_t sl_htm_encoder_encode_placed(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr, const sl_htm_encoder_placement_t* placement)
+{
+  if (value != value) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  uint16_t num_buckets = encoder->size - encoder->num_active_bits + 1;
+  uint16_t bucket;
+  switch (encoder->type) {
+    case SL_HTM_ENCODER_CYCLIC:
+      bucket = sl_htm_encoder_cyclic_bucket(encoder, value);
+      // The run wraps around the end of the field
+      if (bucket + encoder->num_active_bits > encoder->size) {
+        uint16_t len = encoder->size - bucket;
+        sl_htm_encoder_set_run(output_sdr, placement, bucket, len);
+        sl_htm_encoder_set_run(output_sdr, placement, 0, encoder->num_active_bits - len);
+        return SL_HTM_STATUS_OK;
+      }
+      break;
+    case SL_HTM_ENCODER_DELTA: {
+      float delta = encoder->has_prev_value ? value - encoder->prev_value : 0.0f;
+      encoder->prev_value = value;
+      encoder->has_prev_value = true;
+      bucket = sl_htm_encoder_clamped_bucket(delta, encoder->min_value, encoder->max_value, num_buckets);
+      break;
+    }
+    case SL_HTM_ENCODER_LOG:
+      // Values at or below zero have no logarithm, they clamp to the bottom of the range
+      bucket = value > 0.0f ? sl_htm_encoder_clamped_bucket(sl_htm_utils_log2f(value), encoder->min_value, encoder->max_value, num_buckets) : 0;
+      break;
+    case SL_HTM_ENCODER_RDSE:
+      sl_htm_encoder_rdse_set_bits(encoder, value, output_sdr, placement);
+      return SL_HTM_STATUS_OK;
+    case SL_HTM_ENCODER_SCALAR:
+    default:
+      bucket = sl_htm_encoder_clamped_bucket(value, encoder->min_value, encoder->max_value, num_buckets);
+      break;
+  }
+  sl_htm_encoder_set_run(output_sdr, placement, bucket, encoder->num_active_bits);
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_encoder_encode_at(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr, uint16_t offset)
+{
+  if (offset + encoder->size > output_sdr->width * output_sdr->height) {
+    return SL_HTM_STATUS_OUT_OF_BOUNDS;
+  }
+  // A linear field is one long row
+  sl_htm_encoder_placement_t placement = { offset, UINT8_MAX, UINT8_MAX };
+  return sl_htm_encoder_encode_placed(encoder, value, output_sdr, &placement);
+}
+sl_htm_status_t sl_htm_encoder_encode(sl_htm_encoder_t* encoder, float value, sl_htm_sdr_t* output_sdr)
+{
+  sl_htm_sdr_clear(output_sdr);
+  return sl_htm_encoder_encode_at(encoder, value, output_sdr, 0);
+}
+sl_htm_status_t sl_htm_encoder_encode_fields(sl_htm_encoder_t* encoders, const float* values, uint16_t num_fields, sl_htm_sdr_t* output_sdr)
+{
+  sl_htm_sdr_clear(output_sdr);
+  uint16_t offset = 0;
+  for (uint16_t i = 0; i < num_fields; i++) {
+    sl_htm_status_t status = sl_htm_encoder_encode_at(&encoders[i], values[i], output_sdr, offset);
+    if (status != SL_HTM_STATUS_OK) {
+      return status;
+    }
+    offset += encoders[i].size;
+  }
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Number of SDR rows that a channel takes in its region.
+ *
+ */
+static uint16_t sl_htm_encoder_region_rows(const sl_htm_encoder_t* encoder, const sl_htm_encoder_region_t* region)
+{
+  return (encoder->size + region->width - 1) / region->width;
+}
+sl_htm_status_t sl_htm_encoder_composite_init(sl_htm_encoder_composite_t* composite, sl_htm_encoder_t* encoders, const sl_htm_encoder_region_t* regions,
+                                              uint16_t num_channels, uint8_t width, uint8_t height)
+{
+  for (uint16_t i = 0; i < num_channels; i++) {
+    const sl_htm_encoder_region_t* region = &regions[i];
+    if (region->width == 0 || region->x + region->width > width || region->y + sl_htm_encoder_region_rows(&encoders[i], region) > height) {
+      return SL_HTM_STATUS_OUT_OF_BOUNDS;
+    }
+    // Channels must not share bits, or they would read as each other's values. The last row of a region may be partly
+    // unused, the whole rectangle is compared to keep the check simple.
+    for (uint16_t j = 0; j < i; j++) {
+      const sl_htm_encoder_region_t* other = &regions[j];
+      if (region->x < other->x + other->width && other->x < region->x + region->width
+          && region->y < other->y + sl_htm_encoder_region_rows(&encoders[j], other)
+          && other->y < region->y + sl_htm_encoder_region_rows(&encoders[i], region)) {
+        return SL_HTM_STATUS_INVALID_PARAMETER;
+      }
+    }
+  }
+  composite->encoders = encoders;
+  composite->regions = regions;
+  composite->num_channels = num_channels;
+  composite->width = width;
+  composite->height = height;
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_encoder_composite_encode(sl_htm_encoder_composite_t* composite, const float* values, sl_htm_sdr_t* output_sdr)
+{
+  if (output_sdr->width != composite->width || output_sdr->height != composite->height) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  sl_htm_sdr_clear(output_sdr);
+  for (uint16_t i = 0; i < composite->num_channels; i++) {
+    const sl_htm_encoder_region_t* region = &composite->regions[i];
+    sl_htm_encoder_placement_t placement = { sl_htm_utils_xy_to_index(region->x, region->y, composite->width, composite->height), region->width, composite->width };
+    sl_htm_status_t status = sl_htm_encoder_encode_placed(&composite->encoders[i], values[i], output_sdr, &placement);
+    if (status != SL_HTM_STATUS_OK) {
+      return status;
+    }
   }
+  return SL_HTM_STATUS_OK;
 }
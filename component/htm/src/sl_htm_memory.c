@@ -0,0 +1,159 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sl_htm_memory.h"
+
+#ifdef UNIT_TEST
+// Number of heap allocations that may still succeed, so that the tests can fail an allocation halfway through an init
+static size_t sl_htm_memory_heap_allocations_left = SIZE_MAX;
+
+void sl_htm_memory_fail_heap_after(size_t num_allocations)
+{
+  sl_htm_memory_heap_allocations_left = num_allocations;
+}
+#endif
+
+#if !SL_HTM_STATIC_MEMORY
+// Number of heap allocations that were not freed yet. Updated atomically, since models on different threads allocate concurrently.
+static size_t sl_htm_memory_heap_allocations = 0;
+
+/**
+ * @brief Check if a new heap allocation may be made. Always true, except in unit tests that fail allocations on purpose.
+ *
+ */
+static bool sl_htm_memory_heap_available(void)
+{
+#ifdef UNIT_TEST
+  if (sl_htm_memory_heap_allocations_left == 0) {
+    return false;
+  }
+  if (sl_htm_memory_heap_allocations_left != SIZE_MAX) {
+    sl_htm_memory_heap_allocations_left--;
+  }
+#endif
+  return true;
+}
+
+static void* sl_htm_memory_count_heap_allocation(void* ptr)
+{
+  if (ptr != NULL) {
+    __atomic_fetch_add(&sl_htm_memory_heap_allocations, 1, __ATOMIC_RELAXED);
+  }
+  return ptr;
+}
+#endif
+
+sl_htm_status_t sl_htm_memory_init(sl_htm_memory_t* memory, void* buffer, size_t size)
+{
+  if (buffer == NULL || ((uintptr_t)buffer % SL_HTM_MEMORY_ALIGN) != 0) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  memory->buffer = buffer;
+  memory->size = size;
+  memory->used = 0;
+  return SL_HTM_STATUS_OK;
+}
+
+void* sl_htm_memory_alloc(sl_htm_memory_t* memory, size_t size)
+{
+  if (memory == NULL) {
+#if SL_HTM_STATIC_MEMORY
+    return NULL;
+#else
+    // malloc(0) may return NULL, which would look like a failure
+    if (!sl_htm_memory_heap_available()) {
+      return NULL;
+    }
+    return sl_htm_memory_count_heap_allocation(malloc(size > 0 ? size : 1));
+#endif
+  }
+  size_t aligned_size = sl_htm_memory_align(size);
+  if (aligned_size > memory->size - memory->used) {
+    return NULL;
+  }
+  void* ptr = memory->buffer + memory->used;
+  memory->used += aligned_size;
+  return ptr;
+}
+
+void* sl_htm_memory_calloc(sl_htm_memory_t* memory, size_t count, size_t size)
+{
+  if (memory == NULL) {
+#if SL_HTM_STATIC_MEMORY
+    return NULL;
+#else
+    if (!sl_htm_memory_heap_available()) {
+      return NULL;
+    }
+    return sl_htm_memory_count_heap_allocation(calloc(count > 0 ? count : 1, size > 0 ? size : 1));
+#endif
+  }
+  void* ptr = sl_htm_memory_alloc(memory, count * size);
+  if (ptr != NULL) {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void* sl_htm_memory_realloc(sl_htm_memory_t* memory, void* ptr, size_t size)
+{
+#if SL_HTM_STATIC_MEMORY
+  (void)memory;
+  (void)ptr;
+  (void)size;
+  return NULL;
+#else
+  if (memory != NULL) {
+    return NULL;
+  }
+  if (ptr == NULL) {
+    if (!sl_htm_memory_heap_available()) {
+      return NULL;
+    }
+    return sl_htm_memory_count_heap_allocation(realloc(NULL, size > 0 ? size : 1));
+  }
+  return realloc(ptr, size > 0 ? size : 1);
+#endif
+}
+
+void sl_htm_memory_free(sl_htm_memory_t* memory, void* ptr)
+{
+  if (memory == NULL) {
+#if !SL_HTM_STATIC_MEMORY
+    if (ptr != NULL) {
+      __atomic_fetch_sub(&sl_htm_memory_heap_allocations, 1, __ATOMIC_RELAXED);
+    }
+    free(ptr);
+#endif
+    return;
+  }
+  uint8_t* byte = ptr;
+  if (byte >= memory->buffer && byte < memory->buffer + memory->used) {
+    memory->used = byte - memory->buffer;
+  }
+}
+
+size_t sl_htm_memory_num_heap_allocations(void)
+{
+#if SL_HTM_STATIC_MEMORY
+  return 0;
+#else
+  return __atomic_load_n(&sl_htm_memory_heap_allocations, __ATOMIC_RELAXED);
+#endif
+}
@@ -17,90 +17,280 @@
 #include "sl_htm_sdr.h"
 #include "fort.h"
 
+static uint16_t sl_htm_sdr_popcount(sl_htm_sdr_word_t word)
+{
+#if defined(__GNUC__) && SL_HTM_SDR_WORD_BITS == 64
+  return __builtin_popcountll(word);
+#elif defined(__GNUC__)
+  return __builtin_popcount(word);
+#else
+  uint16_t count = 0;
+  while (word) {
+    word &= word - 1;
+    count++;
+  }
+  return count;
+#endif
+}
+static uint8_t sl_htm_sdr_count_trailing_zeros(sl_htm_sdr_word_t word)
+{
+#if defined(__GNUC__) && SL_HTM_SDR_WORD_BITS == 64
+  return __builtin_ctzll(word);
+#elif defined(__GNUC__)
+  return __builtin_ctz(word);
+#else
+  uint8_t count = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    count++;
+  }
+  return count;
+#endif
+}
+/**
+ * @brief Mask with the bits [offset, offset + len) of a word set. len must be in range [1, SL_HTM_SDR_WORD_BITS - offset].
+ *
+ */
+static sl_htm_sdr_word_t sl_htm_sdr_word_mask(uint8_t offset, uint8_t len)
+{
+  sl_htm_sdr_word_t mask = len >= SL_HTM_SDR_WORD_BITS ? ~(sl_htm_sdr_word_t)0 : (((sl_htm_sdr_word_t)1 << len) - 1);
+  return mask << offset;
+}
+/**
+ * @brief Read len bits starting at index, the bits may span two words. len must be in range [1, SL_HTM_SDR_WORD_BITS].
+ *
+ */
+static sl_htm_sdr_word_t sl_htm_sdr_read_bits(const sl_htm_sdr_t *sdr, uint16_t index, uint8_t len)
+{
+  uint16_t word_idx = index >> SL_HTM_SDR_WORD_SHIFT;
+  uint8_t offset = index & SL_HTM_SDR_WORD_MASK;
+  sl_htm_sdr_word_t value = sdr->words[word_idx] >> offset;
+  if (offset + len > SL_HTM_SDR_WORD_BITS) {
+    value |= sdr->words[word_idx + 1] << (SL_HTM_SDR_WORD_BITS - offset);
+  }
+  return value & sl_htm_sdr_word_mask(0, len);
+}
+
 bool sl_htm_sdr_get_bit(sl_htm_sdr_t *sdr, uint16_t index)
 {
+#if SL_HTM_BOUNDS_CHECK
   if (index >= sdr->width * sdr->height) {
-    printf("Index out of bounds: %d\n", index);
-    fflush(stdout);
-    while (1);
+    return false;
   }
-  return sdr->bits[index];
+#endif
+  return (sdr->words[index >> SL_HTM_SDR_WORD_SHIFT] >> (index & SL_HTM_SDR_WORD_MASK)) & 1;
 }
 
-void sl_htm_sdr_set_bit(sl_htm_sdr_t *sdr, uint16_t index, bool value)
+sl_htm_status_t sl_htm_sdr_set_bit(sl_htm_sdr_t *sdr, uint16_t index, bool value)
 {
+#if SL_HTM_BOUNDS_CHECK
   if (index >= sdr->width * sdr->height) {
-    printf("Index out of bounds: %d\n", index);
-    while (1);
+    return SL_HTM_STATUS_OUT_OF_BOUNDS;
   }
+#endif
+  sl_htm_sdr_word_t* word = &sdr->words[index >> SL_HTM_SDR_WORD_SHIFT];
+  sl_htm_sdr_word_t mask = (sl_htm_sdr_word_t)1 << (index & SL_HTM_SDR_WORD_MASK);
   // If the bit is flipped from 0 to 1, increment the active count, and vice versa.
-  if (value && !sdr->bits[index]) {
+  if (value && !(*word & mask)) {
     sdr->num_active_bits++;
-  } else if (!value && sdr->bits[index]) {
+    *word |= mask;
+  } else if (!value && (*word & mask)) {
     sdr->num_active_bits--;
+    *word &= ~mask;
   }
-  sdr->bits[index] = value;
+  return SL_HTM_STATUS_OK;
 }
-/**
- * @brief Initialize an SDR.
- *
- * @param sdr
- * @param width
- * @param height
- * @param depth
- */
-void sl_htm_sdr_init(sl_htm_sdr_t *sdr, uint8_t width, uint8_t height)
+sl_htm_status_t sl_htm_sdr_init(sl_htm_sdr_t *sdr, uint8_t width, uint8_t height)
+{
+  return sl_htm_sdr_init_static(sdr, NULL, width, height);
+}
+sl_htm_status_t sl_htm_sdr_init_static(sl_htm_sdr_t *sdr, sl_htm_memory_t* memory, uint8_t width, uint8_t height)
 {
   sdr->width = width;
   sdr->height = height;
   sdr->num_active_bits = 0;
-  sdr->bits = calloc(width * height, sizeof(bool));
-  if (sdr->bits == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for SDR.\n", __FILE__, __LINE__);
-    while (1);
+  sdr->words = sl_htm_memory_calloc(memory, SL_HTM_SDR_NUM_WORDS(width * height), sizeof(sl_htm_sdr_word_t));
+  if (sdr->words == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
   }
+  return SL_HTM_STATUS_OK;
+}
+size_t sl_htm_sdr_static_memory_size(uint8_t width, uint8_t height)
+{
+  return sl_htm_memory_align(SL_HTM_SDR_NUM_WORDS(width * height) * sizeof(sl_htm_sdr_word_t));
+}
+void sl_htm_sdr_deinit(sl_htm_sdr_t *sdr)
+{
+  sl_htm_memory_free(NULL, sdr->words);
+  sdr->words = NULL;
+  sdr->num_active_bits = 0;
 }
 void sl_htm_sdr_clear(sl_htm_sdr_t *sdr)
 {
-  memset(sdr->bits, 0, sdr->width * sdr->height * sizeof(bool));
+  memset(sdr->words, 0, SL_HTM_SDR_NUM_WORDS(sdr->width * sdr->height) * sizeof(sl_htm_sdr_word_t));
   sdr->num_active_bits = 0;
 }
-void sl_htm_sdr_shuffle(sl_htm_sdr_t *sdr)
+void sl_htm_sdr_shuffle(sl_htm_sdr_t *sdr, sl_htm_random_t* random)
 {
-  for (uint16_t i = 0; i < sdr->width * sdr->height; i++) {
-    uint16_t index1 = rand() % (sdr->width * sdr->height);
-    uint16_t index2 = rand() % (sdr->width * sdr->height);
-    bool temp = sdr->bits[index1];
-    sdr->bits[index1] = sdr->bits[index2];
-    sdr->bits[index2] = temp;
+  // Fisher-Yates shuffle of the bits
+  for (uint16_t i = sdr->width * sdr->height; i > 1; i--) {
+    uint16_t index1 = i - 1;
+    uint16_t index2 = sl_htm_random_below(random, i);
+    // Swapping two bits does not change the number of active bits
+    bool temp = sl_htm_sdr_get_bit(sdr, index1);
+    sl_htm_sdr_set_bit(sdr, index1, sl_htm_sdr_get_bit(sdr, index2));
+    sl_htm_sdr_set_bit(sdr, index2, temp);
   }
 }
-/**
- * @brief Randomize the SDR to the given sparsity.
- *
- * @param sdr
- * @param sparsity
- */
-void sl_htm_sdr_randomize(sl_htm_sdr_t *sdr, float sparsity)
+sl_htm_status_t sl_htm_sdr_randomize(sl_htm_sdr_t *sdr, float sparsity, sl_htm_random_t* random)
 {
+  if (!(sparsity >= 0.0f && sparsity <= 1.0f)) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
   // Clear the SDR
   sl_htm_sdr_clear(sdr);
   // Set N bits to 1
   uint16_t target_active_bits = sparsity * sdr->width * sdr->height;
-  for (uint16_t i = 0; i < target_active_bits; i++) {
-    sl_htm_sdr_set_bit(sdr, i, true);
-  }
+  sl_htm_sdr_set_range(sdr, 0, target_active_bits);
   // Shuffle the bit array
-  sl_htm_sdr_shuffle(sdr);
+  sl_htm_sdr_shuffle(sdr, random);
+  return SL_HTM_STATUS_OK;
+}
+
+sl_htm_status_t sl_htm_sdr_set_range(sl_htm_sdr_t *sdr, uint16_t index, uint16_t len)
+{
+  if (index + len > sdr->width * sdr->height) {
+    return SL_HTM_STATUS_OUT_OF_BOUNDS;
+  }
+  while (len > 0) {
+    uint8_t offset = index & SL_HTM_SDR_WORD_MASK;
+    uint8_t chunk = SL_HTM_SDR_WORD_BITS - offset;
+    if (chunk > len) {
+      chunk = len;
+    }
+    sl_htm_sdr_word_t* word = &sdr->words[index >> SL_HTM_SDR_WORD_SHIFT];
+    sl_htm_sdr_word_t mask = sl_htm_sdr_word_mask(offset, chunk);
+    // Only count the bits that were not already set
+    sdr->num_active_bits += chunk - sl_htm_sdr_popcount(*word & mask);
+    *word |= mask;
+    index += chunk;
+    len -= chunk;
+  }
+  return SL_HTM_STATUS_OK;
 }
 
-void sl_htm_sdr_insert(sl_htm_sdr_t* target_sdr, sl_htm_sdr_t* source_sdr, uint8_t x, uint8_t y)
+sl_htm_status_t sl_htm_sdr_insert(sl_htm_sdr_t* target_sdr, sl_htm_sdr_t* source_sdr, uint8_t x, uint8_t y)
 {
   uint16_t target_index = sl_htm_utils_xy_to_index(x, y, target_sdr->width, target_sdr->height);
-  for (uint16_t src_index = 0; src_index < source_sdr->width * source_sdr->height; src_index++) {
-    bool source_bit = sl_htm_sdr_get_bit(source_sdr, src_index);
-    sl_htm_sdr_set_bit(target_sdr, target_index + src_index, source_bit);
+  uint16_t len = source_sdr->width * source_sdr->height;
+  if (target_index + len > target_sdr->width * target_sdr->height) {
+    return SL_HTM_STATUS_OUT_OF_BOUNDS;
+  }
+  uint16_t src_index = 0;
+  // Copy as many source bits at a time as fit into the current target word
+  while (len > 0) {
+    uint8_t offset = target_index & SL_HTM_SDR_WORD_MASK;
+    uint8_t chunk = SL_HTM_SDR_WORD_BITS - offset;
+    if (chunk > len) {
+      chunk = len;
+    }
+    sl_htm_sdr_word_t* word = &target_sdr->words[target_index >> SL_HTM_SDR_WORD_SHIFT];
+    sl_htm_sdr_word_t mask = sl_htm_sdr_word_mask(offset, chunk);
+    sl_htm_sdr_word_t bits = sl_htm_sdr_read_bits(source_sdr, src_index, chunk) << offset;
+    target_sdr->num_active_bits += sl_htm_sdr_popcount(bits);
+    target_sdr->num_active_bits -= sl_htm_sdr_popcount(*word & mask);
+    *word = (*word & ~mask) | bits;
+    target_index += chunk;
+    src_index += chunk;
+    len -= chunk;
+  }
+  return SL_HTM_STATUS_OK;
+}
+
+uint16_t sl_htm_sdr_overlap(const sl_htm_sdr_t* sdr_a, const sl_htm_sdr_t* sdr_b)
+{
+  uint16_t num_words = SL_HTM_SDR_NUM_WORDS(sdr_a->width * sdr_a->height);
+  uint16_t overlap = 0;
+  for (uint16_t i = 0; i < num_words; i++) {
+    overlap += sl_htm_sdr_popcount(sdr_a->words[i] & sdr_b->words[i]);
+  }
+  return overlap;
+}
+
+uint16_t sl_htm_sdr_intersection(sl_htm_sdr_t* target_sdr, const sl_htm_sdr_t* sdr_a, const sl_htm_sdr_t* sdr_b)
+{
+  uint16_t num_words = SL_HTM_SDR_NUM_WORDS(target_sdr->width * target_sdr->height);
+  uint16_t num_active_bits = 0;
+  for (uint16_t i = 0; i < num_words; i++) {
+    target_sdr->words[i] = sdr_a->words[i] & sdr_b->words[i];
+    num_active_bits += sl_htm_sdr_popcount(target_sdr->words[i]);
+  }
+  target_sdr->num_active_bits = num_active_bits;
+  return num_active_bits;
+}
+sl_htm_status_t sl_htm_sdr_sparse_init(sl_htm_sdr_sparse_t* sparse, uint8_t width, uint8_t height, uint16_t capacity)
+{
+  return sl_htm_sdr_sparse_init_static(sparse, NULL, width, height, capacity);
+}
+sl_htm_status_t sl_htm_sdr_sparse_init_static(sl_htm_sdr_sparse_t* sparse, sl_htm_memory_t* memory, uint8_t width, uint8_t height, uint16_t capacity)
+{
+  if (capacity == 0) {
+    capacity = width * height;
+  }
+  sparse->width = width;
+  sparse->height = height;
+  sparse->len = 0;
+  sparse->capacity = capacity;
+  sparse->indices = sl_htm_memory_alloc(memory, capacity * sizeof(uint16_t));
+  if (sparse->indices == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
   }
+  return SL_HTM_STATUS_OK;
+}
+size_t sl_htm_sdr_sparse_static_memory_size(uint8_t width, uint8_t height, uint16_t capacity)
+{
+  if (capacity == 0) {
+    capacity = width * height;
+  }
+  return sl_htm_memory_align(capacity * sizeof(uint16_t));
+}
+void sl_htm_sdr_sparse_deinit(sl_htm_sdr_sparse_t* sparse)
+{
+  sl_htm_memory_free(NULL, sparse->indices);
+  sparse->indices = NULL;
+  sparse->len = 0;
+  sparse->capacity = 0;
+}
+
+sl_htm_status_t sl_htm_sdr_to_sparse(const sl_htm_sdr_t* sdr, sl_htm_sdr_sparse_t* sparse)
+{
+  if (sdr->num_active_bits > sparse->capacity) {
+    sparse->len = 0;
+    return SL_HTM_STATUS_WOULD_OVERFLOW;
+  }
+  uint16_t num_words = SL_HTM_SDR_NUM_WORDS(sdr->width * sdr->height);
+  sparse->len = 0;
+  for (uint16_t word_idx = 0; word_idx < num_words; word_idx++) {
+    sl_htm_sdr_word_t word = sdr->words[word_idx];
+    // Pop the lowest active bit until the word is empty, this keeps the indices sorted
+    while (word) {
+      sparse->indices[sparse->len++] = (word_idx << SL_HTM_SDR_WORD_SHIFT) + sl_htm_sdr_count_trailing_zeros(word);
+      word &= word - 1;
+    }
+  }
+  return SL_HTM_STATUS_OK;
+}
+
+sl_htm_status_t sl_htm_sdr_from_sparse(sl_htm_sdr_t* sdr, const sl_htm_sdr_sparse_t* sparse)
+{
+  sl_htm_sdr_clear(sdr);
+  for (uint16_t i = 0; i < sparse->len; i++) {
+    sl_htm_status_t status = sl_htm_sdr_set_bit(sdr, sparse->indices[i], true);
+    if (status != SL_HTM_STATUS_OK) {
+      return status;
+    }
+  }
+  return SL_HTM_STATUS_OK;
 }
 /**
  * @brief Print the SDR.
@@ -124,5 +314,9 @@ void sl_htm_sdr_print(sl_htm_sdr_t* sdr)
 }
 size_t sl_htm_sdr_memory_size(sl_htm_sdr_t *sdr)
 {
-  return sizeof(sl_htm_sdr_t) + sdr->width * sdr->height * sizeof(bool);
+  return sizeof(sl_htm_sdr_t) + SL_HTM_SDR_NUM_WORDS(sdr->width * sdr->height) * sizeof(sl_htm_sdr_word_t);
+}
+size_t sl_htm_sdr_sparse_memory_size(sl_htm_sdr_sparse_t *sparse)
+{
+  return sizeof(sl_htm_sdr_sparse_t) + sparse->capacity * sizeof(uint16_t);
 }
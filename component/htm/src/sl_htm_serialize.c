@@ -0,0 +1,60 @@
+/***************************************************************************//**
+ * @file
+ * @brief HTM Implementation
+ *******************************************************************************
+ * # License
+ * <b>Copyright 2023 Silicon Laboratories Inc. www.silabs.com</b>
+ *******************************************************************************
+ *
+ * The licensor of this software is Silicon Laboratories Inc. Your use of this
+ * software is governed by the terms of Silicon Labs Master Software License
+ * Agreement (MSLA) available at
+ * www.silabs.com/about-us/legal/master-software-license-agreement. This
+ * software is distributed to you in Source Code format and is governed by the
+ * sections of the MSLA applicable to Source Code.
+ *
+ ******************************************************************************/
+#include "sl_htm_serialize.h"
+#include <stdio.h>
+#include <string.h>
+
+bool sl_htm_serialize_check_header(const void* buffer, size_t buffer_size, uint32_t magic, uint16_t flags)
+{
+  if (buffer == NULL || ((uintptr_t)buffer % SL_HTM_SERIALIZE_ALIGN) != 0) {
+    printf("Error [%s:%d]: Serialized buffer must be aligned to %d bytes.\n", __FILE__, __LINE__, SL_HTM_SERIALIZE_ALIGN);
+    return false;
+  }
+  if (buffer_size < sizeof(sl_htm_serialize_header_t)) {
+    printf("Error [%s:%d]: Serialized buffer is too small.\n", __FILE__, __LINE__);
+    return false;
+  }
+  const sl_htm_serialize_header_t* header = buffer;
+  if (header->magic != magic) {
+    printf("Error [%s:%d]: Serialized buffer has the wrong magic number, it holds another kind of section or uses another byte order.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (header->version != SL_HTM_SERIALIZE_VERSION) {
+    printf("Error [%s:%d]: Serialized buffer has version %d, expected %d.\n", __FILE__, __LINE__, header->version, SL_HTM_SERIALIZE_VERSION);
+    return false;
+  }
+  if (header->flags != flags) {
+    printf("Error [%s:%d]: Serialized buffer was saved with another configuration.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (header->size > buffer_size) {
+    printf("Error [%s:%d]: Serialized buffer is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  return true;
+}
+
+void sl_htm_serialize_write_header(void* buffer, uint32_t magic, uint16_t flags, size_t size)
+{
+  sl_htm_serialize_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic = magic;
+  header.version = SL_HTM_SERIALIZE_VERSION;
+  header.flags = flags;
+  header.size = size;
+  memcpy(buffer, &header, sizeof(header));
+}
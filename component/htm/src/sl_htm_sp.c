@@ -16,6 +16,7 @@
  ******************************************************************************/
 #include "sl_htm_sp.h"
 #include "sl_htm_utils.h"
+#include "sl_htm_serialize.h"
 #include "fort.h"
 /**
  * @brief Check if a connection is active. A connection is active if it is connected to an active bit in the input SDR.
@@ -26,7 +27,8 @@
 bool sl_htm_sp_connection_active(sl_htm_sp_connection_t* connection, sl_htm_sdr_t* input_sdr)
 {
   uint16_t input_index = sl_htm_utils_xy_to_index(connection->sdr_x, connection->sdr_y, input_sdr->width, input_sdr->height);
-  return input_sdr->bits[input_index];
+  // Read the packed input bit directly, the connection is always inside the input SDR
+  return (input_sdr->words[input_index >> SL_HTM_SDR_WORD_SHIFT] >> (input_index & SL_HTM_SDR_WORD_MASK)) & 1;
 }
 /**
  * @brief Check if a connection is connected. A connection is connected if its permanence is greater than or equal to the permanence threshold.
@@ -38,6 +40,14 @@ bool sl_htm_sp_connection_connected(sl_htm_sp_connection_t* connection, sl_htm_s
 {
   return connection->permanence >= sp->parameters.permanence_threshold;
 }
+/**
+ * @brief Number of connections in the potential pool of every column.
+ *
+ */
+static uint16_t sl_htm_sp_num_connections_per_column(const sl_htm_sp_parameters_t* params)
+{
+  return params->potential_radius * params->potential_radius * 2 * params->potential_pct;
+}
 void sl_htm_sp_init_connection(sl_htm_sp_t* sp, uint8_t column_x, uint8_t column_y, uint8_t input_x, uint8_t input_y, uint16_t connection_idx)
 {
   uint16_t column_index = column_x + column_y * sp->width;
@@ -47,102 +57,288 @@ void sl_htm_sp_init_connection(sl_htm_sp_t* sp, uint8_t column_x, uint8_t column
   sp->columns[column_index].connections[connection_idx].sp_x = column_x;
   sp->columns[column_index].connections[connection_idx].sp_y = column_y;
 
-  sp->columns[column_index].connections[connection_idx].permanence = rand() % UINT8_MAX;
+  sp->columns[column_index].connections[connection_idx].permanence = sl_htm_random_below(&sp->random, UINT8_MAX);
 }
-void sl_htm_sp_init_column(sl_htm_sp_t* sp, uint8_t column_x, uint8_t column_y, uint8_t input_width, uint8_t input_height)
+/**
+ * @brief Pick the potential pool of a column: distinct input bits drawn from the neighborhood within potential_radius of it.
+ * The neighborhood positions are drawn with a partial Fisher-Yates shuffle of neighborhood_order,
+ * and the input bits already in the pool are marked in taken_inputs. Neighborhood positions that wrap around onto the same
+ * input bit are skipped, so the pool is always found in O(pool size) unless the neighborhood has fewer distinct input bits.
+ *
+ * @param neighborhood_order Any permutation of the (2 * potential_radius + 1)^2 neighborhood positions
+ * @param taken_inputs One bit per input bit, all clear, left clear on return
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the neighborhood has fewer distinct input bits than the column has connections
+ */
+static sl_htm_status_t sl_htm_sp_init_potential_pool(sl_htm_sp_t* sp, uint8_t column_x, uint8_t column_y, uint16_t* neighborhood_order, sl_htm_sdr_word_t* taken_inputs)
 {
-  if (input_width < sp->width || input_height < sp->height) {
-    printf("Error [%s:%d]: Input SDR must be larger than or equal to the spatial pooler.\n", __FILE__, __LINE__);
-    while (1);
-  }
+  sl_htm_sp_column_t* column = &sp->columns[column_x + column_y * sp->width];
+  uint16_t diameter = sp->parameters.potential_radius * 2 + 1;
+  uint32_t neighborhood_size = (uint32_t)diameter * diameter;
+  // Visually, the columns are centered in the input SDR, so we need to calculate the offset.
+  int32_t input_x_offset = (sp->input_width - sp->width) / 2 + column_x - sp->parameters.potential_radius;
+  int32_t input_y_offset = (sp->input_height - sp->height) / 2 + column_y - sp->parameters.potential_radius;
 
-  uint16_t column_index = column_x + column_y * sp->width;
-  sp->columns[column_index].num_connections = sp->parameters.potential_radius * sp->parameters.potential_radius * 2 * sp->parameters.potential_pct;
-  sp->columns[column_index].connections = malloc(sizeof(sl_htm_sp_connection_t) * sp->columns[column_index].num_connections);
-  if (sp->columns[column_index].connections == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for column connections.\n", __FILE__, __LINE__);
-    while (1);
+  uint32_t num_drawn = 0;
+  uint16_t connection_idx = 0;
+  while (connection_idx < column->num_connections && num_drawn < neighborhood_size) {
+    // Swap a random remaining position to the front
+    uint32_t j = num_drawn + sl_htm_random_below(&sp->random, neighborhood_size - num_drawn);
+    uint16_t position = neighborhood_order[j];
+    neighborhood_order[j] = neighborhood_order[num_drawn];
+    neighborhood_order[num_drawn] = position;
+    num_drawn++;
+    // If the position is outside the input, wrap around on both sides
+    int32_t x = input_x_offset + position % diameter;
+    int32_t y = input_y_offset + position / diameter;
+    uint8_t input_x = ((x % sp->input_width) + sp->input_width) % sp->input_width;
+    uint8_t input_y = ((y % sp->input_height) + sp->input_height) % sp->input_height;
+    uint16_t input_idx = sl_htm_utils_xy_to_index(input_x, input_y, sp->input_width, sp->input_height);
+    sl_htm_sdr_word_t mask = (sl_htm_sdr_word_t)1 << (input_idx & SL_HTM_SDR_WORD_MASK);
+    if (taken_inputs[input_idx >> SL_HTM_SDR_WORD_SHIFT] & mask) {
+      continue;
+    }
+    taken_inputs[input_idx >> SL_HTM_SDR_WORD_SHIFT] |= mask;
+    sl_htm_sp_init_connection(sp, column_x, column_y, input_x, input_y, connection_idx++);
+  }
+  // Clear the marks for the next column. The neighborhood order stays shuffled, which is as good a starting permutation as any.
+  for (uint16_t i = 0; i < connection_idx; i++) {
+    sl_htm_sp_connection_t* connection = &column->connections[i];
+    uint16_t input_idx = sl_htm_utils_xy_to_index(connection->sdr_x, connection->sdr_y, sp->input_width, sp->input_height);
+    taken_inputs[input_idx >> SL_HTM_SDR_WORD_SHIFT] &= ~((sl_htm_sdr_word_t)1 << (input_idx & SL_HTM_SDR_WORD_MASK));
+  }
+  if (connection_idx < column->num_connections) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
   }
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_sp_init_column(sl_htm_sp_t* sp, uint8_t column_x, uint8_t column_y, uint16_t* neighborhood_order, sl_htm_sdr_word_t* taken_inputs)
+{
+  uint16_t column_index = column_x + column_y * sp->width;
+  // Every column has the same number of connections, so its connections start at a fixed offset in the shared array
+  uint16_t num_connections = sp->num_connections / (sp->width * sp->height);
+  sp->columns[column_index].num_connections = num_connections;
+  sp->columns[column_index].connections = &sp->connections[(uint32_t)column_index * num_connections];
+  sp->columns[column_index].raw_overlap_score = 0;
   sp->columns[column_index].overlap_score = 0;
+  sp->columns[column_index].active_duty_cycle = 0;
+  sp->columns[column_index].overlap_duty_cycle = 0;
+  sp->columns[column_index].boost_factor = 256;
   sp->columns[column_index].column_x = column_x;
   sp->columns[column_index].column_y = column_y;
-
-  // Visually, the columns are centered in the input SDR, so we need to calculate the offset.
-  uint8_t input_x_offset = (input_width - sp->width) / 2;
-  uint8_t input_y_offset = (input_height - sp->height) / 2;
-  // Set up connections for current column
-  for (uint16_t connection_idx = 0; connection_idx < sp->columns[column_index].num_connections; connection_idx++) {
-    bool connection_found = false;
-    uint8_t tries = 0;
-    uint8_t max_tries = 50;
-    uint8_t input_x = 0;
-    uint8_t input_y = 0;
-    while (!connection_found) {
-      // If we have tried 50 times to find a unique connection, then we have a problem
-      if (tries >= max_tries) {
-        printf("Error [%s:%d]: Could not find a unique connection for column (%d, %d).\n", __FILE__, __LINE__, column_x, column_y);
-        while (1);
-      }
-      tries++;
-      // Pick a random x and y in the input that is within the potential radius relative to the current column
-      input_x = rand() % (sp->parameters.potential_radius * 2 + 1) + column_x - sp->parameters.potential_radius + input_x_offset;
-      input_y = rand() % (sp->parameters.potential_radius * 2 + 1) + column_y - sp->parameters.potential_radius + input_y_offset;
-      // If the random x and y are outside the input, wrap around
-      // Cannot be less than 0 due to data type
-      if (input_x >= input_width) {
-        input_x -= input_width;
-      }
-      if (input_y >= input_height) {
-        input_y -= input_height;
-      }
-      bool unique_connection = true;
-      // Check if any other connection in the column points to the same input bit
-      for (uint16_t other_connection_idx = 0; other_connection_idx < connection_idx; other_connection_idx++) {
-        sl_htm_sp_connection_t* other_connection = &sp->columns[column_index].connections[other_connection_idx];
-        // Check if the other connection has been set up
-        if (other_connection->sdr_x == 0 && other_connection->sdr_y == 0) {
-          // If not set up, check the next connection
-          continue;
-        }
-
-        // Compare the input x and y of the other connection to the current input x and y
-        if (other_connection->sdr_x == input_x && other_connection->sdr_y == input_y) {
-          // If equal, then the connection is not unique and we need to try again
-          unique_connection = false;
-          break;
-        }
-      }
-      // If the connection is unique, then we can use it
-      if (unique_connection) {
-        connection_found = true;
-      }
+  return sl_htm_sp_init_potential_pool(sp, column_x, column_y, neighborhood_order, taken_inputs);
+}
+/**
+ * @brief Build the input-major index of the connections with a counting sort on the input bit of each connection.
+ *
+ * @param sp
+ * @param memory The buffer to allocate the index from, NULL for the heap
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the index could not be allocated
+ */
+static sl_htm_status_t sl_htm_sp_init_input_index(sl_htm_sp_t* sp, sl_htm_memory_t* memory)
+{
+  uint16_t num_inputs = sp->input_width * sp->input_height;
+  sp->input_offsets = sl_htm_memory_calloc(memory, num_inputs + 1, sizeof(uint32_t));
+  sp->input_connections = sl_htm_memory_alloc(memory, sizeof(uint32_t) * sp->num_connections);
+  if (sp->input_offsets == NULL || sp->input_connections == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  // Count the connections of every input bit, shifted by one so that the prefix sum gives the start offsets
+  for (uint32_t connection_idx = 0; connection_idx < sp->num_connections; connection_idx++) {
+    sl_htm_sp_connection_t* connection = &sp->connections[connection_idx];
+    sp->input_offsets[sl_htm_utils_xy_to_index(connection->sdr_x, connection->sdr_y, sp->input_width, sp->input_height) + 1]++;
+  }
+  for (uint16_t input_idx = 0; input_idx < num_inputs; input_idx++) {
+    sp->input_offsets[input_idx + 1] += sp->input_offsets[input_idx];
+  }
+  // Fill in the connections, using the start offsets as write positions and restoring them afterwards
+  for (uint32_t connection_idx = 0; connection_idx < sp->num_connections; connection_idx++) {
+    sl_htm_sp_connection_t* connection = &sp->connections[connection_idx];
+    uint16_t input_idx = sl_htm_utils_xy_to_index(connection->sdr_x, connection->sdr_y, sp->input_width, sp->input_height);
+    sp->input_connections[sp->input_offsets[input_idx]++] = connection_idx;
+  }
+  for (uint16_t input_idx = num_inputs; input_idx > 0; input_idx--) {
+    sp->input_offsets[input_idx] = sp->input_offsets[input_idx - 1];
+  }
+  sp->input_offsets[0] = 0;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Number of columns that global inhibition activates.
+ *
+ */
+static uint16_t sl_htm_sp_num_global_active_columns(uint16_t num_columns, float sparsity)
+{
+  return num_columns * sparsity;
+}
+/**
+ * @brief Allocate the buffers that the spatial pooler uses while executing. They hold no learned state.
+ *
+ * @param sp
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if a buffer could not be allocated
+ */
+static sl_htm_status_t sl_htm_sp_init_buffers(sl_htm_sp_t* sp, sl_htm_memory_t* memory)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  if (sl_htm_sdr_sparse_init_static(&sp->active_inputs, memory, sp->input_width, sp->input_height, 0) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  if (sp->parameters.local_inhibition) {
+    // The number of active columns depends on the input, so any column may become active
+    sp->top_columns = sl_htm_memory_alloc(memory, sizeof(sl_htm_sp_column_t*) * num_columns);
+    sp->inhibition_order = sl_htm_memory_alloc(memory, sizeof(uint16_t) * num_columns);
+    sp->inhibition_order_tmp = sl_htm_memory_alloc(memory, sizeof(uint16_t) * num_columns);
+    sp->inhibition_tree = sl_htm_memory_alloc(memory, sizeof(uint16_t) * num_columns);
+    if (sp->inhibition_order == NULL || sp->inhibition_order_tmp == NULL || sp->inhibition_tree == NULL) {
+      return SL_HTM_STATUS_ALLOCATION_FAILED;
     }
-
-    // Initialize the connection
-    sl_htm_sp_init_connection(sp, column_x, column_y, input_x, input_y, connection_idx);
+  } else {
+    uint16_t num_active_columns = sl_htm_sp_num_global_active_columns(num_columns, sp->parameters.sparsity);
+    sp->top_columns = sl_htm_memory_alloc(memory, sizeof(sl_htm_sp_column_t*) * num_active_columns);
+    sp->inhibition_order = NULL;
+    sp->inhibition_order_tmp = NULL;
+    sp->inhibition_tree = NULL;
+  }
+  if (sp->top_columns == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_sp_init(sl_htm_sp_t* sp, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height)
+{
+  return sl_htm_sp_init_static(sp, NULL, input_width, input_height, output_width, output_height);
+}
+/**
+ * @brief Clear the pointers to everything that init and load allocate, so that sl_htm_sp_deinit can release an SP that failed halfway.
+ *
+ */
+static void sl_htm_sp_clear_allocations(sl_htm_sp_t* sp, bool heap_allocated, bool tables_in_place)
+{
+  sp->columns = NULL;
+  sp->connections = NULL;
+  sp->input_offsets = NULL;
+  sp->input_connections = NULL;
+  sp->active_inputs.indices = NULL;
+  sp->active_inputs.len = 0;
+  sp->active_inputs.capacity = 0;
+  sp->top_columns = NULL;
+  sp->inhibition_order = NULL;
+  sp->inhibition_order_tmp = NULL;
+  sp->inhibition_tree = NULL;
+  sp->heap_allocated = heap_allocated;
+  sp->tables_in_place = tables_in_place;
+}
+void sl_htm_sp_deinit(sl_htm_sp_t* sp)
+{
+  if (sp->heap_allocated) {
+    sl_htm_memory_free(NULL, sp->inhibition_tree);
+    sl_htm_memory_free(NULL, sp->inhibition_order_tmp);
+    sl_htm_memory_free(NULL, sp->inhibition_order);
+    sl_htm_memory_free(NULL, sp->top_columns);
+    sl_htm_sdr_sparse_deinit(&sp->active_inputs);
+    if (!sp->tables_in_place) {
+      sl_htm_memory_free(NULL, sp->input_connections);
+      sl_htm_memory_free(NULL, sp->input_offsets);
+      sl_htm_memory_free(NULL, sp->connections);
+    }
+    sl_htm_memory_free(NULL, sp->columns);
   }
+  sl_htm_sp_clear_allocations(sp, false, false);
 }
-static sl_htm_sp_column_t** top_columns = NULL;
-void sl_htm_sp_init(sl_htm_sp_t* sp, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height)
+/**
+ * @brief Allocate and initialize the columns, the input index and the buffers of a spatial pooler.
+ *
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return The status of sl_htm_sp_init_static, whatever was allocated before a failure is left to the caller
+ */
+static sl_htm_status_t sl_htm_sp_init_allocations(sl_htm_sp_t* sp, sl_htm_memory_t* memory, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height)
 {
   sp->width = output_width;
   sp->height = output_height;
-  sp->columns = malloc(sizeof(sl_htm_sp_column_t) * sp->width * sp->height);
+  sp->input_width = input_width;
+  sp->input_height = input_height;
+  sp->num_iterations = 0;
+  sl_htm_random_seed(&sp->random, sp->parameters.seed);
+  // Check the sizes before allocating anything
+  uint16_t diameter = sp->parameters.potential_radius * 2 + 1;
+  uint32_t neighborhood_size = (uint32_t)diameter * diameter;
+  if (input_width < sp->width || input_height < sp->height || sp->width == 0 || sp->height == 0 || neighborhood_size > UINT16_MAX) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  if (!(sp->parameters.sparsity > 0.0f && sp->parameters.sparsity <= 1.0f)) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  sp->columns = sl_htm_memory_alloc(memory, sizeof(sl_htm_sp_column_t) * sp->width * sp->height);
   if (sp->columns == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for spatial pooler columns.\n", __FILE__, __LINE__);
-    while (1);
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sp->num_connections = (uint32_t)sl_htm_sp_num_connections_per_column(&sp->parameters) * sp->width * sp->height;
+  sp->connections = sl_htm_memory_alloc(memory, sizeof(sl_htm_sp_connection_t) * sp->num_connections);
+  if (sp->connections == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
   }
-  // Initialize the columns
-  for (uint8_t column_x = 0; column_x < sp->width; column_x++) {
-    for (uint8_t column_y = 0; column_y < sp->height; column_y++) {
-      sl_htm_sp_init_column(sp, column_x, column_y, input_width, input_height);
+  // Scratch for picking the potential pools, only needed during init. It is freed before anything else is allocated,
+  // so that a buffer reuses it for the input index.
+  uint16_t* neighborhood_order = sl_htm_memory_alloc(memory, sizeof(uint16_t) * neighborhood_size);
+  sl_htm_sdr_word_t* taken_inputs = sl_htm_memory_calloc(memory, SL_HTM_SDR_NUM_WORDS(input_width * input_height), sizeof(sl_htm_sdr_word_t));
+  sl_htm_status_t status = SL_HTM_STATUS_OK;
+  if (neighborhood_order == NULL || taken_inputs == NULL) {
+    status = SL_HTM_STATUS_ALLOCATION_FAILED;
+  } else {
+    for (uint32_t i = 0; i < neighborhood_size; i++) {
+      neighborhood_order[i] = i;
+    }
+    // Initialize the columns
+    for (uint8_t column_x = 0; column_x < sp->width && status == SL_HTM_STATUS_OK; column_x++) {
+      for (uint8_t column_y = 0; column_y < sp->height && status == SL_HTM_STATUS_OK; column_y++) {
+        status = sl_htm_sp_init_column(sp, column_x, column_y, neighborhood_order, taken_inputs);
+      }
     }
   }
-  top_columns = malloc(sizeof(sl_htm_sp_column_t*) * sp->width * sp->height * sp->parameters.sparsity);
-  if (top_columns == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for top columns\n", __FILE__, __LINE__);
-    while (1);
+  sl_htm_memory_free(memory, taken_inputs);
+  sl_htm_memory_free(memory, neighborhood_order);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
   }
+  status = sl_htm_sp_init_input_index(sp, memory);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  return sl_htm_sp_init_buffers(sp, memory);
+}
+sl_htm_status_t sl_htm_sp_init_static(sl_htm_sp_t* sp, sl_htm_memory_t* memory, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height)
+{
+  sl_htm_sp_clear_allocations(sp, memory == NULL, false);
+  sl_htm_status_t status = sl_htm_sp_init_allocations(sp, memory, input_width, input_height, output_width, output_height);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_sp_deinit(sp);
+  }
+  return status;
+}
+size_t sl_htm_sp_static_memory_size(const sl_htm_sp_parameters_t* params, uint8_t input_width, uint8_t input_height, uint8_t output_width, uint8_t output_height)
+{
+  // Mirrors the allocations of sl_htm_sp_init_static, in the same order
+  size_t num_columns = (size_t)output_width * output_height;
+  size_t num_inputs = (size_t)input_width * input_height;
+  size_t num_connections = sl_htm_sp_num_connections_per_column(params) * num_columns;
+  uint16_t diameter = params->potential_radius * 2 + 1;
+  size_t size = 0;
+  size += sl_htm_memory_align(sizeof(sl_htm_sp_column_t) * num_columns);
+  size += sl_htm_memory_align(sizeof(sl_htm_sp_connection_t) * num_connections);
+  // The scratch and the input index with the buffers take turns at the end of the buffer
+  size_t scratch_size = sl_htm_memory_align(sizeof(uint16_t) * diameter * diameter);
+  scratch_size += sl_htm_memory_align(sizeof(sl_htm_sdr_word_t) * SL_HTM_SDR_NUM_WORDS(num_inputs));
+  size_t index_size = sl_htm_memory_align(sizeof(uint32_t) * (num_inputs + 1));
+  index_size += sl_htm_memory_align(sizeof(uint32_t) * num_connections);
+  index_size += sl_htm_sdr_sparse_static_memory_size(input_width, input_height, 0);
+  if (params->local_inhibition) {
+    index_size += sl_htm_memory_align(sizeof(sl_htm_sp_column_t*) * num_columns);
+    index_size += 3 * sl_htm_memory_align(sizeof(uint16_t) * num_columns);
+  } else {
+    index_size += sl_htm_memory_align(sizeof(sl_htm_sp_column_t*) * sl_htm_sp_num_global_active_columns(num_columns, params->sparsity));
+  }
+  size += scratch_size > index_size ? scratch_size : index_size;
+  return size;
 }
 /**
  * @brief Initialize the spatial pooler parameters to some default values
@@ -160,58 +356,229 @@ void sl_htm_sp_init_default_params(sl_htm_sp_parameters_t* params)
   params->permanence_threshold = 128;
   params->permanence_increment = 15;
   params->permanence_decrement = 15;
+
+  params->local_inhibition = false;
+  params->inhibition_radius = params->potential_radius;
+
+  params->boost_strength = 0.0f;
+  params->duty_cycle_period = 1000;
+  params->min_pct_overlap_duty_cycle = 0.001f;
+
+  params->seed = 1;
 }
-void sl_htm_sp_get_top_columns(sl_htm_sp_column_t** top_columns, uint16_t num_active_columns, sl_htm_sp_t* sp)
-{
-  // Clear the top columns
-  memset(top_columns, 0, num_active_columns * sizeof(sl_htm_sp_column_t*));
-  // Go through each column
-  for (uint16_t column_idx = 0; column_idx < sp->width * sp->height; column_idx++) {
-    // Go through each of the already found top columns
-    for (uint16_t top_column_idx = 0; top_column_idx < num_active_columns; top_column_idx++) {
-      bool empty = top_columns[top_column_idx] == NULL;
-      // If the current top column is empty, insert the current column
-      if (empty) {
-        top_columns[top_column_idx] = &sp->columns[column_idx];
-        break;
-      }
-      // If the current column has a higher overlap score than the current top column
-      else if (sp->columns[column_idx].overlap_score > top_columns[top_column_idx]->overlap_score) {
-        // Shift all the columns after the current top column down one
-        for (uint16_t shift_idx = num_active_columns; shift_idx > top_column_idx; shift_idx--) {
-          top_columns[shift_idx] = top_columns[shift_idx - 1];
-        }
-        // Insert the current column into the top columns
-        top_columns[top_column_idx] = &sp->columns[column_idx];
-        break;
+sl_htm_status_t sl_htm_sp_get_top_columns(sl_htm_sp_column_t** top_columns, uint16_t num_active_columns, sl_htm_sp_t* sp)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  if (num_active_columns == 0) {
+    return SL_HTM_STATUS_OK;
+  }
+  if (num_active_columns > num_columns) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  // Find the overlap score of the k-th best column one byte at a time, starting with the highest byte set in any score.
+  // Each pass builds a histogram and walks it from the highest bucket down until it contains the k-th column.
+  uint32_t all_scores = 0;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    all_scores |= sp->columns[column_idx].overlap_score;
+  }
+  uint8_t shift = 0;
+  while (shift < 24 && (all_scores >> (shift + 8)) != 0) {
+    shift += 8;
+  }
+  uint16_t histogram[256];
+  uint16_t num_above = 0;
+  uint32_t threshold = 0;
+  for (int8_t byte_shift = shift; byte_shift >= 0; byte_shift -= 8) {
+    memset(histogram, 0, sizeof(histogram));
+    for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+      uint32_t overlap_score = sp->columns[column_idx].overlap_score;
+      // Only the columns in the bucket of the higher bytes matter for this byte
+      if (byte_shift == shift || (overlap_score >> (byte_shift + 8)) == (threshold >> (byte_shift + 8))) {
+        histogram[(overlap_score >> byte_shift) & 0xFF]++;
       }
     }
+    uint16_t bucket = 255;
+    while (bucket > 0 && num_above + histogram[bucket] < num_active_columns) {
+      num_above += histogram[bucket];
+      bucket--;
+    }
+    threshold |= (uint32_t)bucket << byte_shift;
+  }
+
+  // Every column above the threshold is selected. Columns that tie with the threshold fill the remaining slots
+  // in column order, so the selection does not depend on anything but the scores.
+  uint16_t num_ties = num_active_columns - num_above;
+  uint16_t top_column_idx = 0;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    uint32_t overlap_score = sp->columns[column_idx].overlap_score;
+    if (overlap_score > threshold) {
+      top_columns[top_column_idx++] = &sp->columns[column_idx];
+    } else if (overlap_score == threshold && num_ties > 0) {
+      top_columns[top_column_idx++] = &sp->columns[column_idx];
+      num_ties--;
+    }
+  }
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Sort the columns by descending overlap score with a stable radix sort, so that equal scores stay in column order.
+ *
+ */
+static void sl_htm_sp_sort_columns_by_rank(sl_htm_sp_t* sp, uint16_t* order, uint16_t* order_tmp)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  uint16_t offsets[256];
+  uint32_t all_scores = 0;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    order[column_idx] = column_idx;
+    all_scores |= sp->columns[column_idx].overlap_score;
+  }
+  // Sort on the inverted score so that the highest score comes first, from the low byte up.
+  // The bytes above the highest byte set in any score are the same for every column and need no pass.
+  uint16_t* src = order;
+  uint16_t* dst = order_tmp;
+  uint8_t shift = 0;
+  do {
+    memset(offsets, 0, sizeof(offsets));
+    for (uint16_t i = 0; i < num_columns; i++) {
+      offsets[(~sp->columns[src[i]].overlap_score >> shift) & 0xFF]++;
+    }
+    uint16_t sum = 0;
+    for (uint16_t bucket = 0; bucket < 256; bucket++) {
+      uint16_t count = offsets[bucket];
+      offsets[bucket] = sum;
+      sum += count;
+    }
+    for (uint16_t i = 0; i < num_columns; i++) {
+      dst[offsets[(~sp->columns[src[i]].overlap_score >> shift) & 0xFF]++] = src[i];
+    }
+    uint16_t* sorted = dst;
+    dst = src;
+    src = sorted;
+    shift += 8;
+  } while (shift < 32 && (all_scores >> shift) != 0);
+  if (src != order) {
+    memcpy(order, src, num_columns * sizeof(uint16_t));
+  }
+}
+/**
+ * @brief Count the columns marked in the Fenwick tree in the rectangle [0, x) x [0, y).
+ *
+ */
+static uint16_t sl_htm_sp_tree_prefix(sl_htm_sp_t* sp, uint16_t* tree, uint16_t x, uint16_t y)
+{
+  uint16_t count = 0;
+  for (uint16_t i = y; i > 0; i -= i & -i) {
+    for (uint16_t j = x; j > 0; j -= j & -j) {
+      count += tree[(i - 1) * sp->width + (j - 1)];
+    }
+  }
+  return count;
+}
+static void sl_htm_sp_tree_mark(sl_htm_sp_t* sp, uint16_t* tree, uint16_t x, uint16_t y)
+{
+  for (uint16_t i = y + 1; i <= sp->height; i += i & -i) {
+    for (uint16_t j = x + 1; j <= sp->width; j += j & -j) {
+      tree[(i - 1) * sp->width + (j - 1)]++;
+    }
+  }
+}
+uint16_t sl_htm_sp_get_local_top_columns(sl_htm_sp_column_t** top_columns, sl_htm_sp_t* sp)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  uint16_t radius = sp->parameters.inhibition_radius;
+  sl_htm_sp_sort_columns_by_rank(sp, sp->inhibition_order, sp->inhibition_order_tmp);
+  memset(sp->inhibition_tree, 0, num_columns * sizeof(uint16_t));
+
+  uint16_t num_active_columns = 0;
+  for (uint16_t rank = 0; rank < num_columns; rank++) {
+    sl_htm_sp_column_t* column = &sp->columns[sp->inhibition_order[rank]];
+    // Columns are visited by descending score, so no later column can pass the threshold either
+    if (column->overlap_score < ((uint32_t)sp->parameters.overlap_score_threshold << 8)) {
+      break;
+    }
+    // The neighborhood is clipped to the edges of the spatial pooler
+    uint16_t x0 = column->column_x > radius ? column->column_x - radius : 0;
+    uint16_t y0 = column->column_y > radius ? column->column_y - radius : 0;
+    uint16_t x1 = column->column_x + radius + 1 < sp->width ? column->column_x + radius + 1 : sp->width;
+    uint16_t y1 = column->column_y + radius + 1 < sp->height ? column->column_y + radius + 1 : sp->height;
+    uint16_t num_neighbors = (x1 - x0) * (y1 - y0) - 1;
+    // Every column already in the tree ranks higher than this one
+    uint16_t num_higher = sl_htm_sp_tree_prefix(sp, sp->inhibition_tree, x1, y1)
+                          - sl_htm_sp_tree_prefix(sp, sp->inhibition_tree, x0, y1)
+                          - sl_htm_sp_tree_prefix(sp, sp->inhibition_tree, x1, y0)
+                          + sl_htm_sp_tree_prefix(sp, sp->inhibition_tree, x0, y0);
+    uint16_t num_local_active = (uint16_t)(0.5f + sp->parameters.sparsity * (num_neighbors + 1));
+    if (num_higher < num_local_active) {
+      top_columns[num_active_columns++] = column;
+    }
+    sl_htm_sp_tree_mark(sp, sp->inhibition_tree, column->column_x, column->column_y);
+  }
+  return num_active_columns;
+}
+/**
+ * @brief Select the active columns with the configured inhibition mode.
+ *
+ * @return The number of active columns written to top_columns
+ */
+static uint16_t sl_htm_sp_inhibit(sl_htm_sp_t* sp, sl_htm_sp_column_t** top_columns)
+{
+  if (sp->parameters.local_inhibition) {
+    return sl_htm_sp_get_local_top_columns(top_columns, sp);
+  }
+  uint16_t num_active_columns = sl_htm_sp_num_global_active_columns(sp->width * sp->height, sp->parameters.sparsity);
+  sl_htm_sp_get_top_columns(top_columns, num_active_columns, sp);
+  return num_active_columns;
+}
+/**
+ * @brief Collect the active bits of the input SDR in sp->active_inputs
+ *
+ * @param sp
+ * @param input_sdr
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the input SDR does not have the size the SP was initialized with
+ */
+static sl_htm_status_t sl_htm_sp_collect_active_inputs(sl_htm_sp_t* sp, const sl_htm_sdr_t* input_sdr)
+{
+#if SL_HTM_BOUNDS_CHECK
+  if (input_sdr->width != sp->input_width || input_sdr->height != sp->input_height) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
   }
+#endif
+  return sl_htm_sdr_to_sparse(input_sdr, &sp->active_inputs);
 }
 /**
  * @brief Compute the overlap score for each column in the spatial pooler
  *
  * @param sp
  * @param sdr
+ * @return The status of sl_htm_sp_collect_active_inputs. The overlap scores are not changed on failure.
  */
-void sl_htm_sp_execute_overlap(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr)
+sl_htm_status_t sl_htm_sp_execute_overlap(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr)
 {
-  for (uint16_t column_x = 0; column_x < sp->width; column_x++) {
-    for (uint16_t column_y = 0; column_y < sp->height; column_y++) {
-      uint16_t column_index = column_x + column_y * sp->width;
-      sp->columns[column_index].overlap_score = 0;
-
-      for (uint16_t connection_idx = 0; connection_idx < sp->columns[column_index].num_connections; connection_idx++) {
-        bool connected = sl_htm_sp_connection_connected(&sp->columns[column_index].connections[connection_idx], sp);
-
-        bool active = sl_htm_sp_connection_active(&sp->columns[column_index].connections[connection_idx], input_sdr);
-
-        if (connected && active) {
-          sp->columns[column_index].overlap_score++;
-        }
+  // Only the connections on active input bits can contribute to the overlap
+  sl_htm_status_t status = sl_htm_sp_collect_active_inputs(sp, input_sdr);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  uint16_t num_columns = sp->width * sp->height;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sp->columns[column_idx].raw_overlap_score = 0;
+  }
+  for (uint16_t i = 0; i < sp->active_inputs.len; i++) {
+    uint16_t input_idx = sp->active_inputs.indices[i];
+    for (uint32_t j = sp->input_offsets[input_idx]; j < sp->input_offsets[input_idx + 1]; j++) {
+      sl_htm_sp_connection_t* connection = &sp->connections[sp->input_connections[j]];
+      if (sl_htm_sp_connection_connected(connection, sp)) {
+        sp->columns[connection->sp_x + connection->sp_y * sp->width].raw_overlap_score++;
       }
     }
   }
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sl_htm_sp_column_t* column = &sp->columns[column_idx];
+    // The boost factor is in Q8.8, so the product keeps the fraction of the boosted score
+    column->overlap_score = (uint32_t)column->raw_overlap_score * column->boost_factor;
+  }
+  return SL_HTM_STATUS_OK;
 }
 /**
  * @brief Activate the top columns in the spatial pooler based on the overlap score so that the number of active columns is equal to the desired sparsity
@@ -257,39 +624,142 @@ void sl_htm_sp_execute_learning(sl_htm_sp_t *sp, sl_htm_sdr_t *input_sdr, bool l
   }
 }
 
-void sl_htm_sp_execute(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr, bool learn)
+/**
+ * @brief Move a Q0.32 duty cycle one step towards 1 if value is true, or towards 0 otherwise.
+ * The division truncates, so the duty cycle stops within period / 2^32 of the target, which is far below any sparsity.
+ *
+ */
+static uint32_t sl_htm_sp_update_duty_cycle(uint32_t duty_cycle, bool value, uint16_t period)
+{
+  int64_t target = value ? UINT32_MAX : 0;
+  return duty_cycle + (target - (int64_t)duty_cycle) / period;
+}
+// 2^(i / 16) in Q16.16 for i = 0..16, interpolated linearly by sl_htm_sp_exp
+static const uint32_t sl_htm_sp_exp2_table[17] = {
+  65536, 68438, 71468, 74632, 77936, 81386, 84990, 88752, 92682, 96785, 101070, 105545, 110218, 115098, 120194, 125515, 131072
+};
+/**
+ * @brief Compute e^x for a Q8.8 exponent as a Q8.8 boost factor, clamped to [1, UINT16_MAX].
+ * e^x is computed as 2^(x * log2(e)), with the fractional power of two read from sl_htm_sp_exp2_table.
+ * The result never reaches 0, so a column that is active too often is suppressed but can still win when no other column has any overlap.
+ *
+ */
+static uint16_t sl_htm_sp_exp(int32_t exponent)
+{
+  // e^8 is above the Q8.8 range and e^-8 is below its resolution, so the exponent can be clamped without changing the result
+  if (exponent > 8 << 8) {
+    exponent = 8 << 8;
+  } else if (exponent < -(8 << 8)) {
+    exponent = -(8 << 8);
+  }
+  // log2(e) in Q2.14
+  int32_t power = exponent * 23637 >> 14;
+  int32_t integer = power >> 8;
+  uint8_t fraction = power & 0xFF;
+  uint32_t low = sl_htm_sp_exp2_table[fraction >> 4];
+  uint32_t high = sl_htm_sp_exp2_table[(fraction >> 4) + 1];
+  uint32_t mantissa = low + ((high - low) * (fraction & 0xF) >> 4);
+  // The mantissa is 2^fraction in Q16.16, so it is shifted by 8 - integer to get a Q8.8 result
+  if (integer >= 8) {
+    return UINT16_MAX;
+  }
+  uint32_t boost_factor = mantissa >> (8 - integer);
+  if (boost_factor > UINT16_MAX) {
+    return UINT16_MAX;
+  }
+  return boost_factor == 0 ? 1 : boost_factor;
+}
+/**
+ * @brief Update the duty cycles and boost factors of all columns, and increase the permanences of columns that rarely have any overlap.
+ * Everything is computed in fixed point. The boost factor is the exponential boost function in BAMI,
+ * e^(strength * (sparsity - active duty cycle)), see sl_htm_sp_exp.
+ *
+ * @param sp
+ * @param output_sdr The active columns of this step
+ */
+void sl_htm_sp_execute_boosting(sl_htm_sp_t* sp, sl_htm_sdr_t* output_sdr)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  sp->num_iterations++;
+  // Until a full period has passed, average over the steps seen so far
+  uint16_t period = sp->num_iterations < sp->parameters.duty_cycle_period ? sp->num_iterations : sp->parameters.duty_cycle_period;
+  if (period == 0) {
+    period = 1;
+  }
+
+  uint32_t max_overlap_duty_cycle = 0;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sl_htm_sp_column_t* column = &sp->columns[column_idx];
+    column->active_duty_cycle = sl_htm_sp_update_duty_cycle(column->active_duty_cycle, sl_htm_sdr_get_bit(output_sdr, column_idx), period);
+    column->overlap_duty_cycle = sl_htm_sp_update_duty_cycle(column->overlap_duty_cycle, column->raw_overlap_score > 0, period);
+    if (column->overlap_duty_cycle > max_overlap_duty_cycle) {
+      max_overlap_duty_cycle = column->overlap_duty_cycle;
+    }
+  }
+
+  uint32_t min_overlap_duty_cycle = max_overlap_duty_cycle * sp->parameters.min_pct_overlap_duty_cycle;
+  uint8_t permanence_bump = sp->parameters.permanence_threshold / 10;
+  int32_t target_duty_cycle = sp->parameters.sparsity * UINT16_MAX;
+  int32_t boost_strength = sp->parameters.boost_strength * 256;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sl_htm_sp_column_t* column = &sp->columns[column_idx];
+    // Bump all the permanences of a column that does not see enough input, so that it gets a chance to compete
+    if (column->overlap_duty_cycle < min_overlap_duty_cycle) {
+      for (uint16_t connection_idx = 0; connection_idx < column->num_connections; connection_idx++) {
+        sl_htm_sp_connection_t* connection = &column->connections[connection_idx];
+        if (connection->permanence > UINT8_MAX - permanence_bump) {
+          connection->permanence = UINT8_MAX;
+        } else {
+          connection->permanence += permanence_bump;
+        }
+      }
+    }
+    if (boost_strength > 0) {
+      // Q8.8 strength times the Q0.16 difference, scaled down to Q8.8
+      int32_t exponent = ((target_duty_cycle - (int32_t)(column->active_duty_cycle >> 16)) >> 8) * boost_strength >> 8;
+      column->boost_factor = sl_htm_sp_exp(exponent);
+    }
+  }
+}
+
+sl_htm_status_t sl_htm_sp_execute(sl_htm_sp_t* sp, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr, bool learn)
 {
   // Compute the overlap score for each column
-  sl_htm_sp_execute_overlap(sp, input_sdr);
+  sl_htm_status_t status = sl_htm_sp_execute_overlap(sp, input_sdr);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
 
   // Activate the top columns
-  uint16_t num_active_columns = sp->width * sp->height * sp->parameters.sparsity;
+  uint16_t num_active_columns = sl_htm_sp_inhibit(sp, sp->top_columns);
 
-  sl_htm_sp_get_top_columns(top_columns, num_active_columns, sp);
-  sl_htm_sp_execute_columns(sp, output_sdr, top_columns, num_active_columns);
+  sl_htm_sp_execute_columns(sp, output_sdr, sp->top_columns, num_active_columns);
   // Perform learning
-  sl_htm_sp_execute_learning(sp, input_sdr, learn, top_columns, num_active_columns);
+  sl_htm_sp_execute_learning(sp, input_sdr, learn, sp->top_columns, num_active_columns);
+  if (learn) {
+    sl_htm_sp_execute_boosting(sp, output_sdr);
+  }
+  return SL_HTM_STATUS_OK;
 }
 
 void sl_htm_sp_print(sl_htm_sp_t* sp)
 {
-  uint16_t num_active_columns = sp->width * sp->height * sp->parameters.sparsity;
-  sl_htm_sp_get_top_columns(top_columns, num_active_columns, sp);
+  uint16_t num_active_columns = sl_htm_sp_inhibit(sp, sp->top_columns);
   ft_table_t* table = ft_create_table();
   if (table == NULL) {
     printf("Error [%s:%d]: Failed to create table.\n", __FILE__, __LINE__);
   }
   for (uint16_t column_y = 0; column_y < sp->height; column_y++) {
     for (uint16_t column_x = 0; column_x < sp->width; column_x++) {
-      uint16_t overlap_score = sp->columns[sl_htm_utils_xy_to_index(column_x, column_y, sp->width, sp->height)].overlap_score;
+      uint32_t overlap_score = sp->columns[sl_htm_utils_xy_to_index(column_x, column_y, sp->width, sp->height)].overlap_score;
       bool active = false;
       for (uint16_t active_column_idx = 0; active_column_idx < num_active_columns; active_column_idx++) {
-        if (top_columns[active_column_idx]->column_x == column_x && top_columns[active_column_idx]->column_y == column_y) {
+        if (sp->top_columns[active_column_idx]->column_x == column_x && sp->top_columns[active_column_idx]->column_y == column_y) {
           active = true;
           break;
         }
       }
-      ft_printf(table, "%d (%hu)", active, overlap_score);
+      ft_printf(table, "%d (%.2f)", active, overlap_score / 256.0f);
     }
     ft_ln(table);
   }
@@ -312,9 +782,491 @@ size_t sl_htm_sp_memory_size(sl_htm_sp_t* sp)
   // This is the static version of the memory size calculation
   size_t size = 0;
   size_t num_columns = sp->width * sp->height;
-  size_t num_connections_per_column = sp->parameters.potential_radius * sp->parameters.potential_radius * 2 * sp->parameters.potential_pct;
+  size_t num_connections_per_column = sl_htm_sp_num_connections_per_column(&sp->parameters);
   size += sizeof(sl_htm_sp_t);
   size += num_columns * sizeof(sl_htm_sp_column_t);
   size += num_columns * num_connections_per_column * sizeof(sl_htm_sp_connection_t);
+  // Input-major connection index
+  size += (sp->input_width * sp->input_height + 1) * sizeof(uint32_t);
+  size += num_columns * num_connections_per_column * sizeof(uint32_t);
+  size += sl_htm_sdr_sparse_memory_size(&sp->active_inputs);
+  if (sp->parameters.local_inhibition) {
+    size += num_columns * sizeof(sl_htm_sp_column_t*);
+    size += 3 * num_columns * sizeof(uint16_t);
+  } else {
+    size += sl_htm_sp_num_global_active_columns(num_columns, sp->parameters.sparsity) * sizeof(sl_htm_sp_column_t*);
+  }
+  return size;
+}
+
+// Serialized parameters. They are written field by field with explicit sizes, so that adding a parameter to sl_htm_sp_parameters_t
+// does not silently change the format. Any change here needs a new SL_HTM_SERIALIZE_VERSION.
+typedef struct {
+  float sparsity;
+  float potential_pct;
+  float boost_strength;
+  float min_pct_overlap_duty_cycle;
+  uint32_t seed;
+  uint16_t overlap_score_threshold;
+  uint16_t potential_radius;
+  uint16_t inhibition_radius;
+  uint16_t duty_cycle_period;
+  uint8_t permanence_threshold;
+  uint8_t permanence_increment;
+  uint8_t permanence_decrement;
+  uint8_t local_inhibition;
+} sl_htm_sp_parameters_record_t;
+
+static void sl_htm_sp_write_parameters(sl_htm_sp_parameters_record_t* record, const sl_htm_sp_parameters_t* parameters)
+{
+  record->sparsity = parameters->sparsity;
+  record->potential_pct = parameters->potential_pct;
+  record->boost_strength = parameters->boost_strength;
+  record->min_pct_overlap_duty_cycle = parameters->min_pct_overlap_duty_cycle;
+  record->seed = parameters->seed;
+  record->overlap_score_threshold = parameters->overlap_score_threshold;
+  record->potential_radius = parameters->potential_radius;
+  record->inhibition_radius = parameters->inhibition_radius;
+  record->duty_cycle_period = parameters->duty_cycle_period;
+  record->permanence_threshold = parameters->permanence_threshold;
+  record->permanence_increment = parameters->permanence_increment;
+  record->permanence_decrement = parameters->permanence_decrement;
+  record->local_inhibition = parameters->local_inhibition;
+}
+
+static void sl_htm_sp_read_parameters(sl_htm_sp_parameters_t* parameters, const sl_htm_sp_parameters_record_t* record)
+{
+  parameters->sparsity = record->sparsity;
+  parameters->potential_pct = record->potential_pct;
+  parameters->boost_strength = record->boost_strength;
+  parameters->min_pct_overlap_duty_cycle = record->min_pct_overlap_duty_cycle;
+  parameters->seed = record->seed;
+  parameters->overlap_score_threshold = record->overlap_score_threshold;
+  parameters->potential_radius = record->potential_radius;
+  parameters->inhibition_radius = record->inhibition_radius;
+  parameters->duty_cycle_period = record->duty_cycle_period;
+  parameters->permanence_threshold = record->permanence_threshold;
+  parameters->permanence_increment = record->permanence_increment;
+  parameters->permanence_decrement = record->permanence_decrement;
+  parameters->local_inhibition = record->local_inhibition != 0;
+}
+
+// Fixed-size part of a serialized spatial pooler
+typedef struct {
+  sl_htm_sp_parameters_record_t parameters;
+  uint32_t num_iterations;
+  uint32_t num_connections;
+  uint32_t random_state;
+  uint8_t width;
+  uint8_t height;
+  uint8_t input_width;
+  uint8_t input_height;
+} sl_htm_sp_record_t;
+// Learned state of a serialized column, everything else follows from its index
+typedef struct {
+  uint32_t active_duty_cycle;
+  uint32_t overlap_duty_cycle;
+  uint16_t boost_factor;
+} sl_htm_sp_column_record_t;
+// Offsets of the parts of a serialized spatial pooler from the start of its section
+typedef struct {
+  size_t record;
+  size_t input_offsets;
+  size_t input_connections;
+  size_t columns;
+  size_t connections;
+  size_t size;
+} sl_htm_sp_layout_t;
+
+static sl_htm_sp_layout_t sl_htm_sp_serialized_layout(uint16_t num_columns, uint16_t num_inputs, uint32_t num_connections)
+{
+  sl_htm_sp_layout_t layout;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  layout.record = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_sp_record_t));
+  layout.input_offsets = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(uint32_t) * ((size_t)num_inputs + 1));
+  layout.input_connections = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(uint32_t) * (size_t)num_connections);
+  layout.columns = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_sp_column_record_t) * (size_t)num_columns);
+  layout.connections = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_sp_connection_t) * (size_t)num_connections);
+  layout.size = offset;
+  return layout;
+}
+
+size_t sl_htm_sp_serialized_size(sl_htm_sp_t* sp)
+{
+  return sl_htm_sp_serialized_layout(sp->width * sp->height, sp->input_width * sp->input_height, sp->num_connections).size;
+}
+
+size_t sl_htm_sp_save(sl_htm_sp_t* sp, void* buffer, size_t buffer_size)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  uint16_t num_inputs = sp->input_width * sp->input_height;
+  sl_htm_sp_layout_t layout = sl_htm_sp_serialized_layout(num_columns, num_inputs, sp->num_connections);
+  if (buffer_size < layout.size || ((uintptr_t)buffer % SL_HTM_SERIALIZE_ALIGN) != 0) {
+    printf("Error [%s:%d]: Buffer is too small or not aligned.\n", __FILE__, __LINE__);
+    return 0;
+  }
+  uint8_t* base = buffer;
+  // Clear the padding, so that saving the same model twice gives the same bytes
+  memset(base, 0, layout.size);
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_SP, 0, layout.size);
+
+  sl_htm_sp_record_t* record = (sl_htm_sp_record_t*)(base + layout.record);
+  sl_htm_sp_write_parameters(&record->parameters, &sp->parameters);
+  record->num_iterations = sp->num_iterations;
+  record->num_connections = sp->num_connections;
+  record->random_state = sp->random.state;
+  record->width = sp->width;
+  record->height = sp->height;
+  record->input_width = sp->input_width;
+  record->input_height = sp->input_height;
+
+  memcpy(base + layout.input_offsets, sp->input_offsets, sizeof(uint32_t) * ((size_t)num_inputs + 1));
+  memcpy(base + layout.input_connections, sp->input_connections, sizeof(uint32_t) * (size_t)sp->num_connections);
+  sl_htm_sp_column_record_t* columns = (sl_htm_sp_column_record_t*)(base + layout.columns);
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    columns[column_idx].active_duty_cycle = sp->columns[column_idx].active_duty_cycle;
+    columns[column_idx].overlap_duty_cycle = sp->columns[column_idx].overlap_duty_cycle;
+    columns[column_idx].boost_factor = sp->columns[column_idx].boost_factor;
+  }
+  memcpy(base + layout.connections, sp->connections, sizeof(sl_htm_sp_connection_t) * (size_t)sp->num_connections);
+  return layout.size;
+}
+
+/**
+ * @brief Use an array of a serialized buffer in place, or copy it to the heap.
+ *
+ * @return The array, NULL if it could not be allocated
+ */
+static void* sl_htm_sp_load_array(const uint8_t* source, size_t size, bool in_place)
+{
+  if (in_place) {
+    return (void*)source;
+  }
+  void* array = sl_htm_memory_alloc(NULL, size);
+  if (array != NULL) {
+    memcpy(array, source, size);
+  }
+  return array;
+}
+
+/**
+ * @brief Check that every connection of a serialized spatial pooler lies within the input and the column grid, and that the input index
+ * only refers to connections that sample the input bit they are listed under.
+ *
+ * @return true if the tables are consistent
+ */
+static bool sl_htm_sp_check_tables(const uint8_t* base, const sl_htm_sp_layout_t* layout, const sl_htm_sp_record_t* record)
+{
+  uint16_t num_inputs = record->input_width * record->input_height;
+  const uint32_t* input_offsets = (const uint32_t*)(base + layout->input_offsets);
+  const uint32_t* input_connections = (const uint32_t*)(base + layout->input_connections);
+  const sl_htm_sp_connection_t* connections = (const sl_htm_sp_connection_t*)(base + layout->connections);
+  for (uint32_t connection_idx = 0; connection_idx < record->num_connections; connection_idx++) {
+    const sl_htm_sp_connection_t* connection = &connections[connection_idx];
+    if (connection->sdr_x >= record->input_width || connection->sdr_y >= record->input_height
+        || connection->sp_x >= record->width || connection->sp_y >= record->height) {
+      return false;
+    }
+  }
+  if (input_offsets[0] != 0 || input_offsets[num_inputs] != record->num_connections) {
+    return false;
+  }
+  for (uint16_t input_idx = 0; input_idx < num_inputs; input_idx++) {
+    if (input_offsets[input_idx] > input_offsets[input_idx + 1]) {
+      return false;
+    }
+    for (uint32_t j = input_offsets[input_idx]; j < input_offsets[input_idx + 1]; j++) {
+      if (input_connections[j] >= record->num_connections) {
+        return false;
+      }
+      const sl_htm_sp_connection_t* connection = &connections[input_connections[j]];
+      if (sl_htm_utils_xy_to_index(connection->sdr_x, connection->sdr_y, record->input_width, record->input_height) != input_idx) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool sl_htm_sp_load(sl_htm_sp_t* sp, const void* buffer, size_t buffer_size, bool in_place)
+{
+  sl_htm_sp_clear_allocations(sp, true, in_place);
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_SP, 0)) {
+    return false;
+  }
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  if (size < sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)) + sizeof(sl_htm_sp_record_t)) {
+    printf("Error [%s:%d]: Serialized spatial pooler is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  const sl_htm_sp_record_t* record = (const sl_htm_sp_record_t*)(base + sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)));
+  uint16_t num_columns = record->width * record->height;
+  uint16_t num_inputs = record->input_width * record->input_height;
+  sl_htm_sp_layout_t layout = sl_htm_sp_serialized_layout(num_columns, num_inputs, record->num_connections);
+  if (layout.size != size || num_columns == 0 || record->num_connections % num_columns != 0 || record->num_connections / num_columns > UINT16_MAX
+      || !(record->parameters.sparsity > 0.0f && record->parameters.sparsity <= 1.0f)) {
+    printf("Error [%s:%d]: Serialized spatial pooler is inconsistent.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (!sl_htm_sp_check_tables(base, &layout, record)) {
+    printf("Error [%s:%d]: Serialized spatial pooler is corrupted.\n", __FILE__, __LINE__);
+    return false;
+  }
+
+  sl_htm_sp_read_parameters(&sp->parameters, &record->parameters);
+  sp->num_iterations = record->num_iterations;
+  sp->num_connections = record->num_connections;
+  sp->random.state = record->random_state;
+  sp->width = record->width;
+  sp->height = record->height;
+  sp->input_width = record->input_width;
+  sp->input_height = record->input_height;
+
+  // The connections and the input index are the bulk of the model, those can stay in the buffer
+  sp->input_offsets = sl_htm_sp_load_array(base + layout.input_offsets, sizeof(uint32_t) * ((size_t)num_inputs + 1), in_place);
+  sp->input_connections = sl_htm_sp_load_array(base + layout.input_connections, sizeof(uint32_t) * (size_t)sp->num_connections, in_place);
+  sp->connections = sl_htm_sp_load_array(base + layout.connections, sizeof(sl_htm_sp_connection_t) * (size_t)sp->num_connections, in_place);
+
+  // The columns hold pointers and per-step scores, so they are always rebuilt on the heap
+  sp->columns = sl_htm_memory_alloc(NULL, sizeof(sl_htm_sp_column_t) * num_columns);
+  if (sp->input_offsets == NULL || sp->input_connections == NULL || sp->connections == NULL || sp->columns == NULL) {
+    printf("Error [%s:%d]: Could not allocate memory for the spatial pooler.\n", __FILE__, __LINE__);
+    sl_htm_sp_deinit(sp);
+    return false;
+  }
+  const sl_htm_sp_column_record_t* columns = (const sl_htm_sp_column_record_t*)(base + layout.columns);
+  uint16_t num_connections_per_column = sp->num_connections / num_columns;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sl_htm_sp_column_t* column = &sp->columns[column_idx];
+    column->connections = &sp->connections[(uint32_t)column_idx * num_connections_per_column];
+    column->num_connections = num_connections_per_column;
+    column->raw_overlap_score = 0;
+    column->overlap_score = 0;
+    column->active_duty_cycle = columns[column_idx].active_duty_cycle;
+    column->overlap_duty_cycle = columns[column_idx].overlap_duty_cycle;
+    column->boost_factor = columns[column_idx].boost_factor;
+    column->column_x = column_idx % sp->width;
+    column->column_y = column_idx / sp->width;
+  }
+  if (sl_htm_sp_init_buffers(sp, NULL) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the spatial pooler.\n", __FILE__, __LINE__);
+    sl_htm_sp_deinit(sp);
+    return false;
+  }
+  return true;
+}
+
+// Fixed-size part of the tables of a frozen spatial pooler
+typedef struct {
+  sl_htm_sp_parameters_record_t parameters;
+  uint32_t num_connected;
+  uint8_t width;
+  uint8_t height;
+  uint8_t input_width;
+  uint8_t input_height;
+} sl_htm_sp_frozen_record_t;
+// Offsets of the parts of the tables of a frozen spatial pooler from the start of its section
+typedef struct {
+  size_t record;
+  size_t input_offsets;
+  size_t input_columns;
+  size_t boost_factors;
+  size_t size;
+} sl_htm_sp_frozen_layout_t;
+
+static sl_htm_sp_frozen_layout_t sl_htm_sp_frozen_layout(uint16_t num_columns, uint16_t num_inputs, uint32_t num_connected)
+{
+  sl_htm_sp_frozen_layout_t layout;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  layout.record = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_sp_frozen_record_t));
+  layout.input_offsets = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(uint32_t) * ((size_t)num_inputs + 1));
+  layout.input_columns = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(uint16_t) * (size_t)num_connected);
+  layout.boost_factors = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(uint16_t) * (size_t)num_columns);
+  layout.size = offset;
+  return layout;
+}
+
+sl_htm_status_t sl_htm_sp_freeze(sl_htm_sp_t* sp, sl_htm_sp_frozen_t* frozen)
+{
+  uint16_t num_columns = sp->width * sp->height;
+  uint16_t num_inputs = sp->input_width * sp->input_height;
+  uint32_t num_connected = 0;
+  for (uint32_t connection_idx = 0; connection_idx < sp->num_connections; connection_idx++) {
+    if (sl_htm_sp_connection_connected(&sp->connections[connection_idx], sp)) {
+      num_connected++;
+    }
+  }
+  sl_htm_sp_frozen_layout_t layout = sl_htm_sp_frozen_layout(num_columns, num_inputs, num_connected);
+  uint8_t* base = sl_htm_memory_calloc(NULL, layout.size, 1);
+  if (base == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_SP_FROZEN, 0, layout.size);
+  sl_htm_sp_frozen_record_t* record = (sl_htm_sp_frozen_record_t*)(base + layout.record);
+  sl_htm_sp_write_parameters(&record->parameters, &sp->parameters);
+  record->num_connected = num_connected;
+  record->width = sp->width;
+  record->height = sp->height;
+  record->input_width = sp->input_width;
+  record->input_height = sp->input_height;
+
+  // Walk the input index and keep the connected synapses only, so the table stays in input order
+  uint32_t* input_offsets = (uint32_t*)(base + layout.input_offsets);
+  uint16_t* input_columns = (uint16_t*)(base + layout.input_columns);
+  uint32_t connected_idx = 0;
+  for (uint16_t input_idx = 0; input_idx < num_inputs; input_idx++) {
+    input_offsets[input_idx] = connected_idx;
+    for (uint32_t j = sp->input_offsets[input_idx]; j < sp->input_offsets[input_idx + 1]; j++) {
+      sl_htm_sp_connection_t* connection = &sp->connections[sp->input_connections[j]];
+      if (sl_htm_sp_connection_connected(connection, sp)) {
+        input_columns[connected_idx++] = connection->sp_x + connection->sp_y * sp->width;
+      }
+    }
+  }
+  input_offsets[num_inputs] = connected_idx;
+  uint16_t* boost_factors = (uint16_t*)(base + layout.boost_factors);
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    boost_factors[column_idx] = sp->columns[column_idx].boost_factor;
+  }
+  if (!sl_htm_sp_frozen_load(frozen, base, layout.size)) {
+    sl_htm_memory_free(NULL, base);
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  frozen->owns_tables = true;
+  return SL_HTM_STATUS_OK;
+}
+
+bool sl_htm_sp_frozen_load(sl_htm_sp_frozen_t* frozen, const void* buffer, size_t buffer_size)
+{
+  // The spatial pooler inside only needs what inhibition looks at
+  sl_htm_sp_t* sp = &frozen->sp;
+  memset(sp, 0, sizeof(*sp));
+  sl_htm_sp_clear_allocations(sp, true, false);
+  frozen->tables = NULL;
+  frozen->owns_tables = false;
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_SP_FROZEN, 0)) {
+    return false;
+  }
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  if (size < sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)) + sizeof(sl_htm_sp_frozen_record_t)) {
+    printf("Error [%s:%d]: Frozen spatial pooler is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  const sl_htm_sp_frozen_record_t* record = (const sl_htm_sp_frozen_record_t*)(base + sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)));
+  uint16_t num_columns = record->width * record->height;
+  uint16_t num_inputs = record->input_width * record->input_height;
+  sl_htm_sp_frozen_layout_t layout = sl_htm_sp_frozen_layout(num_columns, num_inputs, record->num_connected);
+  if (layout.size != size || num_columns == 0 || !(record->parameters.sparsity > 0.0f && record->parameters.sparsity <= 1.0f)) {
+    printf("Error [%s:%d]: Frozen spatial pooler is inconsistent.\n", __FILE__, __LINE__);
+    return false;
+  }
+  // Every synapse in the table must point at a column, and the offsets must stay within the table
+  const uint32_t* input_offsets = (const uint32_t*)(base + layout.input_offsets);
+  const uint16_t* input_columns = (const uint16_t*)(base + layout.input_columns);
+  bool consistent = input_offsets[0] == 0 && input_offsets[num_inputs] == record->num_connected;
+  for (uint16_t input_idx = 0; consistent && input_idx < num_inputs; input_idx++) {
+    consistent = input_offsets[input_idx] <= input_offsets[input_idx + 1];
+  }
+  for (uint32_t j = 0; consistent && j < record->num_connected; j++) {
+    consistent = input_columns[j] < num_columns;
+  }
+  if (!consistent) {
+    printf("Error [%s:%d]: Frozen spatial pooler is corrupted.\n", __FILE__, __LINE__);
+    return false;
+  }
+  frozen->tables = buffer;
+  frozen->tables_size = size;
+  frozen->num_connected = record->num_connected;
+  frozen->input_offsets = (const uint32_t*)(base + layout.input_offsets);
+  frozen->input_columns = (const uint16_t*)(base + layout.input_columns);
+  frozen->boost_factors = (const uint16_t*)(base + layout.boost_factors);
+
+  sl_htm_sp_read_parameters(&sp->parameters, &record->parameters);
+  sp->width = record->width;
+  sp->height = record->height;
+  sp->input_width = record->input_width;
+  sp->input_height = record->input_height;
+  sp->columns = sl_htm_memory_calloc(NULL, num_columns, sizeof(sl_htm_sp_column_t));
+  if (sp->columns == NULL) {
+    printf("Error [%s:%d]: Could not allocate memory for the frozen spatial pooler.\n", __FILE__, __LINE__);
+    sl_htm_sp_deinit(sp);
+    return false;
+  }
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sp->columns[column_idx].boost_factor = frozen->boost_factors[column_idx];
+    sp->columns[column_idx].column_x = column_idx % sp->width;
+    sp->columns[column_idx].column_y = column_idx / sp->width;
+  }
+  if (sl_htm_sp_init_buffers(sp, NULL) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the frozen spatial pooler.\n", __FILE__, __LINE__);
+    sl_htm_sp_deinit(sp);
+    return false;
+  }
+  return true;
+}
+
+void sl_htm_sp_frozen_deinit(sl_htm_sp_frozen_t* frozen)
+{
+  sl_htm_sp_deinit(&frozen->sp);
+  if (frozen->owns_tables) {
+    sl_htm_memory_free(NULL, (void*)frozen->tables);
+  }
+  frozen->tables = NULL;
+  frozen->tables_size = 0;
+  frozen->owns_tables = false;
+}
+
+sl_htm_status_t sl_htm_sp_frozen_execute(sl_htm_sp_frozen_t* frozen, sl_htm_sdr_t* input_sdr, sl_htm_sdr_t* output_sdr)
+{
+  sl_htm_sp_t* sp = &frozen->sp;
+  sl_htm_status_t status = sl_htm_sp_collect_active_inputs(sp, input_sdr);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  uint16_t num_columns = sp->width * sp->height;
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sp->columns[column_idx].raw_overlap_score = 0;
+  }
+  // Every synapse in the table is connected, so there is no permanence to check
+  for (uint16_t i = 0; i < sp->active_inputs.len; i++) {
+    uint16_t input_idx = sp->active_inputs.indices[i];
+    for (uint32_t j = frozen->input_offsets[input_idx]; j < frozen->input_offsets[input_idx + 1]; j++) {
+      sp->columns[frozen->input_columns[j]].raw_overlap_score++;
+    }
+  }
+  for (uint16_t column_idx = 0; column_idx < num_columns; column_idx++) {
+    sl_htm_sp_column_t* column = &sp->columns[column_idx];
+    column->overlap_score = (uint32_t)column->raw_overlap_score * frozen->boost_factors[column_idx];
+  }
+  uint16_t num_active_columns = sl_htm_sp_inhibit(sp, sp->top_columns);
+  sl_htm_sp_execute_columns(sp, output_sdr, sp->top_columns, num_active_columns);
+  return SL_HTM_STATUS_OK;
+}
+
+size_t sl_htm_sp_frozen_memory_size(sl_htm_sp_frozen_t* frozen)
+{
+  sl_htm_sp_t* sp = &frozen->sp;
+  size_t num_columns = sp->width * sp->height;
+  size_t size = 0;
+  size += sizeof(sl_htm_sp_frozen_t);
+  size += num_columns * sizeof(sl_htm_sp_column_t);
+  size += sl_htm_sdr_sparse_memory_size(&sp->active_inputs);
+  if (sp->parameters.local_inhibition) {
+    size += num_columns * sizeof(sl_htm_sp_column_t*);
+    size += 3 * num_columns * sizeof(uint16_t);
+  } else {
+    size += sl_htm_sp_num_global_active_columns(num_columns, sp->parameters.sparsity) * sizeof(sl_htm_sp_column_t*);
+  }
   return size;
 }
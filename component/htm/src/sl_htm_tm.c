@@ -20,24 +20,216 @@
 #include "sl_htm_tm_column.h"
 #include "sl_htm_sdr.h"
 #include "sl_htm_utils.h"
-static sl_htm_tm_state_t state_current;
-static sl_htm_tm_state_t state_prev;
-void sl_htm_tm_init(sl_htm_tm_t* tm, uint16_t width, uint16_t height)
+#include "sl_htm_serialize.h"
+/**
+ * @brief Lay out the parallel arrays of the temporal memory in its arena. The arrays are ordered from the widest element type to the narrowest,
+ * so that every array is naturally aligned. If the arena is NULL, only the size is computed.
+ *
+ * @return The size of the arena in bytes
+ */
+static size_t sl_htm_tm_layout_arena(sl_htm_tm_t* tm, uint8_t* arena)
 {
-  sl_htm_tm_init_state(&state_current);
-  sl_htm_tm_init_state(&state_prev);
+  size_t offset = 0;
+#define SL_HTM_TM_ARENA_ARRAY(field, count)             \
+  if (arena != NULL) {                                    \
+    tm->field = (void*)(arena + offset);                  \
+  }                                                       \
+  offset += sizeof(*tm->field) * (size_t)(count);
+  SL_HTM_TM_ARENA_ARRAY(cell_presynaptic_head, tm->num_cells)
+  SL_HTM_TM_ARENA_ARRAY(synapse_presynaptic_cell, tm->num_synapses)
+  SL_HTM_TM_ARENA_ARRAY(synapse_prev_presynaptic, tm->num_synapses)
+  SL_HTM_TM_ARENA_ARRAY(synapse_next_presynaptic, tm->num_synapses)
+  SL_HTM_TM_ARENA_ARRAY(cell_num_segments, tm->num_cells)
+  SL_HTM_TM_ARENA_ARRAY(segment_num_synapses, tm->num_segments)
+  SL_HTM_TM_ARENA_ARRAY(synapse_permanence, tm->num_synapses)
+#undef SL_HTM_TM_ARENA_ARRAY
+  return offset;
+}
 
+/**
+ * @brief Compute the number of cells, segments and synapses from the parameters and the size of the temporal memory.
+ *
+ * @return SL_HTM_STATUS_INVALID_PARAMETER if the temporal memory is empty, wider or higher than an SDR, or too large to be indexed
+ */
+static sl_htm_status_t sl_htm_tm_init_sizes(sl_htm_tm_t* tm, uint16_t width, uint16_t height)
+{
+  // The active columns are a sparse SDR, which is at most 255 bits wide and high
+  if (width > UINT8_MAX || height > UINT8_MAX) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
   tm->width = width;
   tm->height = height;
-  tm->columns = malloc(sizeof(sl_htm_tm_column_t) * tm->width * tm->height);
-  if (tm->columns == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for columns.\n", __FILE__, __LINE__);
-    while (1);
+  tm->num_columns = width * height;
+  uint32_t num_cells = (uint32_t)tm->num_columns * tm->parameters.num_cells_per_column;
+  uint64_t num_segments = (uint64_t)num_cells * tm->parameters.max_segments_in_cell;
+  uint64_t num_synapses = num_segments * tm->parameters.max_synapses_in_segment;
+  // The largest index is reserved as the empty marker
+  if (num_cells > UINT16_MAX || num_synapses >= SL_HTM_TM_INDEX_NONE || tm->parameters.max_synapses_in_segment >= SL_HTM_TM_SEGMENT_FREE) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  // Bursting a column needs at least one cell to pick as winner and one segment slot to learn on
+  if (num_synapses == 0) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
   }
+  // The kernels were compiled for a fixed shape
+  if (SL_HTM_TM_NUM_CELLS_PER_COLUMN(tm) != tm->parameters.num_cells_per_column
+      || SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm) != tm->parameters.max_segments_in_cell
+      || SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm) != tm->parameters.max_synapses_in_segment) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  tm->num_cells = num_cells;
+  tm->num_segments = num_segments;
+  tm->num_synapses = num_synapses;
+  tm->arena_size = sl_htm_tm_layout_arena(tm, NULL);
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Allocate the states and the buffers that the temporal memory uses while executing. They hold no learned state.
+ *
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if a buffer could not be allocated
+ */
+static sl_htm_status_t sl_htm_tm_init_buffers(sl_htm_tm_t* tm, sl_htm_memory_t* memory)
+{
+  sl_htm_tm_init_state(&tm->state_current);
+  sl_htm_tm_init_state(&tm->state_prev);
+  // Size the state arrays once, so that executing does not touch the heap.
+  // A cell is active at most once, and most cells have at most one active or matching segment.
+  if (sl_htm_tm_init_state_active_cells_bitset(&tm->state_current, memory, tm->num_cells) != SL_HTM_STATUS_OK
+      || sl_htm_tm_init_state_active_cells_bitset(&tm->state_prev, memory, tm->num_cells) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_state(&tm->state_current, memory, tm->num_cells, tm->num_cells) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_state(&tm->state_prev, memory, tm->num_cells, tm->num_cells) != SL_HTM_STATUS_OK
+      || sl_htm_sdr_sparse_init_static(&tm->active_columns, memory, tm->width, tm->height, 0) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  // The dendrite counters are written on every step, so they are kept out of the arena
+  tm->segment_num_active_connected = sl_htm_memory_calloc(memory, 2 * (size_t)tm->num_segments, sizeof(uint16_t));
+  if (tm->segment_num_active_connected == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  tm->segment_num_active_potential = tm->segment_num_active_connected + tm->num_segments;
+  // Growing synapses draws at most one candidate per synapse slot of the segment
+  if (sl_htm_tm_sampler_init(&tm->grow_sampler, memory, tm->parameters.max_synapses_in_segment) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  tm->grow_connected_cells = sl_htm_memory_calloc(memory, SL_HTM_SDR_NUM_WORDS(tm->num_cells), sizeof(sl_htm_sdr_word_t));
+  if (tm->grow_connected_cells == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  // Sorting needs as much room as the segment arrays it sorts
+  sl_htm_tm_init_segment_array(&tm->segment_sort_scratch);
+  if (sl_htm_tm_reserve_segment_array(&tm->segment_sort_scratch, memory, tm->num_cells) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  return SL_HTM_STATUS_OK;
+}
+
+sl_htm_status_t sl_htm_tm_init(sl_htm_tm_t* tm, uint16_t width, uint16_t height)
+{
+  return sl_htm_tm_init_static(tm, NULL, width, height);
+}
+
+/**
+ * @brief Clear the pointers to everything that init and load allocate, so that sl_htm_tm_deinit can release a TM that failed halfway.
+ *
+ */
+static void sl_htm_tm_clear_allocations(sl_htm_tm_t* tm, bool heap_allocated, bool arena_in_place)
+{
+  tm->arena = NULL;
+  tm->segment_num_active_connected = NULL;
+  tm->segment_num_active_potential = NULL;
+  tm->active_columns.indices = NULL;
+  tm->active_columns.len = 0;
+  tm->active_columns.capacity = 0;
+  sl_htm_tm_init_state(&tm->state_current);
+  sl_htm_tm_init_state(&tm->state_prev);
+  tm->grow_sampler.swap_positions = NULL;
+  tm->grow_sampler.swap_values = NULL;
+  tm->grow_sampler.capacity = 0;
+  tm->grow_connected_cells = NULL;
+  sl_htm_tm_init_segment_array(&tm->segment_sort_scratch);
+  tm->heap_allocated = heap_allocated;
+  tm->arena_in_place = arena_in_place;
+}
+
+void sl_htm_tm_deinit(sl_htm_tm_t* tm)
+{
+  if (tm->heap_allocated) {
+    sl_htm_memory_free(NULL, tm->segment_sort_scratch.segments);
+    sl_htm_memory_free(NULL, tm->grow_connected_cells);
+    sl_htm_tm_sampler_deinit(&tm->grow_sampler);
+    sl_htm_memory_free(NULL, tm->segment_num_active_connected);
+    sl_htm_sdr_sparse_deinit(&tm->active_columns);
+    sl_htm_tm_deinit_state(&tm->state_prev);
+    sl_htm_tm_deinit_state(&tm->state_current);
+    if (!tm->arena_in_place) {
+      sl_htm_memory_free(NULL, tm->arena);
+    }
+  }
+  sl_htm_tm_clear_allocations(tm, false, false);
+}
+
+/**
+ * @brief Allocate the buffers and the arena of a temporal memory and initialize its columns.
+ *
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return The status of sl_htm_tm_init_static, whatever was allocated before a failure is left to the caller
+ */
+static sl_htm_status_t sl_htm_tm_init_allocations(sl_htm_tm_t* tm, sl_htm_memory_t* memory, uint16_t width, uint16_t height)
+{
+  sl_htm_status_t status = sl_htm_tm_init_sizes(tm, width, height);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  status = sl_htm_tm_init_buffers(tm, memory);
+  if (status != SL_HTM_STATUS_OK) {
+    return status;
+  }
+  sl_htm_random_seed(&tm->random, tm->parameters.seed);
+
+  // All cells, segments and synapses live in one allocation
+  tm->arena = sl_htm_memory_alloc(memory, tm->arena_size);
+  if (tm->arena == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sl_htm_tm_layout_arena(tm, tm->arena);
   // Initialize the columns
-  for (uint16_t i = 0; i < tm->width * tm->height; i++) {
-    sl_htm_tm_column_init(tm, &tm->columns[i]);
+  for (uint16_t i = 0; i < tm->num_columns; i++) {
+    sl_htm_tm_column_init(tm, i);
+  }
+  return SL_HTM_STATUS_OK;
+}
+
+sl_htm_status_t sl_htm_tm_init_static(sl_htm_tm_t* tm, sl_htm_memory_t* memory, uint16_t width, uint16_t height)
+{
+  sl_htm_tm_clear_allocations(tm, memory == NULL, false);
+  sl_htm_status_t status = sl_htm_tm_init_allocations(tm, memory, width, height);
+  if (status != SL_HTM_STATUS_OK) {
+    sl_htm_tm_deinit(tm);
   }
+  return status;
+}
+
+size_t sl_htm_tm_static_memory_size(const sl_htm_tm_parameters_t* params, uint16_t width, uint16_t height)
+{
+  sl_htm_tm_t tm;
+  tm.parameters = *params;
+  if (sl_htm_tm_init_sizes(&tm, width, height) != SL_HTM_STATUS_OK) {
+    return 0;
+  }
+  // Mirrors the allocations of sl_htm_tm_init_static
+  size_t bitset_size = sl_htm_memory_align(sizeof(sl_htm_sdr_word_t) * SL_HTM_SDR_NUM_WORDS(tm.num_cells));
+  size_t size = 0;
+  // One bitset per state, and the cells connected to a growing segment
+  size += 3 * bitset_size;
+  // Two cell arrays, two segment arrays and the matching scores per state, and the scratch for sorting segments
+  size += 9 * sl_htm_memory_align(sizeof(sl_htm_tm_index_t) * tm.num_cells);
+  size += 2 * sl_htm_memory_align(sizeof(uint16_t) * tm.num_cells);
+  size += sl_htm_sdr_sparse_static_memory_size(width, height, 0);
+  size += sl_htm_memory_align(2 * sizeof(uint16_t) * (size_t)tm.num_segments);
+  size += 2 * sl_htm_memory_align(sizeof(uint16_t) * params->max_synapses_in_segment);
+  size += sl_htm_memory_align(tm.arena_size);
+  return size;
 }
 
 void sl_htm_tm_init_default_params(sl_htm_tm_parameters_t* params)
@@ -54,122 +246,781 @@ void sl_htm_tm_init_default_params(sl_htm_tm_parameters_t* params)
 
   params->segment_activation_threshold = (uint16_t)(params->max_synapses_in_segment * 0.5f);
   params->segment_learning_threshold = (uint16_t)(params->max_synapses_in_segment * 0.25f);
+
+  params->seed = 1;
+}
+
+/**
+ * @brief Punish the matching segments of the previous timestep that are on columns that did not become active.
+ *
+ */
+void sl_htm_tm_punish_inactive_columns(sl_htm_tm_t* tm, sl_htm_sdr_t* sdr, sl_htm_tm_state_t* state_prev)
+{
+  for (uint16_t i = 0; i < state_prev->matching_segments.len; i++) {
+    sl_htm_tm_index_t segment = state_prev->matching_segments.segments[i];
+    // The segment may get deleted when one of its synapses is deleted, so we need to make sure to skip it here.
+    if (!sl_htm_tm_segment_is_existing(tm, segment)) {
+      continue;
+    }
+    if (!sl_htm_sdr_get_bit(sdr, sl_htm_tm_segment_column(tm, segment))) {
+      sl_htm_tm_segment_punish(tm, segment, state_prev);
+    }
+  }
 }
 
 void sl_htm_tm_activate_cells(sl_htm_tm_t* tm, sl_htm_sdr_t* sdr, bool learn, sl_htm_tm_state_t* state_current, sl_htm_tm_state_t* state_prev)
 {
-  uint16_t num_columns = tm->width * tm->height;
-  // Go through all the columns
-  for (uint16_t i = 0; i < num_columns; i++) {
-    sl_htm_tm_column_t* column = &tm->columns[i];
-    bool active = sl_htm_sdr_get_bit(sdr, i);
-    if (active) {
-      bool any_predictive_cells = sl_htm_tm_column_activate_predicted(tm, column, learn, state_current, state_prev);
-      if (!any_predictive_cells) {
-        // If no cells are predictive, burst the column
-        sl_htm_tm_column_burst(tm, column, learn, state_current, state_prev);
-      }
-    } else {
-      // Punish active segments on columns that are not active
-      if (learn) {
-        sl_htm_tm_column_punish_predicted(tm, column, state_prev);
-      }
+  // Only go through the active columns
+  sl_htm_sdr_to_sparse(sdr, &tm->active_columns);
+  // The previous segments are sorted by column and the active columns come in increasing order,
+  // so the segments of each column are found by moving forward through the segment arrays once
+  sl_htm_tm_segment_range_t active_segments = { 0, 0 };
+  sl_htm_tm_segment_range_t matching_segments = { 0, 0 };
+  for (uint16_t i = 0; i < tm->active_columns.len; i++) {
+    sl_htm_tm_index_t column = tm->active_columns.indices[i];
+    sl_htm_tm_column_segment_range(tm, column, &state_prev->active_segments, &active_segments);
+    bool any_predictive_cells = sl_htm_tm_column_activate_predicted(tm, learn, state_current, state_prev, &active_segments);
+    if (!any_predictive_cells) {
+      // If no cells are predictive, burst the column
+      sl_htm_tm_column_segment_range(tm, column, &state_prev->matching_segments, &matching_segments);
+      sl_htm_tm_column_burst(tm, column, learn, state_current, state_prev, &matching_segments);
     }
   }
+  // Punish active segments on columns that are not active
+  if (learn) {
+    sl_htm_tm_punish_inactive_columns(tm, sdr, state_prev);
+  }
 }
+/**
+ * @brief Sort the segments of a state array with the scratch of the TM. The next step looks up the segments of a column by range,
+ * which only works on sorted segments, so segments that cannot be sorted are dropped and counted like segments that do not fit.
+ *
+ */
+static void sl_htm_tm_sort_segments(sl_htm_tm_t* tm, sl_htm_tm_segment_array_t* arr)
+{
+  if (sl_htm_tm_sort_segment_array(arr, &tm->segment_sort_scratch) != SL_HTM_STATUS_OK) {
+    arr->num_dropped += arr->len;
+    arr->len = 0;
+  }
+}
+/**
+ * @brief Find the active and matching segments. Instead of visiting every segment, walk outward from the active cells
+ * through the synapses that have them as presynaptic cell, so the work is proportional to the number of active synapses.
+ *
+ */
 void sl_htm_tm_activate_dendrites(sl_htm_tm_t* tm, sl_htm_tm_state_t* state_current)
 {
-  // Go through all columns
-  for (uint16_t i = 0; i < tm->width * tm->height; i++) {
-    sl_htm_tm_column_t* column = &tm->columns[i];
-    // Go through all cells
-    for (uint16_t j = 0; j < tm->parameters.num_cells_per_column; j++) {
-      sl_htm_tm_cell_t* cell = &column->cells[j];
-      // Go through all segments
-      for (uint16_t k = 0; k < cell->num_segments; k++) {
-        sl_htm_tm_segment_t* segment = &cell->segments[k];
-        uint16_t num_active_connected = 0;
-        uint16_t num_active_potential = 0;
-        // Go through all synapses
-        for (uint16_t l = 0; l < segment->num_synapses; l++) {
-          sl_htm_tm_synapse_t* synapse = &segment->synapses[l];
-          if (sl_htm_tm_is_cell_in_array(synapse->target_cell, &state_current->active_cells)) {
-            if (synapse->permanence > 0) {
-              num_active_potential++;
-            }
-            if (synapse->permanence >= tm->parameters.synapse_permanence_threshold) {
-              num_active_connected++;
-            }
-          }
-        }
-        if (num_active_connected >= tm->parameters.segment_activation_threshold) {
-          sl_htm_tm_add_segment_to_array(segment, &state_current->active_segments);
-        }
-        if (num_active_potential >= tm->parameters.segment_learning_threshold) {
-          sl_htm_tm_add_segment_to_array(segment, &state_current->matching_segments);
-        }
+  uint16_t* num_active_connected = tm->segment_num_active_connected;
+  uint16_t* num_active_potential = tm->segment_num_active_potential;
+  // A segment is added the moment its count reaches the threshold, so it is added once. A segment that is
+  // reached at all has a count of at least one, hence the thresholds of at least one.
+  uint16_t activation_threshold = tm->parameters.segment_activation_threshold > 0 ? tm->parameters.segment_activation_threshold : 1;
+  uint16_t learning_threshold = tm->parameters.segment_learning_threshold > 0 ? tm->parameters.segment_learning_threshold : 1;
+  // Count the active synapses of every segment that is reached from the active cells
+  for (uint16_t i = 0; i < state_current->active_cells.len; i++) {
+    sl_htm_tm_index_t cell = state_current->active_cells.cells[i];
+    for (sl_htm_tm_index_t synapse = tm->cell_presynaptic_head[cell]; synapse != SL_HTM_TM_INDEX_NONE; synapse = tm->synapse_next_presynaptic[synapse]) {
+      sl_htm_tm_index_t segment = synapse / SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+      uint8_t permanence = tm->synapse_permanence[synapse];
+      if (sl_htm_tm_synapse_is_potential(permanence) && ++num_active_potential[segment] == learning_threshold) {
+        sl_htm_tm_add_segment_to_array(segment, &state_current->matching_segments);
       }
+      if (permanence >= tm->parameters.synapse_permanence_threshold && ++num_active_connected[segment] == activation_threshold) {
+        sl_htm_tm_add_segment_to_array(segment, &state_current->active_segments);
+      }
+    }
+  }
+  // The segments were collected in the order of the synapses, sort them so that the next step can find the segments of a column directly
+  sl_htm_tm_sort_segments(tm, &state_current->active_segments);
+  sl_htm_tm_sort_segments(tm, &state_current->matching_segments);
+  // Keep the counts of the matching segments for choosing the segment to learn on, then clear the counters by walking the same synapses again
+  sl_htm_tm_score_matching_segments(state_current, num_active_potential);
+  for (uint16_t i = 0; i < state_current->active_cells.len; i++) {
+    sl_htm_tm_index_t cell = state_current->active_cells.cells[i];
+    for (sl_htm_tm_index_t synapse = tm->cell_presynaptic_head[cell]; synapse != SL_HTM_TM_INDEX_NONE; synapse = tm->synapse_next_presynaptic[synapse]) {
+      sl_htm_tm_index_t segment = synapse / SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+      num_active_connected[segment] = 0;
+      num_active_potential[segment] = 0;
     }
   }
 }
 /**
  * @brief Calculate the anomaly score. The anomaly score is the percentage of active columns that were not predicted.
  *
- * @return float
+ * @return float, 0 if no columns are active
  */
 float sl_htm_tm_anomaly_score(sl_htm_sdr_t * sp_sdr, sl_htm_tm_state_t* state_current)
 {
   uint16_t both = state_current->num_predictive_and_active_columns;
   uint16_t active = sp_sdr->num_active_bits;
+  // With no active columns there is nothing unexpected, instead of 0 / 0
+  if (active == 0) {
+    return 0.0f;
+  }
   return (float)(active - both) / (float)active;
 }
 
 float sl_htm_tm_execute(sl_htm_tm_t* tm, sl_htm_sdr_t* sp_sdr, bool learn)
 {
   // Perform the temporal memory algorithm
-  sl_htm_tm_activate_cells(tm, sp_sdr, learn, &state_current, &state_prev);
-  sl_htm_tm_activate_dendrites(tm, &state_current);
+  sl_htm_tm_activate_cells(tm, sp_sdr, learn, &tm->state_current, &tm->state_prev);
+  sl_htm_tm_activate_dendrites(tm, &tm->state_current);
 
   // Calculate the anomaly score
-  float anomaly_score = sl_htm_tm_anomaly_score(sp_sdr, &state_current);
+  float anomaly_score = sl_htm_tm_anomaly_score(sp_sdr, &tm->state_current);
 
   // Put the current state into the previous state, and clear the current state
-  sl_htm_tm_swap_and_clear_states(&state_prev, &state_current);
+  sl_htm_tm_swap_and_clear_states(&tm->state_prev, &tm->state_current);
 
   return anomaly_score;
 }
 
+uint32_t sl_htm_tm_num_state_growths(sl_htm_tm_t* tm)
+{
+  return sl_htm_tm_state_num_growths(&tm->state_current) + sl_htm_tm_state_num_growths(&tm->state_prev);
+}
+
+sl_htm_status_t sl_htm_tm_get_status(sl_htm_tm_t* tm)
+{
+  if (sl_htm_tm_state_num_dropped(&tm->state_current) + sl_htm_tm_state_num_dropped(&tm->state_prev) > 0) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  return SL_HTM_STATUS_OK;
+}
+
 size_t sl_htm_tm_memory_size(sl_htm_tm_t* tm)
 {
   size_t size = 0;
-  // This is the dynamic memory size of the temporal memory
-  // size += sizeof(sl_htm_tm_t);
-  // size += sizeof(sl_htm_tm_column_t) * tm->width * tm->height;
-  // // Go through all the columns
-  // for (uint16_t i = 0; i < tm->width * tm->height; i++) {
-  //   sl_htm_tm_column_t* column = &tm->columns[i];
-  //   size += sizeof(sl_htm_tm_cell_t) * tm->parameters.num_cells_per_column;
-  //   // Go through all the cells
-  //   for (uint16_t j = 0; j < tm->parameters.num_cells_per_column; j++) {
-  //     sl_htm_tm_cell_t* cell = &column->cells[j];
-  //     size += sizeof(sl_htm_tm_segment_t) * cell->num_segments;
-  //     // Go through all the segments
-  //     for (uint16_t k = 0; k < cell->num_segments; k++) {
-  //       sl_htm_tm_segment_t* segment = &cell->segments[k];
-  //       size += sizeof(sl_htm_tm_synapse_t) * segment->num_synapses;
-  //     }
-  //   }
-  // }
-
-  // This is the static memory size of the temporal memory
   size += sizeof(sl_htm_tm_t);
-  size += sizeof(sl_htm_tm_column_t) * tm->width * tm->height;
-  size += sizeof(sl_htm_tm_cell_t) * tm->width * tm->height * tm->parameters.num_cells_per_column;
-  size += sizeof(sl_htm_tm_segment_t) * tm->width * tm->height * tm->parameters.num_cells_per_column * tm->parameters.max_segments_in_cell;
-  size += sizeof(sl_htm_tm_synapse_t) * tm->width * tm->height * tm->parameters.num_cells_per_column * tm->parameters.max_segments_in_cell * tm->parameters.max_synapses_in_segment;
+  size += tm->arena_size;
+  size += 2 * sizeof(uint16_t) * tm->num_segments;
+  size += sl_htm_tm_sampler_memory_size(&tm->grow_sampler);
+  size += sizeof(sl_htm_sdr_word_t) * SL_HTM_SDR_NUM_WORDS(tm->num_cells);
+  size += sizeof(sl_htm_tm_index_t) * tm->segment_sort_scratch.capacity;
 
-  size += sl_htm_tm_state_memory_size(&state_prev);
-  size += sl_htm_tm_state_memory_size(&state_current);
+  size += sl_htm_sdr_sparse_memory_size(&tm->active_columns);
+  size += sl_htm_tm_state_memory_size(&tm->state_prev);
+  size += sl_htm_tm_state_memory_size(&tm->state_current);
 
   return size;
 }
+
+// Serialized parameters. They are written field by field with explicit sizes, so that adding a parameter to sl_htm_tm_parameters_t
+// does not silently change the format. Any change here needs a new SL_HTM_SERIALIZE_VERSION.
+typedef struct {
+  uint32_t seed;
+  uint16_t segment_activation_threshold;
+  uint16_t segment_learning_threshold;
+  uint16_t max_synapses_in_segment;
+  uint16_t max_segments_in_cell;
+  uint16_t num_cells_per_column;
+  uint8_t synapse_permanence_increment;
+  uint8_t synapse_permanence_decrement;
+  uint8_t synapse_permanence_initial;
+  uint8_t synapse_permanence_threshold;
+  uint16_t reserved;
+} sl_htm_tm_parameters_record_t;
+
+static void sl_htm_tm_write_parameters(sl_htm_tm_parameters_record_t* record, const sl_htm_tm_parameters_t* parameters)
+{
+  record->seed = parameters->seed;
+  record->segment_activation_threshold = parameters->segment_activation_threshold;
+  record->segment_learning_threshold = parameters->segment_learning_threshold;
+  record->max_synapses_in_segment = parameters->max_synapses_in_segment;
+  record->max_segments_in_cell = parameters->max_segments_in_cell;
+  record->num_cells_per_column = parameters->num_cells_per_column;
+  record->synapse_permanence_increment = parameters->synapse_permanence_increment;
+  record->synapse_permanence_decrement = parameters->synapse_permanence_decrement;
+  record->synapse_permanence_initial = parameters->synapse_permanence_initial;
+  record->synapse_permanence_threshold = parameters->synapse_permanence_threshold;
+  record->reserved = 0;
+}
+
+static void sl_htm_tm_read_parameters(sl_htm_tm_parameters_t* parameters, const sl_htm_tm_parameters_record_t* record)
+{
+  parameters->seed = record->seed;
+  parameters->segment_activation_threshold = record->segment_activation_threshold;
+  parameters->segment_learning_threshold = record->segment_learning_threshold;
+  parameters->max_synapses_in_segment = record->max_synapses_in_segment;
+  parameters->max_segments_in_cell = record->max_segments_in_cell;
+  parameters->num_cells_per_column = record->num_cells_per_column;
+  parameters->synapse_permanence_increment = record->synapse_permanence_increment;
+  parameters->synapse_permanence_decrement = record->synapse_permanence_decrement;
+  parameters->synapse_permanence_initial = record->synapse_permanence_initial;
+  parameters->synapse_permanence_threshold = record->synapse_permanence_threshold;
+}
+
+// Fixed-size part of a serialized temporal memory
+typedef struct {
+  sl_htm_tm_parameters_record_t parameters;
+  uint16_t width;
+  uint16_t height;
+  uint32_t num_cells;
+  uint32_t num_segments;
+  uint32_t num_synapses;
+  uint32_t random_state;
+  // Lengths of the arrays of the previous state, so that the next step continues where the saved one stopped
+  uint16_t num_active_cells;
+  uint16_t num_winner_cells;
+  uint16_t num_active_segments;
+  uint16_t num_matching_segments;
+  uint16_t num_predictive_and_active_columns;
+} sl_htm_tm_record_t;
+// Offsets of the parts of a serialized temporal memory from the start of its section
+typedef struct {
+  size_t record;
+  size_t arena;
+  size_t active_cells;
+  size_t winner_cells;
+  size_t active_segments;
+  size_t matching_segments;
+  size_t size;
+} sl_htm_tm_layout_t;
+
+static sl_htm_tm_layout_t sl_htm_tm_serialized_layout(size_t arena_size, const sl_htm_tm_record_t* record)
+{
+  sl_htm_tm_layout_t layout;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  layout.record = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_record_t));
+  layout.arena = offset;
+  offset = sl_htm_serialize_align(offset + arena_size);
+  layout.active_cells = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * record->num_active_cells);
+  layout.winner_cells = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * record->num_winner_cells);
+  layout.active_segments = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * record->num_active_segments);
+  layout.matching_segments = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * record->num_matching_segments);
+  layout.size = offset;
+  return layout;
+}
+
+static void sl_htm_tm_fill_record(sl_htm_tm_t* tm, sl_htm_tm_record_t* record)
+{
+  memset(record, 0, sizeof(*record));
+  sl_htm_tm_write_parameters(&record->parameters, &tm->parameters);
+  record->width = tm->width;
+  record->height = tm->height;
+  record->num_cells = tm->num_cells;
+  record->num_segments = tm->num_segments;
+  record->num_synapses = tm->num_synapses;
+  record->random_state = tm->random.state;
+  record->num_active_cells = tm->state_prev.active_cells.len;
+  record->num_winner_cells = tm->state_prev.winner_cells.len;
+  record->num_active_segments = tm->state_prev.active_segments.len;
+  record->num_matching_segments = tm->state_prev.matching_segments.len;
+  record->num_predictive_and_active_columns = tm->state_prev.num_predictive_and_active_columns;
+}
+
+size_t sl_htm_tm_serialized_size(sl_htm_tm_t* tm)
+{
+  sl_htm_tm_record_t record;
+  sl_htm_tm_fill_record(tm, &record);
+  return sl_htm_tm_serialized_layout(tm->arena_size, &record).size;
+}
+
+size_t sl_htm_tm_save(sl_htm_tm_t* tm, void* buffer, size_t buffer_size)
+{
+  sl_htm_tm_record_t record;
+  sl_htm_tm_fill_record(tm, &record);
+  sl_htm_tm_layout_t layout = sl_htm_tm_serialized_layout(tm->arena_size, &record);
+  if (buffer_size < layout.size || ((uintptr_t)buffer % SL_HTM_SERIALIZE_ALIGN) != 0) {
+    printf("Error [%s:%d]: Buffer is too small or not aligned.\n", __FILE__, __LINE__);
+    return 0;
+  }
+  uint8_t* base = buffer;
+  // Clear the padding, so that saving the same model twice gives the same bytes
+  memset(base, 0, layout.size);
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_TM, SL_HTM_TM_INDEX_BITS, layout.size);
+  memcpy(base + layout.record, &record, sizeof(record));
+  // The arena only holds indices, so it can be copied as it is
+  memcpy(base + layout.arena, tm->arena, tm->arena_size);
+  memcpy(base + layout.active_cells, tm->state_prev.active_cells.cells, sizeof(sl_htm_tm_index_t) * record.num_active_cells);
+  memcpy(base + layout.winner_cells, tm->state_prev.winner_cells.cells, sizeof(sl_htm_tm_index_t) * record.num_winner_cells);
+  memcpy(base + layout.active_segments, tm->state_prev.active_segments.segments, sizeof(sl_htm_tm_index_t) * record.num_active_segments);
+  memcpy(base + layout.matching_segments, tm->state_prev.matching_segments.segments, sizeof(sl_htm_tm_index_t) * record.num_matching_segments);
+  return layout.size;
+}
+
+/**
+ * @brief Check that every index stored in a loaded arena points into its table, and that the presynaptic lists and the segment and
+ * synapse counts agree with the synapse slots. Executing then never leaves the arena, even if the buffer was corrupted.
+ *
+ * @return true if the arena is consistent
+ */
+static bool sl_htm_tm_check_arena(sl_htm_tm_t* tm)
+{
+  for (uint32_t cell = 0; cell < tm->num_cells; cell++) {
+    sl_htm_tm_index_t head = tm->cell_presynaptic_head[cell];
+    if (head != SL_HTM_TM_INDEX_NONE
+        && (head >= tm->num_synapses || tm->synapse_presynaptic_cell[head] != cell || tm->synapse_prev_presynaptic[head] != SL_HTM_TM_INDEX_NONE)) {
+      return false;
+    }
+    uint16_t num_segments = 0;
+    for (uint16_t i = 0; i < SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm); i++) {
+      if (sl_htm_tm_segment_is_existing(tm, cell * SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm) + i)) {
+        num_segments++;
+      }
+    }
+    if (tm->cell_num_segments[cell] != num_segments) {
+      return false;
+    }
+  }
+  for (uint32_t segment = 0; segment < tm->num_segments; segment++) {
+    uint16_t num_synapses = 0;
+    sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+    for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+      sl_htm_tm_index_t synapse = first_synapse + i;
+      sl_htm_tm_index_t cell = tm->synapse_presynaptic_cell[synapse];
+      sl_htm_tm_index_t prev = tm->synapse_prev_presynaptic[synapse];
+      sl_htm_tm_index_t next = tm->synapse_next_presynaptic[synapse];
+      if (cell == SL_HTM_TM_INDEX_NONE) {
+        if (prev != SL_HTM_TM_INDEX_NONE || next != SL_HTM_TM_INDEX_NONE) {
+          return false;
+        }
+        continue;
+      }
+      // Both neighbours must link back, so a walk from a head can neither leave the table nor loop
+      if (cell >= tm->num_cells
+          || (prev == SL_HTM_TM_INDEX_NONE && tm->cell_presynaptic_head[cell] != synapse)
+          || (prev != SL_HTM_TM_INDEX_NONE && (prev >= tm->num_synapses || tm->synapse_next_presynaptic[prev] != synapse))
+          || (next != SL_HTM_TM_INDEX_NONE && (next >= tm->num_synapses || tm->synapse_prev_presynaptic[next] != synapse))) {
+        return false;
+      }
+      num_synapses++;
+    }
+    // A free segment has no synapses, a used one counts them
+    if (sl_htm_tm_segment_is_existing(tm, segment) ? tm->segment_num_synapses[segment] != num_synapses : num_synapses != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Check that the saved previous state only refers to cells of the temporal memory and to segments that exist in its arena.
+ *
+ * @return true if the state is consistent
+ */
+static bool sl_htm_tm_check_state_record(sl_htm_tm_t* tm, const uint8_t* base, const sl_htm_tm_layout_t* layout, const sl_htm_tm_record_t* record)
+{
+  const sl_htm_tm_index_t* cells = (const sl_htm_tm_index_t*)(base + layout->active_cells);
+  for (uint16_t i = 0; i < record->num_active_cells; i++) {
+    if (cells[i] >= tm->num_cells) {
+      return false;
+    }
+  }
+  cells = (const sl_htm_tm_index_t*)(base + layout->winner_cells);
+  for (uint16_t i = 0; i < record->num_winner_cells; i++) {
+    if (cells[i] >= tm->num_cells) {
+      return false;
+    }
+  }
+  // The segments are saved sorted, and the previous segments of a column are looked up by range, see sl_htm_tm_sort_segment_array
+  const sl_htm_tm_index_t* segments = (const sl_htm_tm_index_t*)(base + layout->active_segments);
+  for (uint16_t i = 0; i < record->num_active_segments; i++) {
+    if (segments[i] >= tm->num_segments || !sl_htm_tm_segment_is_existing(tm, segments[i]) || (i > 0 && segments[i] <= segments[i - 1])) {
+      return false;
+    }
+  }
+  segments = (const sl_htm_tm_index_t*)(base + layout->matching_segments);
+  for (uint16_t i = 0; i < record->num_matching_segments; i++) {
+    if (segments[i] >= tm->num_segments || !sl_htm_tm_segment_is_existing(tm, segments[i]) || (i > 0 && segments[i] <= segments[i - 1])) {
+      return false;
+    }
+  }
+  return record->num_predictive_and_active_columns <= tm->num_columns;
+}
+
+bool sl_htm_tm_load(sl_htm_tm_t* tm, const void* buffer, size_t buffer_size, bool in_place)
+{
+  sl_htm_tm_clear_allocations(tm, true, in_place);
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_TM, SL_HTM_TM_INDEX_BITS)) {
+    return false;
+  }
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  if (size < sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)) + sizeof(sl_htm_tm_record_t)) {
+    printf("Error [%s:%d]: Serialized temporal memory is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  const sl_htm_tm_record_t* record = (const sl_htm_tm_record_t*)(base + sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)));
+  sl_htm_tm_read_parameters(&tm->parameters, &record->parameters);
+  if (sl_htm_tm_init_sizes(tm, record->width, record->height) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Serialized temporal memory is inconsistent.\n", __FILE__, __LINE__);
+    return false;
+  }
+  sl_htm_tm_layout_t layout = sl_htm_tm_serialized_layout(tm->arena_size, record);
+  if (layout.size != size || tm->num_cells != record->num_cells || tm->num_segments != record->num_segments
+      || tm->num_synapses != record->num_synapses || record->num_active_cells > tm->num_cells || record->num_winner_cells > tm->num_cells) {
+    printf("Error [%s:%d]: Serialized temporal memory is inconsistent.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (sl_htm_tm_init_buffers(tm, NULL) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the temporal memory.\n", __FILE__, __LINE__);
+    sl_htm_tm_deinit(tm);
+    return false;
+  }
+  tm->random.state = record->random_state;
+
+  if (in_place) {
+    tm->arena = (void*)(base + layout.arena);
+  } else {
+    tm->arena = sl_htm_memory_alloc(NULL, tm->arena_size);
+    if (tm->arena == NULL) {
+      printf("Error [%s:%d]: Could not allocate memory for the temporal memory arena.\n", __FILE__, __LINE__);
+      sl_htm_tm_deinit(tm);
+      return false;
+    }
+    memcpy(tm->arena, base + layout.arena, tm->arena_size);
+  }
+  sl_htm_tm_layout_arena(tm, tm->arena);
+  if (!sl_htm_tm_check_arena(tm) || !sl_htm_tm_check_state_record(tm, base, &layout, record)) {
+    printf("Error [%s:%d]: Serialized temporal memory is corrupted.\n", __FILE__, __LINE__);
+    sl_htm_tm_deinit(tm);
+    return false;
+  }
+
+  // Restore the previous state
+  const sl_htm_tm_index_t* cells = (const sl_htm_tm_index_t*)(base + layout.active_cells);
+  for (uint16_t i = 0; i < record->num_active_cells; i++) {
+    sl_htm_tm_activate_cell(cells[i], &tm->state_prev);
+  }
+  cells = (const sl_htm_tm_index_t*)(base + layout.winner_cells);
+  for (uint16_t i = 0; i < record->num_winner_cells; i++) {
+    sl_htm_tm_add_cell_to_array(cells[i], &tm->state_prev.winner_cells);
+  }
+  const sl_htm_tm_index_t* segments = (const sl_htm_tm_index_t*)(base + layout.active_segments);
+  for (uint16_t i = 0; i < record->num_active_segments; i++) {
+    sl_htm_tm_add_segment_to_array(segments[i], &tm->state_prev.active_segments);
+  }
+  segments = (const sl_htm_tm_index_t*)(base + layout.matching_segments);
+  for (uint16_t i = 0; i < record->num_matching_segments; i++) {
+    sl_htm_tm_add_segment_to_array(segments[i], &tm->state_prev.matching_segments);
+  }
+  // The scores are not saved, count them again against the restored active cells
+  for (uint16_t i = 0; i < tm->state_prev.matching_segments.len; i++) {
+    sl_htm_tm_index_t segment = tm->state_prev.matching_segments.segments[i];
+    tm->segment_num_active_potential[segment] = sl_htm_tm_segment_potential_score(tm, segment, &tm->state_prev);
+  }
+  sl_htm_tm_score_matching_segments(&tm->state_prev, tm->segment_num_active_potential);
+  for (uint16_t i = 0; i < tm->state_prev.matching_segments.len; i++) {
+    tm->segment_num_active_potential[tm->state_prev.matching_segments.segments[i]] = 0;
+  }
+  tm->state_prev.num_predictive_and_active_columns = record->num_predictive_and_active_columns;
+  return true;
+}
+
+// Fixed-size part of the tables of a frozen temporal memory
+typedef struct {
+  uint16_t width;
+  uint16_t height;
+  uint16_t num_cells_per_column;
+  uint16_t segment_activation_threshold;
+  uint32_t num_cells;
+  uint32_t num_segments;
+  uint32_t num_connected;
+  // Cells predicted by the last step before freezing
+  uint32_t num_predictive_cells;
+} sl_htm_tm_frozen_record_t;
+// Offsets of the parts of the tables of a frozen temporal memory from the start of its section
+typedef struct {
+  size_t record;
+  size_t cell_offsets;
+  size_t cell_segments;
+  size_t segment_cell;
+  size_t predictive_cells;
+  size_t size;
+} sl_htm_tm_frozen_layout_t;
+
+static sl_htm_tm_frozen_layout_t sl_htm_tm_frozen_layout(const sl_htm_tm_frozen_record_t* record)
+{
+  sl_htm_tm_frozen_layout_t layout;
+  size_t offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  layout.record = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_frozen_record_t));
+  layout.cell_offsets = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * ((size_t)record->num_cells + 1));
+  layout.cell_segments = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * (size_t)record->num_connected);
+  layout.segment_cell = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * (size_t)record->num_segments);
+  layout.predictive_cells = offset;
+  offset = sl_htm_serialize_align(offset + sizeof(sl_htm_tm_index_t) * (size_t)record->num_predictive_cells);
+  layout.size = offset;
+  return layout;
+}
+
+sl_htm_status_t sl_htm_tm_freeze(sl_htm_tm_t* tm, sl_htm_tm_frozen_t* frozen)
+{
+  uint16_t threshold = tm->parameters.segment_activation_threshold;
+  uint8_t permanence_threshold = tm->parameters.synapse_permanence_threshold;
+  // Segments that are active without connected synapses cannot be found through the presynaptic cells
+  if (threshold == 0) {
+    return SL_HTM_STATUS_INVALID_PARAMETER;
+  }
+  // Number the segments that have enough connected synapses to ever become active, the others are left out
+  sl_htm_tm_index_t* frozen_segment = sl_htm_memory_alloc(NULL, sizeof(sl_htm_tm_index_t) * tm->num_segments);
+  if (frozen_segment == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sl_htm_tm_frozen_record_t record;
+  memset(&record, 0, sizeof(record));
+  record.width = tm->width;
+  record.height = tm->height;
+  record.num_cells_per_column = tm->parameters.num_cells_per_column;
+  record.segment_activation_threshold = threshold;
+  record.num_cells = tm->num_cells;
+  for (uint32_t segment = 0; segment < tm->num_segments; segment++) {
+    uint16_t num_connected = 0;
+    if (sl_htm_tm_segment_is_existing(tm, segment)) {
+      sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+      for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+        sl_htm_tm_index_t synapse = first_synapse + i;
+        if (tm->synapse_presynaptic_cell[synapse] != SL_HTM_TM_INDEX_NONE && tm->synapse_permanence[synapse] >= permanence_threshold) {
+          num_connected++;
+        }
+      }
+    }
+    if (num_connected >= threshold) {
+      frozen_segment[segment] = record.num_segments++;
+      record.num_connected += num_connected;
+    } else {
+      frozen_segment[segment] = SL_HTM_TM_INDEX_NONE;
+    }
+  }
+  for (uint16_t i = 0; i < tm->state_prev.active_segments.len; i++) {
+    if (frozen_segment[tm->state_prev.active_segments.segments[i]] != SL_HTM_TM_INDEX_NONE) {
+      record.num_predictive_cells++;
+    }
+  }
+
+  sl_htm_tm_frozen_layout_t layout = sl_htm_tm_frozen_layout(&record);
+  uint8_t* base = sl_htm_memory_calloc(NULL, layout.size, 1);
+  if (base == NULL) {
+    sl_htm_memory_free(NULL, frozen_segment);
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_TM_FROZEN, SL_HTM_TM_INDEX_BITS, layout.size);
+  memcpy(base + layout.record, &record, sizeof(record));
+  sl_htm_tm_index_t* cell_offsets = (sl_htm_tm_index_t*)(base + layout.cell_offsets);
+  sl_htm_tm_index_t* cell_segments = (sl_htm_tm_index_t*)(base + layout.cell_segments);
+  sl_htm_tm_index_t* segment_cell = (sl_htm_tm_index_t*)(base + layout.segment_cell);
+  sl_htm_tm_index_t* predictive_cells = (sl_htm_tm_index_t*)(base + layout.predictive_cells);
+  // The presynaptic lists already group the synapses by presynaptic cell, so one walk per cell fills its row of the table
+  sl_htm_tm_index_t connected_idx = 0;
+  for (uint16_t cell = 0; cell < tm->num_cells; cell++) {
+    cell_offsets[cell] = connected_idx;
+    for (sl_htm_tm_index_t synapse = tm->cell_presynaptic_head[cell]; synapse != SL_HTM_TM_INDEX_NONE; synapse = tm->synapse_next_presynaptic[synapse]) {
+      sl_htm_tm_index_t segment = frozen_segment[synapse / SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm)];
+      if (segment != SL_HTM_TM_INDEX_NONE && tm->synapse_permanence[synapse] >= permanence_threshold) {
+        cell_segments[connected_idx++] = segment;
+      }
+    }
+  }
+  cell_offsets[tm->num_cells] = connected_idx;
+  for (uint32_t segment = 0; segment < tm->num_segments; segment++) {
+    if (frozen_segment[segment] != SL_HTM_TM_INDEX_NONE) {
+      segment_cell[frozen_segment[segment]] = sl_htm_tm_segment_cell(tm, segment);
+    }
+  }
+  uint32_t predictive_idx = 0;
+  for (uint16_t i = 0; i < tm->state_prev.active_segments.len; i++) {
+    sl_htm_tm_index_t segment = tm->state_prev.active_segments.segments[i];
+    if (frozen_segment[segment] != SL_HTM_TM_INDEX_NONE) {
+      predictive_cells[predictive_idx++] = sl_htm_tm_segment_cell(tm, segment);
+    }
+  }
+  sl_htm_memory_free(NULL, frozen_segment);
+  if (!sl_htm_tm_frozen_load(frozen, base, layout.size)) {
+    sl_htm_memory_free(NULL, base);
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  frozen->owns_tables = true;
+  return SL_HTM_STATUS_OK;
+}
+
+/**
+ * @brief Check that the tables of a frozen temporal memory only refer to its own cells and segments, and that the offsets of the
+ * cells stay within the table of connected synapses.
+ *
+ * @return true if the tables are consistent
+ */
+static bool sl_htm_tm_frozen_check_tables(const uint8_t* base, const sl_htm_tm_frozen_layout_t* layout, const sl_htm_tm_frozen_record_t* record)
+{
+  const sl_htm_tm_index_t* cell_offsets = (const sl_htm_tm_index_t*)(base + layout->cell_offsets);
+  const sl_htm_tm_index_t* cell_segments = (const sl_htm_tm_index_t*)(base + layout->cell_segments);
+  const sl_htm_tm_index_t* segment_cell = (const sl_htm_tm_index_t*)(base + layout->segment_cell);
+  const sl_htm_tm_index_t* predictive_cells = (const sl_htm_tm_index_t*)(base + layout->predictive_cells);
+  if (cell_offsets[0] != 0 || cell_offsets[record->num_cells] != record->num_connected) {
+    return false;
+  }
+  for (uint32_t cell = 0; cell < record->num_cells; cell++) {
+    if (cell_offsets[cell] > cell_offsets[cell + 1]) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < record->num_connected; i++) {
+    if (cell_segments[i] >= record->num_segments) {
+      return false;
+    }
+  }
+  for (uint32_t segment = 0; segment < record->num_segments; segment++) {
+    if (segment_cell[segment] >= record->num_cells) {
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < record->num_predictive_cells; i++) {
+    if (predictive_cells[i] >= record->num_cells) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sl_htm_tm_frozen_load(sl_htm_tm_frozen_t* frozen, const void* buffer, size_t buffer_size)
+{
+  frozen->tables = NULL;
+  frozen->owns_tables = false;
+  frozen->segment_num_active = NULL;
+  frozen->predictive_cells = NULL;
+  frozen->active_cells = NULL;
+  frozen->active_columns.indices = NULL;
+  if (!sl_htm_serialize_check_header(buffer, buffer_size, SL_HTM_SERIALIZE_MAGIC_TM_FROZEN, SL_HTM_TM_INDEX_BITS)) {
+    return false;
+  }
+  const uint8_t* base = buffer;
+  size_t size = ((const sl_htm_serialize_header_t*)buffer)->size;
+  if (size < sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)) + sizeof(sl_htm_tm_frozen_record_t)) {
+    printf("Error [%s:%d]: Frozen temporal memory is truncated.\n", __FILE__, __LINE__);
+    return false;
+  }
+  const sl_htm_tm_frozen_record_t* record = (const sl_htm_tm_frozen_record_t*)(base + sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t)));
+  sl_htm_tm_frozen_layout_t layout = sl_htm_tm_frozen_layout(record);
+  if (layout.size != size || record->num_cells != (uint32_t)record->width * record->height * record->num_cells_per_column
+      || record->num_cells > UINT16_MAX || record->width > UINT8_MAX || record->height > UINT8_MAX) {
+    printf("Error [%s:%d]: Frozen temporal memory is inconsistent.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (SL_HTM_TM_SHAPE(SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN, record->num_cells_per_column) != record->num_cells_per_column) {
+    printf("Error [%s:%d]: Frozen temporal memory does not match SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN.\n", __FILE__, __LINE__);
+    return false;
+  }
+  if (!sl_htm_tm_frozen_check_tables(base, &layout, record)) {
+    printf("Error [%s:%d]: Frozen temporal memory is corrupted.\n", __FILE__, __LINE__);
+    return false;
+  }
+  frozen->width = record->width;
+  frozen->height = record->height;
+  frozen->num_columns = record->width * record->height;
+  frozen->num_cells = record->num_cells;
+  frozen->num_cells_per_column = record->num_cells_per_column;
+  frozen->segment_activation_threshold = record->segment_activation_threshold;
+  frozen->num_segments = record->num_segments;
+  frozen->num_connected = record->num_connected;
+  frozen->cell_offsets = (const sl_htm_tm_index_t*)(base + layout.cell_offsets);
+  frozen->cell_segments = (const sl_htm_tm_index_t*)(base + layout.cell_segments);
+  frozen->segment_cell = (const sl_htm_tm_index_t*)(base + layout.segment_cell);
+  frozen->tables = buffer;
+  frozen->tables_size = size;
+
+  frozen->segment_num_active = sl_htm_memory_calloc(NULL, frozen->num_segments, sizeof(uint16_t));
+  frozen->predictive_cells = sl_htm_memory_calloc(NULL, SL_HTM_SDR_NUM_WORDS(frozen->num_cells), sizeof(sl_htm_sdr_word_t));
+  frozen->active_cells = sl_htm_memory_alloc(NULL, sizeof(sl_htm_tm_index_t) * frozen->num_cells);
+  if (frozen->segment_num_active == NULL || frozen->predictive_cells == NULL || frozen->active_cells == NULL
+      || sl_htm_sdr_sparse_init(&frozen->active_columns, frozen->width, frozen->height, 0) != SL_HTM_STATUS_OK) {
+    printf("Error [%s:%d]: Could not allocate memory for the frozen temporal memory.\n", __FILE__, __LINE__);
+    sl_htm_tm_frozen_deinit(frozen);
+    return false;
+  }
+  frozen->num_active_cells = 0;
+  const sl_htm_tm_index_t* predictive_cells = (const sl_htm_tm_index_t*)(base + layout.predictive_cells);
+  for (uint32_t i = 0; i < record->num_predictive_cells; i++) {
+    sl_htm_tm_index_t cell = predictive_cells[i];
+    frozen->predictive_cells[cell >> SL_HTM_SDR_WORD_SHIFT] |= (sl_htm_sdr_word_t)1 << (cell & SL_HTM_SDR_WORD_MASK);
+  }
+  return true;
+}
+
+void sl_htm_tm_frozen_deinit(sl_htm_tm_frozen_t* frozen)
+{
+  sl_htm_sdr_sparse_deinit(&frozen->active_columns);
+  sl_htm_memory_free(NULL, frozen->active_cells);
+  sl_htm_memory_free(NULL, frozen->predictive_cells);
+  sl_htm_memory_free(NULL, frozen->segment_num_active);
+  if (frozen->owns_tables) {
+    sl_htm_memory_free(NULL, (void*)frozen->tables);
+  }
+  frozen->active_cells = NULL;
+  frozen->predictive_cells = NULL;
+  frozen->segment_num_active = NULL;
+  frozen->tables = NULL;
+  frozen->tables_size = 0;
+  frozen->owns_tables = false;
+}
+
+float sl_htm_tm_frozen_execute(sl_htm_tm_frozen_t* frozen, sl_htm_sdr_t* sp_sdr)
+{
+  // Activate the predicted cells of every active column, or burst the column if none of its cells were predicted
+  sl_htm_sdr_to_sparse(sp_sdr, &frozen->active_columns);
+  uint16_t num_cells_per_column = SL_HTM_TM_SHAPE(SL_HTM_TM_FIXED_NUM_CELLS_PER_COLUMN, frozen->num_cells_per_column);
+  uint16_t num_predictive_and_active_columns = 0;
+  frozen->num_active_cells = 0;
+  for (uint16_t i = 0; i < frozen->active_columns.len; i++) {
+    sl_htm_tm_index_t first_cell = frozen->active_columns.indices[i] * num_cells_per_column;
+    uint16_t num_predicted = 0;
+    for (uint16_t j = 0; j < num_cells_per_column; j++) {
+      sl_htm_tm_index_t cell = first_cell + j;
+      if ((frozen->predictive_cells[cell >> SL_HTM_SDR_WORD_SHIFT] >> (cell & SL_HTM_SDR_WORD_MASK)) & 1) {
+        frozen->active_cells[frozen->num_active_cells++] = cell;
+        num_predicted++;
+      }
+    }
+    if (num_predicted > 0) {
+      num_predictive_and_active_columns++;
+    } else {
+      for (uint16_t j = 0; j < num_cells_per_column; j++) {
+        frozen->active_cells[frozen->num_active_cells++] = first_cell + j;
+      }
+    }
+  }
+
+  // Walk out from the active cells and predict the cell of every segment that reaches the threshold
+  memset(frozen->predictive_cells, 0, SL_HTM_SDR_NUM_WORDS(frozen->num_cells) * sizeof(sl_htm_sdr_word_t));
+  for (uint16_t i = 0; i < frozen->num_active_cells; i++) {
+    sl_htm_tm_index_t cell = frozen->active_cells[i];
+    for (sl_htm_tm_index_t j = frozen->cell_offsets[cell]; j < frozen->cell_offsets[cell + 1]; j++) {
+      sl_htm_tm_index_t segment = frozen->cell_segments[j];
+      if (++frozen->segment_num_active[segment] == frozen->segment_activation_threshold) {
+        sl_htm_tm_index_t predictive_cell = frozen->segment_cell[segment];
+        frozen->predictive_cells[predictive_cell >> SL_HTM_SDR_WORD_SHIFT] |= (sl_htm_sdr_word_t)1 << (predictive_cell & SL_HTM_SDR_WORD_MASK);
+      }
+    }
+  }
+  // Clear the counters by walking the same synapses again
+  for (uint16_t i = 0; i < frozen->num_active_cells; i++) {
+    sl_htm_tm_index_t cell = frozen->active_cells[i];
+    for (sl_htm_tm_index_t j = frozen->cell_offsets[cell]; j < frozen->cell_offsets[cell + 1]; j++) {
+      frozen->segment_num_active[frozen->cell_segments[j]] = 0;
+    }
+  }
+
+  uint16_t active = sp_sdr->num_active_bits;
+  if (active == 0) {
+    return 0.0f;
+  }
+  return (float)(active - num_predictive_and_active_columns) / (float)active;
+}
+
+size_t sl_htm_tm_frozen_memory_size(sl_htm_tm_frozen_t* frozen)
+{
+  size_t size = 0;
+  size += sizeof(sl_htm_tm_frozen_t);
+  size += sizeof(uint16_t) * frozen->num_segments;
+  size += sizeof(sl_htm_sdr_word_t) * SL_HTM_SDR_NUM_WORDS(frozen->num_cells);
+  size += sizeof(sl_htm_tm_index_t) * frozen->num_cells;
+  size += sl_htm_sdr_sparse_memory_size(&frozen->active_columns);
+  return size;
+}
@@ -17,74 +17,75 @@
 #include "sl_htm_tm_cell.h"
 #include "sl_htm_tm_segment.h"
 #include "sl_htm_tm_column.h"
-void sl_htm_tm_cell_init(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell, sl_htm_tm_column_t* parent_column)
+void sl_htm_tm_cell_init(sl_htm_tm_t* tm, sl_htm_tm_index_t cell)
 {
-  cell->segments = malloc(tm->parameters.max_segments_in_cell * sizeof(sl_htm_tm_segment_t));
-  if (cell->segments == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for segments.\n", __FILE__, __LINE__);
-    while (1);
+  sl_htm_tm_index_t first_segment = cell * SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm); i++) {
+    sl_htm_segment_init(tm, first_segment + i);
   }
-  for (uint16_t i = 0; i < tm->parameters.max_segments_in_cell; i++) {
-    sl_htm_segment_init(tm, &cell->segments[i]);
-  }
-  cell->parent_column = parent_column;
-  cell->num_segments = 0;
+  tm->cell_num_segments[cell] = 0;
+  tm->cell_presynaptic_head[cell] = SL_HTM_TM_INDEX_NONE;
+}
+sl_htm_tm_index_t sl_htm_tm_cell_column(sl_htm_tm_t* tm, sl_htm_tm_index_t cell)
+{
+  return cell / SL_HTM_TM_NUM_CELLS_PER_COLUMN(tm);
 }
 /**
  * @brief Find the least used segment in the cell. The heuristic used is to sum all the permanences squared of the synapses in the segment.
  *
  */
-void sl_htm_tm_cell_delete_least_useful_segment(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell)
+void sl_htm_tm_cell_delete_least_useful_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t cell)
 {
-  sl_htm_tm_segment_t* least_used_segment = NULL;
+  sl_htm_tm_index_t least_used_segment = SL_HTM_TM_INDEX_NONE;
   uint8_t max_heuristic_value = 0;
   // Go through all the segments in the cell
-  for (uint16_t i = 0; i < cell->num_segments; i++) {
-    sl_htm_tm_segment_t* segment = &cell->segments[i];
-    if (!sl_htm_tm_segment_is_existing(segment)) {
+  sl_htm_tm_index_t first_segment = cell * SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm); i++) {
+    sl_htm_tm_index_t segment = first_segment + i;
+    if (!sl_htm_tm_segment_is_existing(tm, segment)) {
       continue;
     }
     uint8_t heuristic_value = 0;
     // Go through all the synapses in the segment
-    for (uint16_t j = 0; j < segment->num_synapses; j++) {
-      sl_htm_tm_synapse_t* synapse = &segment->synapses[j];
-      if (!sl_htm_tm_synapse_is_existing(synapse)) {
+    sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+    for (uint16_t j = 0; j < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); j++) {
+      sl_htm_tm_index_t synapse = first_synapse + j;
+      if (!sl_htm_tm_synapse_is_existing(tm, synapse)) {
         continue;
       }
-      heuristic_value += synapse->permanence * synapse->permanence;
+      heuristic_value += tm->synapse_permanence[synapse] * tm->synapse_permanence[synapse];
     }
-    if (least_used_segment == NULL || heuristic_value > max_heuristic_value) {
+    if (least_used_segment == SL_HTM_TM_INDEX_NONE || heuristic_value > max_heuristic_value) {
       least_used_segment = segment;
       max_heuristic_value = heuristic_value;
     }
   }
-  if (least_used_segment == NULL) {
-    printf("Error [%s:%d]: Could not find a segment to delete.\n", __FILE__, __LINE__);
-    while (1);
+  // The cell has no segment slots, growing a segment then finds no free slot either
+  if (least_used_segment == SL_HTM_TM_INDEX_NONE) {
+    return;
   }
   sl_htm_tm_cell_delete_segment(tm, cell, least_used_segment);
 }
-sl_htm_tm_segment_t* sl_htm_tm_cell_grow_segment(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell)
+sl_htm_tm_index_t sl_htm_tm_cell_grow_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t cell)
 {
   // If all the slots are full, prune the least used segment
-  if (cell->num_segments >= tm->parameters.max_segments_in_cell) {
+  if (tm->cell_num_segments[cell] >= SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm)) {
     sl_htm_tm_cell_delete_least_useful_segment(tm, cell);
   }
   // Find an empty segment
-  for (uint16_t i = 0; i < tm->parameters.max_segments_in_cell; i++) {
-    sl_htm_tm_segment_t* segment = &cell->segments[i];
-    if (!sl_htm_tm_segment_is_existing(segment)) {
-      segment->parent_cell = cell;
-      segment->num_synapses = 0;
-
-      segment->parent_cell->num_segments++;
+  sl_htm_tm_index_t first_segment = cell * SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm); i++) {
+    sl_htm_tm_index_t segment = first_segment + i;
+    if (!sl_htm_tm_segment_is_existing(tm, segment)) {
+      tm->segment_num_synapses[segment] = 0;
+      tm->cell_num_segments[cell]++;
       return segment;
     }
   }
-  return NULL;
+  return SL_HTM_TM_INDEX_NONE;
 }
-void sl_htm_tm_cell_delete_segment(sl_htm_tm_t* tm, sl_htm_tm_cell_t* cell, sl_htm_tm_segment_t* segment)
+void sl_htm_tm_cell_delete_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t cell, sl_htm_tm_index_t segment)
 {
   sl_htm_segment_reset(tm, segment);
-  cell->num_segments--;
+  tm->cell_num_segments[cell]--;
 }
@@ -17,137 +17,185 @@
 #include "sl_htm_tm_segment.h"
 #include "sl_htm_tm_synapse.h"
 #include "sl_htm_tm_cell.h"
-void sl_htm_segment_init(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment)
+void sl_htm_segment_init(sl_htm_tm_t* tm, sl_htm_tm_index_t segment)
 {
-  segment->synapses = calloc(tm->parameters.max_synapses_in_segment, sizeof(sl_htm_tm_synapse_t));
-  if (segment->synapses == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for synapses.\n", __FILE__, __LINE__);
-    while (1);
+  tm->segment_num_synapses[segment] = SL_HTM_TM_SEGMENT_FREE;
+  tm->segment_num_active_connected[segment] = 0;
+  tm->segment_num_active_potential[segment] = 0;
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_index_t synapse = first_synapse + i;
+    tm->synapse_presynaptic_cell[synapse] = SL_HTM_TM_INDEX_NONE;
+    tm->synapse_permanence[synapse] = 0;
+    tm->synapse_prev_presynaptic[synapse] = SL_HTM_TM_INDEX_NONE;
+    tm->synapse_next_presynaptic[synapse] = SL_HTM_TM_INDEX_NONE;
   }
-  segment->num_synapses = 0;
-  segment->parent_cell = NULL;
 }
-void sl_htm_segment_reset(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment)
+void sl_htm_segment_reset(sl_htm_tm_t* tm, sl_htm_tm_index_t segment)
 {
-  segment->num_synapses = 0;
-  segment->parent_cell = NULL;
-  segment->synapses = memset(segment->synapses, 0, sizeof(sl_htm_tm_synapse_t) * tm->parameters.max_synapses_in_segment);
-  if (segment->synapses == NULL) {
-    printf("Error [%s:%d]: Could not allocate memory for synapses.\n", __FILE__, __LINE__);
-    while (1);
+  // Unlink the remaining synapses from their presynaptic cells before clearing them
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_synapse_reset(tm, first_synapse + i);
   }
+  tm->segment_num_synapses[segment] = SL_HTM_TM_SEGMENT_FREE;
 }
-bool sl_htm_tm_segment_is_existing(sl_htm_tm_segment_t* segment)
+bool sl_htm_tm_segment_is_existing(sl_htm_tm_t* tm, sl_htm_tm_index_t segment)
 {
-  return segment->parent_cell != NULL;
+  return tm->segment_num_synapses[segment] != SL_HTM_TM_SEGMENT_FREE;
+}
+sl_htm_tm_index_t sl_htm_tm_segment_cell(sl_htm_tm_t* tm, sl_htm_tm_index_t segment)
+{
+  return segment / SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm);
+}
+sl_htm_tm_index_t sl_htm_tm_segment_column(sl_htm_tm_t* tm, sl_htm_tm_index_t segment)
+{
+  return segment / (SL_HTM_TM_MAX_SEGMENTS_IN_CELL(tm) * SL_HTM_TM_NUM_CELLS_PER_COLUMN(tm));
 }
 
-bool sl_htm_tm_segment_is_active(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_current)
+bool sl_htm_tm_segment_is_active(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_current)
 {
   // Count the number of active synapses
   uint16_t num_active_synapses = 0;
-  for (uint16_t i = 0; i < tm->parameters.max_synapses_in_segment; i++) {
-    if (sl_htm_tm_synapse_is_connected_active(tm, &segment->synapses[i], state_current)) {
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    if (sl_htm_tm_synapse_is_connected_active(tm, first_synapse + i, state_current)) {
       num_active_synapses++;
     }
   }
   return num_active_synapses >= tm->parameters.segment_activation_threshold;
 }
 
-uint16_t sl_htm_tm_segment_potential_score(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state)
+uint16_t sl_htm_tm_segment_potential_score(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state)
 {
   uint16_t num_active_potential_synapses = 0;
-  for (uint16_t i = 0; i < tm->parameters.max_synapses_in_segment; i++) {
-    if (sl_htm_tm_synapse_is_existing_active(tm, &segment->synapses[i], state)) {
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_index_t synapse = first_synapse + i;
+    if (sl_htm_tm_synapse_is_existing_active(tm, synapse, state) && sl_htm_tm_synapse_is_potential(tm->synapse_permanence[synapse])) {
       num_active_potential_synapses++;
     }
   }
   return num_active_potential_synapses;
 }
-/**
- * @brief Grow a new synapse on the segment.
- *
- * @param tm
- * @param segment
- * @param target_cell
- * @return Returns a pointer to the new synapse, or NULL if the segment is full.
- */
-sl_htm_tm_synapse_t* sl_htm_tm_segment_grow_synapse(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_cell_t* target_cell)
+
+sl_htm_tm_index_t sl_htm_tm_segment_grow_synapse(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_index_t target_cell)
 {
-  //If all the slots are full, return NULL
-  if (segment->num_synapses >= tm->parameters.max_synapses_in_segment) {
-    return NULL;
+  //If all the slots are full, return NONE
+  if (tm->segment_num_synapses[segment] >= SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm)) {
+    return SL_HTM_TM_INDEX_NONE;
   }
   // Find an empty synapse slot
-  for (uint16_t i = 0; i < tm->parameters.max_synapses_in_segment; i++) {
-    sl_htm_tm_synapse_t* synapse = &segment->synapses[i];
-    if (!sl_htm_tm_synapse_is_existing(synapse)) {
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_index_t synapse = first_synapse + i;
+    if (!sl_htm_tm_synapse_is_existing(tm, synapse)) {
       // Grow (initialize) the synapse
-      sl_htm_tm_synapse_setup(tm, synapse, segment, target_cell);
-      segment->num_synapses++;
+      sl_htm_tm_synapse_setup(tm, synapse, target_cell);
+      tm->segment_num_synapses[segment]++;
       return synapse;
     }
   }
-  return NULL;
+  return SL_HTM_TM_INDEX_NONE;
 }
-void sl_htm_tm_segment_delete_synapse(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_synapse_t* synapse)
+void sl_htm_tm_segment_delete_synapse(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_index_t synapse)
 {
-  sl_htm_tm_synapse_reset(synapse);
+  sl_htm_tm_synapse_reset(tm, synapse);
 
-  segment->num_synapses--;
+  tm->segment_num_synapses[segment]--;
 
   // If the segment is empty, delete it
-  if (segment->num_synapses == 0) {
-    sl_htm_tm_cell_delete_segment(tm, segment->parent_cell, segment);
+  if (tm->segment_num_synapses[segment] == 0) {
+    sl_htm_tm_cell_delete_segment(tm, sl_htm_tm_segment_cell(tm, segment), segment);
   }
 }
-void sl_htm_tm_segment_update_permanence(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_prev)
+void sl_htm_tm_segment_update_permanence(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev)
 {
-  for (uint16_t i = 0; i < tm->parameters.max_synapses_in_segment; i++) {
-    sl_htm_tm_synapse_t* synapse = &segment->synapses[i];
-    if (!sl_htm_tm_synapse_is_existing(synapse)) {
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_index_t synapse = first_synapse + i;
+    if (!sl_htm_tm_synapse_is_existing(tm, synapse)) {
       continue;
     }
 
-    if (sl_htm_tm_is_cell_in_array(synapse->target_cell, &state_prev->active_cells)) {
-      if (synapse->permanence < UINT8_MAX - tm->parameters.synapse_permanence_increment) {
-        synapse->permanence += tm->parameters.synapse_permanence_increment;
+    uint8_t* permanence = &tm->synapse_permanence[synapse];
+    if (sl_htm_tm_is_cell_active(tm->synapse_presynaptic_cell[synapse], state_prev)) {
+      if (*permanence < UINT8_MAX - tm->parameters.synapse_permanence_increment) {
+        *permanence += tm->parameters.synapse_permanence_increment;
       } else {
-        synapse->permanence = UINT8_MAX;
+        *permanence = UINT8_MAX;
       }
     } else {
-      if (synapse->permanence > tm->parameters.synapse_permanence_decrement) {
-        synapse->permanence -= tm->parameters.synapse_permanence_decrement;
+      if (*permanence > tm->parameters.synapse_permanence_decrement) {
+        *permanence -= tm->parameters.synapse_permanence_decrement;
       } else {
         sl_htm_tm_segment_delete_synapse(tm, segment, synapse);
       }
     }
   }
 }
-
-void sl_htm_tm_segment_grow_synapses(sl_htm_tm_t* tm, sl_htm_tm_segment_t* segment, sl_htm_tm_state_t* state_prev)
+void sl_htm_tm_segment_punish(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev)
 {
-  // Shuffle the previous winner cells
-  sl_htm_tm_shuffle_cell_array(&state_prev->active_cells);
-  // Go through the previous winner cells
-  for (uint16_t i = 0; i < state_prev->active_cells.len; i++) {
-    sl_htm_tm_cell_t* cell = state_prev->active_cells.cells[i];
-    bool already_connected = false;
-    // Check if the cell is already connected to the segment
-    for (uint16_t j = 0; j < tm->parameters.max_synapses_in_segment; j++) {
-      sl_htm_tm_synapse_t* synapse = &segment->synapses[j];
-      if (sl_htm_tm_synapse_is_existing(synapse) && synapse->target_cell == cell) {
-        already_connected = true;
-        break;
-      }
+  // Go through all the synapses in the segment
+  sl_htm_tm_index_t first_synapse = segment * SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  for (uint16_t i = 0; i < SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm); i++) {
+    sl_htm_tm_index_t synapse = first_synapse + i;
+    if (!sl_htm_tm_synapse_is_existing(tm, synapse)) {
+      continue;
     }
-    // If the cell is not already connected, add a synapse to it
-    if (!already_connected) {
-      sl_htm_tm_synapse_t* synapse = sl_htm_tm_segment_grow_synapse(tm, segment, cell);
-      // If the segment is now full, stop growing
-      if (synapse == NULL) {
-        break;
+    if (sl_htm_tm_is_cell_active(tm->synapse_presynaptic_cell[synapse], state_prev)) {
+      // Wrap in if statement to avoid decrementing below 0 and causing overflow
+      if (tm->synapse_permanence[synapse] < tm->parameters.synapse_permanence_decrement) {
+        sl_htm_tm_segment_delete_synapse(tm, segment, synapse);
+      } else {
+        tm->synapse_permanence[synapse] -= tm->parameters.synapse_permanence_decrement;
       }
     }
   }
 }
+
+void sl_htm_tm_segment_grow_synapses(sl_htm_tm_t* tm, sl_htm_tm_index_t segment, sl_htm_tm_state_t* state_prev)
+{
+  uint16_t max_synapses = SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
+  uint16_t num_synapses = tm->segment_num_synapses[segment];
+  if (num_synapses >= max_synapses) {
+    return;
+  }
+  sl_htm_tm_index_t first_synapse = segment * max_synapses;
+  sl_htm_sdr_word_t* connected = tm->grow_connected_cells;
+  // Mark the cells the segment is already connected to, so every candidate is checked in constant time
+  for (uint16_t i = 0; i < max_synapses; i++) {
+    sl_htm_tm_index_t cell = tm->synapse_presynaptic_cell[first_synapse + i];
+    if (cell != SL_HTM_TM_INDEX_NONE) {
+      connected[cell >> SL_HTM_SDR_WORD_SHIFT] |= (sl_htm_sdr_word_t)1 << (cell & SL_HTM_SDR_WORD_MASK);
+    }
+  }
+  // Draw the previous active cells in random order without shuffling them, since other columns still read them.
+  // Every drawn cell either gets a synapse or already has one, so at most max_synapses cells are drawn.
+  sl_htm_tm_sampler_start(&tm->grow_sampler, state_prev->active_cells.len);
+  uint16_t slot = 0;
+  while (num_synapses < max_synapses) {
+    uint16_t candidate = sl_htm_tm_sampler_next(&tm->grow_sampler, &tm->random);
+    if (candidate == UINT16_MAX) {
+      break;
+    }
+    sl_htm_tm_index_t cell = state_prev->active_cells.cells[candidate];
+    if ((connected[cell >> SL_HTM_SDR_WORD_SHIFT] >> (cell & SL_HTM_SDR_WORD_MASK)) & 1) {
+      continue;
+    }
+    // The free slots are filled in order, so the slots are walked once in total
+    while (sl_htm_tm_synapse_is_existing(tm, first_synapse + slot)) {
+      slot++;
+    }
+    sl_htm_tm_synapse_setup(tm, first_synapse + slot, cell);
+    num_synapses++;
+  }
+  tm->segment_num_synapses[segment] = num_synapses;
+  // Clear the marks, including those of the cells that were just connected
+  for (uint16_t i = 0; i < max_synapses; i++) {
+    sl_htm_tm_index_t cell = tm->synapse_presynaptic_cell[first_synapse + i];
+    if (cell != SL_HTM_TM_INDEX_NONE) {
+      connected[cell >> SL_HTM_SDR_WORD_SHIFT] &= ~((sl_htm_sdr_word_t)1 << (cell & SL_HTM_SDR_WORD_MASK));
+    }
+  }
+}
@@ -16,30 +16,56 @@
  ******************************************************************************/
 #include "sl_htm_tm_synapse.h"
 
-void sl_htm_tm_synapse_setup(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_segment_t* parent_segment, sl_htm_tm_cell_t* target_cell)
+sl_htm_tm_index_t sl_htm_tm_synapse_segment(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse)
 {
-  synapse->parent_segment = parent_segment;
-  synapse->target_cell = target_cell;
-  synapse->permanence = tm->parameters.synapse_permanence_initial;
+  return synapse / SL_HTM_TM_MAX_SYNAPSES_IN_SEGMENT(tm);
 }
-void sl_htm_tm_synapse_reset(sl_htm_tm_synapse_t* synapse)
+void sl_htm_tm_synapse_setup(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_index_t target_cell)
 {
-  synapse->parent_segment = NULL;
-  synapse->target_cell = NULL;
-  synapse->permanence = 0;
+  tm->synapse_presynaptic_cell[synapse] = target_cell;
+  tm->synapse_permanence[synapse] = tm->parameters.synapse_permanence_initial;
+  // Add the synapse to the front of the presynaptic cell's list
+  sl_htm_tm_index_t next = tm->cell_presynaptic_head[target_cell];
+  tm->synapse_prev_presynaptic[synapse] = SL_HTM_TM_INDEX_NONE;
+  tm->synapse_next_presynaptic[synapse] = next;
+  if (next != SL_HTM_TM_INDEX_NONE) {
+    tm->synapse_prev_presynaptic[next] = synapse;
+  }
+  tm->cell_presynaptic_head[target_cell] = synapse;
 }
-bool sl_htm_tm_synapse_is_existing(sl_htm_tm_synapse_t* synapse)
+void sl_htm_tm_synapse_reset(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse)
 {
-  return synapse->parent_segment != NULL;
+  // Remove the synapse from the presynaptic cell's list
+  if (sl_htm_tm_synapse_is_existing(tm, synapse)) {
+    sl_htm_tm_index_t prev = tm->synapse_prev_presynaptic[synapse];
+    sl_htm_tm_index_t next = tm->synapse_next_presynaptic[synapse];
+    if (prev != SL_HTM_TM_INDEX_NONE) {
+      tm->synapse_next_presynaptic[prev] = next;
+    } else {
+      tm->cell_presynaptic_head[tm->synapse_presynaptic_cell[synapse]] = next;
+    }
+    if (next != SL_HTM_TM_INDEX_NONE) {
+      tm->synapse_prev_presynaptic[next] = prev;
+    }
+  }
+  tm->synapse_prev_presynaptic[synapse] = SL_HTM_TM_INDEX_NONE;
+  tm->synapse_next_presynaptic[synapse] = SL_HTM_TM_INDEX_NONE;
+  tm->synapse_presynaptic_cell[synapse] = SL_HTM_TM_INDEX_NONE;
+  tm->synapse_permanence[synapse] = 0;
 }
-bool sl_htm_tm_synapse_is_existing_active(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_state_t* state_current)
+bool sl_htm_tm_synapse_is_existing(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse)
 {
-  return sl_htm_tm_synapse_is_existing(synapse) && sl_htm_tm_is_cell_in_array(synapse->target_cell, &state_current->active_cells);
+  return tm->synapse_presynaptic_cell[synapse] != SL_HTM_TM_INDEX_NONE;
 }
-bool sl_htm_tm_synapse_is_connected_active(sl_htm_tm_t* tm, sl_htm_tm_synapse_t* synapse, sl_htm_tm_state_t* state_current)
+bool sl_htm_tm_synapse_is_existing_active(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_state_t* state_current)
 {
-  bool is_existing = sl_htm_tm_synapse_is_existing(synapse);
-  bool is_connected = synapse->permanence >= tm->parameters.synapse_permanence_threshold;
-  bool is_active = sl_htm_tm_is_cell_in_array(synapse->target_cell, &state_current->active_cells);
-  return is_existing && is_connected && is_active;
+  return sl_htm_tm_synapse_is_existing(tm, synapse) && sl_htm_tm_is_cell_active(tm->synapse_presynaptic_cell[synapse], state_current);
+}
+bool sl_htm_tm_synapse_is_connected_active(sl_htm_tm_t* tm, sl_htm_tm_index_t synapse, sl_htm_tm_state_t* state_current)
+{
+  if (!sl_htm_tm_synapse_is_existing(tm, synapse)) {
+    return false;
+  }
+  bool is_connected = tm->synapse_permanence[synapse] >= tm->parameters.synapse_permanence_threshold;
+  return is_connected && sl_htm_tm_is_cell_active(tm->synapse_presynaptic_cell[synapse], state_current);
 }
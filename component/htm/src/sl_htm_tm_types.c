@@ -15,37 +15,181 @@
  *
  ******************************************************************************/
 #include "sl_htm_tm_types.h"
+static void sl_htm_tm_init_cell_array(sl_htm_tm_cell_array_t* arr)
+{
+  arr->len = 0;
+  arr->capacity = 0;
+  arr->num_growths = 0;
+  arr->num_dropped = 0;
+  arr->fixed_capacity = false;
+  arr->cells = NULL;
+}
+void sl_htm_tm_init_segment_array(sl_htm_tm_segment_array_t* arr)
+{
+  arr->len = 0;
+  arr->capacity = 0;
+  arr->num_growths = 0;
+  arr->num_dropped = 0;
+  arr->fixed_capacity = false;
+  arr->segments = NULL;
+}
 void sl_htm_tm_init_state(sl_htm_tm_state_t* state)
 {
-  state->active_cells.len = 0;
-  state->active_cells.capacity = 4;
-  state->active_cells.cells = NULL;
+  sl_htm_tm_init_cell_array(&state->active_cells);
+  sl_htm_tm_init_cell_array(&state->winner_cells);
+  sl_htm_tm_init_segment_array(&state->active_segments);
+  sl_htm_tm_init_segment_array(&state->matching_segments);
+  state->matching_scores = NULL;
+  state->matching_scores_capacity = 0;
 
-  state->winner_cells.len = 0;
-  state->winner_cells.capacity = 4;
-  state->winner_cells.cells = NULL;
-
-  state->active_segments.len = 0;
-  state->active_segments.capacity = 4;
-  state->active_segments.segments = NULL;
-
-  state->matching_segments.len = 0;
-  state->matching_segments.capacity = 4;
-  state->matching_segments.segments = NULL;
+  state->num_predictive_and_active_columns = 0;
+  state->active_cells_bitset = NULL;
+  state->num_cells = 0;
+}
+void sl_htm_tm_deinit_state(sl_htm_tm_state_t* state)
+{
+  sl_htm_memory_free(NULL, state->active_cells_bitset);
+  sl_htm_memory_free(NULL, state->matching_scores);
+  sl_htm_memory_free(NULL, state->matching_segments.segments);
+  sl_htm_memory_free(NULL, state->active_segments.segments);
+  sl_htm_memory_free(NULL, state->winner_cells.cells);
+  sl_htm_memory_free(NULL, state->active_cells.cells);
+  sl_htm_tm_init_state(state);
+}
+sl_htm_status_t sl_htm_tm_init_state_active_cells_bitset(sl_htm_tm_state_t* state, sl_htm_memory_t* memory, uint16_t num_cells)
+{
+  state->active_cells_bitset = sl_htm_memory_calloc(memory, SL_HTM_SDR_NUM_WORDS(num_cells), sizeof(sl_htm_sdr_word_t));
+  if (state->active_cells_bitset == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  state->num_cells = num_cells;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Reallocate storage of old_size bytes to size bytes. Storage in a buffer cannot grow in place,
+ * so the contents are moved to new storage that is carved from it.
+ *
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return The new storage, or NULL if it could not be allocated. The old storage is then left as it was.
+ */
+static void* sl_htm_tm_resize_storage(void* elements, sl_htm_memory_t* memory, size_t old_size, size_t size)
+{
+  if (memory == NULL) {
+    return sl_htm_memory_realloc(NULL, elements, size);
+  }
+  void* resized = sl_htm_memory_alloc(memory, size);
+  if (resized != NULL && elements != NULL) {
+    memcpy(resized, elements, old_size);
+  }
+  return resized;
+}
+/**
+ * @brief Reallocate the storage of an array so it can hold capacity elements. Storage in a buffer cannot grow in place,
+ * so the elements are moved to new storage that is carved from it.
+ *
+ * @param memory The buffer to allocate from, NULL for the heap
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the storage could not be reallocated, the old storage is then left as it was
+ */
+static sl_htm_status_t sl_htm_tm_resize_array(sl_htm_tm_index_t** elements, sl_htm_memory_t* memory, uint16_t old_capacity, uint16_t capacity)
+{
+  sl_htm_tm_index_t* resized = sl_htm_tm_resize_storage(*elements, memory, old_capacity * sizeof(sl_htm_tm_index_t), capacity * sizeof(sl_htm_tm_index_t));
+  if (resized == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  *elements = resized;
+  return SL_HTM_STATUS_OK;
+}
+/**
+ * @brief Capacity to grow a full array to. The capacity is doubled so that the number of growths is logarithmic in the final size.
+ *
+ */
+static uint16_t sl_htm_tm_grown_capacity(uint16_t capacity)
+{
+  if (capacity == 0) {
+    return 4;
+  }
+  if (capacity > UINT16_MAX / 2) {
+    return UINT16_MAX;
+  }
+  return capacity * 2;
 }
-void sl_htm_tm_add_cell_to_array(sl_htm_tm_cell_t* cell, sl_htm_tm_cell_array_t* arr)
+/**
+ * @brief Make room for one more element in an array, growing its storage if it is full.
+ *
+ * @return SL_HTM_STATUS_ALLOCATION_FAILED if the array is full and could not grow, the array is then left as it was
+ */
+static sl_htm_status_t sl_htm_tm_make_room(sl_htm_tm_index_t** elements, uint16_t len, uint16_t* capacity, uint16_t* num_growths, bool fixed_capacity)
 {
-  //Increment the length
-  arr->len++;
-  // Grow the array and add the cell
-  arr->cells = (sl_htm_tm_cell_t**)realloc(arr->cells, arr->len * sizeof(sl_htm_tm_cell_t*));
-  if (arr->cells == NULL) {
-    printf("Error [%s:%d]: Could not reallocate memory for cells array.\n", __FILE__, __LINE__);
-    while (1);
+  // Only touch the heap if the reserved capacity is exceeded
+  if (len < *capacity) {
+    return SL_HTM_STATUS_OK;
+  }
+  if (fixed_capacity) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  uint16_t grown_capacity = sl_htm_tm_grown_capacity(*capacity);
+  if (grown_capacity <= len || sl_htm_tm_resize_array(elements, NULL, *capacity, grown_capacity) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  *capacity = grown_capacity;
+  (*num_growths)++;
+  return SL_HTM_STATUS_OK;
+}
+static sl_htm_status_t sl_htm_tm_reserve_cell_array(sl_htm_tm_cell_array_t* arr, sl_htm_memory_t* memory, uint16_t capacity)
+{
+  if (arr->capacity < capacity) {
+    if (sl_htm_tm_resize_array(&arr->cells, memory, arr->capacity, capacity) != SL_HTM_STATUS_OK) {
+      return SL_HTM_STATUS_ALLOCATION_FAILED;
+    }
+    arr->capacity = capacity;
+    arr->fixed_capacity = memory != NULL;
   }
-  arr->cells[arr->len - 1] = cell;
+  return SL_HTM_STATUS_OK;
 }
-bool sl_htm_tm_is_cell_in_array(sl_htm_tm_cell_t* cell, sl_htm_tm_cell_array_t* arr)
+sl_htm_status_t sl_htm_tm_reserve_segment_array(sl_htm_tm_segment_array_t* arr, sl_htm_memory_t* memory, uint16_t capacity)
+{
+  if (arr->capacity < capacity) {
+    if (sl_htm_tm_resize_array(&arr->segments, memory, arr->capacity, capacity) != SL_HTM_STATUS_OK) {
+      return SL_HTM_STATUS_ALLOCATION_FAILED;
+    }
+    arr->capacity = capacity;
+    arr->fixed_capacity = memory != NULL;
+  }
+  return SL_HTM_STATUS_OK;
+}
+static sl_htm_status_t sl_htm_tm_reserve_matching_scores(sl_htm_tm_state_t* state, sl_htm_memory_t* memory, uint16_t capacity)
+{
+  if (state->matching_scores_capacity < capacity) {
+    uint16_t* resized = sl_htm_tm_resize_storage(state->matching_scores, memory, state->matching_scores_capacity * sizeof(uint16_t), capacity * sizeof(uint16_t));
+    if (resized == NULL) {
+      return SL_HTM_STATUS_ALLOCATION_FAILED;
+    }
+    state->matching_scores = resized;
+    state->matching_scores_capacity = capacity;
+  }
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_tm_reserve_state(sl_htm_tm_state_t* state, sl_htm_memory_t* memory, uint16_t cell_capacity, uint16_t segment_capacity)
+{
+  if (sl_htm_tm_reserve_cell_array(&state->active_cells, memory, cell_capacity) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_cell_array(&state->winner_cells, memory, cell_capacity) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_segment_array(&state->active_segments, memory, segment_capacity) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_segment_array(&state->matching_segments, memory, segment_capacity) != SL_HTM_STATUS_OK
+      || sl_htm_tm_reserve_matching_scores(state, memory, segment_capacity) != SL_HTM_STATUS_OK) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  return SL_HTM_STATUS_OK;
+}
+sl_htm_status_t sl_htm_tm_add_cell_to_array(sl_htm_tm_index_t cell, sl_htm_tm_cell_array_t* arr)
+{
+  if (sl_htm_tm_make_room(&arr->cells, arr->len, &arr->capacity, &arr->num_growths, arr->fixed_capacity) != SL_HTM_STATUS_OK) {
+    arr->num_dropped++;
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  arr->cells[arr->len++] = cell;
+  return SL_HTM_STATUS_OK;
+}
+bool sl_htm_tm_is_cell_in_array(sl_htm_tm_index_t cell, sl_htm_tm_cell_array_t* arr)
 {
   for (uint16_t i = 0; i < arr->len; i++) {
     if (arr->cells[i] == cell) {
@@ -54,59 +198,215 @@ bool sl_htm_tm_is_cell_in_array(sl_htm_tm_cell_t* cell, sl_htm_tm_cell_array_t*
   }
   return false;
 }
-void sl_htm_tm_shuffle_cell_array(sl_htm_tm_cell_array_t* arr)
+void sl_htm_tm_activate_cell(sl_htm_tm_index_t cell, sl_htm_tm_state_t* state)
 {
-  for (uint16_t i = 0; i < arr->len; i++) {
-    uint16_t j = rand() % arr->len;
-    sl_htm_tm_cell_t* tmp = arr->cells[i];
-    arr->cells[i] = arr->cells[j];
+  if (state->active_cells_bitset != NULL) {
+    sl_htm_sdr_word_t* word = &state->active_cells_bitset[cell >> SL_HTM_SDR_WORD_SHIFT];
+    sl_htm_sdr_word_t mask = (sl_htm_sdr_word_t)1 << (cell & SL_HTM_SDR_WORD_MASK);
+    // The cell is already active, e.g. because it has several active segments
+    if (*word & mask) {
+      return;
+    }
+    // Only mark the cell if it made it into the array, so the bitset and the array agree
+    if (sl_htm_tm_add_cell_to_array(cell, &state->active_cells) == SL_HTM_STATUS_OK) {
+      *word |= mask;
+    }
+    return;
+  }
+  sl_htm_tm_add_cell_to_array(cell, &state->active_cells);
+}
+bool sl_htm_tm_is_cell_active(sl_htm_tm_index_t cell, sl_htm_tm_state_t* state)
+{
+  if (state->active_cells_bitset == NULL) {
+    return sl_htm_tm_is_cell_in_array(cell, &state->active_cells);
+  }
+  return (state->active_cells_bitset[cell >> SL_HTM_SDR_WORD_SHIFT] >> (cell & SL_HTM_SDR_WORD_MASK)) & 1;
+}
+void sl_htm_tm_shuffle_cell_array(sl_htm_tm_cell_array_t* arr, sl_htm_random_t* random)
+{
+  // Fisher-Yates: swapping with any element instead of one not placed yet would make some orders more likely than others
+  for (uint16_t i = arr->len; i > 1; i--) {
+    uint16_t j = sl_htm_random_below(random, i);
+    sl_htm_tm_index_t tmp = arr->cells[i - 1];
+    arr->cells[i - 1] = arr->cells[j];
     arr->cells[j] = tmp;
   }
 }
 
-void sl_htm_tm_add_segment_to_array(sl_htm_tm_segment_t* segment, sl_htm_tm_segment_array_t* arr)
+sl_htm_status_t sl_htm_tm_sampler_init(sl_htm_tm_sampler_t* sampler, sl_htm_memory_t* memory, uint16_t capacity)
+{
+  sampler->swap_positions = sl_htm_memory_alloc(memory, sizeof(uint16_t) * capacity);
+  sampler->swap_values = sl_htm_memory_alloc(memory, sizeof(uint16_t) * capacity);
+  if (sampler->swap_positions == NULL || sampler->swap_values == NULL) {
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  sampler->capacity = capacity;
+  sl_htm_tm_sampler_start(sampler, 0);
+  return SL_HTM_STATUS_OK;
+}
+void sl_htm_tm_sampler_deinit(sl_htm_tm_sampler_t* sampler)
+{
+  sl_htm_memory_free(NULL, sampler->swap_values);
+  sl_htm_memory_free(NULL, sampler->swap_positions);
+  sampler->swap_values = NULL;
+  sampler->swap_positions = NULL;
+  sampler->capacity = 0;
+}
+void sl_htm_tm_sampler_start(sl_htm_tm_sampler_t* sampler, uint16_t population)
+{
+  sampler->num_swaps = 0;
+  sampler->num_drawn = 0;
+  sampler->population = population;
+}
+/**
+ * @brief Find the value at a position of the virtual shuffle.
+ *
+ * @return The index in the swap table, or num_swaps if the position was never swapped
+ */
+static uint16_t sl_htm_tm_sampler_find(sl_htm_tm_sampler_t* sampler, uint16_t position)
 {
-  //Increment the length
-  arr->len++;
-  // Grow the array and add the cell
-  arr->segments = (sl_htm_tm_segment_t**)realloc(arr->segments, arr->len * sizeof(sl_htm_tm_segment_t*));
-  if (arr->segments == NULL) {
-    printf("Error [%s:%d]: Could not reallocate memory for segments array.\n", __FILE__, __LINE__);
-    while (1);
+  uint16_t i = 0;
+  while (i < sampler->num_swaps && sampler->swap_positions[i] != position) {
+    i++;
   }
-  arr->segments[arr->len - 1] = segment;
+  return i;
+}
+uint16_t sl_htm_tm_sampler_next(sl_htm_tm_sampler_t* sampler, sl_htm_random_t* random)
+{
+  if (sampler->num_drawn >= sampler->population || sampler->num_drawn >= sampler->capacity) {
+    return UINT16_MAX;
+  }
+  // Swap position num_drawn with a random position at or after it, and return what lands on num_drawn.
+  // Position num_drawn is never looked at again, so only the other side of the swap needs to be recorded.
+  uint16_t first = sampler->num_drawn++;
+  uint16_t position = first + sl_htm_random_below(random, sampler->population - first);
+  uint16_t first_swap = sl_htm_tm_sampler_find(sampler, first);
+  uint16_t first_value = first_swap < sampler->num_swaps ? sampler->swap_values[first_swap] : first;
+  if (position == first) {
+    return first_value;
+  }
+  uint16_t swap = sl_htm_tm_sampler_find(sampler, position);
+  uint16_t value = position;
+  if (swap < sampler->num_swaps) {
+    value = sampler->swap_values[swap];
+  } else {
+    // A new entry, there is room since every draw adds at most one
+    sampler->swap_positions[swap] = position;
+    sampler->num_swaps++;
+  }
+  sampler->swap_values[swap] = first_value;
+  return value;
+}
+size_t sl_htm_tm_sampler_memory_size(sl_htm_tm_sampler_t* sampler)
+{
+  return 2 * sizeof(uint16_t) * sampler->capacity;
 }
 
-void sl_htm_tm_swap_and_clear_cell_array(sl_htm_tm_cell_array_t* prev, sl_htm_tm_cell_array_t* current)
+sl_htm_status_t sl_htm_tm_add_segment_to_array(sl_htm_tm_index_t segment, sl_htm_tm_segment_array_t* arr)
 {
-  // Swap the arrays inside the struct
-  sl_htm_tm_cell_t** temp = prev->cells;
+  if (sl_htm_tm_make_room(&arr->segments, arr->len, &arr->capacity, &arr->num_growths, arr->fixed_capacity) != SL_HTM_STATUS_OK) {
+    arr->num_dropped++;
+    return SL_HTM_STATUS_ALLOCATION_FAILED;
+  }
+  arr->segments[arr->len++] = segment;
+  return SL_HTM_STATUS_OK;
+}
 
-  prev->cells = current->cells;
-  prev->len = current->len;
+sl_htm_status_t sl_htm_tm_sort_segment_array(sl_htm_tm_segment_array_t* arr, sl_htm_tm_segment_array_t* scratch)
+{
+  // The scratch needs room for the whole array
+  if (scratch->capacity < arr->len) {
+    if (scratch->fixed_capacity) {
+      return SL_HTM_STATUS_WOULD_OVERFLOW;
+    }
+    if (sl_htm_tm_resize_array(&scratch->segments, NULL, scratch->capacity, arr->len) != SL_HTM_STATUS_OK) {
+      return SL_HTM_STATUS_ALLOCATION_FAILED;
+    }
+    scratch->capacity = arr->len;
+    scratch->num_growths++;
+  }
+  uint16_t offsets[256];
+  // Stable radix sort, one byte per pass starting with the low byte. There is an even number of passes, so the result ends up in arr.
+  for (uint8_t shift = 0; shift < 8 * sizeof(sl_htm_tm_index_t); shift += 8) {
+    sl_htm_tm_index_t* src = (shift & 8) == 0 ? arr->segments : scratch->segments;
+    sl_htm_tm_index_t* dst = (shift & 8) == 0 ? scratch->segments : arr->segments;
+    memset(offsets, 0, sizeof(offsets));
+    for (uint16_t i = 0; i < arr->len; i++) {
+      offsets[(src[i] >> shift) & 0xFF]++;
+    }
+    uint16_t sum = 0;
+    for (uint16_t bucket = 0; bucket < 256; bucket++) {
+      uint16_t count = offsets[bucket];
+      offsets[bucket] = sum;
+      sum += count;
+    }
+    for (uint16_t i = 0; i < arr->len; i++) {
+      dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+    }
+  }
+  return SL_HTM_STATUS_OK;
+}
+
+void sl_htm_tm_score_matching_segments(sl_htm_tm_state_t* state, const uint16_t* segment_num_active_potential)
+{
+  sl_htm_tm_segment_array_t* matching = &state->matching_segments;
+  // The matching segments may have outgrown the scores. Storage carved from a buffer cannot follow, so the segments without a score are left out.
+  if (state->matching_scores_capacity < matching->len) {
+    if (!matching->fixed_capacity && sl_htm_tm_reserve_matching_scores(state, NULL, matching->capacity) == SL_HTM_STATUS_OK) {
+      matching->num_growths++;
+    } else {
+      matching->num_dropped += matching->len - state->matching_scores_capacity;
+      matching->len = state->matching_scores_capacity;
+    }
+  }
+  for (uint16_t i = 0; i < matching->len; i++) {
+    state->matching_scores[i] = segment_num_active_potential[matching->segments[i]];
+  }
+}
 
-  current->cells = temp;
+void sl_htm_tm_swap_and_clear_cell_array(sl_htm_tm_cell_array_t* prev, sl_htm_tm_cell_array_t* current)
+{
+  // Swap the arrays, including their capacity, so no memory is copied
+  sl_htm_tm_cell_array_t temp = *prev;
+  *prev = *current;
+  *current = temp;
   // Clear the current array
   current->len = 0;
 }
 
 void sl_htm_tm_swap_and_clear_segment_array(sl_htm_tm_segment_array_t* prev, sl_htm_tm_segment_array_t* current)
 {
-  // Swap the arrays inside the struct
-  sl_htm_tm_segment_t** temp = prev->segments;
-
-  prev->segments = current->segments;
-  prev->len = current->len;
-  current->segments = temp;
+  // Swap the arrays, including their capacity, so no memory is copied
+  sl_htm_tm_segment_array_t temp = *prev;
+  *prev = *current;
+  *current = temp;
   // Clear the current array
   current->len = 0;
 }
 void sl_htm_tm_swap_and_clear_states(sl_htm_tm_state_t* state_prev, sl_htm_tm_state_t* state_current)
 {
+  // The previous bitset becomes the current one, so clear the bits of the cells that were active in it.
+  // This only touches the active cells instead of the whole bitset.
+  if (state_prev->active_cells_bitset != NULL) {
+    for (uint16_t i = 0; i < state_prev->active_cells.len; i++) {
+      sl_htm_tm_index_t index = state_prev->active_cells.cells[i];
+      state_prev->active_cells_bitset[index >> SL_HTM_SDR_WORD_SHIFT] &= ~((sl_htm_sdr_word_t)1 << (index & SL_HTM_SDR_WORD_MASK));
+    }
+  }
+  sl_htm_sdr_word_t* bitset = state_prev->active_cells_bitset;
+  state_prev->active_cells_bitset = state_current->active_cells_bitset;
+  state_current->active_cells_bitset = bitset;
+
   sl_htm_tm_swap_and_clear_cell_array(&state_prev->active_cells, &state_current->active_cells);
   sl_htm_tm_swap_and_clear_cell_array(&state_prev->winner_cells, &state_current->winner_cells);
   sl_htm_tm_swap_and_clear_segment_array(&state_prev->active_segments, &state_current->active_segments);
   sl_htm_tm_swap_and_clear_segment_array(&state_prev->matching_segments, &state_current->matching_segments);
+  uint16_t* scores = state_prev->matching_scores;
+  uint16_t scores_capacity = state_prev->matching_scores_capacity;
+  state_prev->matching_scores = state_current->matching_scores;
+  state_prev->matching_scores_capacity = state_current->matching_scores_capacity;
+  state_current->matching_scores = scores;
+  state_current->matching_scores_capacity = scores_capacity;
 
   state_prev->num_predictive_and_active_columns = state_current->num_predictive_and_active_columns;
   state_current->num_predictive_and_active_columns = 0;
@@ -114,10 +414,28 @@ void sl_htm_tm_swap_and_clear_states(sl_htm_tm_state_t* state_prev, sl_htm_tm_st
 size_t sl_htm_tm_state_memory_size(sl_htm_tm_state_t* state)
 {
   size_t size = 0;
-  size += sizeof(sl_htm_tm_cell_t*) * state->active_cells.len;
-  size += sizeof(sl_htm_tm_cell_t*) * state->winner_cells.len;
-  size += sizeof(sl_htm_tm_segment_t*) * state->active_segments.len;
-  size += sizeof(sl_htm_tm_segment_t*) * state->matching_segments.len;
+  size += sizeof(sl_htm_tm_index_t) * state->active_cells.capacity;
+  size += sizeof(sl_htm_tm_index_t) * state->winner_cells.capacity;
+  size += sizeof(sl_htm_tm_index_t) * state->active_segments.capacity;
+  size += sizeof(sl_htm_tm_index_t) * state->matching_segments.capacity;
+  size += sizeof(uint16_t) * state->matching_scores_capacity;
+  if (state->active_cells_bitset != NULL) {
+    size += sizeof(sl_htm_sdr_word_t) * SL_HTM_SDR_NUM_WORDS(state->num_cells);
+  }
 
   return size;
 }
+uint32_t sl_htm_tm_state_num_growths(sl_htm_tm_state_t* state)
+{
+  return state->active_cells.num_growths
+         + state->winner_cells.num_growths
+         + state->active_segments.num_growths
+         + state->matching_segments.num_growths;
+}
+uint32_t sl_htm_tm_state_num_dropped(sl_htm_tm_state_t* state)
+{
+  return state->active_cells.num_dropped
+         + state->winner_cells.num_dropped
+         + state->active_segments.num_dropped
+         + state->matching_segments.num_dropped;
+}
@@ -15,6 +15,15 @@
  *
  ******************************************************************************/
 #include "sl_htm_utils.h"
+void sl_htm_random_seed(sl_htm_random_t* random, uint32_t seed)
+{
+  // Mix the seed so that nearby seeds give unrelated sequences, and keep the state away from zero, which xorshift never leaves
+  uint32_t x = seed + 0x9E3779B9u;
+  x = (x ^ (x >> 16)) * 0x85EBCA6Bu;
+  x = (x ^ (x >> 13)) * 0xC2B2AE35u;
+  x ^= x >> 16;
+  random->state = x != 0 ? x : 0x6D2B79F5u;
+}
 uint8_t sl_htm_utils_clamp_uint8(uint8_t d, uint8_t min, uint8_t max)
 {
   const uint8_t t = d < min ? min : d;
@@ -24,6 +33,18 @@ int sl_htm_utils_floorf(float x)
 {
   return (int) x - (x < (int) x);
 }
+float sl_htm_utils_log2f(float x)
+{
+  union {
+    float f;
+    uint32_t i;
+  } bits = { x };
+  // x = 2^exponent * m with m in [1, 2), and log2(m) is fitted with a parabola
+  int exponent = (int)((bits.i >> 23) & 0xFF) - 127;
+  bits.i = (bits.i & 0x007FFFFFu) | 0x3F800000u;
+  float m = bits.f;
+  return (float)exponent + (-0.34484843f * m + 2.02466578f) * m - 1.67487759f;
+}
 uint16_t sl_htm_utils_xy_to_index(uint8_t x, uint8_t y, uint8_t width, uint8_t height)
 {
   return x + y * width;
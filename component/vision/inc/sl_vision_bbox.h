@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include "sl_slist.h"
+#include "sl_status.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -43,16 +44,18 @@ size_t sl_vision_bbox_non_max_suppression(sl_vision_bbox_t bboxes[], size_t max_
  *
  * @param img The input image
  * @param bb The bounding box to blur
+ * @return SL_STATUS_NOT_SUPPORTED if the image format is unknown
  */
-void sl_vision_bbox_blur(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t kernel_size);
+sl_status_t sl_vision_bbox_blur(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t kernel_size);
 /**
  * @brief Pixelize a bounding box
  *
  * @param img The input image
  * @param bb The bounding box to pixelize
  * @param pixel_size The pixel size
+ * @return SL_STATUS_NOT_SUPPORTED if the image format is unknown
  */
-void sl_vision_bbox_pixelize(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t pixel_size);
+sl_status_t sl_vision_bbox_pixelize(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t pixel_size);
 /**
  * @brief Export bounding boxes over serial
  *
@@ -1,7 +1,9 @@
 #ifndef SL_VISION_IMAGE_H
 #define SL_VISION_IMAGE_H
 #include <stdio.h>
+#include <stdint.h>
 #include "sl_slist.h"
+#include "sl_status.h"
 #include <string.h>
 #ifndef UNIT_TEST
 #include "sl_iostream_handles.h"
@@ -49,11 +51,34 @@ size_t sl_vision_image_bytesize(const sl_vision_image_t *img);
  *
  * @param src_img The source image
  * @param dst_img The destination image
+ * @return SL_STATUS_INVALID_PARAMETER if the destination is larger than the source or differs in format or depth,
+ * SL_STATUS_NOT_SUPPORTED if the image format is unknown
  */
-void sl_vision_image_crop_center(const sl_vision_image_t* src_img, const sl_vision_image_t* dst_img);
+sl_status_t sl_vision_image_crop_center(const sl_vision_image_t* src_img, const sl_vision_image_t* dst_img);
 
-void sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format);
-void sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format);
+/**
+ * @brief Allocate an image and fill it with random pixel values.
+ *
+ * @param out The output image struct, all the fields will be allocated and properly set
+ * @param width
+ * @param height
+ * @param depth
+ * @param format
+ * @param seed Seed of the random number generator, the same seed always gives the same image
+ * @return SL_STATUS_ALLOCATION_FAILED if the pixels could not be allocated, SL_STATUS_NOT_SUPPORTED if the image format is unknown
+ */
+sl_status_t sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format, uint32_t seed);
+/**
+ * @brief Allocate an image with all pixel values set to 0.
+ *
+ * @param out The output image struct, all the fields will be allocated and properly set
+ * @param width
+ * @param height
+ * @param depth
+ * @param format
+ * @return SL_STATUS_ALLOCATION_FAILED if the pixels could not be allocated, SL_STATUS_NOT_SUPPORTED if the image format is unknown
+ */
+sl_status_t sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format);
 /**
  * @brief Finds connected pixels and outputs a label image containing that information.
  *
@@ -62,7 +87,7 @@ void sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t
  * @param threshold The threshold to turn floats into 1s and 0s
  * @param working_memory The working memory for the algorithm
  * @param working_memory_len The size of the working memory for the algorithm
- * @return uint8_t Number of unique blobs of connected pixels
+ * @return uint8_t Number of unique blobs of connected pixels, 0 if the image format is unknown
  */
 uint8_t sl_vision_image_connected_pixels(const sl_vision_image_t *dst_label_img, const sl_vision_image_t *src_img, float threshold);
 #ifndef UNIT_TEST
@@ -73,7 +98,13 @@ __INLINE void sl_vision_image_export(const sl_vision_image_t *img, const char *t
   printf("\n");
 }
 #endif
-void sl_vision_image_print(const sl_vision_image_t *img);
+/**
+ * @brief Print the first channel of an image as comma separated values, one row per line.
+ *
+ * @param img
+ * @return SL_STATUS_NOT_SUPPORTED if the image format is unknown
+ */
+sl_status_t sl_vision_image_print(const sl_vision_image_t *img);
 #ifdef __cplusplus
 }
 #endif
@@ -156,29 +156,37 @@ uint8_t generic_sl_vision_image_connected_pixels(const sl_vision_image_t *dst_la
  * @param width
  * @param height
  * @param depth
+ * @param seed Seed of the random number generator, the same seed always gives the same image
  */
 template<typename T>
-void generic_sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth)
+sl_status_t generic_sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth, uint32_t seed)
 {
   out->width = width;
   out->height = height;
   out->depth = depth;
   out->data.raw = malloc(width * height * depth * sizeof(T));
+  if (out->data.raw == NULL) {
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
 
-  std::mt19937 rng;
-  rng.seed(std::random_device()());
+  // A small generator seeded by the caller, instead of a Mersenne Twister seeded from the system on every call
+  std::minstd_rand rng(seed);
   std::uniform_real_distribution<float> dist(0, 255);
   for (size_t i = 0; i < width * height * depth; i++) {
     ((T *)out->data.raw)[i] = (T)dist(rng);
   }
+  return SL_STATUS_OK;
 }
 template<typename T>
-void generic_sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth)
+sl_status_t generic_sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth)
 {
   out->width = width;
   out->height = height;
   out->depth = depth;
-  out->data.raw = malloc(width * height * depth * sizeof(T));
-  memset(out->data.raw, 0, width * height * depth * sizeof(T));
+  out->data.raw = calloc(width * height * depth, sizeof(T));
+  if (out->data.raw == NULL) {
+    return SL_STATUS_ALLOCATION_FAILED;
+  }
+  return SL_STATUS_OK;
 }
 #endif // SL_VISION_IMAGE_HPP
@@ -57,33 +57,31 @@ size_t sl_vision_bbox_non_max_suppression(sl_vision_bbox_t bboxes[], size_t max_
   return num_kept_bboxes;
 }
 
-void sl_vision_bbox_blur(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t kernel_size)
+sl_status_t sl_vision_bbox_blur(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t kernel_size)
 {
   switch (img->format) {
     case IMAGEFORMAT_UINT8:
       generic_sl_vision_bbox_blur<uint8_t>(img, bb, kernel_size);
-      break;
+      return SL_STATUS_OK;
     case IMAGEFORMAT_FLOAT:
       generic_sl_vision_bbox_blur<float>(img, bb, kernel_size);
-      break;
+      return SL_STATUS_OK;
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return SL_STATUS_NOT_SUPPORTED;
   }
 }
 
-void sl_vision_bbox_pixelize(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t pixel_size)
+sl_status_t sl_vision_bbox_pixelize(const sl_vision_image_t* img, const sl_vision_bbox_t* bb, size_t pixel_size)
 {
   switch (img->format) {
     case IMAGEFORMAT_UINT8:
       generic_sl_vision_bbox_pixelize<uint8_t>(img, bb, pixel_size);
-      break;
+      return SL_STATUS_OK;
     case IMAGEFORMAT_FLOAT:
       generic_sl_vision_bbox_pixelize<float>(img, bb, pixel_size);
-      break;
+      return SL_STATUS_OK;
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return SL_STATUS_NOT_SUPPORTED;
   }
 }
 
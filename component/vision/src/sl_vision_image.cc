@@ -19,49 +19,45 @@ uint8_t sl_vision_image_format_bytesize(sl_vision_image_format_t format)
   }
   return 0;
 }
-void sl_vision_image_crop_center(const sl_vision_image_t* src_img, const sl_vision_image_t* dst_img)
+sl_status_t sl_vision_image_crop_center(const sl_vision_image_t* src_img, const sl_vision_image_t* dst_img)
 {
+  if (dst_img->format != src_img->format || dst_img->width > src_img->width || dst_img->height > src_img->height || dst_img->depth != src_img->depth) {
+    return SL_STATUS_INVALID_PARAMETER;
+  }
   switch (src_img->format) {
     case IMAGEFORMAT_UINT8:
       generic_sl_vision_image_crop_center<uint8_t>(src_img, dst_img);
-      break;
+      return SL_STATUS_OK;
     case IMAGEFORMAT_FLOAT:
       generic_sl_vision_image_crop_center<float>(src_img, dst_img);
-      break;
+      return SL_STATUS_OK;
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return SL_STATUS_NOT_SUPPORTED;
   }
 }
-void sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format)
+sl_status_t sl_vision_image_generate_random(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format, uint32_t seed)
 {
+  out->format = format;
   switch (format) {
     case IMAGEFORMAT_FLOAT:
-      generic_sl_vision_image_generate_random<float>(out, width, height, depth);
-      break;
+      return generic_sl_vision_image_generate_random<float>(out, width, height, depth, seed);
     case IMAGEFORMAT_UINT8:
-      generic_sl_vision_image_generate_random<uint8_t>(out, width, height, depth);
-      break;
+      return generic_sl_vision_image_generate_random<uint8_t>(out, width, height, depth, seed);
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return SL_STATUS_NOT_SUPPORTED;
   }
-  out->format = format;
 }
-void sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format)
+sl_status_t sl_vision_image_generate_empty(sl_vision_image_t* out, size_t width, size_t height, size_t depth, sl_vision_image_format_t format)
 {
+  out->format = format;
   switch (format) {
     case IMAGEFORMAT_FLOAT:
-      generic_sl_vision_image_generate_empty<float>(out, width, height, depth);
-      break;
+      return generic_sl_vision_image_generate_empty<float>(out, width, height, depth);
     case IMAGEFORMAT_UINT8:
-      generic_sl_vision_image_generate_empty<uint8_t>(out, width, height, depth);
-      break;
+      return generic_sl_vision_image_generate_empty<uint8_t>(out, width, height, depth);
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return SL_STATUS_NOT_SUPPORTED;
   }
-  out->format = format;
 }
 
 uint8_t sl_vision_image_connected_pixels(const sl_vision_image_t *dst_label_img, const sl_vision_image_t *src_img, float threshold)
@@ -72,13 +68,14 @@ uint8_t sl_vision_image_connected_pixels(const sl_vision_image_t *dst_label_img,
     case IMAGEFORMAT_UINT8:
       return generic_sl_vision_image_connected_pixels<uint8_t>(dst_label_img, src_img, threshold);
     default:
-      printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-      exit(1);
+      return 0;
   }
-  return 0;
 }
-void sl_vision_image_print(const sl_vision_image_t *img)
+sl_status_t sl_vision_image_print(const sl_vision_image_t *img)
 {
+  if (img->format != IMAGEFORMAT_UINT8 && img->format != IMAGEFORMAT_FLOAT) {
+    return SL_STATUS_NOT_SUPPORTED;
+  }
   for (size_t y = 0; y < img->height; y++) {
     for (size_t x = 0; x < img->width; x++) {
       switch (img->format) {
@@ -88,11 +85,9 @@ void sl_vision_image_print(const sl_vision_image_t *img)
         case IMAGEFORMAT_FLOAT:
           printf("%f,", generic_sl_vision_image_pixel_get_value<float>(img, x, y, 0));
           break;
-        default:
-          printf("Unsupported image format in file %s:%d!\n", __FILE__, __LINE__);
-          exit(1);
       }
     }
     printf("\n");
   }
+  return SL_STATUS_OK;
 }
@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+#include "sl_htm.h"
+#include "sl_htm_anomaly.h"
+
+TEST(AnomalyTest, InvalidParameters){
+  sl_htm_anomaly_likelihood_t likelihood;
+  sl_htm_anomaly_likelihood_init_default_params(&likelihood.parameters);
+  EXPECT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_OK);
+  likelihood.parameters.averaging_window = SL_HTM_ANOMALY_MAX_AVERAGING_WINDOW + 1;
+  EXPECT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_INVALID_PARAMETER);
+  likelihood.parameters.averaging_window = 0;
+  EXPECT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_INVALID_PARAMETER);
+  likelihood.parameters.averaging_window = 1;
+  likelihood.parameters.window = 0;
+  EXPECT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_INVALID_PARAMETER);
+}
+
+TEST(AnomalyTest, Likelihood){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_anomaly_likelihood_t likelihood;
+  sl_htm_anomaly_likelihood_init_default_params(&likelihood.parameters);
+  likelihood.parameters.averaging_window = 5;
+  likelihood.parameters.window = 200;
+  likelihood.parameters.learning_period = 100;
+  ASSERT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_OK);
+
+  // Noisy low scores: the likelihood is 0.5 while learning, and stays away from 1 after
+  float max_likelihood = 0.0f;
+  for (uint16_t i = 0; i < 400; i++) {
+    float score = 0.1f + 0.1f * (float)sl_htm_random_below(&random, 100) / 100.0f;
+    float value = sl_htm_anomaly_likelihood_update(&likelihood, score);
+    if (i < 100) {
+      EXPECT_EQ(value, 0.5f);
+    } else if (value > max_likelihood) {
+      max_likelihood = value;
+    }
+    EXPECT_GE(value, 0.0f);
+    EXPECT_LE(value, 1.0f);
+  }
+  EXPECT_LT(max_likelihood, 0.999f);
+  // The long-term statistics follow the scores
+  EXPECT_NEAR((float)likelihood.mean / SL_HTM_ANOMALY_ONE, 0.15f, 0.01f);
+
+  // A burst of high scores is very unlikely under those statistics
+  float value = 0.0f;
+  for (uint16_t i = 0; i < 3; i++) {
+    value = sl_htm_anomaly_likelihood_update(&likelihood, 1.0f);
+  }
+  EXPECT_GT(value, 0.9999f);
+  EXPECT_EQ(sl_htm_anomaly_likelihood_get(&likelihood), value);
+
+  // Scores below the mean give a likelihood below 0.5
+  for (uint16_t i = 0; i < 5; i++) {
+    value = sl_htm_anomaly_likelihood_update(&likelihood, 0.0f);
+  }
+  EXPECT_LT(value, 0.5f);
+  // NaN and out-of-range scores are clamped
+  value = sl_htm_anomaly_likelihood_update(&likelihood, 0.0f / 0.0f);
+  EXPECT_GE(value, 0.0f);
+  EXPECT_LE(value, 1.0f);
+  value = sl_htm_anomaly_likelihood_update(&likelihood, 5.0f);
+  EXPECT_LE(value, 1.0f);
+}
+
+TEST(AnomalyTest, SteadyScore){
+  // A score that never changes has no variance, the floor of the standard deviation keeps the likelihood at 0.5
+  sl_htm_anomaly_likelihood_t likelihood;
+  sl_htm_anomaly_likelihood_init_default_params(&likelihood.parameters);
+  ASSERT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_OK);
+  float value = 0.0f;
+  for (uint16_t i = 0; i < 600; i++) {
+    value = sl_htm_anomaly_likelihood_update(&likelihood, 0.25f);
+  }
+  EXPECT_EQ(value, 0.5f);
+}
+
+TEST(AnomalyTest, ModelStage){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_model_init(&model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+
+  sl_htm_anomaly_likelihood_t likelihood;
+  sl_htm_anomaly_likelihood_init_default_params(&likelihood.parameters);
+  likelihood.parameters.learning_period = 50;
+  ASSERT_EQ(sl_htm_anomaly_likelihood_init(&likelihood), SL_HTM_STATUS_OK);
+  sl_htm_model_set_anomaly_likelihood(&model, &likelihood);
+
+  // Learn a repeating sequence
+  sl_htm_sdr_t inputs[4];
+  for (uint16_t i = 0; i < 4; i++) {
+    sl_htm_sdr_init(&inputs[i], 30, 30);
+    sl_htm_sdr_randomize(&inputs[i], 0.2f, &random);
+  }
+  float score = 1.0f;
+  for (uint16_t i = 0; i < 400; i++) {
+    score = sl_htm_model_execute(&model, &inputs[i % 4], true);
+  }
+  // The stage saw every step, and execute still returns the raw score
+  EXPECT_EQ(likelihood.num_steps, 400u);
+  EXPECT_LT(score, 0.5f);
+  float learned_likelihood = sl_htm_anomaly_likelihood_get(&likelihood);
+  EXPECT_LT(learned_likelihood, 0.9f);
+
+  // Inputs the model has never seen raise the likelihood
+  sl_htm_sdr_t novel;
+  sl_htm_sdr_init(&novel, 30, 30);
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_sdr_randomize(&novel, 0.2f, &random);
+    sl_htm_model_execute(&model, &novel, false);
+  }
+  EXPECT_GT(sl_htm_anomaly_likelihood_get(&likelihood), learned_likelihood);
+
+  // Without the stage, the likelihood is left alone
+  sl_htm_model_set_anomaly_likelihood(&model, NULL);
+  sl_htm_model_execute(&model, &inputs[0], false);
+  EXPECT_EQ(likelihood.num_steps, 403u);
+}
+
+TEST(AnomalyTest, NoActiveColumns){
+  // An empty SP output used to give a score of 0 / 0
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_model_init(&model, 20, 20, 10, 10, sp_params, tm_params), SL_HTM_STATUS_OK);
+  sl_htm_sdr_t empty;
+  sl_htm_sdr_init(&empty, 10, 10);
+  EXPECT_EQ(sl_htm_tm_execute(&model.tm, &empty, true), 0.0f);
+}
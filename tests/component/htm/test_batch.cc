@@ -0,0 +1,98 @@
+#include "gtest/gtest.h"
+#include "sl_htm_batch.h"
+
+TEST(BatchTest, Execute){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+
+  const uint16_t num_models = 8;
+  sl_htm_batch_t batch;
+  sl_htm_batch_init(&batch, num_models, 30, 30, 15, 15, sp_params, tm_params, 4);
+  EXPECT_EQ(batch.num_workers, SL_HTM_BATCH_THREADS ? 3 : 0);
+  // Every model starts on its own cache line
+  for (uint16_t i = 0; i < num_models; i++) {
+    EXPECT_EQ((uintptr_t)sl_htm_batch_get_model(&batch, i) % 64, 0u);
+  }
+
+  sl_htm_sdr_t input_sdrs[num_models];
+  for (uint16_t i = 0; i < num_models; i++) {
+    sl_htm_sdr_init(&input_sdrs[i], 30, 30);
+    sl_htm_sdr_randomize(&input_sdrs[i], 0.2f, &random);
+  }
+  float anomaly_scores[num_models];
+
+  // The first step is never predicted
+  sl_htm_batch_execute(&batch, input_sdrs, true, anomaly_scores);
+  for (uint16_t i = 0; i < num_models; i++) {
+    EXPECT_EQ(anomaly_scores[i], 1.0f);
+  }
+  // Every model learns its own repeating input
+  for (uint16_t step = 0; step < 100; step++) {
+    sl_htm_batch_execute(&batch, input_sdrs, true, anomaly_scores);
+  }
+  for (uint16_t i = 0; i < num_models; i++) {
+    EXPECT_LT(anomaly_scores[i], 0.1f);
+  }
+  sl_htm_batch_deinit(&batch);
+  EXPECT_EQ(batch.num_workers, 0);
+  EXPECT_EQ(batch.memory, nullptr);
+
+  // Without worker threads the batch runs on the calling thread
+  ASSERT_EQ(sl_htm_batch_init(&batch, num_models, 30, 30, 15, 15, sp_params, tm_params, 1), SL_HTM_STATUS_OK);
+  EXPECT_EQ(batch.num_workers, 0);
+  for (uint16_t step = 0; step < 100; step++) {
+    sl_htm_batch_execute(&batch, input_sdrs, true, anomaly_scores);
+  }
+  for (uint16_t i = 0; i < num_models; i++) {
+    EXPECT_LT(anomaly_scores[i], 0.1f);
+  }
+  sl_htm_batch_deinit(&batch);
+  for (uint16_t i = 0; i < num_models; i++) {
+    sl_htm_sdr_deinit(&input_sdrs[i]);
+  }
+}
+
+TEST(BatchTest, InitFailure){
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  // A model that cannot be initialized leaves nothing allocated
+  sl_htm_batch_t batch;
+  EXPECT_NE(sl_htm_batch_init(&batch, 4, 30, 30, 0, 15, sp_params, tm_params, 2), SL_HTM_STATUS_OK);
+  EXPECT_EQ(batch.memory, nullptr);
+  EXPECT_EQ(batch.slots, nullptr);
+  EXPECT_EQ(batch.num_models, 0);
+  sl_htm_batch_deinit(&batch);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+
+  // Count the allocations of one model, then run out of heap halfway through the third model of a batch
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_model_init(&model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+  size_t model_allocations = sl_htm_memory_num_heap_allocations() - num_allocations;
+  sl_htm_model_deinit(&model);
+  sl_htm_memory_fail_heap_after(1 + 2 * model_allocations + model_allocations / 2);
+  EXPECT_EQ(sl_htm_batch_init(&batch, 4, 30, 30, 15, 15, sp_params, tm_params, 1), SL_HTM_STATUS_ALLOCATION_FAILED);
+  sl_htm_memory_fail_heap_after(SIZE_MAX);
+  EXPECT_EQ(batch.memory, nullptr);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+}
+
+TEST(BatchTest, Deinit){
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  // The models, their slots and the thread pool are all freed
+  sl_htm_batch_t batch;
+  ASSERT_EQ(sl_htm_batch_init(&batch, 4, 30, 30, 15, 15, sp_params, tm_params, 2), SL_HTM_STATUS_OK);
+  EXPECT_GT(sl_htm_memory_num_heap_allocations(), num_allocations);
+  sl_htm_batch_deinit(&batch);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+}
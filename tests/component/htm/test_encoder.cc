@@ -8,7 +8,7 @@ TEST(EncoderTest, SimpleNumber) {
 
   // Assert that the first 7 bits are set.
   for (int i = 0; i < 7; i++) {
-    EXPECT_EQ(1, sdr.bits[i]);
+    EXPECT_EQ(1, sl_htm_sdr_get_bit(&sdr, i));
   }
   sl_htm_sdr_t sdr2;
   sl_htm_sdr_init(&sdr2, 10, 10);
@@ -16,3 +16,229 @@ TEST(EncoderTest, SimpleNumber) {
 
   sl_htm_sdr_print(&sdr2);
 }
+
+// Index of the first active bit of the SDR, or -1 if it is empty
+static int first_active_bit(sl_htm_sdr_t* sdr)
+{
+  for (int i = 0; i < sdr->width * sdr->height; i++) {
+    if (sl_htm_sdr_get_bit(sdr, i)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+TEST(EncoderTest, Scalar) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 10, 10);
+  sl_htm_encoder_t encoder;
+  EXPECT_EQ(sl_htm_encoder_scalar_init(&encoder, 1.0f, 1.0f, 100, 10), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sl_htm_encoder_scalar_init(&encoder, 0.0f, 1.0f, 100, 101), SL_HTM_STATUS_INVALID_PARAMETER);
+  ASSERT_EQ(sl_htm_encoder_scalar_init(&encoder, 0.0f, 10.0f, 100, 10), SL_HTM_STATUS_OK);
+
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, 0.0f, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sdr.num_active_bits, 10);
+  EXPECT_EQ(first_active_bit(&sdr), 0);
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, 5.0f, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(first_active_bit(&sdr), 45);
+  // Values outside of the range are clamped to the first or last bucket
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, -100.0f, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(first_active_bit(&sdr), 0);
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, 1e30f, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(first_active_bit(&sdr), 90);
+  EXPECT_EQ(sdr.num_active_bits, 10);
+  // NaN is rejected
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, 0.0f / 0.0f, &sdr), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sdr.num_active_bits, 0);
+  // Matches the simple number encoder inside of the range
+  sl_htm_sdr_t simple;
+  sl_htm_sdr_init(&simple, 10, 10);
+  for (float value = 0.0f; value < 10.0f; value += 0.37f) {
+    sl_htm_encoder_encode(&encoder, value, &sdr);
+    sl_htm_encoder_simple_number(value, 0.0f, 10.0f, 10, &simple);
+    EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &simple), 10);
+  }
+}
+
+TEST(EncoderTest, Cyclic) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 10, 4);
+  sl_htm_encoder_t encoder;
+  ASSERT_EQ(sl_htm_encoder_cyclic_init(&encoder, 0.0f, 360.0f, 40, 5), SL_HTM_STATUS_OK);
+  sl_htm_encoder_encode(&encoder, 90.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 10);
+  // One period further encodes the same
+  sl_htm_sdr_t other;
+  sl_htm_sdr_init(&other, 10, 4);
+  sl_htm_encoder_encode(&encoder, 450.0f, &other);
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &other), 5);
+  sl_htm_encoder_encode(&encoder, -270.0f, &other);
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &other), 5);
+  // Close to the end of the period, the run wraps around to the start of the field
+  sl_htm_encoder_encode(&encoder, 351.0f, &sdr);
+  EXPECT_EQ(sdr.num_active_bits, 5);
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 39));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 0));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 3));
+  EXPECT_FALSE(sl_htm_sdr_get_bit(&sdr, 4));
+  // So values on both sides of the wrap overlap
+  sl_htm_encoder_encode(&encoder, 1.0f, &other);
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &other), 4);
+}
+
+TEST(EncoderTest, Delta) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 21, 1);
+  sl_htm_encoder_t encoder;
+  ASSERT_EQ(sl_htm_encoder_delta_init(&encoder, 10.0f, 21, 1), SL_HTM_STATUS_OK);
+  // The first value has no change, which is the middle of the field
+  sl_htm_encoder_encode(&encoder, 100.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 10);
+  sl_htm_encoder_encode(&encoder, 105.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 15);
+  sl_htm_encoder_encode(&encoder, 105.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 10);
+  // Changes past max_delta are clamped
+  sl_htm_encoder_encode(&encoder, 0.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 0);
+}
+
+TEST(EncoderTest, Log) {
+  EXPECT_NEAR(sl_htm_utils_log2f(1.0f), 0.0f, 0.01f);
+  EXPECT_NEAR(sl_htm_utils_log2f(3.0f), 1.585f, 0.01f);
+  EXPECT_NEAR(sl_htm_utils_log2f(0.001f), -9.966f, 0.01f);
+  EXPECT_NEAR(sl_htm_utils_log2f(1e6f), 19.93f, 0.01f);
+
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 41, 1);
+  sl_htm_encoder_t encoder;
+  EXPECT_EQ(sl_htm_encoder_log_init(&encoder, 0.0f, 1000.0f, 41, 1), SL_HTM_STATUS_INVALID_PARAMETER);
+  ASSERT_EQ(sl_htm_encoder_log_init(&encoder, 1.0f, 1024.0f, 41, 1), SL_HTM_STATUS_OK);
+  // Every doubling moves the bit by the same amount
+  sl_htm_encoder_encode(&encoder, 2.0f, &sdr);
+  int bit_2 = first_active_bit(&sdr);
+  sl_htm_encoder_encode(&encoder, 4.0f, &sdr);
+  int bit_4 = first_active_bit(&sdr);
+  sl_htm_encoder_encode(&encoder, 8.0f, &sdr);
+  int bit_8 = first_active_bit(&sdr);
+  EXPECT_EQ(bit_4 - bit_2, 4);
+  EXPECT_EQ(bit_8 - bit_4, 4);
+  // Values at or below zero clamp to the bottom
+  sl_htm_encoder_encode(&encoder, -5.0f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 0);
+  sl_htm_encoder_encode(&encoder, 1e9f, &sdr);
+  EXPECT_EQ(first_active_bit(&sdr), 40);
+}
+
+TEST(EncoderTest, RDSE) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_t other;
+  sl_htm_sdr_init(&sdr, 50, 20);
+  sl_htm_sdr_init(&other, 50, 20);
+  sl_htm_encoder_t encoder;
+  EXPECT_EQ(sl_htm_encoder_rdse_init(&encoder, 0.0f, 1000, 20, 1), SL_HTM_STATUS_INVALID_PARAMETER);
+  ASSERT_EQ(sl_htm_encoder_rdse_init(&encoder, 1.0f, 1000, 20, 1), SL_HTM_STATUS_OK);
+  // The same bucket gives the same bits
+  sl_htm_encoder_encode(&encoder, 10.2f, &sdr);
+  sl_htm_encoder_encode(&encoder, 10.8f, &other);
+  EXPECT_GE(sdr.num_active_bits, 18);
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &other), sdr.num_active_bits);
+  // Neighboring buckets share all but one bit, far away buckets share almost none
+  sl_htm_encoder_encode(&encoder, 11.0f, &other);
+  EXPECT_GE(sl_htm_sdr_overlap(&sdr, &other), 17);
+  sl_htm_encoder_encode(&encoder, 100.0f, &other);
+  EXPECT_LE(sl_htm_sdr_overlap(&sdr, &other), 3);
+  // The range is unbounded
+  EXPECT_EQ(sl_htm_encoder_encode(&encoder, -1e20f, &other), SL_HTM_STATUS_OK);
+  EXPECT_GE(other.num_active_bits, 18);
+}
+
+TEST(EncoderTest, Fields) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 30, 3);
+  sl_htm_encoder_t encoders[3];
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_encoder_scalar_init(&encoders[i], -1.0f, 1.0f, 30, 3);
+  }
+  float values[3] = { -1.0f, 0.0f, 1.0f };
+  EXPECT_EQ(sl_htm_encoder_encode_fields(encoders, values, 3, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sdr.num_active_bits, 9);
+  // Field i starts at row i
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 0));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 30 + 14));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 60 + 27));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, 60 + 29));
+  // The fields do not fit in a smaller SDR
+  sl_htm_sdr_t small;
+  sl_htm_sdr_init(&small, 30, 2);
+  EXPECT_EQ(sl_htm_encoder_encode_fields(encoders, values, 3, &small), SL_HTM_STATUS_OUT_OF_BOUNDS);
+}
+
+TEST(EncoderTest, Composite) {
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 20, 10);
+  sl_htm_encoder_t encoders[3];
+  // Two scalar channels side by side in the top half, a cyclic channel in the bottom half
+  sl_htm_encoder_scalar_init(&encoders[0], 0.0f, 1.0f, 50, 6);
+  sl_htm_encoder_scalar_init(&encoders[1], 0.0f, 1.0f, 50, 6);
+  sl_htm_encoder_cyclic_init(&encoders[2], 0.0f, 24.0f, 100, 8);
+  const sl_htm_encoder_region_t regions[3] = { { 0, 0, 10 }, { 10, 0, 10 }, { 0, 5, 20 } };
+  sl_htm_encoder_composite_t composite;
+  ASSERT_EQ(sl_htm_encoder_composite_init(&composite, encoders, regions, 3, 20, 10), SL_HTM_STATUS_OK);
+
+  float values[3] = { 0.0f, 0.5f, 23.5f };
+  EXPECT_EQ(sl_htm_encoder_composite_encode(&composite, values, &sdr), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sdr.num_active_bits, 20);
+  // Channel 0 starts at the top left corner
+  for (uint8_t x = 0; x < 6; x++) {
+    EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(x, 0, 20, 10)));
+  }
+  // Channel 1 is at bucket 22 of its field, which wraps from the third to the fourth row of its region
+  for (uint16_t bit = 22; bit < 28; bit++) {
+    EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(10 + bit % 10, bit / 10, 20, 10)));
+  }
+  // Channel 2 wraps around the end of its field to the start of its region
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(19, 9, 20, 10)));
+  EXPECT_TRUE(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(0, 5, 20, 10)));
+  // The rest of the region of channel 0 is clear
+  for (uint8_t x = 0; x < 10; x++) {
+    for (uint8_t y = 0; y < 5; y++) {
+      EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(x, y, 20, 10)), y == 0 && x < 6);
+    }
+  }
+
+  // Regions that do not fit or overlap are rejected
+  const sl_htm_encoder_region_t too_wide[1] = { { 15, 0, 10 } };
+  EXPECT_EQ(sl_htm_encoder_composite_init(&composite, encoders, too_wide, 1, 20, 10), SL_HTM_STATUS_OUT_OF_BOUNDS);
+  const sl_htm_encoder_region_t too_low[1] = { { 0, 6, 10 } };
+  EXPECT_EQ(sl_htm_encoder_composite_init(&composite, encoders, too_low, 1, 20, 10), SL_HTM_STATUS_OUT_OF_BOUNDS);
+  const sl_htm_encoder_region_t overlapping[2] = { { 0, 0, 10 }, { 5, 4, 10 } };
+  EXPECT_EQ(sl_htm_encoder_composite_init(&composite, encoders, overlapping, 2, 20, 10), SL_HTM_STATUS_INVALID_PARAMETER);
+  // The SDR must have the size of the layout
+  sl_htm_encoder_composite_init(&composite, encoders, regions, 3, 20, 10);
+  sl_htm_sdr_t other;
+  sl_htm_sdr_init(&other, 10, 20);
+  EXPECT_EQ(sl_htm_encoder_composite_encode(&composite, values, &other), SL_HTM_STATUS_INVALID_PARAMETER);
+}
+
+TEST(EncoderTest, CompositeMatchesFields) {
+  // Full-width regions stacked on top of each other are the same layout as consecutive fields
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_t fields_sdr;
+  sl_htm_sdr_init(&sdr, 27, 27);
+  sl_htm_sdr_init(&fields_sdr, 27, 27);
+  sl_htm_encoder_t encoders[3];
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_encoder_scalar_init(&encoders[i], -1.0f, 1.0f, 27 * 9, 9);
+  }
+  const sl_htm_encoder_region_t regions[3] = { { 0, 0, 27 }, { 0, 9, 27 }, { 0, 18, 27 } };
+  sl_htm_encoder_composite_t composite;
+  ASSERT_EQ(sl_htm_encoder_composite_init(&composite, encoders, regions, 3, 27, 27), SL_HTM_STATUS_OK);
+  for (float value = -1.2f; value < 1.2f; value += 0.05f) {
+    float values[3] = { value, -value, value * 0.5f };
+    sl_htm_encoder_composite_encode(&composite, values, &sdr);
+    sl_htm_encoder_encode_fields(encoders, values, 3, &fields_sdr);
+    EXPECT_EQ(sdr.num_active_bits, 27);
+    EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &fields_sdr), 27);
+  }
+}
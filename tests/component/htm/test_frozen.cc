@@ -0,0 +1,142 @@
+#include <vector>
+#include "gtest/gtest.h"
+#include "sl_htm.h"
+
+static void init_model(sl_htm_model_t* model, bool local_inhibition)
+{
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sp_params.local_inhibition = local_inhibition;
+  sp_params.boost_strength = 2.0f;
+  sl_htm_model_init(model, 30, 30, 15, 15, sp_params, tm_params);
+}
+
+static void expect_same_as_model(bool local_inhibition)
+{
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_model_t model;
+  init_model(&model, local_inhibition);
+  sl_htm_sdr_t inputs[4];
+  for (uint16_t i = 0; i < 4; i++) {
+    sl_htm_sdr_init(&inputs[i], 30, 30);
+    sl_htm_sdr_randomize(&inputs[i], 0.2f, &random);
+  }
+  for (uint16_t step = 0; step < 80; step++) {
+    sl_htm_model_execute(&model, &inputs[step % 4], true);
+  }
+  sl_htm_model_frozen_t frozen;
+  sl_htm_model_freeze(&model, &frozen);
+
+  sl_htm_sdr_t noisy;
+  sl_htm_sdr_init(&noisy, 30, 30);
+  float min_score = 1.0f;
+  for (uint16_t step = 0; step < 40; step++) {
+    sl_htm_sdr_t* input = &inputs[step % 4];
+    if (step % 7 == 6) {
+      sl_htm_sdr_randomize(&noisy, 0.2f, &random);
+      input = &noisy;
+    }
+    float expected = sl_htm_model_execute(&model, input, false);
+    min_score = expected < min_score ? expected : min_score;
+    EXPECT_EQ(sl_htm_model_frozen_execute(&frozen, input), expected) << "step " << step;
+    EXPECT_EQ(sl_htm_sdr_overlap(&frozen.sp_sdr, &model.sp_sdr), model.sp_sdr.num_active_bits);
+    EXPECT_EQ(frozen.sp_sdr.num_active_bits, model.sp_sdr.num_active_bits);
+  }
+  // Some steps must have been predicted for the comparison to cover the frozen segments
+  EXPECT_LT(min_score, 1.0f);
+}
+
+TEST(FrozenTest, SameAsModel){
+  expect_same_as_model(false);
+}
+
+TEST(FrozenTest, SameAsModelLocalInhibition){
+  expect_same_as_model(true);
+}
+
+TEST(FrozenTest, Tables){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_model_t model;
+  init_model(&model, false);
+  sl_htm_sdr_t inputs[3];
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_sdr_init(&inputs[i], 30, 30);
+    sl_htm_sdr_randomize(&inputs[i], 0.2f, &random);
+  }
+  for (uint16_t step = 0; step < 60; step++) {
+    sl_htm_model_execute(&model, &inputs[step % 3], true);
+  }
+  sl_htm_model_frozen_t frozen;
+  sl_htm_model_freeze(&model, &frozen);
+  // Only connected synapses are kept
+  EXPECT_LT(frozen.sp.num_connected, model.sp.num_connections);
+  EXPECT_LT(frozen.tm.num_segments, model.tm.num_segments);
+  EXPECT_LT(sl_htm_model_frozen_memory_size(&frozen), sl_htm_sp_memory_size(&model.sp) + sl_htm_tm_memory_size(&model.tm));
+
+  // Saved tables are used in place, as they would be from flash
+  size_t size = sl_htm_model_frozen_serialized_size(&frozen);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_frozen_save(&frozen, buffer.data(), size), size);
+  sl_htm_model_frozen_t loaded;
+  ASSERT_TRUE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  EXPECT_EQ((const void*)loaded.tm.segment_cell, (const void*)((const uint8_t*)buffer.data() + ((const uint8_t*)frozen.tm.segment_cell - (const uint8_t*)frozen.tm.tables) + size - frozen.tm.tables_size));
+  for (uint16_t step = 0; step < 6; step++) {
+    float expected = sl_htm_model_frozen_execute(&frozen, &inputs[step % 3]);
+    EXPECT_EQ(sl_htm_model_frozen_execute(&loaded, &inputs[step % 3]), expected);
+  }
+  // A trained model is not a frozen one
+  std::vector<uint64_t> model_buffer(sl_htm_model_serialized_size(&model) / sizeof(uint64_t));
+  sl_htm_model_save(&model, model_buffer.data(), model_buffer.size() * sizeof(uint64_t));
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, model_buffer.data(), model_buffer.size() * sizeof(uint64_t)));
+}
+
+TEST(FrozenTest, Deinit){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  sl_htm_model_t model;
+  init_model(&model, true);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 30, 30);
+  sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
+  for (uint16_t step = 0; step < 20; step++) {
+    sl_htm_model_execute(&model, &input_sdr, true);
+  }
+
+  // Running out of heap at any point of a freeze leaves nothing behind
+  size_t model_allocations = sl_htm_memory_num_heap_allocations();
+  sl_htm_model_frozen_t frozen;
+  size_t num_failures = 0;
+  while (true) {
+    sl_htm_memory_fail_heap_after(num_failures);
+    sl_htm_status_t status = sl_htm_model_freeze(&model, &frozen);
+    sl_htm_memory_fail_heap_after(SIZE_MAX);
+    if (status == SL_HTM_STATUS_OK) {
+      break;
+    }
+    ASSERT_EQ(status, SL_HTM_STATUS_ALLOCATION_FAILED);
+    ASSERT_EQ(sl_htm_memory_num_heap_allocations(), model_allocations);
+    num_failures++;
+  }
+  EXPECT_GT(num_failures, 0u);
+
+  // The trained model can be discarded, the frozen one keeps running on its own tables
+  float expected = sl_htm_model_execute(&model, &input_sdr, false);
+  sl_htm_model_deinit(&model);
+  EXPECT_EQ(sl_htm_model_frozen_execute(&frozen, &input_sdr), expected);
+
+  // A frozen model loaded from a buffer frees its runtime buffers, the tables stay in the buffer
+  size_t size = sl_htm_model_frozen_serialized_size(&frozen);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_frozen_save(&frozen, buffer.data(), size), size);
+  sl_htm_model_frozen_t loaded;
+  ASSERT_TRUE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  sl_htm_model_frozen_deinit(&loaded);
+  sl_htm_model_frozen_deinit(&frozen);
+  sl_htm_sdr_deinit(&input_sdr);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+}
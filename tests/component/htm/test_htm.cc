@@ -1,7 +1,11 @@
+#include <cmath>
+#include <vector>
 #include "gtest/gtest.h"
 #include "sl_htm.h"
 
 TEST(HTMTest, System){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
   sl_htm_sp_parameters_t sp_params;
   sl_htm_tm_parameters_t tm_params;
 
@@ -14,7 +18,7 @@ TEST(HTMTest, System){
 
   sl_htm_sdr_t input_sdr;
   sl_htm_sdr_init(&input_sdr, 50, 50);
-  sl_htm_sdr_randomize(&input_sdr, 0.2f);
+  sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
 
   float score = 0;
 
@@ -35,3 +39,93 @@ TEST(HTMTest, System){
   printf("SP memory size: %zu bytes\n", sl_htm_sp_memory_size(sl_htm_get_sp()));
   printf("TM memory size: %zu bytes\n", sl_htm_tm_memory_size(sl_htm_get_tm()));
 }
+
+TEST(HTMTest, MultipleModels){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+
+  sl_htm_sdr_t input_a;
+  sl_htm_sdr_init(&input_a, 30, 30);
+  sl_htm_sdr_randomize(&input_a, 0.2f, &random);
+  sl_htm_sdr_t input_b;
+  sl_htm_sdr_init(&input_b, 30, 30);
+  sl_htm_sdr_randomize(&input_b, 0.2f, &random);
+
+  // Train the first model until it predicts its input
+  sl_htm_model_t model_a;
+  sl_htm_model_init(&model_a, 30, 30, 15, 15, sp_params, tm_params);
+  float score = 1.0f;
+  for (uint16_t i = 0; i < 100; i++) {
+    score = sl_htm_model_execute(&model_a, &input_a, true);
+  }
+  ASSERT_LT(score, 0.1f);
+
+  // A second model starts from scratch, and running it does not disturb the first one
+  sl_htm_model_t model_b;
+  sl_htm_model_init(&model_b, 30, 30, 15, 15, sp_params, tm_params);
+  EXPECT_EQ(sl_htm_model_execute(&model_b, &input_b, true), 1.0f);
+  EXPECT_LT(sl_htm_model_execute(&model_a, &input_a, true), 0.1f);
+}
+
+TEST(HTMTest, InputSize){
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_model_init(&model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+
+  // An input of the wrong size is rejected without running the TM
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 40, 30);
+  sl_htm_sdr_set_range(&input_sdr, 0, 200);
+  EXPECT_TRUE(std::isnan(sl_htm_model_execute(&model, &input_sdr, true)));
+  EXPECT_EQ(model.sp_sdr.num_active_bits, 0);
+
+  sl_htm_sdr_deinit(&input_sdr);
+  sl_htm_model_deinit(&model);
+}
+
+TEST(HTMTest, Reproducible){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+
+  sl_htm_sdr_t inputs[3];
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_sdr_init(&inputs[i], 30, 30);
+    sl_htm_sdr_randomize(&inputs[i], 0.2f, &random);
+  }
+  // Models with the same seeds learn exactly the same way, whatever runs in between
+  sl_htm_model_t model_a;
+  sl_htm_model_t model_b;
+  sl_htm_model_init(&model_a, 30, 30, 15, 15, sp_params, tm_params);
+  sl_htm_model_init(&model_b, 30, 30, 15, 15, sp_params, tm_params);
+  tm_params.seed = 2;
+  sl_htm_model_t model_c;
+  sl_htm_model_init(&model_c, 30, 30, 15, 15, sp_params, tm_params);
+  for (uint16_t step = 0; step < 60; step++) {
+    float score_a = sl_htm_model_execute(&model_a, &inputs[step % 3], true);
+    sl_htm_model_execute(&model_c, &inputs[step % 3], true);
+    EXPECT_EQ(sl_htm_model_execute(&model_b, &inputs[step % 3], true), score_a);
+  }
+  size_t size = sl_htm_model_serialized_size(&model_a);
+  ASSERT_EQ(sl_htm_model_serialized_size(&model_b), size);
+  std::vector<uint64_t> buffer_a(size / sizeof(uint64_t));
+  std::vector<uint64_t> buffer_b(size / sizeof(uint64_t));
+  sl_htm_model_save(&model_a, buffer_a.data(), size);
+  sl_htm_model_save(&model_b, buffer_b.data(), size);
+  EXPECT_EQ(buffer_a, buffer_b);
+  // Another seed grows other segments
+  size_t size_c = sl_htm_model_serialized_size(&model_c);
+  std::vector<uint64_t> buffer_c(size_c / sizeof(uint64_t));
+  sl_htm_model_save(&model_c, buffer_c.data(), size_c);
+  EXPECT_NE(buffer_a, buffer_c);
+}
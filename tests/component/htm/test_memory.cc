@@ -0,0 +1,158 @@
+#include <vector>
+#include "gtest/gtest.h"
+#include "sl_htm.h"
+
+TEST(MemoryTest, Buffer){
+  alignas(SL_HTM_MEMORY_ALIGN) uint8_t buffer[64];
+  sl_htm_memory_t memory;
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer, sizeof(buffer)), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_memory_init(&memory, buffer + 1, sizeof(buffer) - 1), SL_HTM_STATUS_INVALID_PARAMETER);
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer, sizeof(buffer)), SL_HTM_STATUS_OK);
+
+  // Allocations are aligned and packed one after the other
+  uint8_t* a = (uint8_t*)sl_htm_memory_alloc(&memory, 3);
+  uint8_t* b = (uint8_t*)sl_htm_memory_calloc(&memory, 4, 4);
+  EXPECT_EQ(a, buffer);
+  EXPECT_EQ(b, buffer + SL_HTM_MEMORY_ALIGN);
+  EXPECT_EQ(b[15], 0);
+  // The buffer is never overrun
+  EXPECT_EQ(sl_htm_memory_alloc(&memory, 64), nullptr);
+  EXPECT_EQ(sl_htm_memory_realloc(&memory, b, 32), nullptr);
+
+  // Freeing rewinds to the freed allocation
+  sl_htm_memory_free(&memory, b);
+  EXPECT_EQ(memory.used, (size_t)SL_HTM_MEMORY_ALIGN);
+  EXPECT_EQ(sl_htm_memory_alloc(&memory, 56), buffer + SL_HTM_MEMORY_ALIGN);
+  EXPECT_EQ(memory.used, sizeof(buffer));
+}
+
+TEST(MemoryTest, StaticSize){
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sp_params.local_inhibition = true;
+
+  // The reported size is exactly enough, one allocation unit less is not
+  size_t size = sl_htm_model_static_memory_size(20, 20, 10, 10, &sp_params, &tm_params);
+  ASSERT_GT(size, 0u);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  sl_htm_memory_t memory;
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer.data(), size - SL_HTM_MEMORY_ALIGN), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_model_init_static(&model, &memory, 20, 20, 10, 10, sp_params, tm_params), SL_HTM_STATUS_ALLOCATION_FAILED);
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer.data(), size), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_model_init_static(&model, &memory, 20, 20, 10, 10, sp_params, tm_params), SL_HTM_STATUS_OK);
+
+  // Sizes that init would reject have no buffer size
+  tm_params.max_segments_in_cell = 0;
+  EXPECT_EQ(sl_htm_model_static_memory_size(20, 20, 10, 10, &sp_params, &tm_params), 0u);
+}
+
+TEST(MemoryTest, StaticModel){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+
+  size_t size = sl_htm_model_static_memory_size(30, 30, 15, 15, &sp_params, &tm_params);
+  std::vector<uint64_t> buffer((size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  sl_htm_memory_t memory;
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer.data(), size), SL_HTM_STATUS_OK);
+  sl_htm_model_t static_model;
+  ASSERT_EQ(sl_htm_model_init_static(&static_model, &memory, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+  sl_htm_model_t heap_model;
+  ASSERT_EQ(sl_htm_model_init(&heap_model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 30, 30);
+  // Both models learn the same sequence the same way
+  float static_score = 1.0f;
+  for (uint16_t i = 0; i < 300; i++) {
+    sl_htm_encoder_simple_number(i % 5, 0, 5, 30, &input_sdr);
+    static_score = sl_htm_model_execute(&static_model, &input_sdr, true);
+    float heap_score = sl_htm_model_execute(&heap_model, &input_sdr, true);
+    ASSERT_EQ(static_score, heap_score);
+  }
+  EXPECT_LT(static_score, 0.2f);
+  // The state arrays of a static model never grew
+  EXPECT_EQ(sl_htm_tm_state_num_growths(&static_model.tm.state_current), 0u);
+  EXPECT_EQ(sl_htm_tm_state_num_growths(&static_model.tm.state_prev), 0u);
+  EXPECT_EQ(sl_htm_tm_get_status(&static_model.tm), SL_HTM_STATUS_OK);
+  sl_htm_model_deinit(&heap_model);
+  sl_htm_sdr_deinit(&input_sdr);
+}
+
+TEST(MemoryTest, FixedCapacityState){
+  alignas(SL_HTM_MEMORY_ALIGN) uint8_t buffer[64];
+  sl_htm_memory_t memory;
+  ASSERT_EQ(sl_htm_memory_init(&memory, buffer, sizeof(buffer)), SL_HTM_STATUS_OK);
+  sl_htm_tm_state_t state;
+  sl_htm_tm_init_state(&state);
+  ASSERT_EQ(sl_htm_tm_reserve_state(&state, &memory, 4, 2), SL_HTM_STATUS_OK);
+
+  // Cells past the reserved capacity are dropped instead of growing the array
+  for (uint16_t i = 0; i < 4; i++) {
+    EXPECT_EQ(sl_htm_tm_add_cell_to_array(i, &state.active_cells), SL_HTM_STATUS_OK);
+  }
+  EXPECT_EQ(sl_htm_tm_add_cell_to_array(4, &state.active_cells), SL_HTM_STATUS_ALLOCATION_FAILED);
+  EXPECT_EQ(state.active_cells.len, 4);
+  EXPECT_EQ(state.active_cells.capacity, 4);
+  EXPECT_EQ(sl_htm_tm_state_num_dropped(&state), 1u);
+  EXPECT_EQ(sl_htm_tm_state_num_growths(&state), 0u);
+}
+
+TEST(MemoryTest, Deinit){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sp_params.local_inhibition = true;
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+
+  // Everything a heap model allocates, including state arrays that grew while learning, is freed again
+  sl_htm_model_t model;
+  ASSERT_EQ(sl_htm_model_init(&model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+  EXPECT_GT(sl_htm_memory_num_heap_allocations(), num_allocations);
+  sl_htm_sdr_t input_sdr;
+  ASSERT_EQ(sl_htm_sdr_init(&input_sdr, 30, 30), SL_HTM_STATUS_OK);
+  for (uint16_t i = 0; i < 50; i++) {
+    sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
+    sl_htm_model_execute(&model, &input_sdr, true);
+  }
+  size_t size = sl_htm_model_serialized_size(&model);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+  sl_htm_model_deinit(&model);
+  sl_htm_sdr_deinit(&input_sdr);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+
+  // Loaded models free their copies, the tables of an in-place model stay in the buffer
+  sl_htm_model_t copied;
+  ASSERT_TRUE(sl_htm_model_load(&copied, buffer.data(), size, false));
+  sl_htm_model_t in_place;
+  ASSERT_TRUE(sl_htm_model_load(&in_place, buffer.data(), size, true));
+  sl_htm_model_deinit(&copied);
+  sl_htm_model_deinit(&in_place);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+
+  // A model that fails halfway through init leaves nothing allocated
+  tm_params.max_segments_in_cell = 0;
+  EXPECT_EQ(sl_htm_model_init(&model, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+  sl_htm_tm_init_default_params(&tm_params);
+
+  // A static model never touches the heap, and deinit leaves its buffer alone
+  size_t static_size = sl_htm_model_static_memory_size(30, 30, 15, 15, &sp_params, &tm_params);
+  std::vector<uint64_t> static_buffer((static_size + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  sl_htm_memory_t memory;
+  ASSERT_EQ(sl_htm_memory_init(&memory, static_buffer.data(), static_size), SL_HTM_STATUS_OK);
+  ASSERT_EQ(sl_htm_model_init_static(&model, &memory, 30, 30, 15, 15, sp_params, tm_params), SL_HTM_STATUS_OK);
+  sl_htm_model_deinit(&model);
+  EXPECT_EQ(memory.used, static_size);
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+}
@@ -5,13 +5,8 @@
 TEST(SDRTest, IndexCoordinates) {
   // Arrange
   sl_htm_sdr_t sdr;
-  sdr.width = 2;
-  sdr.height = 2;
-  sdr.num_active_bits = 0;
-  sdr.bits = new bool[4] {
-    0, 0,
-    1, 0
-  };
+  sl_htm_sdr_init(&sdr, 2, 2);
+  sl_htm_sdr_set_bit(&sdr, 2, true);
 
   // Assert
   EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, sl_htm_utils_xy_to_index(0, 0, sdr.width, sdr.height)), false);
@@ -30,17 +25,19 @@ TEST(SDRTest, IndexCoordinates) {
   EXPECT_EQ(sl_htm_utils_index_to_y(index, sdr.width, sdr.height), y);
 }
 TEST(SDRTest, Randomize) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
   // Arrange
   sl_htm_sdr_t sdr;
   sl_htm_sdr_init(&sdr, 100, 100);
   float target_sparsity = 0.2f;
-  sl_htm_sdr_randomize(&sdr, target_sparsity);
+  sl_htm_sdr_randomize(&sdr, target_sparsity, &random);
   // Assert that the SDR has the correct number of active bits according to the sparsity.
   EXPECT_EQ(sdr.num_active_bits, (uint16_t)(target_sparsity * sdr.width * sdr.height));
 
   // Randomize again
   target_sparsity = 0.5f;
-  sl_htm_sdr_randomize(&sdr, target_sparsity);
+  sl_htm_sdr_randomize(&sdr, target_sparsity, &random);
   // Assert that the SDR has the correct number of active bits according to the sparsity.
   EXPECT_EQ(sdr.num_active_bits, (uint16_t)(target_sparsity * sdr.width * sdr.height));
 }
@@ -88,3 +85,130 @@ TEST(SDRTest, Insert2){
   // Assert
   EXPECT_EQ(target_sdr.num_active_bits, 20);
 }
+TEST(SDRTest, SetRange){
+  // Arrange
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 20, 10);
+
+  // Act, the range crosses several word boundaries
+  sl_htm_sdr_set_range(&sdr, 30, 70);
+  sl_htm_sdr_set_range(&sdr, 95, 10);
+
+  // Assert
+  EXPECT_EQ(sdr.num_active_bits, 75);
+  EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, 29), false);
+  for (uint16_t i = 30; i < 105; i++) {
+    EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, i), true);
+  }
+  EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, 105), false);
+}
+TEST(SDRTest, InsertUnaligned){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  // Arrange
+  sl_htm_sdr_t target_sdr;
+  sl_htm_sdr_init(&target_sdr, 27, 27);
+  sl_htm_sdr_randomize(&target_sdr, 0.5f, &random);
+
+  sl_htm_sdr_t source_sdr;
+  sl_htm_sdr_init(&source_sdr, 27, 9);
+  sl_htm_sdr_randomize(&source_sdr, 0.3f, &random);
+
+  // Act, overwrite the middle band of the target
+  sl_htm_sdr_insert(&target_sdr, &source_sdr, 0, 9);
+
+  // Assert that the band matches the source bit for bit, and that the active count was kept in sync
+  uint16_t num_active_bits = 0;
+  for (uint16_t i = 0; i < 27 * 27; i++) {
+    bool bit = sl_htm_sdr_get_bit(&target_sdr, i);
+    if (i >= 27 * 9 && i < 27 * 18) {
+      EXPECT_EQ(bit, sl_htm_sdr_get_bit(&source_sdr, i - 27 * 9));
+    }
+    num_active_bits += bit;
+  }
+  EXPECT_EQ(target_sdr.num_active_bits, num_active_bits);
+}
+TEST(SDRTest, Overlap){
+  // Arrange
+  sl_htm_sdr_t sdr_a;
+  sl_htm_sdr_init(&sdr_a, 10, 10);
+  sl_htm_sdr_set_range(&sdr_a, 10, 40);
+
+  sl_htm_sdr_t sdr_b;
+  sl_htm_sdr_init(&sdr_b, 10, 10);
+  sl_htm_sdr_set_range(&sdr_b, 40, 40);
+
+  sl_htm_sdr_t intersection;
+  sl_htm_sdr_init(&intersection, 10, 10);
+
+  // Act & Assert, bits [40, 50) are active in both SDRs
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr_a, &sdr_b), 10);
+  EXPECT_EQ(sl_htm_sdr_intersection(&intersection, &sdr_a, &sdr_b), 10);
+  EXPECT_EQ(intersection.num_active_bits, 10);
+  EXPECT_EQ(sl_htm_sdr_get_bit(&intersection, 40), true);
+  EXPECT_EQ(sl_htm_sdr_get_bit(&intersection, 39), false);
+}
+TEST(SDRTest, Sparse){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  // Arrange
+  sl_htm_sdr_t sdr;
+  sl_htm_sdr_init(&sdr, 30, 30);
+  sl_htm_sdr_randomize(&sdr, 0.2f, &random);
+
+  sl_htm_sdr_sparse_t sparse;
+  sl_htm_sdr_sparse_init(&sparse, sdr.width, sdr.height, sdr.num_active_bits);
+
+  // Act
+  sl_htm_sdr_to_sparse(&sdr, &sparse);
+
+  // Assert that all active bits are listed, in ascending order
+  EXPECT_EQ(sparse.len, sdr.num_active_bits);
+  for (uint16_t i = 0; i < sparse.len; i++) {
+    EXPECT_EQ(sl_htm_sdr_get_bit(&sdr, sparse.indices[i]), true);
+    if (i > 0) {
+      EXPECT_LT(sparse.indices[i - 1], sparse.indices[i]);
+    }
+  }
+
+  // Convert back again and assert that the dense SDR is unchanged
+  sl_htm_sdr_t sdr2;
+  sl_htm_sdr_init(&sdr2, 30, 30);
+  sl_htm_sdr_from_sparse(&sdr2, &sparse);
+  EXPECT_EQ(sdr2.num_active_bits, sdr.num_active_bits);
+  EXPECT_EQ(sl_htm_sdr_overlap(&sdr, &sdr2), sdr.num_active_bits);
+}
+TEST(SDRTest, OutOfBounds){
+  // Arrange
+  sl_htm_sdr_t target_sdr;
+  ASSERT_EQ(sl_htm_sdr_init(&target_sdr, 5, 3), SL_HTM_STATUS_OK);
+  sl_htm_sdr_t source_sdr;
+  ASSERT_EQ(sl_htm_sdr_init(&source_sdr, 5, 2), SL_HTM_STATUS_OK);
+  sl_htm_sdr_set_range(&source_sdr, 0, 10);
+
+  // Assert that runs and inserts that do not fit are rejected and leave the target unchanged
+  EXPECT_EQ(sl_htm_sdr_set_range(&target_sdr, 10, 6), SL_HTM_STATUS_OUT_OF_BOUNDS);
+  EXPECT_EQ(sl_htm_sdr_insert(&target_sdr, &source_sdr, 0, 2), SL_HTM_STATUS_OUT_OF_BOUNDS);
+  EXPECT_EQ(target_sdr.num_active_bits, 0);
+  EXPECT_EQ(sl_htm_sdr_insert(&target_sdr, &source_sdr, 0, 1), SL_HTM_STATUS_OK);
+  EXPECT_EQ(target_sdr.num_active_bits, 10);
+
+  // A sparse SDR that is too small is left empty
+  sl_htm_sdr_sparse_t sparse;
+  ASSERT_EQ(sl_htm_sdr_sparse_init(&sparse, 5, 3, 4), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_sdr_to_sparse(&target_sdr, &sparse), SL_HTM_STATUS_WOULD_OVERFLOW);
+  EXPECT_EQ(sparse.len, 0);
+
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  EXPECT_EQ(sl_htm_sdr_randomize(&target_sdr, 1.5f, &random), SL_HTM_STATUS_INVALID_PARAMETER);
+#if SL_HTM_BOUNDS_CHECK
+  // Single bits outside of the SDR read as 0 and are never written
+  EXPECT_EQ(sl_htm_sdr_set_bit(&target_sdr, 15, true), SL_HTM_STATUS_OUT_OF_BOUNDS);
+  EXPECT_FALSE(sl_htm_sdr_get_bit(&target_sdr, 15));
+  EXPECT_EQ(target_sdr.num_active_bits, 10);
+#endif
+  free(target_sdr.words);
+  free(source_sdr.words);
+  free(sparse.indices);
+}
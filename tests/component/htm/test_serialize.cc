@@ -0,0 +1,353 @@
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "sl_htm.h"
+
+static void train_model(sl_htm_model_t* model, sl_htm_sdr_t* inputs, uint16_t num_inputs)
+{
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sl_htm_model_init(model, 30, 30, 15, 15, sp_params, tm_params);
+  for (uint16_t i = 0; i < num_inputs; i++) {
+    sl_htm_sdr_init(&inputs[i], 30, 30);
+    sl_htm_sdr_randomize(&inputs[i], 0.2f, &random);
+  }
+  for (uint16_t step = 0; step < 60; step++) {
+    sl_htm_model_execute(model, &inputs[step % num_inputs], true);
+  }
+}
+
+TEST(SerializeTest, RoundTrip){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[3];
+  train_model(&model, inputs, 3);
+
+  size_t size = sl_htm_model_serialized_size(&model);
+  EXPECT_EQ(size % SL_HTM_SERIALIZE_ALIGN, 0u);
+  // Use 64-bit elements so that the buffer is aligned
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+
+  sl_htm_model_t copied;
+  ASSERT_TRUE(sl_htm_model_load(&copied, buffer.data(), size, false));
+  sl_htm_model_t in_place;
+  ASSERT_TRUE(sl_htm_model_load(&in_place, buffer.data(), size, true));
+  // The in-place model references the buffer instead of copying the TM arena
+  EXPECT_GE((uint8_t*)in_place.tm.arena, (uint8_t*)buffer.data());
+  EXPECT_LT((uint8_t*)in_place.tm.arena, (uint8_t*)buffer.data() + size);
+
+  // The parameters are written field by field and read back the same
+  EXPECT_EQ(copied.sp.parameters.sparsity, model.sp.parameters.sparsity);
+  EXPECT_EQ(copied.sp.parameters.seed, model.sp.parameters.seed);
+  EXPECT_EQ(copied.sp.parameters.local_inhibition, model.sp.parameters.local_inhibition);
+  EXPECT_EQ(copied.sp.parameters.duty_cycle_period, model.sp.parameters.duty_cycle_period);
+  EXPECT_EQ(copied.tm.parameters.seed, model.tm.parameters.seed);
+  EXPECT_EQ(copied.tm.parameters.num_cells_per_column, model.tm.parameters.num_cells_per_column);
+  EXPECT_EQ(copied.tm.parameters.synapse_permanence_threshold, model.tm.parameters.synapse_permanence_threshold);
+
+  // A loaded model saves to the same bytes
+  std::vector<uint64_t> buffer_copy(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&copied, buffer_copy.data(), size), size);
+  EXPECT_EQ(buffer, buffer_copy);
+
+  // And continues the sequence where the saved model stopped
+  sl_htm_sdr_t* next = &inputs[60 % 3];
+  float expected = sl_htm_model_execute(&model, next, false);
+  EXPECT_EQ(sl_htm_model_execute(&copied, next, false), expected);
+  EXPECT_EQ(sl_htm_model_execute(&in_place, next, false), expected);
+  // The random number generators are saved too, so learning goes on exactly as in the saved model
+  for (uint16_t step = 61; step < 70; step++) {
+    expected = sl_htm_model_execute(&model, &inputs[step % 3], true);
+    EXPECT_EQ(sl_htm_model_execute(&copied, &inputs[step % 3], true), expected);
+  }
+}
+
+TEST(SerializeTest, ZeroPermanenceMatchingScores){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[3];
+  train_model(&model, inputs, 3);
+  // Synapses with a permanence of 0 exist but do not make a segment matching
+  sl_htm_tm_t* tm = &model.tm;
+  for (uint32_t synapse = 0; synapse < tm->num_synapses; synapse += 2) {
+    if (tm->synapse_presynaptic_cell[synapse] != SL_HTM_TM_INDEX_NONE) {
+      tm->synapse_permanence[synapse] = 0;
+    }
+  }
+  sl_htm_model_execute(&model, &inputs[60 % 3], false);
+  // Make sure that some matching segment has an active synapse the score leaves out
+  bool has_zero_active = false;
+  for (uint16_t i = 0; i < tm->state_prev.matching_segments.len; i++) {
+    uint32_t first_synapse = tm->state_prev.matching_segments.segments[i] * tm->parameters.max_synapses_in_segment;
+    for (uint16_t j = 0; j < tm->parameters.max_synapses_in_segment; j++) {
+      sl_htm_tm_index_t cell = tm->synapse_presynaptic_cell[first_synapse + j];
+      if (cell != SL_HTM_TM_INDEX_NONE && tm->synapse_permanence[first_synapse + j] == 0 && sl_htm_tm_is_cell_active(cell, &tm->state_prev)) {
+        has_zero_active = true;
+      }
+    }
+  }
+  ASSERT_TRUE(has_zero_active);
+
+  size_t size = sl_htm_model_serialized_size(&model);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+  sl_htm_model_t copied;
+  ASSERT_TRUE(sl_htm_model_load(&copied, buffer.data(), size, false));
+  // The restored scores count the same synapses as the dendrite pass did
+  ASSERT_EQ(copied.tm.state_prev.matching_segments.len, tm->state_prev.matching_segments.len);
+  for (uint16_t i = 0; i < tm->state_prev.matching_segments.len; i++) {
+    EXPECT_EQ(copied.tm.state_prev.matching_segments.segments[i], tm->state_prev.matching_segments.segments[i]);
+    EXPECT_EQ(copied.tm.state_prev.matching_scores[i], tm->state_prev.matching_scores[i]);
+  }
+  // So learning goes on exactly as in the saved model
+  for (uint16_t step = 61; step < 70; step++) {
+    float expected = sl_htm_model_execute(&model, &inputs[step % 3], true);
+    EXPECT_EQ(sl_htm_model_execute(&copied, &inputs[step % 3], true), expected);
+  }
+  size_t size_after = sl_htm_model_serialized_size(&model);
+  ASSERT_EQ(sl_htm_model_serialized_size(&copied), size_after);
+  std::vector<uint64_t> saved(size_after / sizeof(uint64_t));
+  std::vector<uint64_t> saved_copy(size_after / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, saved.data(), size_after), size_after);
+  ASSERT_EQ(sl_htm_model_save(&copied, saved_copy.data(), size_after), size_after);
+  EXPECT_EQ(saved, saved_copy);
+}
+
+TEST(SerializeTest, InvalidBuffer){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[2];
+  train_model(&model, inputs, 2);
+  size_t size = sl_htm_model_serialized_size(&model);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  // Too small
+  EXPECT_EQ(sl_htm_model_save(&model, buffer.data(), size - 1), 0u);
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+
+  sl_htm_model_t loaded;
+  // Truncated
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size / 2, false));
+  // Not aligned
+  EXPECT_FALSE(sl_htm_model_load(&loaded, (uint8_t*)buffer.data() + 1, size - 1, false));
+  // Saved by another version of the format
+  std::vector<uint64_t> original = buffer;
+  ((sl_htm_serialize_header_t*)buffer.data())->version = SL_HTM_SERIALIZE_VERSION + 1;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // The version of the sections is checked as well
+  size_t sp_offset = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  ((sl_htm_serialize_header_t*)((uint8_t*)buffer.data() + sp_offset))->version = SL_HTM_SERIALIZE_VERSION + 1;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  EXPECT_TRUE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  // Wrong magic number
+  buffer[0] ^= 1;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+}
+
+TEST(SerializeTest, CorruptedIndices){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[3];
+  train_model(&model, inputs, 3);
+  size_t size = sl_htm_model_serialized_size(&model);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+  std::vector<uint64_t> original = buffer;
+
+  // A model loaded in place points into the buffer, which gives a handle on every stored index
+  sl_htm_model_t view;
+  ASSERT_TRUE(sl_htm_model_load(&view, buffer.data(), size, true));
+  sl_htm_tm_t* tm = &view.tm;
+  sl_htm_tm_index_t synapse = SL_HTM_TM_INDEX_NONE;
+  for (uint32_t cell = 0; synapse == SL_HTM_TM_INDEX_NONE && cell < tm->num_cells; cell++) {
+    synapse = tm->cell_presynaptic_head[cell];
+  }
+  ASSERT_NE(synapse, SL_HTM_TM_INDEX_NONE);
+
+  sl_htm_model_t loaded;
+  // A load that is rejected after its SP was allocated frees it again
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  // Presynaptic cell out of range
+  tm->synapse_presynaptic_cell[synapse] = tm->num_cells;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // Presynaptic list that points out of the synapse table
+  tm->synapse_next_presynaptic[synapse] = tm->num_synapses;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // Presynaptic list that loops back on itself
+  tm->synapse_next_presynaptic[synapse] = synapse;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // List head of a cell that points at another cell's synapse
+  tm->cell_presynaptic_head[(tm->synapse_presynaptic_cell[synapse] + 1) % tm->num_cells] = synapse;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // Segment count that does not match the synapses of the segment
+  sl_htm_tm_index_t segment = synapse / tm->parameters.max_synapses_in_segment;
+  tm->segment_num_synapses[segment]--;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // Cell that claims more segments than it has
+  tm->cell_num_segments[segment / tm->parameters.max_segments_in_cell]++;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+
+  // SP connection outside of the input and of the column grid
+  view.sp.connections[0].sdr_x = view.sp.input_width;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  view.sp.connections[0].sp_y = view.sp.height;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  // Input index that points out of the connections, or at a connection of another input bit
+  view.sp.input_connections[0] = view.sp.num_connections;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  std::swap(view.sp.input_connections[0], view.sp.input_connections[view.sp.num_connections - 1]);
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+  view.sp.input_offsets[1] = view.sp.num_connections + 1;
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  buffer = original;
+
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+
+  // The untouched buffer still loads
+  EXPECT_TRUE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+}
+
+TEST(SerializeTest, MismatchedSizes){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[2];
+  train_model(&model, inputs, 2);
+  sl_htm_sp_parameters_t sp_params;
+  sl_htm_tm_parameters_t tm_params;
+  sl_htm_sp_init_default_params(&sp_params);
+  sl_htm_tm_init_default_params(&tm_params);
+  sl_htm_model_t other;
+  ASSERT_EQ(sl_htm_model_init(&other, 30, 30, 10, 10, sp_params, tm_params), SL_HTM_STATUS_OK);
+
+  // The SP of one model followed by the TM of the other
+  size_t header_size = sl_htm_serialize_align(sizeof(sl_htm_serialize_header_t));
+  size_t sp_size = sl_htm_sp_serialized_size(&model.sp);
+  size_t tm_size = sl_htm_tm_serialized_size(&other.tm);
+  size_t size = header_size + sp_size + tm_size;
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  uint8_t* base = (uint8_t*)buffer.data();
+  sl_htm_serialize_write_header(base, SL_HTM_SERIALIZE_MAGIC_MODEL, 0, size);
+  ASSERT_EQ(sl_htm_sp_save(&model.sp, base + header_size, sp_size), sp_size);
+  ASSERT_EQ(sl_htm_tm_save(&other.tm, base + header_size + sp_size, tm_size), tm_size);
+  sl_htm_model_t loaded;
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  EXPECT_FALSE(sl_htm_model_load(&loaded, buffer.data(), size, false));
+  EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+}
+
+TEST(SerializeTest, AllocationFailure){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[2];
+  train_model(&model, inputs, 2);
+  size_t size = sl_htm_model_serialized_size(&model);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_save(&model, buffer.data(), size), size);
+
+  // Run out of heap at every allocation of a load in turn, each failed load leaves nothing behind
+  size_t num_allocations = sl_htm_memory_num_heap_allocations();
+  for (bool in_place : {false, true}) {
+    sl_htm_model_t loaded;
+    size_t num_failures = 0;
+    while (true) {
+      sl_htm_memory_fail_heap_after(num_failures);
+      bool success = sl_htm_model_load(&loaded, buffer.data(), size, in_place);
+      sl_htm_memory_fail_heap_after(SIZE_MAX);
+      if (success) {
+        break;
+      }
+      ASSERT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+      num_failures++;
+    }
+    EXPECT_GT(num_failures, 0u);
+    sl_htm_model_deinit(&loaded);
+    EXPECT_EQ(sl_htm_memory_num_heap_allocations(), num_allocations);
+  }  sl_htm_model_deinit(&model);
+  for (sl_htm_sdr_t& input : inputs) {
+    sl_htm_sdr_deinit(&input);
+  }
+}
+
+TEST(SerializeTest, CorruptedFrozen){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[3];
+  train_model(&model, inputs, 3);
+  sl_htm_model_frozen_t frozen;
+  ASSERT_EQ(sl_htm_model_freeze(&model, &frozen), SL_HTM_STATUS_OK);
+  size_t size = sl_htm_model_frozen_serialized_size(&frozen);
+  std::vector<uint64_t> buffer(size / sizeof(uint64_t));
+  ASSERT_EQ(sl_htm_model_frozen_save(&frozen, buffer.data(), size), size);
+  std::vector<uint64_t> original = buffer;
+
+  // The frozen tables always live in the buffer
+  sl_htm_model_frozen_t view;
+  ASSERT_TRUE(sl_htm_model_frozen_load(&view, buffer.data(), size));
+  ASSERT_GT(view.tm.num_connected, 0u);
+  ASSERT_GT(view.sp.num_connected, 0u);
+  sl_htm_model_frozen_t loaded;
+  ((sl_htm_tm_index_t*)view.tm.cell_segments)[0] = view.tm.num_segments;
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  buffer = original;
+  ((sl_htm_tm_index_t*)view.tm.segment_cell)[0] = view.tm.num_cells;
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  buffer = original;
+  ((sl_htm_tm_index_t*)view.tm.cell_offsets)[1] = view.tm.num_connected + 1;
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  buffer = original;
+  ((uint16_t*)view.sp.input_columns)[0] = view.sp.sp.width * view.sp.sp.height;
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  buffer = original;
+  ((uint32_t*)view.sp.input_offsets)[1] = view.sp.num_connected + 1;
+  EXPECT_FALSE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+  buffer = original;
+  EXPECT_TRUE(sl_htm_model_frozen_load(&loaded, buffer.data(), size));
+}
+
+#if SL_HTM_SERIALIZE_FILES
+TEST(SerializeTest, File){
+  sl_htm_model_t model;
+  sl_htm_sdr_t inputs[3];
+  train_model(&model, inputs, 3);
+  std::string path = testing::TempDir() + "sl_htm_model.bin";
+  ASSERT_TRUE(sl_htm_model_save_file(&model, path.c_str()));
+
+  sl_htm_model_t read;
+  ASSERT_TRUE(sl_htm_model_load_file(&read, path.c_str(), false));
+  sl_htm_model_t mapped;
+  ASSERT_TRUE(sl_htm_model_load_file(&mapped, path.c_str(), true));
+
+  float expected = sl_htm_model_execute(&model, &inputs[0], true);
+  EXPECT_EQ(sl_htm_model_execute(&read, &inputs[0], true), expected);
+  EXPECT_EQ(sl_htm_model_execute(&mapped, &inputs[0], true), expected);
+  EXPECT_EQ(read.file_mapped, false);
+  EXPECT_EQ(mapped.file_mapped, true);
+  sl_htm_model_deinit(&read);
+  sl_htm_model_deinit(&mapped);
+  EXPECT_EQ(read.file_buffer, nullptr);
+  EXPECT_EQ(mapped.file_buffer, nullptr);
+
+  // A file that does not hold a model leaves nothing behind
+  FILE* file = fopen(path.c_str(), "wb");
+  ASSERT_NE(file, nullptr);
+  fputs("not a model", file);
+  fclose(file);
+  sl_htm_model_t invalid;
+  EXPECT_FALSE(sl_htm_model_load_file(&invalid, path.c_str(), false));
+  EXPECT_FALSE(sl_htm_model_load_file(&invalid, path.c_str(), true));
+  remove(path.c_str());
+  sl_htm_model_deinit(&model);
+  for (sl_htm_sdr_t& input : inputs) {
+    sl_htm_sdr_deinit(&input);
+  }
+}
+#endif
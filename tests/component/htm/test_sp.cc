@@ -1,7 +1,10 @@
+#include <cmath>
 #include "gtest/gtest.h"
 #include "sl_htm_sp.h"
 
 TEST(SPTest, Initialization) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
   sl_htm_sdr_t input_sdr;
   sl_htm_sdr_init(&input_sdr, 100, 100);
   sl_htm_sdr_t output_sdr;
@@ -12,7 +15,7 @@ TEST(SPTest, Initialization) {
   sl_htm_sp_init(&sp, input_sdr.width, input_sdr.height, output_sdr.width, output_sdr.height);
 
   for (int i = 0; i < 100; i++) {
-    sl_htm_sdr_randomize(&input_sdr, 0.2f);
+    sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
     sl_htm_sp_execute(&sp, &input_sdr, &output_sdr, true);
   }
   sl_htm_sp_print(&sp);
@@ -24,3 +27,345 @@ TEST(SPTest, Initialization) {
   sp.height = 10;
   printf("SP memory size: %zu bytes\n", sl_htm_sp_memory_size(&sp));
 }
+
+TEST(SPTest, InvalidSizes) {
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  // The input must be at least as large as the output
+  EXPECT_EQ(sl_htm_sp_init(&sp, 10, 10, 20, 20), SL_HTM_STATUS_INVALID_PARAMETER);
+
+  // The potential radius covers fewer input bits than a column has connections
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sp.parameters.potential_radius = 4;
+  sp.parameters.potential_pct = 1.0f;
+  EXPECT_EQ(sl_htm_sp_init(&sp, 3, 3, 3, 3), SL_HTM_STATUS_INVALID_PARAMETER);
+
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sp.parameters.sparsity = 0.0f;
+  EXPECT_EQ(sl_htm_sp_init(&sp, 20, 20, 10, 10), SL_HTM_STATUS_INVALID_PARAMETER);
+
+  sl_htm_sp_init_default_params(&sp.parameters);
+  EXPECT_EQ(sl_htm_sp_init(&sp, 20, 20, 10, 10), SL_HTM_STATUS_OK);
+  sl_htm_sp_column_t* top_columns[101];
+  EXPECT_EQ(sl_htm_sp_get_top_columns(top_columns, 101, &sp), SL_HTM_STATUS_INVALID_PARAMETER);
+}
+
+TEST(SPTest, InputSize) {
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  ASSERT_EQ(sl_htm_sp_init(&sp, 20, 20, 10, 10), SL_HTM_STATUS_OK);
+  sl_htm_sdr_t output_sdr;
+  sl_htm_sdr_init(&output_sdr, 10, 10);
+  sl_htm_sdr_set_bit(&output_sdr, 0, true);
+
+  // An input wider than the SP input would index past the connection table
+  sl_htm_sdr_t wide_sdr;
+  sl_htm_sdr_init(&wide_sdr, 40, 20);
+  sl_htm_sdr_set_range(&wide_sdr, 0, 800);
+  sl_htm_sdr_t narrow_sdr;
+  sl_htm_sdr_init(&narrow_sdr, 20, 10);
+  EXPECT_EQ(sl_htm_sp_execute(&sp, &wide_sdr, &output_sdr, true), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sl_htm_sp_execute(&sp, &narrow_sdr, &output_sdr, true), SL_HTM_STATUS_INVALID_PARAMETER);
+  // The output is left as it was
+  EXPECT_EQ(output_sdr.num_active_bits, 1);
+
+  sl_htm_sp_frozen_t frozen;
+  ASSERT_EQ(sl_htm_sp_freeze(&sp, &frozen), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_sp_frozen_execute(&frozen, &wide_sdr, &output_sdr), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(output_sdr.num_active_bits, 1);
+
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 20, 20);
+  sl_htm_sdr_set_range(&input_sdr, 0, 40);
+  EXPECT_EQ(sl_htm_sp_execute(&sp, &input_sdr, &output_sdr, true), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_sp_frozen_execute(&frozen, &input_sdr, &output_sdr), SL_HTM_STATUS_OK);
+
+  sl_htm_sp_frozen_deinit(&frozen);
+  sl_htm_sp_deinit(&sp);
+  sl_htm_sdr_deinit(&input_sdr);
+  sl_htm_sdr_deinit(&narrow_sdr);
+  sl_htm_sdr_deinit(&wide_sdr);
+  sl_htm_sdr_deinit(&output_sdr);
+}
+
+TEST(SPTest, PotentialPool) {
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  // The neighborhood of every column covers the whole 9x9 input, and the pool needs all of it, (0, 0) included
+  sp.parameters.potential_radius = 4;
+  sp.parameters.potential_pct = 81.0f / 32.0f;
+  sl_htm_sp_init(&sp, 9, 9, 5, 5);
+  for (uint16_t column_idx = 0; column_idx < 25; column_idx++) {
+    sl_htm_sp_column_t* column = &sp.columns[column_idx];
+    ASSERT_EQ(column->num_connections, 81);
+    bool taken[81] = { false };
+    for (uint16_t i = 0; i < column->num_connections; i++) {
+      uint16_t input_idx = column->connections[i].sdr_x + column->connections[i].sdr_y * 9;
+      EXPECT_FALSE(taken[input_idx]);
+      taken[input_idx] = true;
+    }
+  }
+
+  // Smaller pools stay within the potential radius, wrapping around the edges of the input
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sl_htm_sp_init(&sp, 40, 40, 20, 20);
+  for (uint16_t column_idx = 0; column_idx < 400; column_idx++) {
+    sl_htm_sp_column_t* column = &sp.columns[column_idx];
+    int32_t center_x = column->column_x + 10;
+    int32_t center_y = column->column_y + 10;
+    for (uint16_t i = 0; i < column->num_connections; i++) {
+      int32_t dx = ((column->connections[i].sdr_x - center_x) % 40 + 60) % 40 - 20;
+      int32_t dy = ((column->connections[i].sdr_y - center_y) % 40 + 60) % 40 - 20;
+      EXPECT_LE(abs(dx), sp.parameters.potential_radius);
+      EXPECT_LE(abs(dy), sp.parameters.potential_radius);
+      for (uint16_t j = 0; j < i; j++) {
+        EXPECT_FALSE(column->connections[j].sdr_x == column->connections[i].sdr_x && column->connections[j].sdr_y == column->connections[i].sdr_y);
+      }
+    }
+  }
+}
+
+TEST(SPTest, TopColumns) {
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sl_htm_sp_init(&sp, 40, 40, 20, 20);
+
+  // Scores spread over three bytes, with a tie across the selection boundary
+  for (uint16_t i = 0; i < 400; i++) {
+    sp.columns[i].overlap_score = i % 7;
+  }
+  sp.columns[10].overlap_score = 1000 << 8;
+  sp.columns[20].overlap_score = 300;
+  sp.columns[30].overlap_score = 300;
+
+  // 3 columns above 6, then 57 columns with score 6 compete for 10 slots
+  sl_htm_sp_column_t* top_columns[13];
+  sl_htm_sp_get_top_columns(top_columns, 13, &sp);
+  uint16_t num_ties = 0;
+  for (uint16_t i = 0; i < 13; i++) {
+    uint16_t column_idx = top_columns[i] - sp.columns;
+    if (column_idx == 10 || column_idx == 20 || column_idx == 30) {
+      continue;
+    }
+    EXPECT_EQ(top_columns[i]->overlap_score, 6);
+    num_ties++;
+  }
+  EXPECT_EQ(num_ties, 10);
+  // Ties are broken by column index, and the output is in column order
+  EXPECT_EQ(top_columns[0] - sp.columns, 6);
+  EXPECT_EQ(top_columns[1] - sp.columns, 10);
+  EXPECT_EQ(top_columns[12] - sp.columns, 76);
+
+  // Boosted scores that only differ in their Q8.8 fraction are not tied
+  for (uint16_t i = 0; i < 400; i++) {
+    sp.columns[i].overlap_score = 3 << 8;
+  }
+  sp.columns[200].overlap_score = (3 << 8) + 1;
+  sl_htm_sp_get_top_columns(top_columns, 1, &sp);
+  EXPECT_EQ(top_columns[0] - sp.columns, 200);
+}
+
+TEST(SPTest, LocalInhibition) {
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sp.parameters.local_inhibition = true;
+  sp.parameters.inhibition_radius = 2;
+  sp.parameters.overlap_score_threshold = 1;
+  sl_htm_sp_init(&sp, 40, 40, 32, 24);
+
+  // The left half has much stronger overlaps than the right half, so global inhibition would only pick the left half
+  for (uint16_t i = 0; i < 32 * 24; i++) {
+    bool left = sp.columns[i].column_x < 16;
+    sp.columns[i].overlap_score = (left ? 300 << 8 : 0) + rand() % 2048;
+  }
+  sl_htm_sp_column_t* top_columns[32 * 24];
+  uint16_t num_active_columns = sl_htm_sp_get_local_top_columns(top_columns, &sp);
+
+  bool active[32 * 24] = { false };
+  uint16_t num_right = 0;
+  for (uint16_t i = 0; i < num_active_columns; i++) {
+    active[top_columns[i] - sp.columns] = true;
+    if (top_columns[i]->column_x >= 16) {
+      num_right++;
+    }
+  }
+  EXPECT_GT(num_right, 0);
+
+  // Compare against counting the higher ranked neighbors of every column directly
+  for (uint16_t i = 0; i < 32 * 24; i++) {
+    sl_htm_sp_column_t* column = &sp.columns[i];
+    uint16_t num_neighbors = 0;
+    uint16_t num_higher = 0;
+    for (uint16_t j = 0; j < 32 * 24; j++) {
+      sl_htm_sp_column_t* other = &sp.columns[j];
+      if (i == j || abs(other->column_x - column->column_x) > 2 || abs(other->column_y - column->column_y) > 2) {
+        continue;
+      }
+      num_neighbors++;
+      if (other->overlap_score > column->overlap_score || (other->overlap_score == column->overlap_score && j < i)) {
+        num_higher++;
+      }
+    }
+    bool expected = column->overlap_score >= 256 && num_higher < (uint16_t)(0.5f + sp.parameters.sparsity * (num_neighbors + 1));
+    EXPECT_EQ(active[i], expected) << "column " << i;
+  }
+}
+
+TEST(SPTest, Boosting) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 40, 40);
+  sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
+  sl_htm_sdr_t output_sdr;
+  sl_htm_sdr_init(&output_sdr, 10, 10);
+
+  // Feed the same input over and over, and count how many different columns win
+  uint16_t num_winners[2];
+  for (uint16_t boosting = 0; boosting < 2; boosting++) {
+    sl_htm_sp_t sp;
+    sl_htm_sp_init_default_params(&sp.parameters);
+    sp.parameters.boost_strength = boosting ? 10.0f : 0.0f;
+    sp.parameters.duty_cycle_period = 20;
+    sl_htm_sp_init(&sp, input_sdr.width, input_sdr.height, output_sdr.width, output_sdr.height);
+
+    bool ever_active[100] = { false };
+    for (uint16_t i = 0; i < 200; i++) {
+      sl_htm_sp_execute(&sp, &input_sdr, &output_sdr, true);
+      for (uint16_t j = 0; j < 100; j++) {
+        ever_active[j] |= sl_htm_sdr_get_bit(&output_sdr, j);
+      }
+    }
+    num_winners[boosting] = 0;
+    for (uint16_t j = 0; j < 100; j++) {
+      num_winners[boosting] += ever_active[j];
+      // The duty cycles follow the activity of the column
+      if (!ever_active[j]) {
+        EXPECT_EQ(sp.columns[j].active_duty_cycle, 0);
+      }
+    }
+    // The active duty cycles average out to the sparsity
+    uint64_t duty_cycle_sum = 0;
+    for (uint16_t j = 0; j < 100; j++) {
+      duty_cycle_sum += sp.columns[j].active_duty_cycle;
+    }
+    EXPECT_NEAR(duty_cycle_sum / 100.0 / UINT32_MAX, sp.parameters.sparsity, 0.02);
+  }
+  // Without boosting the same columns win every time
+  EXPECT_EQ(num_winners[0], 20);
+  EXPECT_GT(num_winners[1], num_winners[0]);
+}
+
+TEST(SPTest, BoostFactor) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 40, 40);
+  sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
+  sl_htm_sdr_t output_sdr;
+  sl_htm_sdr_init(&output_sdr, 10, 10);
+
+  for (float boost_strength : { 2.0f, 100.0f }) {
+    sl_htm_sp_t sp;
+    sl_htm_sp_init_default_params(&sp.parameters);
+    sp.parameters.boost_strength = boost_strength;
+    sp.parameters.duty_cycle_period = 20;
+    sl_htm_sp_init(&sp, input_sdr.width, input_sdr.height, output_sdr.width, output_sdr.height);
+    for (uint16_t i = 0; i < 100; i++) {
+      sl_htm_sp_execute(&sp, &input_sdr, &output_sdr, true);
+      for (uint16_t j = 0; j < 100; j++) {
+        uint16_t boost_factor = sp.columns[j].boost_factor;
+        // Even the most active column keeps a boost above 0, so it is never shut out completely
+        EXPECT_GT(boost_factor, 0) << "column " << j;
+        if (boost_strength < 10.0f) {
+          // The boost follows the exponential boost function
+          double duty_cycle = sp.columns[j].active_duty_cycle / (double)UINT32_MAX;
+          double expected = 256.0 * std::exp(boost_strength * (sp.parameters.sparsity - duty_cycle));
+          EXPECT_NEAR(boost_factor, expected, 1.0 + expected * 0.02) << "column " << j;
+        }
+      }
+    }
+    sl_htm_sp_deinit(&sp);
+  }
+  sl_htm_sdr_deinit(&input_sdr);
+  sl_htm_sdr_deinit(&output_sdr);
+}
+
+TEST(SPTest, DutyCycleDecay) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sdr_t input_sdrs[2];
+  for (uint16_t i = 0; i < 2; i++) {
+    sl_htm_sdr_init(&input_sdrs[i], 40, 40);
+    sl_htm_sdr_randomize(&input_sdrs[i], 0.2f, &random);
+  }
+  sl_htm_sdr_t output_sdrs[2];
+  sl_htm_sdr_init(&output_sdrs[0], 10, 10);
+  sl_htm_sdr_init(&output_sdrs[1], 10, 10);
+
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sp.parameters.boost_strength = 0.0f;
+  sp.parameters.duty_cycle_period = 100;
+  sl_htm_sp_init(&sp, 40, 40, 10, 10);
+  for (uint16_t i = 0; i < 100; i++) {
+    sl_htm_sp_execute(&sp, &input_sdrs[0], &output_sdrs[0], true);
+  }
+  // Switch to another input, the columns that only won on the first one stop winning
+  for (uint16_t i = 0; i < 1000; i++) {
+    sl_htm_sp_execute(&sp, &input_sdrs[1], &output_sdrs[1], true);
+  }
+  uint16_t num_decayed = 0;
+  for (uint16_t j = 0; j < 100; j++) {
+    if (sl_htm_sdr_get_bit(&output_sdrs[0], j) && !sl_htm_sdr_get_bit(&output_sdrs[1], j)) {
+      // A truncated step would leave it stuck around period / 65536 of Q0.16
+      EXPECT_LT((double)sp.columns[j].active_duty_cycle / UINT32_MAX, 0.0005);
+      num_decayed++;
+    }
+  }
+  EXPECT_GT(num_decayed, 0);
+}
+
+TEST(SPTest, InputIndex) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 27, 27);
+  sl_htm_sdr_t output_sdr;
+  sl_htm_sdr_init(&output_sdr, 9, 9);
+
+  sl_htm_sp_t sp;
+  sl_htm_sp_init_default_params(&sp.parameters);
+  sl_htm_sp_init(&sp, input_sdr.width, input_sdr.height, output_sdr.width, output_sdr.height);
+
+  // Every connection is listed exactly once, under the input bit it samples
+  EXPECT_EQ(sp.input_offsets[27 * 27], sp.num_connections);
+  for (uint16_t input_idx = 0; input_idx < 27 * 27; input_idx++) {
+    for (uint32_t j = sp.input_offsets[input_idx]; j < sp.input_offsets[input_idx + 1]; j++) {
+      sl_htm_sp_connection_t* connection = &sp.connections[sp.input_connections[j]];
+      EXPECT_EQ(connection->sdr_x + connection->sdr_y * 27, input_idx);
+    }
+  }
+
+  // The overlap walked from the active inputs matches the overlap counted per column, and boosting keeps its fraction
+  for (uint16_t step = 0; step < 10; step++) {
+    sl_htm_sdr_randomize(&input_sdr, 0.33f, &random);
+    for (uint16_t column_idx = 0; column_idx < 9 * 9; column_idx++) {
+      sp.columns[column_idx].boost_factor = 200 + sl_htm_random_below(&random, 200);
+    }
+    sl_htm_sp_execute(&sp, &input_sdr, &output_sdr, false);
+    for (uint16_t column_idx = 0; column_idx < 9 * 9; column_idx++) {
+      sl_htm_sp_column_t* column = &sp.columns[column_idx];
+      uint16_t overlap_score = 0;
+      for (uint16_t connection_idx = 0; connection_idx < column->num_connections; connection_idx++) {
+        sl_htm_sp_connection_t* connection = &column->connections[connection_idx];
+        bool active = sl_htm_sdr_get_bit(&input_sdr, connection->sdr_x + connection->sdr_y * 27);
+        if (active && connection->permanence >= sp.parameters.permanence_threshold) {
+          overlap_score++;
+        }
+      }
+      EXPECT_EQ(column->raw_overlap_score, overlap_score);
+      EXPECT_EQ(column->overlap_score, (uint32_t)overlap_score * column->boost_factor);
+    }
+  }
+}
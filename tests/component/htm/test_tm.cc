@@ -3,7 +3,11 @@
 #include "sl_htm_sdr.h"
 #include "sl_htm_tm_types.h"
 #include "sl_htm_tm_cell.h"
+#include "sl_htm_tm_segment.h"
+#include "sl_htm_tm_column.h"
 TEST(TMTest, States){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
   sl_htm_tm_state_t state_current;
   sl_htm_tm_state_t state_previous;
   sl_htm_tm_init_state(&state_current);
@@ -13,18 +17,17 @@ TEST(TMTest, States){
   EXPECT_EQ(state_current.winner_cells.len, 0);
   EXPECT_EQ(state_current.active_segments.len, 0);
   EXPECT_EQ(state_current.matching_segments.len, 0);
-  // Add a active cell to the current state, use the num_segments field to store an id of the cell used for testing
-  sl_htm_tm_cell_t active_cell;
-  active_cell.num_segments = 1;
+  // Add a active cell to the current state, cells are identified by their index
+  sl_htm_tm_index_t active_cell = 1;
 
-  sl_htm_tm_add_cell_to_array(&active_cell, &state_current.active_cells);
+  sl_htm_tm_add_cell_to_array(active_cell, &state_current.active_cells);
 
   // Test if cell was added
   EXPECT_EQ(state_current.active_cells.len, 1);
   EXPECT_EQ(state_current.winner_cells.len, 0);
   EXPECT_EQ(state_current.active_segments.len, 0);
   EXPECT_EQ(state_current.matching_segments.len, 0);
-  EXPECT_TRUE(sl_htm_tm_is_cell_in_array(&active_cell, &state_current.active_cells));
+  EXPECT_TRUE(sl_htm_tm_is_cell_in_array(active_cell, &state_current.active_cells));
 
   // Swap and clear the states, and see if the cell is still there in the previous state
   sl_htm_tm_swap_and_clear_states(&state_previous, &state_current);
@@ -39,41 +42,27 @@ TEST(TMTest, States){
   EXPECT_EQ(state_previous.active_segments.len, 0);
   EXPECT_EQ(state_previous.matching_segments.len, 0);
 
-  EXPECT_TRUE(sl_htm_tm_is_cell_in_array(&active_cell, &state_previous.active_cells));
-
-  // Add 5 more active cells to the current state
-  sl_htm_tm_cell_t active_cell_2;
-  active_cell_2.num_segments = 2;
-  sl_htm_tm_cell_t active_cell_3;
-  active_cell_3.num_segments = 3;
-  sl_htm_tm_cell_t active_cell_4;
-  active_cell_4.num_segments = 4;
-  sl_htm_tm_cell_t active_cell_5;
-  active_cell_5.num_segments = 5;
-  sl_htm_tm_cell_t active_cell_6;
-  active_cell_6.num_segments = 6;
-
-  sl_htm_tm_add_cell_to_array(&active_cell, &state_current.active_cells);
-  sl_htm_tm_add_cell_to_array(&active_cell_2, &state_current.active_cells);
-  sl_htm_tm_add_cell_to_array(&active_cell_3, &state_current.active_cells);
-  sl_htm_tm_add_cell_to_array(&active_cell_4, &state_current.active_cells);
-  sl_htm_tm_add_cell_to_array(&active_cell_5, &state_current.active_cells);
-  sl_htm_tm_add_cell_to_array(&active_cell_6, &state_current.active_cells);
+  EXPECT_TRUE(sl_htm_tm_is_cell_in_array(active_cell, &state_previous.active_cells));
+
+  // Add 6 active cells to the current state
+  for (sl_htm_tm_index_t cell = 1; cell <= 6; cell++) {
+    sl_htm_tm_add_cell_to_array(cell, &state_current.active_cells);
+  }
   // Ensure that the cells are in order
-  EXPECT_EQ(state_current.active_cells.cells[0]->num_segments, (uint16_t)1);
-  EXPECT_EQ(state_current.active_cells.cells[1]->num_segments, (uint16_t)2);
-  EXPECT_EQ(state_current.active_cells.cells[2]->num_segments, (uint16_t)3);
-  EXPECT_EQ(state_current.active_cells.cells[3]->num_segments, (uint16_t)4);
-  EXPECT_EQ(state_current.active_cells.cells[4]->num_segments, (uint16_t)5);
-  EXPECT_EQ(state_current.active_cells.cells[5]->num_segments, (uint16_t)6);
+  EXPECT_EQ(state_current.active_cells.cells[0], (sl_htm_tm_index_t)1);
+  EXPECT_EQ(state_current.active_cells.cells[1], (sl_htm_tm_index_t)2);
+  EXPECT_EQ(state_current.active_cells.cells[2], (sl_htm_tm_index_t)3);
+  EXPECT_EQ(state_current.active_cells.cells[3], (sl_htm_tm_index_t)4);
+  EXPECT_EQ(state_current.active_cells.cells[4], (sl_htm_tm_index_t)5);
+  EXPECT_EQ(state_current.active_cells.cells[5], (sl_htm_tm_index_t)6);
 
   uint16_t num_out_of_order = 0;
   uint16_t num_in_order = 0;
   // Shuffle multiple times to reduce the chance of the cells being in order
   for (uint16_t i = 0; i < 100; i++) {
-    sl_htm_tm_shuffle_cell_array(&state_current.active_cells);
+    sl_htm_tm_shuffle_cell_array(&state_current.active_cells, &random);
     for (uint16_t i = 0; i < state_current.active_cells.len; i++) {
-      if (state_current.active_cells.cells[i]->num_segments != i + 1) {
+      if (state_current.active_cells.cells[i] != i + 1) {
         num_out_of_order++;
       } else {
         num_in_order++;
@@ -87,11 +76,361 @@ TEST(TMTest, States){
   EXPECT_GT(num_in_order, 0);
 }
 
+TEST(TMTest, ShuffleUniform){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_tm_state_t state;
+  sl_htm_tm_init_state(&state);
+  for (sl_htm_tm_index_t cell = 0; cell < 3; cell++) {
+    sl_htm_tm_add_cell_to_array(cell, &state.active_cells);
+  }
+  // Each of the 6 orders of 3 cells comes up 1/6 of the time. Swapping every cell with any cell would give 4/27 or 5/27 instead.
+  uint32_t counts[9] = { 0 };
+  for (uint32_t i = 0; i < 60000; i++) {
+    for (sl_htm_tm_index_t cell = 0; cell < 3; cell++) {
+      state.active_cells.cells[cell] = cell;
+    }
+    sl_htm_tm_shuffle_cell_array(&state.active_cells, &random);
+    counts[state.active_cells.cells[0] * 3 + state.active_cells.cells[1]]++;
+  }
+  for (uint16_t first = 0; first < 3; first++) {
+    for (uint16_t second = 0; second < 3; second++) {
+      if (first != second) {
+        EXPECT_NEAR(counts[first * 3 + second], 10000, 400) << "order " << first << second;
+      }
+    }
+  }
+  sl_htm_tm_deinit_state(&state);
+}
+
+TEST(TMTest, ReservedState){
+  sl_htm_tm_state_t state;
+  sl_htm_tm_init_state(&state);
+  sl_htm_tm_reserve_state(&state, NULL, 8, 4);
+  EXPECT_EQ(state.active_cells.capacity, 8);
+  EXPECT_EQ(state.matching_segments.capacity, 4);
+
+  // Filling up to the reserved capacity must not grow the array
+  for (uint16_t i = 0; i < 8; i++) {
+    sl_htm_tm_add_cell_to_array(i, &state.active_cells);
+  }
+  EXPECT_EQ(sl_htm_tm_state_num_growths(&state), 0u);
+  // Going past it grows the array geometrically
+  sl_htm_tm_add_cell_to_array(8, &state.active_cells);
+  EXPECT_EQ(sl_htm_tm_state_num_growths(&state), 1u);
+  EXPECT_EQ(state.active_cells.capacity, 16);
+  for (uint16_t i = 0; i < 9; i++) {
+    EXPECT_EQ(state.active_cells.cells[i], i);
+  }
+}
+
+TEST(TMTest, ActiveCellsBitset){
+  sl_htm_tm_state_t state_current;
+  sl_htm_tm_state_t state_previous;
+  sl_htm_tm_init_state(&state_current);
+  sl_htm_tm_init_state(&state_previous);
+  sl_htm_tm_init_state_active_cells_bitset(&state_current, NULL, 100);
+  sl_htm_tm_init_state_active_cells_bitset(&state_previous, NULL, 100);
+
+  sl_htm_tm_activate_cell(3, &state_current);
+  sl_htm_tm_activate_cell(64, &state_current);
+  // Activating the same cell twice must not add it twice
+  sl_htm_tm_activate_cell(64, &state_current);
+
+  EXPECT_EQ(state_current.active_cells.len, 2);
+  EXPECT_TRUE(sl_htm_tm_is_cell_active(3, &state_current));
+  EXPECT_TRUE(sl_htm_tm_is_cell_active(64, &state_current));
+  EXPECT_FALSE(sl_htm_tm_is_cell_active(4, &state_current));
+
+  // After swapping, the cells are active in the previous state only
+  sl_htm_tm_swap_and_clear_states(&state_previous, &state_current);
+  EXPECT_TRUE(sl_htm_tm_is_cell_active(3, &state_previous));
+  EXPECT_FALSE(sl_htm_tm_is_cell_active(3, &state_current));
+
+  // After swapping again, the bitset that is reused for the current state must be empty
+  sl_htm_tm_activate_cell(5, &state_current);
+  sl_htm_tm_swap_and_clear_states(&state_previous, &state_current);
+  EXPECT_TRUE(sl_htm_tm_is_cell_active(5, &state_previous));
+  EXPECT_FALSE(sl_htm_tm_is_cell_active(3, &state_previous));
+  EXPECT_FALSE(sl_htm_tm_is_cell_active(3, &state_current));
+  EXPECT_FALSE(sl_htm_tm_is_cell_active(64, &state_current));
+}
+
+TEST(TMTest, Arena){
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  sl_htm_tm_init(&tm, 4, 4);
+  EXPECT_EQ(tm.num_cells, 16 * tm.parameters.num_cells_per_column);
+  EXPECT_EQ(tm.num_segments, tm.num_cells * tm.parameters.max_segments_in_cell);
+  EXPECT_EQ(tm.num_synapses, tm.num_segments * tm.parameters.max_synapses_in_segment);
+
+  // Parents are found from the index alone
+  sl_htm_tm_index_t cell = 5 * tm.parameters.num_cells_per_column + 1;
+  sl_htm_tm_index_t segment = sl_htm_tm_cell_grow_segment(&tm, cell);
+  ASSERT_NE(segment, SL_HTM_TM_INDEX_NONE);
+  EXPECT_EQ(sl_htm_tm_segment_cell(&tm, segment), cell);
+  EXPECT_EQ(sl_htm_tm_segment_column(&tm, segment), 5);
+  EXPECT_EQ(tm.cell_num_segments[cell], 1);
+
+  // Growing synapses links them into the list of their presynaptic cell
+  sl_htm_tm_index_t synapse_a = sl_htm_tm_segment_grow_synapse(&tm, segment, 9);
+  sl_htm_tm_index_t synapse_b = sl_htm_tm_segment_grow_synapse(&tm, segment, 9);
+  EXPECT_EQ(sl_htm_tm_synapse_segment(&tm, synapse_a), segment);
+  EXPECT_EQ(tm.cell_presynaptic_head[9], synapse_b);
+  EXPECT_EQ(tm.synapse_next_presynaptic[synapse_b], synapse_a);
+  EXPECT_EQ(tm.synapse_next_presynaptic[synapse_a], SL_HTM_TM_INDEX_NONE);
+
+  // Deleting the last synapse also deletes the segment and empties the list
+  sl_htm_tm_segment_delete_synapse(&tm, segment, synapse_b);
+  EXPECT_EQ(tm.cell_presynaptic_head[9], synapse_a);
+  sl_htm_tm_segment_delete_synapse(&tm, segment, synapse_a);
+  EXPECT_EQ(tm.cell_presynaptic_head[9], SL_HTM_TM_INDEX_NONE);
+  EXPECT_FALSE(sl_htm_tm_segment_is_existing(&tm, segment));
+  EXPECT_EQ(tm.cell_num_segments[cell], 0);
+}
+
+TEST(TMTest, InvalidSizes){
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  tm.parameters.max_segments_in_cell = 0;
+  EXPECT_EQ(sl_htm_tm_init(&tm, 4, 4), SL_HTM_STATUS_INVALID_PARAMETER);
+
+  // More cells than a TM index can address
+  sl_htm_tm_init_default_params(&tm.parameters);
+  tm.parameters.num_cells_per_column = 255;
+  EXPECT_EQ(sl_htm_tm_init(&tm, 255, 255), SL_HTM_STATUS_INVALID_PARAMETER);
+
+  // Wider than an SDR, even though the cells could be indexed
+  sl_htm_tm_init_default_params(&tm.parameters);
+  EXPECT_EQ(sl_htm_tm_init(&tm, 256, 1), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sl_htm_tm_init(&tm, 1, 300), SL_HTM_STATUS_INVALID_PARAMETER);
+  EXPECT_EQ(sl_htm_tm_static_memory_size(&tm.parameters, 256, 1), 0u);
+
+  sl_htm_tm_init_default_params(&tm.parameters);
+  EXPECT_EQ(sl_htm_tm_init(&tm, 4, 4), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_tm_get_status(&tm), SL_HTM_STATUS_OK);
+}
+
+TEST(TMTest, FixedShape){
+  if (SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT == 0) {
+    GTEST_SKIP() << "The shape is not fixed at compile time";
+  }
+  // A TM whose shape differs from the compiled one is rejected
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  tm.parameters.max_synapses_in_segment = SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT + 1;
+  EXPECT_EQ(sl_htm_tm_init(&tm, 4, 4), SL_HTM_STATUS_INVALID_PARAMETER);
+  tm.parameters.max_synapses_in_segment = SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT;
+  EXPECT_EQ(sl_htm_tm_init(&tm, 4, 4), SL_HTM_STATUS_OK);
+}
+
+TEST(TMTest, Sampler){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_tm_sampler_t sampler;
+  sl_htm_tm_sampler_init(&sampler, NULL, 8);
+  // Drawing the whole population gives every position once
+  for (uint16_t round = 0; round < 20; round++) {
+    sl_htm_tm_sampler_start(&sampler, 8);
+    bool drawn[8] = { false };
+    for (uint16_t i = 0; i < 8; i++) {
+      uint16_t position = sl_htm_tm_sampler_next(&sampler, &random);
+      ASSERT_LT(position, 8);
+      EXPECT_FALSE(drawn[position]);
+      drawn[position] = true;
+    }
+    EXPECT_EQ(sl_htm_tm_sampler_next(&sampler, &random), UINT16_MAX);
+  }
+  // From a larger population, draws are distinct and stop at the capacity
+  uint16_t counts[1000] = { 0 };
+  for (uint16_t round = 0; round < 500; round++) {
+    sl_htm_tm_sampler_start(&sampler, 1000);
+    bool drawn[1000] = { false };
+    for (uint16_t i = 0; i < 8; i++) {
+      uint16_t position = sl_htm_tm_sampler_next(&sampler, &random);
+      ASSERT_LT(position, 1000);
+      EXPECT_FALSE(drawn[position]);
+      drawn[position] = true;
+      counts[position]++;
+    }
+    EXPECT_EQ(sl_htm_tm_sampler_next(&sampler, &random), UINT16_MAX);
+  }
+  // Every part of the population gets drawn
+  for (uint16_t i = 0; i < 1000; i += 100) {
+    uint16_t count = 0;
+    for (uint16_t j = i; j < i + 100; j++) {
+      count += counts[j];
+    }
+    EXPECT_GT(count, 200);
+    EXPECT_LT(count, 600);
+  }
+}
+
+TEST(TMTest, SortSegments){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_tm_segment_array_t arr;
+  sl_htm_tm_segment_array_t scratch;
+  sl_htm_tm_init_segment_array(&arr);
+  sl_htm_tm_init_segment_array(&scratch);
+  uint16_t counts[1000] = { 0 };
+  for (uint16_t i = 0; i < 300; i++) {
+    sl_htm_tm_index_t segment = sl_htm_random_below(&random, 1000);
+    sl_htm_tm_add_segment_to_array(segment, &arr);
+    counts[segment]++;
+  }
+  // The scratch grows to fit, and the sort keeps every segment
+  EXPECT_EQ(sl_htm_tm_sort_segment_array(&arr, &scratch), SL_HTM_STATUS_OK);
+  EXPECT_EQ(arr.len, 300);
+  EXPECT_EQ(arr.num_dropped, 0);
+  EXPECT_GE(scratch.capacity, 300);
+  for (uint16_t i = 0; i < arr.len; i++) {
+    if (i > 0) {
+      EXPECT_LE(arr.segments[i - 1], arr.segments[i]);
+    }
+    counts[arr.segments[i]]--;
+  }
+  for (uint16_t i = 0; i < 1000; i++) {
+    EXPECT_EQ(counts[i], 0);
+  }
+  // A scratch that cannot grow is reported, and no segment is lost
+  sl_htm_memory_t memory;
+  uint64_t buffer[16];
+  sl_htm_memory_init(&memory, buffer, sizeof(buffer));
+  sl_htm_tm_segment_array_t fixed_scratch;
+  sl_htm_tm_init_segment_array(&fixed_scratch);
+  ASSERT_EQ(sl_htm_tm_reserve_segment_array(&fixed_scratch, &memory, 10), SL_HTM_STATUS_OK);
+  EXPECT_EQ(sl_htm_tm_sort_segment_array(&arr, &fixed_scratch), SL_HTM_STATUS_WOULD_OVERFLOW);
+  EXPECT_EQ(arr.len, 300);
+  EXPECT_EQ(arr.num_dropped, 0);
+  free(arr.segments);
+  free(scratch.segments);
+}
+
+TEST(TMTest, SegmentsByColumn){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 20, 20);
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  sl_htm_tm_init(&tm, input_sdr.width, input_sdr.height);
+  // Learn a short sequence, so that there are active and matching segments spread over many columns
+  sl_htm_sdr_t inputs[4];
+  for (uint16_t i = 0; i < 4; i++) {
+    sl_htm_sdr_init(&inputs[i], 20, 20);
+    sl_htm_sdr_randomize(&inputs[i], 0.1f, &random);
+  }
+  uint32_t num_active_segments = 0;
+  for (uint16_t step = 0; step < 200; step++) {
+    sl_htm_tm_execute(&tm, &inputs[step % 4], true);
+    sl_htm_tm_segment_array_t* arrays[2] = { &tm.state_prev.active_segments, &tm.state_prev.matching_segments };
+    for (uint16_t a = 0; a < 2; a++) {
+      // The segments are sorted, and walking the columns in order finds every segment in the range of its column
+      sl_htm_tm_segment_range_t range = { 0, 0 };
+      uint16_t num_found = 0;
+      for (sl_htm_tm_index_t column = 0; column < tm.num_columns; column++) {
+        sl_htm_tm_column_segment_range(&tm, column, arrays[a], &range);
+        for (uint16_t i = range.begin; i < range.end; i++) {
+          EXPECT_EQ(sl_htm_tm_segment_column(&tm, arrays[a]->segments[i]), column);
+          if (i > range.begin) {
+            EXPECT_LE(arrays[a]->segments[i - 1], arrays[a]->segments[i]);
+          }
+        }
+        num_found += range.end - range.begin;
+      }
+      EXPECT_EQ(num_found, arrays[a]->len);
+    }
+    num_active_segments += tm.state_prev.active_segments.len;
+  }
+  EXPECT_GT(num_active_segments, 0u);
+  // The sequence is learned
+  EXPECT_LT(sl_htm_tm_execute(&tm, &inputs[0], true), 0.1f);
+}
+
+TEST(TMTest, MatchingScores){
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 2);
+  sl_htm_sdr_t input_sdr;
+  sl_htm_sdr_init(&input_sdr, 20, 20);
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  sl_htm_tm_init(&tm, input_sdr.width, input_sdr.height);
+  sl_htm_sdr_t inputs[3];
+  for (uint16_t i = 0; i < 3; i++) {
+    sl_htm_sdr_init(&inputs[i], 20, 20);
+    sl_htm_sdr_randomize(&inputs[i], 0.1f, &random);
+  }
+  uint32_t num_scored = 0;
+  for (uint16_t step = 0; step < 100; step++) {
+    sl_htm_tm_execute(&tm, &inputs[step % 3], true);
+    // The kept score of every matching segment is its number of active synapses with a nonzero permanence
+    sl_htm_tm_state_t* state = &tm.state_prev;
+    ASSERT_GE(state->matching_scores_capacity, state->matching_segments.len);
+    for (uint16_t i = 0; i < state->matching_segments.len; i++) {
+      sl_htm_tm_index_t first_synapse = state->matching_segments.segments[i] * tm.parameters.max_synapses_in_segment;
+      uint16_t num_active_potential = 0;
+      for (uint16_t j = 0; j < tm.parameters.max_synapses_in_segment; j++) {
+        sl_htm_tm_index_t cell = tm.synapse_presynaptic_cell[first_synapse + j];
+        if (cell != SL_HTM_TM_INDEX_NONE && tm.synapse_permanence[first_synapse + j] > 0 && sl_htm_tm_is_cell_active(cell, state)) {
+          num_active_potential++;
+        }
+      }
+      EXPECT_EQ(state->matching_scores[i], num_active_potential);
+      EXPECT_GE(state->matching_scores[i], tm.parameters.segment_learning_threshold);
+      num_scored++;
+    }
+    // The dendrite counters are cleared after every step
+    for (uint32_t segment = 0; segment < tm.num_segments; segment++) {
+      ASSERT_EQ(tm.segment_num_active_connected[segment], 0);
+      ASSERT_EQ(tm.segment_num_active_potential[segment], 0);
+    }
+  }
+  EXPECT_GT(num_scored, 0u);
+}
+
+TEST(TMTest, GrowSynapses){
+  if (SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT != 0 && SL_HTM_TM_FIXED_MAX_SYNAPSES_IN_SEGMENT != 8) {
+    GTEST_SKIP() << "Needs 8 synapses per segment";
+  }
+  sl_htm_tm_t tm;
+  sl_htm_tm_init_default_params(&tm.parameters);
+  tm.parameters.max_synapses_in_segment = 8;
+  sl_htm_tm_init(&tm, 4, 4);
+  for (sl_htm_tm_index_t cell = 20; cell < 40; cell++) {
+    sl_htm_tm_activate_cell(cell, &tm.state_prev);
+  }
+  sl_htm_tm_index_t segment = sl_htm_tm_cell_grow_segment(&tm, 0);
+  sl_htm_tm_segment_grow_synapse(&tm, segment, 25);
+  sl_htm_tm_segment_grow_synapse(&tm, segment, 3);
+  sl_htm_tm_segment_grow_synapses(&tm, segment, &tm.state_prev);
+  EXPECT_EQ(tm.segment_num_synapses[segment], 8);
+
+  // The segment is connected to distinct cells, and the new ones are all previously active
+  sl_htm_tm_index_t first_synapse = segment * tm.parameters.max_synapses_in_segment;
+  for (uint16_t i = 0; i < 8; i++) {
+    sl_htm_tm_index_t cell = tm.synapse_presynaptic_cell[first_synapse + i];
+    EXPECT_TRUE(cell == 3 || (cell >= 20 && cell < 40));
+    for (uint16_t j = 0; j < i; j++) {
+      EXPECT_NE(tm.synapse_presynaptic_cell[first_synapse + j], cell);
+    }
+  }
+  // The previous state is left as it was
+  for (uint16_t i = 0; i < tm.state_prev.active_cells.len; i++) {
+    EXPECT_EQ(tm.state_prev.active_cells.cells[i], 20 + i);
+  }
+  // A full segment does not grow
+  sl_htm_tm_segment_grow_synapses(&tm, segment, &tm.state_prev);
+  EXPECT_EQ(tm.segment_num_synapses[segment], 8);
+}
+
 TEST(TMTest, Learning) {
+  sl_htm_random_t random;
+  sl_htm_random_seed(&random, 1);
   // Setup
   sl_htm_sdr_t input_sdr;
   sl_htm_sdr_init(&input_sdr, 20, 20);
-  sl_htm_sdr_randomize(&input_sdr, 0.2f);
+  sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
 
   sl_htm_tm_t tm;
   sl_htm_tm_init_default_params(&tm.parameters);
@@ -117,7 +456,7 @@ TEST(TMTest, Learning) {
   float total_anomaly_score = 0.0f;
   uint16_t num_anomaly_scores = 0;
   for (uint16_t i = 0; i < 100; i++) {
-    sl_htm_sdr_randomize(&input_sdr, 0.2f);
+    sl_htm_sdr_randomize(&input_sdr, 0.2f, &random);
     total_anomaly_score += sl_htm_tm_execute(&tm, &input_sdr, true);
     num_anomaly_scores++;
   }
@@ -125,4 +464,5 @@ TEST(TMTest, Learning) {
   EXPECT_GT(anomaly_score, 0.9f);
 
   printf("TM Memory Size: %zu bytes\n", sl_htm_tm_memory_size(&tm));
+  printf("TM State Growths: %u\n", sl_htm_tm_num_state_growths(&tm));
 }
@@ -7,13 +7,39 @@ TEST(FrontendTest, Clamp) {
   EXPECT_EQ(7 * 6, 42);
   EXPECT_EQ(sl_vision_clampf(10, 0, 5), 5);
 }
+TEST(FrontendTest, GenerateRandom) {
+  sl_vision_image_t img_a;
+  sl_vision_image_t img_b;
+  sl_vision_image_t img_c;
+  sl_vision_image_generate_random(&img_a, 20, 20, 3, IMAGEFORMAT_UINT8, 7);
+  sl_vision_image_generate_random(&img_b, 20, 20, 3, IMAGEFORMAT_UINT8, 7);
+  sl_vision_image_generate_random(&img_c, 20, 20, 3, IMAGEFORMAT_UINT8, 8);
+  // The same seed gives the same image
+  EXPECT_EQ(memcmp(img_a.data.raw, img_b.data.raw, sl_vision_image_bytesize(&img_a)), 0);
+  EXPECT_NE(memcmp(img_a.data.raw, img_c.data.raw, sl_vision_image_bytesize(&img_a)), 0);
+  free(img_a.data.raw);
+  free(img_b.data.raw);
+  free(img_c.data.raw);
+}
+TEST(FrontendTest, InvalidImages) {
+  sl_vision_image_t src_img;
+  sl_vision_image_t dst_img;
+  EXPECT_EQ(sl_vision_image_generate_empty(&src_img, 4, 4, 1, (sl_vision_image_format_t)7), SL_STATUS_NOT_SUPPORTED);
+
+  ASSERT_EQ(sl_vision_image_generate_empty(&src_img, 4, 4, 1, IMAGEFORMAT_UINT8), SL_STATUS_OK);
+  ASSERT_EQ(sl_vision_image_generate_empty(&dst_img, 8, 8, 1, IMAGEFORMAT_UINT8), SL_STATUS_OK);
+  // The crop may not be larger than the source
+  EXPECT_EQ(sl_vision_image_crop_center(&src_img, &dst_img), SL_STATUS_INVALID_PARAMETER);
+  free(src_img.data.raw);
+  free(dst_img.data.raw);
+}
 TEST(FrontendTest, CenterCrop_uint8) {
   // Arrange
   sl_vision_image_t src_img;
-  sl_vision_image_generate_random(&src_img, 200, 200, 3, IMAGEFORMAT_UINT8);
+  sl_vision_image_generate_random(&src_img, 200, 200, 3, IMAGEFORMAT_UINT8, 1);
 
   sl_vision_image_t dst_img;
-  sl_vision_image_generate_random(&dst_img, 200, 200, 3, IMAGEFORMAT_UINT8);
+  sl_vision_image_generate_random(&dst_img, 200, 200, 3, IMAGEFORMAT_UINT8, 2);
 
   size_t start_x = (src_img.width - dst_img.width) / 2;
   size_t start_y = (src_img.height - dst_img.height) / 2;
@@ -37,10 +63,10 @@ TEST(FrontendTest, CenterCrop_uint8) {
 TEST(FrontendTest, CenterCrop_float) {
   // Arrange
   sl_vision_image_t src_img;
-  sl_vision_image_generate_random(&src_img, 200, 200, 3, IMAGEFORMAT_FLOAT);
+  sl_vision_image_generate_random(&src_img, 200, 200, 3, IMAGEFORMAT_FLOAT, 1);
 
   sl_vision_image_t dst_img;
-  sl_vision_image_generate_random(&dst_img, 100, 100, 3, IMAGEFORMAT_FLOAT);
+  sl_vision_image_generate_random(&dst_img, 100, 100, 3, IMAGEFORMAT_FLOAT, 2);
 
   size_t start_x = (src_img.width - dst_img.width) / 2;
   size_t start_y = (src_img.height - dst_img.height) / 2;